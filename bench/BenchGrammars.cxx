@@ -0,0 +1,297 @@
+/**
+ * \file BenchGrammars.cxx
+ *
+ * \brief Lexer, grammars and input generators for the benchmark harness
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <string.h>
+#include <random>
+
+#include "BenchGrammars.h"
+
+
+using wr::parse::NonTerminal;
+using wr::parse::Token;
+using wr::parse::TokenKind;
+
+enum { MAX_NESTING = 8 };
+
+static const char * const GRAMMAR_NAMES[] = {
+        "expression",
+        "statements",
+        "ambiguous",
+        nullptr
+};
+
+//--------------------------------------
+
+BenchLexer::BenchLexer() :
+        PatternLexer({
+                { R"(\+)", [](Token &t) { t.setKind(TOK_PLUS); }},
+                { "-", [](Token &t) { t.setKind(TOK_MINUS); }},
+                { R"(\*)", [](Token &t) { t.setKind(TOK_MULTIPLY); }},
+                { "/", [](Token &t) { t.setKind(TOK_DIVIDE); }},
+                { R"(\()", [](Token &t) { t.setKind(TOK_LPAREN); }},
+                { R"(\))", [](Token &t) { t.setKind(TOK_RPAREN); }},
+                { ",", [](Token &t) { t.setKind(TOK_COMMA); }},
+                { ";", [](Token &t) { t.setKind(TOK_SEMICOLON); }},
+                { "=", [](Token &t) { t.setKind(TOK_ASSIGN); }},
+                { R"(\s+)" },  // ignore whitespace
+                { R"(\d+)",
+                        [this](Token &t) {
+                                t.setKind(TOK_NUMBER)
+                                 .setSpelling(storeMatchedIfMultiChar());
+                        }},
+                { R"([A-Za-z_]\w*)",
+                        [this](Token &t) {
+                                t.setKind(TOK_IDENTIFIER)
+                                 .setSpelling(storeMatchedIfMultiChar());
+                        }}
+        })
+{
+}
+
+//--------------------------------------
+
+const char *
+BenchLexer::tokenKindName(
+        TokenKind kind
+) const
+{
+        switch (kind) {
+        case TOK_NUMBER:     return "number";
+        case TOK_IDENTIFIER: return "identifier";
+        default:
+                return sampleSpelling(kind) ? sampleSpelling(kind)
+                                            : base_t::tokenKindName(kind);
+        }
+}
+
+//--------------------------------------
+
+const char *
+BenchLexer::sampleSpelling(
+        TokenKind kind
+)
+{
+        switch (kind) {
+        case TOK_PLUS:       return "+";
+        case TOK_MINUS:      return "-";
+        case TOK_MULTIPLY:   return "*";
+        case TOK_DIVIDE:     return "/";
+        case TOK_LPAREN:     return "(";
+        case TOK_RPAREN:     return ")";
+        case TOK_COMMA:      return ",";
+        case TOK_SEMICOLON:  return ";";
+        case TOK_ASSIGN:     return "=";
+        case TOK_NUMBER:     return "1";
+        case TOK_IDENTIFIER: return "x";
+        default:             return nullptr;
+        }
+}
+
+//--------------------------------------
+
+BenchGrammars::BenchGrammars() :
+        factor { "factor", {
+                { TOK_NUMBER },
+                { TOK_IDENTIFIER },
+                { call },
+                { TOK_LPAREN, expression, TOK_RPAREN }
+        }},
+
+        call { "call", {
+                { TOK_IDENTIFIER, TOK_LPAREN, TOK_RPAREN },
+                { TOK_IDENTIFIER, TOK_LPAREN, arguments, TOK_RPAREN }
+        }},
+
+        arguments { "arguments", {
+                { expression },
+                { arguments, TOK_COMMA, expression }
+        }},
+
+        term { "term", {
+                { factor },
+                { term, TOK_MULTIPLY, factor },
+                { term, TOK_DIVIDE, factor }
+        }, NonTerminal::HIDE_IF_DELEGATE },
+
+        expression { "expression", {
+                { term },
+                { expression, TOK_PLUS, term },
+                { expression, TOK_MINUS, term }
+        }, NonTerminal::HIDE_IF_DELEGATE },
+
+        statement { "statement", {
+                { TOK_IDENTIFIER, TOK_ASSIGN, expression, TOK_SEMICOLON },
+                { call, TOK_SEMICOLON }
+        }},
+
+        statements { "statements", {
+                { statement },
+                { statements, statement }
+        }},
+
+        ambiguous { "ambiguous", {
+                { ambiguous, TOK_PLUS, ambiguous },
+                { ambiguous, TOK_MULTIPLY, ambiguous },
+                { TOK_LPAREN, ambiguous, TOK_RPAREN },
+                { TOK_NUMBER }
+        }}
+{
+}
+
+//--------------------------------------
+
+const NonTerminal *
+BenchGrammars::find(
+        const char *grammar
+) const
+{
+        if (!strcmp(grammar, "expression")) {
+                return &expression;
+        } else if (!strcmp(grammar, "statements")) {
+                return &statements;
+        } else if (!strcmp(grammar, "ambiguous")) {
+                return &ambiguous;
+        } else {
+                return nullptr;
+        }
+}
+
+//--------------------------------------
+
+const char * const *
+BenchGrammars::names()
+{
+        return GRAMMAR_NAMES;
+}
+
+//--------------------------------------
+/*
+ * append an expression of about `tokens` tokens (at least one) to `out`,
+ * returning the number actually appended
+ */
+static size_t
+generateExpression(
+        std::string       &out,
+        std::minstd_rand  &random,
+        size_t             tokens,
+        int                nesting
+)
+{
+        static const char OPERATORS[] = "+-*/";
+
+        size_t emitted = 0;
+
+        do {
+                if (emitted) {
+                        out += ' ';
+                        out += OPERATORS[random() % 4];
+                        out += ' ';
+                        ++emitted;
+                }
+
+                size_t left = (tokens > emitted) ? tokens - emitted : 0;
+
+                switch ((nesting < MAX_NESTING) && (left > 4) ? random() % 8
+                                                              : 7) {
+                case 0: case 1: {  // parenthesised
+                        out += '(';
+                        emitted += 2 + generateExpression(out, random,
+                                                1 + random() % (left - 2),
+                                                nesting + 1);
+                        out += ')';
+                        break;
+                }
+                case 2: {  // call
+                        size_t args = random() % 4;
+
+                        out += "f(";
+                        emitted += 3;
+                        for (size_t i = 0; i < args; ++i) {
+                                if (i) {
+                                        out += ", ";
+                                        ++emitted;
+                                }
+                                emitted += generateExpression(out, random,
+                                                1 + random() % 6,
+                                                nesting + 1);
+                        }
+                        out += ')';
+                        break;
+                }
+                case 3: case 4:
+                        out += "x";
+                        ++emitted;
+                        break;
+                default:
+                        out += std::to_string(random() % 1000);
+                        ++emitted;
+                        break;
+                }
+        } while (emitted + 2 <= tokens);
+
+        return emitted;
+}
+
+//--------------------------------------
+
+std::string
+BenchGrammars::generate(
+        const char *grammar,
+        size_t      tokens,
+        uint32_t    seed
+)
+{
+        std::minstd_rand random(seed);
+        std::string      out;
+        size_t           emitted = 0;
+
+        if (!strcmp(grammar, "expression")) {
+                generateExpression(out, random, tokens, 0);
+        } else if (!strcmp(grammar, "statements")) {
+                do {
+                        if (random() % 2) {
+                                out += "x = ";
+                                emitted += 3 + generateExpression(out, random,
+                                                        1 + random() % 30, 0);
+                        } else {
+                                out += "f(";
+                                emitted += 4 + generateExpression(out, random,
+                                                        1 + random() % 30, 0);
+                                out += ')';
+                        }
+                        out += ";\n";
+                } while (emitted < tokens);
+        } else if (!strcmp(grammar, "ambiguous")) {
+                do {
+                        if (emitted) {
+                                out += (random() % 2) ? " + " : " * ";
+                                ++emitted;
+                        }
+                        out += std::to_string(random() % 10);
+                        ++emitted;
+                } while (emitted + 2 <= tokens);
+        }
+
+        return out;
+}
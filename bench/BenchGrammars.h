@@ -0,0 +1,120 @@
+/**
+ * \file BenchGrammars.h
+ *
+ * \brief Lexer, grammars and input generators for the benchmark harness
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_BENCH_BENCH_GRAMMARS_H
+#define WRPARSE_BENCH_BENCH_GRAMMARS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include <wrparse/Grammar.h>
+#include <wrparse/PatternLexer.h>
+
+
+enum : wr::parse::TokenKind
+{
+        TOK_PLUS = wr::parse::TOK_USER_MIN,
+        TOK_MINUS,
+        TOK_MULTIPLY,
+        TOK_DIVIDE,
+        TOK_LPAREN,
+        TOK_RPAREN,
+        TOK_COMMA,
+        TOK_SEMICOLON,
+        TOK_ASSIGN,
+        TOK_NUMBER,
+        TOK_IDENTIFIER,
+        TOK_BENCH_MAX = TOK_IDENTIFIER
+};
+
+//--------------------------------------
+/**
+ * \brief Lexer for the input languages of all benchmark grammars
+ *
+ * Whitespace, including newlines, separates tokens and is otherwise ignored.
+ */
+class BenchLexer : public wr::parse::PatternLexer
+{
+public:
+        using base_t = wr::parse::PatternLexer;
+
+        BenchLexer();
+
+        virtual const char *tokenKindName(wr::parse::TokenKind kind) const
+                override;
+
+        /// \brief Text of a token of the given kind, as generators emit it
+        static const char *sampleSpelling(wr::parse::TokenKind kind);
+};
+
+//--------------------------------------
+/**
+ * \brief Grammars exercised by the benchmarks
+ *
+ *  - \c expression: arithmetic with left-recursive precedence levels,
+ *    identifiers and function calls; deterministic, but not LL(1)
+ *  - \c statements: a sequence of assignments and calls using
+ *    \c expression
+ *  - \c ambiguous: `e ::= e '+' e | e '*' e | '(' e ')' | number`, which
+ *    has a number of derivations exponential in the length of the input,
+ *    and is parsed in cubic time
+ */
+class BenchGrammars
+{
+public:
+        BenchGrammars();
+
+        /// \brief Start symbol of the named grammar, or \c nullptr
+        const wr::parse::NonTerminal *find(const char *grammar) const;
+
+        /// \brief Names of the grammars, terminated by \c nullptr
+        static const char * const *names();
+
+        /**
+         * \brief Generate input for the named grammar
+         *
+         * The same arguments always give the same input.
+         *
+         * \param [in] grammar  grammar name, see names()
+         * \param [in] tokens   approximate number of tokens to generate
+         * \param [in] seed     seed for the pseudo-random choices made
+         * \return the input text, or an empty string if \c grammar is not
+         *      known
+         */
+        static std::string generate(const char *grammar, size_t tokens,
+                                    uint32_t seed = 1);
+
+        const wr::parse::NonTerminal factor,
+                                     call,
+                                     arguments,
+                                     term,
+                                     expression,
+                                     statement,
+                                     statements,
+                                     ambiguous;
+};
+
+
+#endif // !WRPARSE_BENCH_BENCH_GRAMMARS_H
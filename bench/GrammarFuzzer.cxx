@@ -0,0 +1,607 @@
+/**
+ * \file GrammarFuzzer.cxx
+ *
+ * \brief Search for inputs making the parser do the most work per token
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+
+#include "BenchGrammars.h"
+
+
+using wr::parse::Component;
+using wr::parse::NonTerminal;
+using wr::parse::Parser;
+using wr::parse::Rule;
+using wr::parse::Token;
+using wr::parse::TokenKind;
+
+using Sequence = std::vector<TokenKind>;
+
+static const char USAGE[] =
+"Usage: GrammarFuzzer -g GRAMMAR [options]\n"
+"\n"
+"Searches for token sequences making the parser do the most work per\n"
+"token, counting descriptors, GSS edges, SPPF nodes and packed nodes.\n"
+"\n"
+"Options:\n"
+"  -n ROUNDS     number of mutated inputs to try (default 2000)\n"
+"  -l TOKENS     greatest input length (default 64)\n"
+"  -k COUNT      number of inputs kept in the corpus (default 8)\n"
+"  -r SEED       seed for the pseudo-random choices made (default 1)\n"
+"  -e ENGINE     parse with the 'gll' (default) or 'crf' engine\n"
+"  -o DIR        write the minimised corpus to DIR/GRAMMAR-N.txt, for\n"
+"                'ParserBench -g GRAMMAR -i FILE'\n";
+
+enum { MAX_DERIVATION_DEPTH = 12 };
+
+//--------------------------------------
+/*
+ * feeds a token sequence to the parser without lexing text
+ */
+class SequenceLexer : public wr::parse::Lexer
+{
+public:
+        SequenceLexer() : input_(nullptr), pos_(0) {}
+
+        void setInput(const Sequence &input)
+                { input_ = &input; pos_ = 0; }
+
+        virtual Token &lex(Token &out_token) override
+        {
+                TokenKind kind = wr::parse::TOK_EOF;
+
+                if (pos_ < input_->size()) {
+                        kind = (*input_)[pos_];
+                }
+
+                out_token.reset();
+                out_token.setOffset(pos_++);
+                out_token.setKind(kind);
+                return out_token;
+        }
+
+private:
+        const Sequence *input_;
+        size_t          pos_;
+};
+
+struct Candidate
+{
+        Sequence           tokens;
+        Parser::Statistics statistics;
+        double             fitness;  // work per token
+};
+
+//--------------------------------------
+
+class Fuzzer
+{
+public:
+        Fuzzer(const NonTerminal &start, Parser::Engine engine,
+               size_t max_tokens, uint32_t seed);
+
+        /// \brief parse \c tokens, returning its work per token
+        double evaluate(const Sequence &tokens,
+                        Parser::Statistics *statistics = nullptr);
+
+        Sequence derive();
+        Sequence mutate(const Sequence &parent, const Sequence &other);
+        Sequence minimise(const Sequence &tokens, double fitness);
+
+        /// \brief terminals reachable from the start symbol
+        const std::vector<TokenKind> &terminals() const
+                { return terminals_; }
+
+private:
+        void collect(const NonTerminal &nt);
+        size_t minLength(const Rule &rule) const;
+        void derive(const NonTerminal &nt, Sequence &out, int depth);
+
+        const NonTerminal                              &start_;
+        SequenceLexer                                   lexer_;
+        Parser                                          parser_;
+        size_t                                          max_tokens_;
+        std::minstd_rand                                random_;
+        std::vector<TokenKind>                          terminals_;
+        std::unordered_map<const NonTerminal *, size_t> min_length_;
+};
+
+//--------------------------------------
+
+Fuzzer::Fuzzer(
+        const NonTerminal &start,
+        Parser::Engine     engine,
+        size_t             max_tokens,
+        uint32_t           seed
+) :
+        start_     (start),
+        parser_    (lexer_),
+        max_tokens_(max_tokens),
+        random_    (seed)
+{
+        parser_.setEngine(engine);
+        collect(start);
+
+        /* the shortest sentence each nonterminal derives, by fixed point
+           from no known sentences */
+        for (bool changed = true; changed; ) {
+                changed = false;
+                for (auto &entry: min_length_) {
+                        for (const Rule &rule: *entry.first) {
+                                size_t length = minLength(rule);
+
+                                if (length < entry.second) {
+                                        entry.second = length;
+                                        changed = true;
+                                }
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+/*
+ * note the terminals and nonterminals reachable from 'nt'
+ */
+void
+Fuzzer::collect(
+        const NonTerminal &nt
+)
+{
+        if (!min_length_.emplace(&nt, SIZE_MAX).second) {
+                return;
+        }
+
+        for (const Rule &rule: nt) {
+                for (const Component &component: rule) {
+                        if (component.isTerminal()) {
+                                TokenKind kind = component.getAsTerminal();
+
+                                if (std::find(terminals_.begin(),
+                                              terminals_.end(), kind)
+                                                == terminals_.end()) {
+                                        terminals_.push_back(kind);
+                                }
+                        } else {
+                                collect(*component.getAsNonTerminal());
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+
+size_t
+Fuzzer::minLength(
+        const Rule &rule
+) const
+{
+        size_t length = 0;
+
+        for (const Component &component: rule) {
+                if (component.isOptional()) {
+                        continue;
+                } else if (component.isTerminal()) {
+                        ++length;
+                } else {
+                        size_t sub = min_length_.at(
+                                                component.getAsNonTerminal());
+
+                        if (sub == SIZE_MAX) {
+                                return SIZE_MAX;
+                        }
+                        length += sub;
+                }
+        }
+
+        return length;
+}
+
+//--------------------------------------
+
+double
+Fuzzer::evaluate(
+        const Sequence     &tokens,
+        Parser::Statistics *statistics
+)
+{
+        lexer_.setInput(tokens);
+        parser_.reset();
+        parser_.parse(start_);  // failed parses count as much as any
+
+        const Parser::Statistics &s = parser_.statistics();
+
+        if (statistics) {
+                *statistics = s;
+        }
+
+        size_t work = s.descriptors_ + s.gss_edges_ + s.sppf_nodes_
+                      + s.packed_nodes_;
+
+        return static_cast<double>(work) / std::max<size_t>(tokens.size(), 1);
+}
+
+//--------------------------------------
+/*
+ * a random sentence of the grammar, choosing the shortest rules once deep
+ * in the derivation
+ */
+Sequence
+Fuzzer::derive()
+{
+        Sequence out;
+
+        derive(start_, out, 0);
+        if (out.size() > max_tokens_) {
+                out.resize(max_tokens_);
+        }
+        return out;
+}
+
+//--------------------------------------
+
+void
+Fuzzer::derive(
+        const NonTerminal &nt,
+        Sequence          &out,
+        int                depth
+)
+{
+        std::vector<const Rule *> candidates;
+        size_t                    shortest = SIZE_MAX;
+
+        for (const Rule &rule: nt) {
+                size_t length = minLength(rule);
+
+                if (length == SIZE_MAX) {
+                        continue;
+                } else if ((depth < MAX_DERIVATION_DEPTH)
+                           && (out.size() < max_tokens_)) {
+                        candidates.push_back(&rule);
+                } else if (length < shortest) {
+                        candidates.assign(1, &rule);
+                        shortest = length;
+                }
+        }
+
+        if (candidates.empty()) {
+                return;
+        }
+
+        const Rule &rule = *candidates[random_() % candidates.size()];
+
+        for (const Component &component: rule) {
+                if (component.isOptional() && (random_() % 2)) {
+                        continue;
+                } else if (component.isTerminal()) {
+                        out.push_back(component.getAsTerminal());
+                } else {
+                        derive(*component.getAsNonTerminal(), out, depth + 1);
+                }
+        }
+}
+
+//--------------------------------------
+
+Sequence
+Fuzzer::mutate(
+        const Sequence &parent,
+        const Sequence &other
+)
+{
+        Sequence child = parent;
+        size_t   pos = child.empty() ? 0 : random_() % (child.size() + 1);
+
+        switch (random_() % 6) {
+        case 0:  // insert a terminal
+                if (!terminals_.empty()) {
+                        child.insert(child.begin() + pos,
+                                     terminals_[random_()
+                                                % terminals_.size()]);
+                }
+                break;
+        case 1:  // replace a terminal
+                if ((pos < child.size()) && !terminals_.empty()) {
+                        child[pos] = terminals_[random_() % terminals_.size()];
+                }
+                break;
+        case 2:  // remove a terminal
+                if (pos < child.size()) {
+                        child.erase(child.begin() + pos);
+                }
+                break;
+        case 3: {  // repeat a range
+                size_t end = pos + random_() % 8;
+
+                end = std::min(end, child.size());
+                child.insert(child.begin() + pos, parent.begin() + pos,
+                             parent.begin() + end);
+                break;
+        }
+        case 4: {  // insert a range of another input
+                if (!other.empty()) {
+                        size_t first = random_() % other.size(),
+                               end = std::min(first + 1 + random_() % 8,
+                                              other.size());
+
+                        child.insert(child.begin() + pos,
+                                     other.begin() + first,
+                                     other.begin() + end);
+                }
+                break;
+        }
+        default: {  // insert a fresh derivation
+                Sequence sentence = derive();
+                child.insert(child.begin() + pos, sentence.begin(),
+                             sentence.end());
+                break;
+        }
+        }
+
+        if (child.size() > max_tokens_) {
+                child.resize(max_tokens_);
+        }
+        return child;
+}
+
+//--------------------------------------
+/*
+ * remove ever smaller ranges of tokens while the work per token does not
+ * fall below 'fitness'
+ */
+Sequence
+Fuzzer::minimise(
+        const Sequence &tokens,
+        double          fitness
+)
+{
+        Sequence best = tokens;
+
+        for (size_t chunk = std::max<size_t>(best.size() / 2, 1); ;
+                                                        chunk /= 2) {
+                for (size_t pos = 0; pos < best.size(); ) {
+                        Sequence trial = best;
+
+                        trial.erase(trial.begin() + pos,
+                                    trial.begin() + std::min(pos + chunk,
+                                                             trial.size()));
+                        if (!trial.empty() && (evaluate(trial) >= fitness)) {
+                                best = std::move(trial);
+                        } else {
+                                pos += chunk;
+                        }
+                }
+
+                if (chunk == 1) {
+                        break;
+                }
+        }
+
+        return best;
+}
+
+//--------------------------------------
+/*
+ * the sample spellings of 'tokens', separated by spaces; main() checks
+ * beforehand that every terminal of the grammar has one
+ */
+static std::string
+render(
+        const Sequence &tokens
+)
+{
+        std::string text;
+
+        for (TokenKind kind: tokens) {
+                const char *spelling = BenchLexer::sampleSpelling(kind);
+
+                if (!spelling) {
+                        throw std::logic_error("no sample spelling for token"
+                                               " kind "
+                                               + std::to_string(kind));
+                }
+                if (!text.empty()) {
+                        text += ' ';
+                }
+                text += spelling;
+        }
+
+        return text;
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        const char     *grammar = nullptr,
+                       *out_dir = nullptr;
+        unsigned long   rounds = 2000,
+                        max_tokens = 64,
+                        keep = 8,
+                        seed = 1;
+        Parser::Engine  engine = Parser::GLL_ENGINE;
+
+        for (int i = 1; i + 1 < argc; i += 2) {
+                const char *value = argv[i + 1];
+
+                if ((argv[i][0] != '-') || !argv[i][1] || argv[i][2]) {
+                        std::cerr << USAGE;
+                        return EXIT_FAILURE;
+                }
+
+                switch (argv[i][1]) {
+                case 'g': grammar = value; break;
+                case 'n': rounds = strtoul(value, nullptr, 10); break;
+                case 'l': max_tokens = strtoul(value, nullptr, 10); break;
+                case 'k': keep = strtoul(value, nullptr, 10); break;
+                case 'r': seed = strtoul(value, nullptr, 10); break;
+                case 'o': out_dir = value; break;
+                case 'e':
+                        if (!strcmp(value, "crf")) {
+                                engine = Parser::CRF_ENGINE;
+                        } else if (strcmp(value, "gll")) {
+                                std::cerr << USAGE;
+                                return EXIT_FAILURE;
+                        }
+                        break;
+                default:
+                        std::cerr << USAGE;
+                        return EXIT_FAILURE;
+                }
+        }
+
+        BenchGrammars grammars;
+        const NonTerminal *start = grammar ? grammars.find(grammar) : nullptr;
+
+        if (!start || (argc % 2 == 0) || !max_tokens || !keep) {
+                std::cerr << USAGE;
+                return EXIT_FAILURE;
+        }
+
+        Fuzzer fuzzer(*start, engine, max_tokens,
+                      static_cast<uint32_t>(seed));
+
+        /* mutation draws on the grammar's terminals, and the inputs found
+           are written with their sample spellings */
+        if (fuzzer.terminals().empty()) {
+                std::cerr << grammar << ": no terminals to fuzz with\n";
+                return EXIT_FAILURE;
+        }
+        for (TokenKind kind: fuzzer.terminals()) {
+                if (!BenchLexer::sampleSpelling(kind)) {
+                        std::cerr << grammar << ": no sample spelling for"
+                                  " token kind " << kind << '\n';
+                        return EXIT_FAILURE;
+                }
+        }
+
+        std::vector<Candidate> corpus;
+        std::set<Sequence>     seen;
+        std::minstd_rand       random(static_cast<uint32_t>(seed));
+
+        auto consider = [&](Sequence tokens) {
+                if (tokens.empty() || !seen.insert(tokens).second) {
+                        return;
+                }
+
+                Candidate c;
+
+                c.fitness = fuzzer.evaluate(tokens, &c.statistics);
+                c.tokens = std::move(tokens);
+
+                if (corpus.size() < keep) {
+                        corpus.push_back(std::move(c));
+                } else {
+                        auto worst = std::min_element(corpus.begin(),
+                                        corpus.end(),
+                                        [](const Candidate &a,
+                                           const Candidate &b) {
+                                                return a.fitness < b.fitness;
+                                        });
+
+                        if (c.fitness > worst->fitness) {
+                                *worst = std::move(c);
+                        }
+                }
+        };
+
+        for (unsigned long i = 0; i < keep * 4; ++i) {
+                consider(fuzzer.derive());
+        }
+
+        for (unsigned long round = 0; round < rounds && !corpus.empty();
+                                                                ++round) {
+                const Candidate &parent = corpus[random() % corpus.size()],
+                                &other = corpus[random() % corpus.size()];
+
+                consider(fuzzer.mutate(parent.tokens, other.tokens));
+        }
+
+        std::sort(corpus.begin(), corpus.end(),
+                  [](const Candidate &a, const Candidate &b) {
+                          return a.fitness > b.fitness;
+                  });
+
+        std::cout << std::left << std::setw(4) << "#" << std::right
+                  << std::setw(8) << "tokens" << std::setw(13) << "descriptors"
+                  << std::setw(11) << "GSS edges" << std::setw(12)
+                  << "SPPF nodes" << std::setw(9) << "packed"
+                  << std::setw(11) << "work/token" << "  input\n";
+
+        int                status = EXIT_SUCCESS;
+        size_t             i = 0;
+        std::set<Sequence> minimised;
+
+        for (Candidate &c: corpus) {
+                c.tokens = fuzzer.minimise(c.tokens, c.fitness);
+                if (!minimised.insert(c.tokens).second) {
+                        continue;  // same as a fitter input once minimised
+                }
+                c.fitness = fuzzer.evaluate(c.tokens, &c.statistics);
+
+                std::string text = render(c.tokens);
+
+                std::cout << std::left << std::setw(4) << i << std::right
+                          << std::setw(8) << c.tokens.size()
+                          << std::setw(13) << c.statistics.descriptors_
+                          << std::setw(11) << c.statistics.gss_edges_
+                          << std::setw(12) << c.statistics.sppf_nodes_
+                          << std::setw(9) << c.statistics.packed_nodes_
+                          << std::setw(11) << std::fixed
+                          << std::setprecision(1) << c.fitness << "  "
+                          << text << '\n';
+
+                if (out_dir) {
+                        std::string   path = std::string(out_dir) + '/'
+                                             + grammar + '-'
+                                             + std::to_string(i) + ".txt";
+                        std::ofstream out(path);
+
+                        if (!(out << text << '\n')) {
+                                std::cerr << "cannot write " << path << '\n';
+                                status = EXIT_FAILURE;
+                        }
+                }
+                ++i;
+        }
+
+        return status;
+}
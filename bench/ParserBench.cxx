@@ -0,0 +1,389 @@
+/**
+ * \file ParserBench.cxx
+ *
+ * \brief Benchmark harness timing the phases of parsing
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <wrparse/Parser.h>
+
+#include "BenchGrammars.h"
+#include "PerfCounters.h"
+
+
+using wr::parse::Parser;
+using wr::parse::SPPFNode;
+using wr::parse::Token;
+
+static const char USAGE[] =
+"Usage: ParserBench [options] [case...]\n"
+"\n"
+"Options:\n"
+"  -n RUNS       repeat each case RUNS times (default 5)\n"
+"  -s SCALE      multiply the size of generated inputs by SCALE\n"
+"  -e ENGINE     parse with the 'gll' (default) or 'crf' engine\n"
+"  -c            collect hardware performance counters\n"
+"  -g GRAMMAR    grammar for the files given with -i\n"
+"  -i FILE       add a case parsing FILE, named after the file; its\n"
+"                input need not match the grammar\n"
+"\n"
+"Without -i, runs the named built-in cases, or all of them.\n";
+
+/*
+ * the built-in cases; sizes are in tokens, chosen for runs of comparable
+ * length
+ */
+static const struct
+{
+        const char *name;
+        const char *grammar;
+        size_t      tokens;
+} BUILTIN_CASES[] = {
+        { "expression", "expression", 200000 },
+        { "statements", "statements", 200000 },
+        { "ambiguous",  "ambiguous",  41 }
+};
+
+enum Phase
+{
+        LEX,
+        PARSE,
+        TEARDOWN,
+        PHASE_COUNT
+};
+
+static const char * const PHASE_NAMES[PHASE_COUNT] = {
+        "lex",
+        "parse",
+        "teardown"
+};
+
+struct BenchCase
+{
+        std::string  name;
+        const char  *grammar;
+        std::string  input;
+        bool         must_match;  // else time failed parses too
+};
+
+struct PhaseResult
+{
+        double               seconds;
+        PerfCounters::Sample counts;
+        bool                 counted;
+
+        PhaseResult() : seconds(0), counted(false) {}
+
+        void add(double s, const PerfCounters::Sample &sample)
+        {
+                seconds += s;
+                if (!counted) {
+                        counts = sample;
+                        counted = true;
+                } else {
+                        counts += sample;
+                }
+        }
+};
+
+//--------------------------------------
+/*
+ * times a phase, counting events if counters are available
+ */
+class PhaseTimer
+{
+public:
+        PhaseTimer(PerfCounters &counters, PhaseResult &result) :
+                counters_(counters),
+                result_  (result)
+        {
+                counters_.start();
+                start_ = std::chrono::steady_clock::now();
+        }
+
+        ~PhaseTimer()
+        {
+                auto end = std::chrono::steady_clock::now();
+
+                result_.add(std::chrono::duration<double>(end - start_)
+                                                                .count(),
+                            counters_.stop());
+        }
+
+private:
+        PerfCounters                          &counters_;
+        PhaseResult                           &result_;
+        std::chrono::steady_clock::time_point  start_;
+};
+
+//--------------------------------------
+
+static bool
+runCase(
+        const BenchCase     &bench,
+        const BenchGrammars &grammars,
+        Parser::Engine       engine,
+        unsigned             runs,
+        PerfCounters        &counters
+)
+{
+        const wr::parse::NonTerminal *start = grammars.find(bench.grammar);
+        BenchLexer                    lexer;
+        Parser                        parser(lexer);
+        PhaseResult                   results[PHASE_COUNT];
+        size_t                        tokens = 0;
+        bool                          matched = false;
+
+        parser.setEngine(engine);
+
+        for (unsigned run = 0; run < runs; ++run) {
+                std::istringstream input(bench.input);
+                SPPFNode::Ptr      result;
+
+                lexer.reset(input);
+                lexer.clearStorage();
+                parser.reset();
+                tokens = 0;
+
+                {
+                        PhaseTimer timer(counters, results[LEX]);
+
+                        for (Token *t = parser.nextToken();
+                             !t->is(wr::parse::TOK_EOF);
+                             t = parser.nextToken(t)) {
+                                ++tokens;
+                        }
+                }
+                {
+                        PhaseTimer timer(counters, results[PARSE]);
+
+                        result = parser.parse(*start);
+                }
+
+                matched = result && !parser.errorCount();
+                if (!matched && bench.must_match) {
+                        std::cerr << bench.name << ": parse failed\n";
+                        return false;
+                }
+
+                {
+                        PhaseTimer timer(counters, results[TEARDOWN]);
+
+                        result.reset();
+                }
+        }
+
+        std::cout << bench.name << " (" << bench.grammar << ", " << tokens
+                  << " tokens, " << (matched ? "" : "no match, ") << runs
+                  << " runs, means per run)\n";
+
+        std::cout << "  " << std::left << std::setw(10) << "phase"
+                  << std::right << std::setw(12) << "ms";
+        if (counters.anyAvailable()) {
+                for (int e = 0; e < PerfCounters::EVENT_COUNT; ++e) {
+                        std::cout << std::setw(15) << PerfCounters::name(
+                                        static_cast<PerfCounters::Event>(e));
+                }
+                std::cout << std::setw(7) << "IPC";
+        }
+        std::cout << '\n';
+
+        PhaseResult total;
+
+        for (int p = 0; p <= PHASE_COUNT; ++p) {
+                const PhaseResult &r = (p < PHASE_COUNT) ? results[p] : total;
+
+                if (p < PHASE_COUNT) {
+                        total.add(r.seconds, r.counts);
+                }
+
+                std::cout << "  " << std::left << std::setw(10)
+                          << ((p < PHASE_COUNT) ? PHASE_NAMES[p] : "total")
+                          << std::right << std::setw(12) << std::fixed
+                          << std::setprecision(3)
+                          << (r.seconds * 1000 / runs);
+
+                if (counters.anyAvailable()) {
+                        for (int e = 0; e < PerfCounters::EVENT_COUNT; ++e) {
+                                auto event = static_cast<PerfCounters::Event>(
+                                                                        e);
+
+                                std::cout << std::setw(15);
+                                if (r.counts.has(event)) {
+                                        std::cout << (r.counts.values_[e]
+                                                      / runs);
+                                } else {
+                                        std::cout << '-';
+                                }
+                        }
+
+                        std::cout << std::setw(7) << std::setprecision(2);
+                        if (r.counts.has(PerfCounters::CYCLES)
+                            && r.counts.has(PerfCounters::INSTRUCTIONS)
+                            && r.counts.values_[PerfCounters::CYCLES]) {
+                                std::cout << (static_cast<double>(
+                                    r.counts.values_[PerfCounters::INSTRUCTIONS])
+                                    / r.counts.values_[PerfCounters::CYCLES]);
+                        } else {
+                                std::cout << '-';
+                        }
+                }
+                std::cout << '\n';
+        }
+
+        std::cout << std::endl;
+        return true;
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        std::vector<BenchCase>   cases;
+        std::vector<const char*> names;
+        unsigned                 runs = 5;
+        double                   scale = 1;
+        Parser::Engine           engine = Parser::GLL_ENGINE;
+        bool                     use_counters = false;
+        const char              *file_grammar = nullptr;
+        BenchGrammars            grammars;
+
+        for (int i = 1; i < argc; ++i) {
+                const char *arg = argv[i],
+                           *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+                if (!strcmp(arg, "-c")) {
+                        use_counters = true;
+                        continue;
+                } else if ((arg[0] != '-') || !arg[1]) {
+                        names.push_back(arg);
+                        continue;
+                } else if (!value || arg[2]) {
+                        std::cerr << USAGE;
+                        return EXIT_FAILURE;
+                }
+
+                ++i;
+
+                switch (arg[1]) {
+                case 'n':
+                        runs = static_cast<unsigned>(atoi(value));
+                        break;
+                case 's':
+                        scale = atof(value);
+                        break;
+                case 'e':
+                        if (!strcmp(value, "crf")) {
+                                engine = Parser::CRF_ENGINE;
+                        } else if (strcmp(value, "gll")) {
+                                std::cerr << "unknown engine " << value
+                                          << '\n';
+                                return EXIT_FAILURE;
+                        }
+                        break;
+                case 'g':
+                        if (!grammars.find(value)) {
+                                std::cerr << "unknown grammar " << value
+                                          << '\n';
+                                return EXIT_FAILURE;
+                        }
+                        file_grammar = value;
+                        break;
+                case 'i': {
+                        std::ifstream      in(value, std::ios::binary);
+                        std::ostringstream text;
+
+                        if (!file_grammar) {
+                                std::cerr << "-i requires a preceding -g\n";
+                                return EXIT_FAILURE;
+                        } else if (!(text << in.rdbuf())) {
+                                std::cerr << "cannot read " << value << '\n';
+                                return EXIT_FAILURE;
+                        }
+                        cases.push_back({ value, file_grammar, text.str(),
+                                          false });
+                        break;
+                }
+                default:
+                        std::cerr << USAGE;
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (!runs || (scale <= 0)) {
+                std::cerr << USAGE;
+                return EXIT_FAILURE;
+        }
+
+        if (cases.empty()) {
+                for (const auto &builtin: BUILTIN_CASES) {
+                        bool selected = names.empty();
+
+                        for (const char *name: names) {
+                                selected = selected
+                                           || !strcmp(name, builtin.name);
+                        }
+
+                        if (selected) {
+                                auto tokens = static_cast<size_t>(
+                                                builtin.tokens * scale);
+
+                                cases.push_back({ builtin.name,
+                                        builtin.grammar,
+                                        BenchGrammars::generate(
+                                                builtin.grammar, tokens),
+                                        true });
+                        }
+                }
+        }
+
+        PerfCounters counters(use_counters);
+
+        if (use_counters && !counters.whyUnavailable().empty()) {
+                std::cerr << (counters.anyAvailable()
+                                ? "some performance counters unavailable: "
+                                : "performance counters unavailable: ")
+                          << counters.whyUnavailable() << "\n\n";
+        }
+
+        int status = EXIT_SUCCESS;
+
+        for (const BenchCase &bench: cases) {
+                if (!runCase(bench, grammars, engine, runs, counters)) {
+                        status = EXIT_FAILURE;
+                }
+        }
+
+        return status;
+}
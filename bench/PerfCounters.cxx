@@ -0,0 +1,230 @@
+/**
+ * \file PerfCounters.cxx
+ *
+ * \brief Hardware performance counters for the benchmark harness
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "PerfCounters.h"
+
+
+#ifdef __linux__
+
+struct EventConfig
+{
+        uint32_t type;
+        uint64_t config;
+};
+
+static const EventConfig EVENT_CONFIGS[PerfCounters::EVENT_COUNT] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                              | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                              | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+/*
+ * there is no glibc wrapper for perf_event_open(2)
+ */
+static int
+openEvent(
+        const EventConfig &event
+)
+{
+        perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = event.type;
+        attr.config = event.config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                           | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr,
+                                        0 /* this thread */, -1 /* any CPU */,
+                                        -1 /* no group */, 0));
+}
+
+#endif // __linux__
+
+//--------------------------------------
+
+PerfCounters::Sample &
+PerfCounters::Sample::operator+=(
+        const Sample &other
+)
+{
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+                values_[i] += other.values_[i];
+        }
+        valid_ &= other.valid_;
+        return *this;
+}
+
+//--------------------------------------
+
+PerfCounters::PerfCounters(
+        bool enable
+) :
+        start_()
+{
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+                fds_[i] = -1;
+        }
+
+        if (!enable) {
+                return;
+        }
+
+#ifdef __linux__
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+                fds_[i] = openEvent(EVENT_CONFIGS[i]);
+                if ((fds_[i] < 0) && why_.empty()) {
+                        why_ = name(static_cast<Event>(i));
+                        why_ += ": ";
+                        why_ += strerror(errno);
+                        if ((errno == EACCES) || (errno == EPERM)) {
+                                why_ += " (see /proc/sys/kernel/"
+                                        "perf_event_paranoid)";
+                        }
+                }
+        }
+#else
+        why_ = "performance counters are only supported on Linux";
+#endif
+}
+
+//--------------------------------------
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+        for (int fd: fds_) {
+                if (fd >= 0) {
+                        close(fd);
+                }
+        }
+#endif
+}
+
+//--------------------------------------
+
+bool
+PerfCounters::anyAvailable() const
+{
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+                if (available(static_cast<Event>(i))) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+//--------------------------------------
+
+const char *
+PerfCounters::name(
+        Event event
+)
+{
+        switch (event) {
+        case CYCLES:        return "cycles";
+        case INSTRUCTIONS:  return "instructions";
+        case L1D_MISSES:    return "L1D-misses";
+        case LLC_MISSES:    return "LLC-misses";
+        case BRANCH_MISSES: return "branch-misses";
+        default:            return "?";
+        }
+}
+
+//--------------------------------------
+
+bool
+PerfCounters::read(
+        Event    event,
+        Reading &out
+) const
+{
+#ifdef __linux__
+        return (fds_[event] >= 0)
+               && (::read(fds_[event], &out, sizeof(out)) == sizeof(out));
+#else
+        (void) event;
+        (void) out;
+        return false;
+#endif
+}
+
+//--------------------------------------
+
+void
+PerfCounters::start()
+{
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+                if (!read(static_cast<Event>(i), start_[i])) {
+                        start_[i] = Reading();
+                }
+        }
+}
+
+//--------------------------------------
+
+PerfCounters::Sample
+PerfCounters::stop()
+{
+        Reading end[EVENT_COUNT];
+        Sample  sample;
+
+        for (int i = 0; i < EVENT_COUNT; ++i) {
+                if (!read(static_cast<Event>(i), end[i])) {
+                        continue;
+                }
+
+                uint64_t value = end[i].value_ - start_[i].value_,
+                         enabled = end[i].enabled_ - start_[i].enabled_,
+                         running = end[i].running_ - start_[i].running_;
+
+                if (!running) {
+                        continue;  // never scheduled during the interval
+                } else if (running < enabled) {
+                        value = static_cast<uint64_t>(
+                                static_cast<double>(value) * enabled / running);
+                }
+
+                sample.values_[i] = value;
+                sample.valid_ |= 1U << i;
+        }
+
+        return sample;
+}
@@ -0,0 +1,114 @@
+/**
+ * \file PerfCounters.h
+ *
+ * \brief Hardware performance counters for the benchmark harness
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_BENCH_PERF_COUNTERS_H
+#define WRPARSE_BENCH_PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <string>
+
+
+/**
+ * \brief Counts hardware events occurring in the calling thread
+ *
+ * On Linux the counters are opened with `perf_event_open(2)`, counting user
+ * space only. Each event is opened separately, so any that the processor,
+ * kernel or container does not allow (see `perf_event_paranoid`) are simply
+ * unavailable while the rest are still counted. Elsewhere no event is
+ * available.
+ *
+ * Where the kernel multiplexes more events than the processor has counters,
+ * values are scaled by the proportion of the interval each was counting.
+ */
+class PerfCounters
+{
+public:
+        using this_t = PerfCounters;
+
+        enum Event
+        {
+                CYCLES,
+                INSTRUCTIONS,
+                L1D_MISSES,     ///< level 1 data cache read misses
+                LLC_MISSES,     ///< last level cache misses
+                BRANCH_MISSES,
+                EVENT_COUNT
+        };
+
+        /// \brief Events counted over an interval
+        struct Sample
+        {
+                uint64_t values_[EVENT_COUNT];
+                unsigned valid_;  ///< bit (1 << event) set if counted
+
+                Sample() : values_(), valid_(0) {}
+
+                bool has(Event event) const { return (valid_ >> event) & 1; }
+
+                /// \brief Accumulate \c other, keeping events valid in both
+                Sample &operator+=(const Sample &other);
+        };
+
+        /// \brief Open the counters for all events if \c enable is `true`
+        explicit PerfCounters(bool enable = true);
+
+        PerfCounters(const this_t &) = delete;
+        this_t &operator=(const this_t &) = delete;
+
+        ~PerfCounters();
+
+        bool available(Event event) const { return fds_[event] >= 0; }
+        bool anyAvailable() const;
+
+        /**
+         * \brief Describe why the first unavailable event could not be
+         *      opened, or give an empty string
+         */
+        const std::string &whyUnavailable() const { return why_; }
+
+        static const char *name(Event event);
+
+        /// \brief Begin an interval
+        void start();
+
+        /// \brief End the interval begun by start() and return its counts
+        Sample stop();
+
+private:
+        struct Reading
+        {
+                uint64_t value_;
+                uint64_t enabled_;
+                uint64_t running_;
+        };
+
+        bool read(Event event, Reading &out) const;
+
+        int         fds_[EVENT_COUNT];
+        Reading     start_[EVENT_COUNT];
+        std::string why_;
+};
+
+
+#endif // !WRPARSE_BENCH_PERF_COUNTERS_H
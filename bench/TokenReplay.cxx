@@ -0,0 +1,275 @@
+/**
+ * \file TokenReplay.cxx
+ *
+ * \brief Records the tokens parsed from inputs, and times parses replayed
+ *      from such recordings
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <wrparse/Parser.h>
+#include <wrparse/Replay.h>
+
+#include "BenchGrammars.h"
+#include "PerfCounters.h"
+
+
+using wr::parse::NonTerminal;
+using wr::parse::Parser;
+using wr::parse::ReplayLexer;
+using wr::parse::TokenRecorder;
+
+static const char USAGE[] =
+"Usage: TokenReplay -g GRAMMAR -w RECORDING [-x] INPUT...\n"
+"       TokenReplay -g GRAMMAR [options] RECORDING\n"
+"\n"
+"The first form parses each INPUT with GRAMMAR, recording the tokens read\n"
+"to RECORDING; -x records only the lengths of their spellings. The second\n"
+"form repeats the parses recorded.\n"
+"\n"
+"Options:\n"
+"  -n RUNS       repeat the recorded parses RUNS times (default 5)\n"
+"  -e ENGINE     parse with the 'gll' (default) or 'crf' engine\n"
+"  -c            collect hardware performance counters\n";
+
+//--------------------------------------
+
+static int
+record(
+        const BenchGrammars            &grammars,
+        const char                     *grammar,
+        const char                     *path,
+        TokenRecorder::SpellingMode     mode,
+        const std::vector<const char*> &inputs
+)
+{
+        std::ofstream out(path, std::ios::binary);
+        TokenRecorder recorder(out, mode);
+        BenchLexer    lexer;
+        Parser        parser(lexer);
+        size_t        matched = 0;
+
+        parser.setTokenRecorder(&recorder);
+
+        for (const char *input_path: inputs) {
+                std::ifstream input(input_path, std::ios::binary);
+
+                if (!input) {
+                        std::cerr << "cannot read " << input_path << '\n';
+                        return EXIT_FAILURE;
+                }
+
+                lexer.reset(input);
+                parser.reset();
+                if (parser.parse(*grammars.find(grammar))
+                    && !parser.errorCount()) {
+                        ++matched;
+                }
+        }
+
+        if (!out.flush()) {
+                std::cerr << "cannot write " << path << '\n';
+                return EXIT_FAILURE;
+        }
+
+        std::cout << path << ": " << recorder.size() << " tokens, "
+                  << inputs.size() << " parses, " << matched
+                  << " matched\n";
+        return EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+static int
+replay(
+        const BenchGrammars &grammars,
+        const char          *grammar,
+        const char          *path,
+        Parser::Engine       engine,
+        unsigned             runs,
+        PerfCounters        &counters
+)
+{
+        std::ifstream in(path, std::ios::binary);
+
+        if (!in) {
+                std::cerr << "cannot read " << path << '\n';
+                return EXIT_FAILURE;
+        }
+
+        ReplayLexer          lexer(in);
+        Parser               parser(lexer);
+        const NonTerminal   &root = *grammars.find(grammar);
+        PerfCounters::Sample counts;
+        double               seconds = 0;
+        size_t               parses = 0,
+                             matched = 0;
+
+        parser.setEngine(engine);
+        lexer.prepare(root);  // check the grammar before timing
+
+        for (const ReplayLexer::Event &event: lexer.events()) {
+                parses += (event.kind_ == ReplayLexer::Event::PARSE);
+        }
+
+        for (unsigned run = 0; run < runs; ++run) {
+                parser.reset();
+                counters.start();
+
+                auto start = std::chrono::steady_clock::now();
+
+                matched = lexer.replay(parser, root);
+
+                auto end = std::chrono::steady_clock::now();
+
+                if (run) {
+                        counts += counters.stop();
+                } else {
+                        counts = counters.stop();
+                }
+                seconds += std::chrono::duration<double>(end - start)
+                                                                .count();
+        }
+
+        std::cout << path << " (" << grammar << ", " << lexer.size()
+                  << " tokens, " << parses << " parses, " << matched
+                  << " matched, " << runs << " runs, means per run)\n"
+                  << "  " << std::left << std::setw(15) << "ms"
+                  << std::right << std::setw(15) << std::fixed
+                  << std::setprecision(3) << (seconds * 1000 / runs)
+                  << '\n';
+
+        for (int e = 0; e < PerfCounters::EVENT_COUNT; ++e) {
+                auto event = static_cast<PerfCounters::Event>(e);
+
+                if (counts.has(event)) {
+                        std::cout << "  " << std::left << std::setw(15)
+                                  << PerfCounters::name(event)
+                                  << std::right << std::setw(15)
+                                  << (counts.values_[e] / runs) << '\n';
+                }
+        }
+
+        return EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        std::vector<const char*>    files;
+        const char                 *grammar = nullptr,
+                                   *recording = nullptr;
+        TokenRecorder::SpellingMode mode = TokenRecorder::HASH_SPELLINGS;
+        unsigned                    runs = 5;
+        Parser::Engine              engine = Parser::GLL_ENGINE;
+        bool                        use_counters = false;
+        BenchGrammars               grammars;
+
+        for (int i = 1; i < argc; ++i) {
+                const char *arg = argv[i],
+                           *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+                if (!strcmp(arg, "-c")) {
+                        use_counters = true;
+                        continue;
+                } else if (!strcmp(arg, "-x")) {
+                        mode = TokenRecorder::REDACT_SPELLINGS;
+                        continue;
+                } else if ((arg[0] != '-') || !arg[1]) {
+                        files.push_back(arg);
+                        continue;
+                } else if (!value || arg[2]) {
+                        std::cerr << USAGE;
+                        return EXIT_FAILURE;
+                }
+
+                ++i;
+
+                switch (arg[1]) {
+                case 'n':
+                        runs = static_cast<unsigned>(atoi(value));
+                        break;
+                case 'e':
+                        if (!strcmp(value, "crf")) {
+                                engine = Parser::CRF_ENGINE;
+                        } else if (strcmp(value, "gll")) {
+                                std::cerr << "unknown engine " << value
+                                          << '\n';
+                                return EXIT_FAILURE;
+                        }
+                        break;
+                case 'g':
+                        if (!grammars.find(value)) {
+                                std::cerr << "unknown grammar " << value
+                                          << '\n';
+                                return EXIT_FAILURE;
+                        }
+                        grammar = value;
+                        break;
+                case 'w':
+                        recording = value;
+                        break;
+                default:
+                        std::cerr << USAGE;
+                        return EXIT_FAILURE;
+                }
+        }
+
+        if (!grammar || !runs || files.empty()
+            || (!recording && (files.size() != 1))) {
+                std::cerr << USAGE;
+                return EXIT_FAILURE;
+        }
+
+        try {
+                if (recording) {
+                        return record(grammars, grammar, recording, mode,
+                                      files);
+                }
+
+                PerfCounters counters(use_counters);
+
+                if (use_counters && !counters.whyUnavailable().empty()) {
+                        std::cerr << (counters.anyAvailable()
+                                ? "some performance counters unavailable: "
+                                : "performance counters unavailable: ")
+                                  << counters.whyUnavailable() << "\n\n";
+                }
+
+                return replay(grammars, grammar, files[0], engine, runs,
+                              counters);
+        } catch (const std::exception &e) {
+                std::cerr << e.what() << '\n';
+                return EXIT_FAILURE;
+        }
+}
@@ -0,0 +1,204 @@
+/**
+ * \file CodeGen.h
+ *
+ * \brief Generation of grammar-specific parser code
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_CODEGEN_H
+#define WRPARSE_CODEGEN_H
+
+#include <stdint.h>
+#include <iosfwd>
+#include <unordered_map>
+#include <vector>
+
+#include <wrparse/Config.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Token.h>
+
+
+namespace wr {
+namespace parse {
+
+
+class Lexer;  // see Lexer.h
+
+/**
+ * \brief Base class for parser code generated by generateParser()
+ *
+ * Generated code performs the grammar-specific steps of the CRF engine
+ * (see Parser::Engine): one `case` per grammar slot with the components of
+ * each rule matched in sequence, token kinds compared against constants
+ * and FIRST set tests folded into `switch` statements. It is used in place
+ * of the engine's interpretation of the grammar once attached to a parser
+ * with Parser::setCompiledGrammar().
+ *
+ * The grammar objects are still needed at run time, for predicates and the
+ * nonterminals and components referenced by SPPF nodes; a grammar with
+ * parse actions is parsed by the GLL engine (see Parser::Engine).
+ * A generated class binds to them on construction, and matches them only
+ * if they are structurally identical to the grammar it was generated from
+ * (see grammarFingerprint()); otherwise it is ignored by the parser.
+ */
+class WRPARSE_API CompiledGrammar
+{
+public:
+        using Slot = uint32_t;              ///< index of a grammar slot
+        using NonTerminalIndex = uint32_t;  ///< index of a nonterminal
+        using Pos = uint32_t;               ///< index of an input token
+
+        /**
+         * \brief Primitive operations of the CRF engine used by generated
+         *      code
+         *
+         * \c left is the input position at which the current rule began.
+         */
+        class Engine
+        {
+        public:
+                virtual TokenKind kind(Pos pos) = 0;
+                virtual bool test(Slot predicate, Pos pos) = 0;
+                virtual void add(Slot slot, Pos left, Pos pos) = 0;
+                virtual void beginRule(Slot first, Pos pos) = 0;
+                virtual void call(Slot slot, Pos left, Pos pos) = 0;
+                virtual bool endRule(Slot end, Pos left, Pos pos) = 0;
+                virtual void ret(NonTerminalIndex nonterminal, Pos left,
+                                 Pos pos) = 0;
+                virtual void addBSR(Slot slot, Pos left, Pos pivot,
+                                    Pos right, bool skipped) = 0;
+                virtual void expect(Pos pos, TokenKind terminal) = 0;
+                virtual void expectFirst(NonTerminalIndex nonterminal,
+                                         Pos pos) = 0;
+
+        protected:
+                ~Engine() = default;
+        };
+
+        virtual ~CompiledGrammar();
+
+        /**
+         * \brief Attach to the grammar objects rooted at \c start
+         * \return `false`, leaving the object unbound, if the grammar is
+         *         not that the code was generated from
+         */
+        bool bind(const NonTerminal &start);
+
+        bool isBound() const { return start_ != nullptr; }
+
+        /// \brief Test if \c nt is part of the grammar bound to
+        bool contains(const NonTerminal &nt) const
+                { return nonterminal_index_.count(&nt) != 0; }
+
+        /// \brief Start symbol bound to, or \c nullptr
+        const NonTerminal *start() const { return start_; }
+
+        Slot slotIndex(const Component &slot) const
+                { return slot_index_.at(&slot); }
+        const Component &slot(Slot index) const { return *slots_[index]; }
+
+        NonTerminalIndex nonTerminalIndex(const NonTerminal &nt) const
+                { return nonterminal_index_.at(&nt); }
+        const NonTerminal &nonTerminal(NonTerminalIndex index) const
+                { return *nonterminals_[index]; }
+
+        /// \brief grammarFingerprint() of the grammar generated from
+        virtual uint64_t fingerprint() const = 0;
+
+        /**
+         * \brief Add descriptors for the rules of a nonterminal that may
+         *      match the input at \c pos, via Engine::add() or
+         *      Engine::beginRule()
+         */
+        virtual void beginNonTerminal(Engine &engine,
+                                      NonTerminalIndex nonterminal,
+                                      Pos pos) const = 0;
+
+        /**
+         * \brief Match a rule from \c slot onwards, until it calls a
+         *      nonterminal, fails or completes
+         */
+        virtual void parse(Engine &engine, Slot slot, Pos left,
+                           Pos pos) const = 0;
+
+protected:
+        CompiledGrammar() : start_(nullptr) {}
+
+private:
+        const NonTerminal                                     *start_;
+        std::vector<const Component *>                         slots_;
+        std::unordered_map<const Component *, Slot>            slot_index_;
+        std::vector<const NonTerminal *>                       nonterminals_;
+        std::unordered_map<const NonTerminal *,
+                           NonTerminalIndex>                   nonterminal_index_;
+};
+
+//--------------------------------------
+/**
+ * \brief Compute a hash of the structure of a grammar
+ *
+ * The fingerprint covers each nonterminal reachable from \c start, in the
+ * order used to number slots in generated code, with its name, flags,
+ * rules and components. Parse actions, predicates and cost functions are
+ * not involved, other than whether each component has a predicate.
+ *
+ * \param [in] start  start symbol of the grammar
+ * \return the fingerprint
+ */
+WRPARSE_API uint64_t grammarFingerprint(const NonTerminal &start);
+
+/**
+ * \brief Write C++ source for a parser specialised to a grammar
+ *
+ * The output defines a class derived from CompiledGrammar, named
+ * \c class_name, whose constructor takes the grammar's start symbol. It
+ * may be compiled as a header into a program that also builds the grammar,
+ * for example:
+ *
+ *     // once, by a program linking the grammar definition
+ *     wr::parse::generateParser(out, grammar.start, "ExprParser", &lexer);
+ *
+ *     // in the application
+ *     #include "ExprParser.h"
+ *     ExprParser compiled(grammar.start);
+ *     parser.setEngine(Parser::CRF_ENGINE).setCompiledGrammar(&compiled);
+ *
+ * A grammar using ordered choice, commit points or predicates that are not
+ * pure cannot be compiled, as the CRF engine does not support them.
+ *
+ * \param [out] out         stream receiving the source
+ * \param [in]  start       start symbol of the grammar
+ * \param [in]  class_name  name of the class to define
+ * \param [in]  lexer       if not \c nullptr, used to name token kinds in
+ *                          comments
+ *
+ * \return `false` if the grammar cannot be compiled or the stream reported
+ *         an error
+ */
+WRPARSE_API bool generateParser(std::ostream &out, const NonTerminal &start,
+                                const char *class_name,
+                                const Lexer *lexer = nullptr);
+
+
+} // namespace parse
+} // namespace wr
+
+
+#endif // !WRPARSE_CODEGEN_H
@@ -26,6 +26,7 @@
 #define WRPARSE_GRAMMAR_H
 
 #include <algorithm>
+#include <functional>
 #include <iosfwd>
 #include <map>
 #include <set>
@@ -43,6 +44,9 @@ namespace parse {
 
 class Lexer;       // see Lexer.h
 class ParseState;  // see Parser.h
+class GrammarImage; // see GrammarImage.h
+class SPPFNode;    // see SPPF.h
+class StaticGrammarInstance;  // see StaticGrammar.h
 class Rule;        // see below
 class NonTerminal; // see below
 
@@ -95,9 +99,17 @@ public:
         bool isTerminal() const     { return is_terminal_; }
         bool isNonTerminal() const  { return !is_terminal_; }
         bool isOptional() const     { return is_optional_; }
+        bool isCommitPoint() const  { return is_commit_; }
+        bool isPure() const         { return is_pure_; }
         bool isRecursive() const;
         int index() const;
 
+        this_t &setCommitPoint(bool enable = true)
+                { is_commit_ = enable; return *this; }
+
+        this_t &setPure(bool enable = true)
+                { is_pure_ = enable; return *this; }
+
         TokenKind getAsTerminal() const
                 { return isTerminal() ? terminal_ : TOK_NULL; }
 
@@ -121,7 +133,9 @@ private:
         Predicate  predicate_;
         Rule      *rule_;
         uint8_t    is_terminal_ : 1,
-                   is_optional_ : 1;
+                   is_optional_ : 1,
+                   is_commit_   : 1,
+                   is_pure_     : 1;
 };
 
 static_assert(alignof(Component) >= 4,
@@ -160,6 +174,7 @@ public:
         bool isDelegate() const;
         bool isEnabled() const              { return enabled_; }
         bool mustHide() const;
+        const NonTerminal *inlineTarget() const;
         bool matchesEmpty() const;
 
         bool empty() const           { return base_t::size() == 1; }
@@ -181,7 +196,9 @@ public:
         bool operator!=(const this_t &rhs) const { return this != &rhs; }
 
 private:
+        friend GrammarImage;
         friend NonTerminal;
+        friend StaticGrammarInstance;
 
         using iterator = base_t::iterator;
 
@@ -219,9 +236,22 @@ public:
 
         enum
         {
+                /* nodes are hidden from the parse result, their children
+                   taking their place; of its rules, only those delegating
+                   to another nonterminal may be bypassed by the parser
+                   (see Rule::inlineTarget()), as others have no single
+                   nonterminal to begin in their place, and only while no
+                   parse actions are attached */
                 TRANSPARENT      = 1U,
+                /* nodes of delegate rules are hidden, and those rules may
+                   be bypassed by the parser unless parse actions are
+                   attached */
                 HIDE_IF_DELEGATE = 1U << 1,
-                KEEP_RECURSION   = 1U << 2
+                KEEP_RECURSION   = 1U << 2,
+                /* rules are tried in order; once one completes, later
+                   rules starting at the same input position are
+                   abandoned (PEG-style ordered choice) */
+                ORDERED_CHOICE   = 1U << 3
         };
 
         /* used below to prevent an initialiser list for a single
@@ -240,6 +270,17 @@ public:
 
         using Action = bool (*)(ParseState &);
 
+        /**
+         * \brief Rate one derivation of a nonterminal for bounded parsing
+         *
+         * Receives the packed node for a derivation (whose rule() gives the
+         * rule matched) and returns a non-negative cost, to which the parser
+         * adds the costs of the nodes below it.
+         *
+         * \see Parser::setBeam()
+         */
+        using CostFunction = double (*)(const SPPFNode &derivation);
+
         NonTerminal();
         NonTerminal(const this_t &other);
         NonTerminal(this_t &&other);
@@ -262,6 +303,7 @@ public:
         bool isTransparent() const  { return is_transparent_; }
         bool hideIfDelegate() const { return hide_if_delegate_; }
         bool keepRecursion() const  { return keep_recursion_; }
+        bool isOrderedChoice() const { return ordered_choice_; }
         bool matchesEmpty() const;
         bool isLL1() const;
         int indexOf(const Rule &rule) const;
@@ -279,8 +321,80 @@ public:
 
         using FirstSet = std::map<TokenKind, RuleIndices>;
 
+        /**
+         * \brief Get the rules that may begin with each terminal
+         *
+         * The entry for \c TOK_NULL lists the rules that may match empty.
+         * Rules that may begin with any token (via a \c TOK_NULL terminal,
+         * such as a lone predicate) are listed under every terminal and
+         * also by anyTokenRules(). If no rule begins with a specific
+         * terminal the set is empty.
+         */
         const FirstSet &firstSet() const;
 
+        /// \brief Get the rules that may begin with any token
+        const RuleIndices &anyTokenRules() const;
+
+        using Rank = std::function<uint64_t (TokenKind, size_t)>;
+
+        /**
+         * \brief Reorder the candidate rules listed in the FIRST set
+         *
+         * The rules listed for each terminal are sorted into ascending order
+         * of `rank(terminal, rule_index)`, which determines the order in
+         * which the parser begins them. A rule sharing a prefix with an
+         * earlier rule (see sharedPrefixes()) takes the higher of its own
+         * rank and that of the earlier rule, and both remain in their
+         * original relative order. Ordered choice nonterminals are not
+         * reordered.
+         *
+         * \param [in] rank  function ranking rule `rule_index` for input
+         *                   beginning with `terminal`
+         */
+        void orderFirstSet(const Rank &rank) const;
+
+        bool matchesAnyToken() const { return !anyTokenRules().empty(); }
+
+        /**
+         * \brief Leading components of a rule that are parsed on its behalf
+         *        by an earlier rule of the same nonterminal
+         *
+         * Where rules begin with the same sequence of components (e.g.
+         * `if ( expr ) stmt` and `if ( expr ) stmt else stmt`) the parser
+         * matches that sequence once, for the leader, and then continues
+         * the follower from where the leader has reached. The parse result
+         * is unchanged: each intermediate node the leader builds within the
+         * prefix is copied, with its packed node, for every follower
+         * sharing that much of it, so a follower's derivations refer to its
+         * own rule throughout. Sharing thus saves descriptors and GSS work
+         * but not SPPF nodes: each follower gains an intermediate and a
+         * packed node for every derivation of each component it shares.
+         * A follower is only resumed where it would otherwise have been
+         * begun, so prediction (see Parser::setPredictionDepth()) applies
+         * to it as to any other rule.
+         */
+        struct SharedPrefix
+        {
+                size_t leader_;    ///< index of the rule parsing the prefix
+                size_t follower_;  ///< index of the rule sharing it
+                size_t length_;    ///< number of components shared
+        };
+
+        using SharedPrefixes = std::vector<SharedPrefix>;
+
+        /**
+         * \brief Find the rules of this nonterminal that share leading
+         *        components with an earlier rule
+         *
+         * A prefix is shared only if it is non-empty, its first component
+         * cannot match empty, none of its components has a predicate or is
+         * a commit point and both rules have at least one component
+         * following it. Ordered choice nonterminals share no prefixes.
+         *
+         * \return the shared prefixes, ordered by leader then length
+         */
+        const SharedPrefixes &sharedPrefixes() const;
+
         bool operator==(const this_t &rhs) const { return this == &rhs; }
         bool operator!=(const this_t &rhs) const { return this != &rhs; }
 
@@ -296,21 +410,30 @@ public:
                 { return invokeActions(pre_parse_actions_, state); }
         bool invokePostParseActions(ParseState &state) const
                 { return invokeActions(post_parse_actions_, state); }
+        bool hasActions() const
+                { return !pre_parse_actions_.empty()
+                         || !post_parse_actions_.empty(); }
+
+        /**
+         * \brief Set the function rating derivations of this nonterminal
+         * \param [in] cost  cost function, or \c nullptr if derivations of
+         *                   this nonterminal cost nothing beyond their parts
+         */
+        void setCostFunction(CostFunction cost) const { cost_ = cost; }
+        CostFunction costFunction() const             { return cost_; }
 
         void dump(std::ostream &to, const Lexer &lexer) const;
         void gdb(const Lexer &lexer) const;
 
 private:
-        void initRules(size_t from_pos = 0);
-
-        enum class InitStatus { OK, IS_LR, INDETERMINATE };
+        friend GrammarImage;
+        friend StaticGrammarInstance;
 
-        InitStatus initFirstAndLL1(std::set<const this_t *> &visited) const;
+        void initRules(size_t from_pos = 0);
 
-        InitStatus initFirstAndLL1(std::set<const this_t *> &visited,
-                                   const Rule &rule) const;
+        class Analysis;  // see Grammar.cxx
 
-        void updateFirstAndLL1(TokenKind t, const Rule &rule) const;
+        void initSharedPrefixes() const;
 
         using ActionList = circ_fwd_list<Action>;
 
@@ -318,18 +441,23 @@ private:
         static bool invokeActions(const ActionList &in, ParseState &state);
 
 
-        const char *       name_;
-        mutable FirstSet   first_;
-        mutable ActionList pre_parse_actions_,
-                           post_parse_actions_;
+        const char *           name_;
+        mutable FirstSet       first_;
+        mutable RuleIndices    any_rules_;
+        mutable SharedPrefixes shared_prefixes_;
+        mutable ActionList     pre_parse_actions_,
+                               post_parse_actions_;
+        mutable CostFunction   cost_;
         union {
                 struct {
-                        mutable bool got_first_set_    : 1,
-                                     is_ll1_           : 1,
-                                     matches_empty_    : 1,
-                                     is_transparent_   : 1,
-                                     hide_if_delegate_ : 1,
-                                     keep_recursion_   : 1;
+                        mutable bool got_first_set_       : 1,
+                                     is_ll1_              : 1,
+                                     matches_empty_       : 1,
+                                     is_transparent_      : 1,
+                                     hide_if_delegate_    : 1,
+                                     keep_recursion_      : 1,
+                                     ordered_choice_      : 1,
+                                     got_shared_prefixes_ : 1;
                 };
                 uint8_t flags_;
         };
@@ -353,6 +481,44 @@ inline Component pred(const NonTerminal &nonterminal,
                       Component::Predicate predicate)
         { return Component(nonterminal, false, predicate); }
 
+/**
+ * \brief Mark a rule component as a commit point
+ *
+ * Once every path being explored has advanced beyond the input matched by a
+ * commit point, the parser discards the internal state it holds for earlier
+ * input and passes the matched subtree to Parser::onCommit(). Marking the
+ * last component of a rule commits at the end of that rule.
+ */
+inline Component commit(Component component)
+        { return component.setCommitPoint(); }
+
+/**
+ * \brief Declare the predicate of a rule component to be pure
+ *
+ * A pure predicate's result depends only on the input position, the
+ * nonterminal and the rule being parsed, not on the node parsed so far
+ * (ParseState::parsedNode()), the symbol table (ParseState::symbols()) nor
+ * on the state of the program. The parser calls it at most once per input
+ * position and rule during a parse, reusing the result wherever else the
+ * same predicate is reached.
+ */
+inline Component pure(Component component)
+        { return component.setPure(); }
+
+//--------------------------------------
+/**
+ * \brief Get the nonterminals used, directly or indirectly, by a grammar
+ *
+ * The start symbol comes first, then the others in breadth-first order of
+ * their first use by a rule component. grammarFingerprint(), generated
+ * code and grammar images number nonterminals in this order.
+ *
+ * \param [in] start  start symbol of the grammar
+ * \return each nonterminal reachable from \c start, once
+ */
+WRPARSE_API std::vector<const NonTerminal *>
+reachableNonTerminals(const NonTerminal &start);
+
 
 } // namespace parse
 } // namespace wr
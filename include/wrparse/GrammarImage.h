@@ -0,0 +1,179 @@
+/**
+ * \file GrammarImage.h
+ *
+ * \brief Precompiled grammars stored in binary image files
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_GRAMMAR_IMAGE_H
+#define WRPARSE_GRAMMAR_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <wrparse/Config.h>
+#include <wrparse/Grammar.h>
+
+
+namespace wr {
+namespace parse {
+
+
+/**
+ * \brief Grammar loaded from a binary image written by GrammarImage::write()
+ *
+ * An image holds each nonterminal reachable from a start symbol, with its
+ * rules, components and flags, together with the results of grammar
+ * analysis: the FIRST set of each nonterminal, the rules that may begin
+ * with any token, nullability and the LL(1) property. Loading an image
+ * rebuilds the NonTerminal objects with those results in place, so the
+ * parser does not analyse the grammar on first use.
+ *
+ * An image file is mapped read-only into memory, so that its pages are
+ * shared by every process loading it. Nonterminal names refer directly to
+ * the mapped image, which is unmapped when the GrammarImage is destroyed.
+ *
+ * Parse actions, predicates and cost functions are stored by name and
+ * rebound on loading through a Registry, which must name every function
+ * used by the grammar:
+ *
+ *     GrammarImage::Registry functions;
+ *     functions.add("declare", &declare).add("isTypeName", &isTypeName);
+ *
+ *     // once, by a program building the grammar
+ *     std::ofstream out("c.grammar", std::ios::binary);
+ *     GrammarImage::write(out, grammar.translation_unit, functions);
+ *
+ *     // in each worker
+ *     GrammarImage image("c.grammar", functions);
+ *     parser.parse(image.start());
+ *
+ * Images are specific to the byte order of the machine writing them.
+ */
+class WRPARSE_API GrammarImage
+{
+public:
+        using this_t = GrammarImage;
+
+        /// \brief Names of the functions a grammar refers to
+        class WRPARSE_API Registry
+        {
+        public:
+                /// \brief Name a parse action or predicate
+                Registry &add(const char *name, NonTerminal::Action fn);
+
+                /// \brief Name a cost function
+                Registry &add(const char *name, NonTerminal::CostFunction fn);
+
+                NonTerminal::Action action(const char *name) const;
+                NonTerminal::CostFunction costFunction(
+                                                const char *name) const;
+
+                /// \return the name of \c fn, or \c nullptr if not known
+                const char *name(NonTerminal::Action fn) const;
+                const char *name(NonTerminal::CostFunction fn) const;
+
+        private:
+                std::unordered_map<std::string,
+                                   NonTerminal::Action>        actions_;
+                std::unordered_map<NonTerminal::Action,
+                                   std::string>                action_names_;
+                std::unordered_map<std::string,
+                                   NonTerminal::CostFunction>  costs_;
+                std::unordered_map<NonTerminal::CostFunction,
+                                   std::string>                cost_names_;
+        };
+
+        /**
+         * \brief Map and load the image file at \c path
+         * \throw std::runtime_error if the file cannot be mapped, is not a
+         *      valid image or names a function missing from \c registry
+         */
+        explicit GrammarImage(const char *path,
+                              const Registry &registry = Registry());
+
+        /**
+         * \brief Load an image already in memory
+         *
+         * The image is not copied, and must be aligned to four bytes and
+         * remain valid for the lifetime of this object.
+         */
+        GrammarImage(const void *data, size_t size,
+                     const Registry &registry = Registry());
+
+        GrammarImage(const this_t &other) = delete;
+        this_t &operator=(const this_t &other) = delete;
+
+        ~GrammarImage();
+
+        /**
+         * \brief Write an image of the grammar reachable from \c start
+         *
+         * \param [out] out       binary stream receiving the image
+         * \param [in]  start     start symbol of the grammar
+         * \param [in]  registry  names of the functions used by the grammar
+         *
+         * \return `false` if the stream reported an error
+         * \throw std::invalid_argument if the grammar uses a function
+         *      missing from \c registry
+         */
+        static bool write(std::ostream &out, const NonTerminal &start,
+                          const Registry &registry = Registry());
+
+        /// \brief Start symbol of the grammar written to the image
+        const NonTerminal &start() const { return nonterminals_[0]; }
+
+        /**
+         * \brief Nonterminals, numbered in breadth-first order from the
+         *      start symbol
+         */
+        const NonTerminal &operator[](size_t index) const
+                { return nonterminals_[index]; }
+
+        size_t size() const { return size_; }
+
+        /// \brief Find a nonterminal by name, or return \c nullptr
+        const NonTerminal *find(const char *name) const;
+
+        /// \brief grammarFingerprint() of the grammar written to the image
+        uint64_t fingerprint() const { return fingerprint_; }
+
+private:
+        void load(const Registry &registry);
+        void unmap();
+
+        const char                     *image_;
+        size_t                          image_size_;
+        void                           *mapping_;   // if mapped from file
+        std::unique_ptr<NonTerminal[]>  nonterminals_;
+        size_t                          size_;
+        uint64_t                        fingerprint_;
+};
+
+
+} // namespace parse
+} // namespace wr
+
+
+#endif // !WRPARSE_GRAMMAR_IMAGE_H
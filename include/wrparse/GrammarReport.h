@@ -0,0 +1,147 @@
+/**
+ * \file GrammarReport.h
+ *
+ * \brief Static analysis of grammars for nondeterminism and parsing cost
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_GRAMMAR_REPORT_H
+#define WRPARSE_GRAMMAR_REPORT_H
+
+#include <stddef.h>
+#include <iosfwd>
+#include <unordered_map>
+#include <vector>
+
+#include <wrparse/Config.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Token.h>
+
+
+namespace wr {
+namespace parse {
+
+
+class Lexer;  // see Lexer.h
+
+/**
+ * \brief Properties of each nonterminal of a grammar that bear on the cost
+ *      of parsing it
+ *
+ * The report covers every nonterminal reachable from a start symbol, in
+ * breadth-first order. Only enabled rules are considered, and predicates
+ * are assumed to accept, so the report errs towards nondeterminism.
+ *
+ * The estimated complexity of a nonterminal is that of parsing input with
+ * it as the start symbol, and so takes account of every nonterminal it
+ * refers to: linear if all of them are LL(1), quadratic if any is not but
+ * none may be ambiguous, and cubic otherwise. These are the worst-case
+ * bounds of the parser for deterministic, unambiguous and general grammars.
+ *
+ * writeJSON() gives the report in a form suitable for checking by scripts,
+ * for example to reject a change making a frequently used nonterminal
+ * nondeterministic.
+ */
+class WRPARSE_API GrammarReport
+{
+public:
+        using this_t = GrammarReport;
+
+        enum Complexity
+        {
+                LINEAR,
+                QUADRATIC,
+                CUBIC
+        };
+
+        /// \brief Reasons for a nonterminal possibly being ambiguous
+        enum
+        {
+                /// more than one rule matches empty input
+                MULTIPLE_EMPTY_RULES = 1U,
+                /// two rules have identical components
+                DUPLICATE_RULES      = 1U << 1,
+                /// a rule both begins and ends with its own nonterminal
+                /// (as `e ::= e '+' e`) so its associativity is undefined
+                BINARY_RECURSION     = 1U << 2,
+                /// the nonterminal derives itself without consuming input
+                NULLABLE_CYCLE       = 1U << 3
+        };
+
+        /// \brief Rules of a nonterminal that may begin with the same token
+        struct Conflict
+        {
+                TokenKind           token_;  ///< \c TOK_NULL for empty input
+                std::vector<size_t> rules_;
+        };
+
+        struct Entry
+        {
+                const NonTerminal     *nonterminal_;
+                std::vector<Conflict>  conflicts_;
+                unsigned               ambiguity_;  ///< reasons, or 0
+                Complexity             complexity_;
+                bool                   is_ll1_               : 1,
+                                       matches_empty_        : 1,
+                                       left_recursive_       : 1,
+                                       hidden_left_recursive_ : 1;
+                                               ///< left recursion after a
+                                               ///  nullable prefix
+        };
+
+        using const_iterator = std::vector<Entry>::const_iterator;
+
+        /// \brief Analyse the grammar reachable from \c start
+        explicit GrammarReport(const NonTerminal &start);
+
+        const_iterator begin() const { return entries_.begin(); }
+        const_iterator end() const   { return entries_.end(); }
+        size_t size() const          { return entries_.size(); }
+
+        const Entry &operator[](size_t index) const
+                { return entries_[index]; }
+
+        /// \brief Entry for \c nt, or \c nullptr if not reachable
+        const Entry *find(const NonTerminal &nt) const;
+
+        static const char *complexityName(Complexity complexity);
+
+        /**
+         * \brief Write the report as a JSON document
+         *
+         * \param [out] out    stream receiving the document
+         * \param [in]  lexer  if not \c nullptr, used to name token kinds,
+         *                     otherwise they are given as numbers
+         *
+         * \return `false` if the stream reported an error
+         */
+        bool writeJSON(std::ostream &out, const Lexer *lexer = nullptr) const;
+
+private:
+        std::vector<Entry>                                entries_;
+        std::unordered_map<const NonTerminal *, size_t>   index_;
+};
+
+
+} // namespace parse
+} // namespace wr
+
+
+#endif // !WRPARSE_GRAMMAR_REPORT_H
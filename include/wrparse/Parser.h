@@ -26,6 +26,9 @@
 #define WRPARSE_PARSER_H
 
 #include <iosfwd>
+#include <limits>
+#include <memory>
+#include <set>
 #include <unordered_set>
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
@@ -34,6 +37,7 @@
 #include <wrparse/Diagnostics.h>
 #include <wrparse/Grammar.h>
 #include <wrparse/SPPF.h>
+#include <wrparse/SymbolTable.h>
 #include <wrparse/Token.h>
 
 
@@ -41,7 +45,12 @@ namespace wr {
 namespace parse {
 
 
+class CompiledGrammar;  // see CodeGen.h
 class Lexer;
+class RuleProfile;  // see Profile.h
+class SlotProfile;  // ditto
+class AmbiguityProfile;  // ditto
+class TokenRecorder;  // see Replay.h
 
 
 class WRPARSE_API Parser :
@@ -54,8 +63,70 @@ public:
         // opaque internal types
         class GLL;
         class GSS;
+        class CRF;
 
         enum { DEFAULT_ERROR_LIMIT = 20 };
+        enum { DEFAULT_WORKSPACE_LIMIT = 1 << 16 };
+        enum { MAX_PREDICTION_DEPTH = 4 };
+
+        /**
+         * \brief Determines when parse() stops searching for matches
+         *
+         * With \c FIRST_MATCH_AT_EOF parsing stops as soon as a match of
+         * the start symbol consuming all of the input is found; shorter
+         * matches do not stop it. Alternative derivations not yet explored
+         * at that point are absent from the resulting SPPF, so it may be
+         * partial with respect to ambiguity.
+         */
+        enum MatchPolicy
+        {
+                LONGEST_MATCH,      ///< explore all paths, return longest match
+                FIRST_MATCH_AT_EOF  /**< stop at the first match followed by
+                                         end of input; note that this reads
+                                         one token beyond each match found */
+        };
+
+        /**
+         * \brief Parsing algorithm used by parse()
+         *
+         * The CRF engine records a call return forest (CRF) in place of
+         * the GSS and binary subtree representation (BSR) sets in place of
+         * the SPPF, from which it builds the SPPF nodes reachable from the
+         * result once parsing is complete. Its descriptors are smaller and
+         * it performs no SPPF bookkeeping while parsing.
+         *
+         * Both engines produce the same SPPF for unambiguous input. Where
+         * the input is ambiguous, the CRF engine's may include derivations
+         * of left-recursive rules that the GLL engine's omits, and with
+         * \c FIRST_MATCH_AT_EOF the derivation found first may differ.
+         *
+         * The CRF engine does not make predictions, nor does it give each
+         * derivation its own symbol table: predicates see the parser's
+         * table, and are given no parsed node. Should the grammar reachable
+         * from the start symbol have parse actions, an ordered choice
+         * nonterminal, a commit point or a predicate that is not pure, or
+         * should a rule, slot or ambiguity profile be recorded or bounded
+         * mode (see setBeam()) be in effect, the GLL engine is used instead;
+         * this is decided before parsing begins. The CRF engine's tables
+         * are allocated afresh by each parse, so are not subject to
+         * setWorkspaceLimit().
+         */
+        enum Engine
+        {
+                GLL_ENGINE,  ///< graph-structured stack and SPPF (default)
+                CRF_ENGINE   ///< call return forest and BSR sets
+        };
+
+        /// \brief Work done by a call to parse()
+        struct Statistics
+        {
+                size_t descriptors_;   ///< distinct descriptors scheduled
+                size_t gss_nodes_;     ///< GSS nodes, or CRF clusters
+                size_t gss_edges_;     ///< GSS edges, or CRF return edges
+                size_t sppf_nodes_;    ///< symbol, intermediate and terminal
+                                       ///  SPPF nodes
+                size_t packed_nodes_;  ///< packed SPPF nodes
+        };
 
         Parser();
         Parser(Lexer &lexer);
@@ -77,10 +148,225 @@ public:
         Parser &enableDebug(bool enable);
         bool debugEnabled() const { return debug_; }
 
+        /**
+         * \brief Select when parse() stops searching for matches
+         * \param [in] policy  the policy to apply to subsequent parses
+         * \return `*this`
+         */
+        Parser &setMatchPolicy(MatchPolicy policy);
+        MatchPolicy matchPolicy() const { return match_policy_; }
+
+        /**
+         * \brief Select the parsing algorithm for subsequent parses
+         * \return `*this`
+         */
+        Parser &setEngine(Engine engine);
+        Engine engine() const { return engine_; }
+
+        /**
+         * \brief Use generated code in place of the CRF engine's
+         *      interpretation of the grammar
+         *
+         * The code is used by parses with the CRF engine from any start
+         * symbol within the grammar it is bound to.
+         *
+         * \param [in] grammar  code produced by generateParser(), or
+         *                      \c nullptr to interpret the grammar
+         * \return `*this`
+         */
+        Parser &setCompiledGrammar(const CompiledGrammar *grammar);
+        const CompiledGrammar *compiledGrammar() const
+                { return compiled_grammar_; }
+
+        /**
+         * \brief Enable adaptive prediction of rules to be explored
+         *
+         * Where several rules of a nonterminal are candidates for the next
+         * input token, the parser notes which of them went on to complete
+         * given the kinds of the next \c depth tokens. In later parses with
+         * the same lookahead, rules that were begun but never completed
+         * are left out; a rule seen both to complete and to fail is always
+         * begun. Should the parse then fail, or match less than the whole
+         * input, it is repeated with all rules. Ordered choice nonterminals
+         * and those with more than 64 rules are not predicted.
+         *
+         * \note Predictions may leave out derivations that only succeed in
+         * other contexts, so the SPPF may be partial with respect to
+         * ambiguity. Parse actions may be invoked more than once for the same
+         * input if a parse is repeated. Predictions are keyed on nonterminal
+         * addresses and must be cleared with clearPredictions() if grammar
+         * objects are destroyed or changed.
+         *
+         * \param [in] depth  number of lookahead tokens to consider, up to
+         *                    \c MAX_PREDICTION_DEPTH; zero disables
+         *                    prediction
+         * \return `*this`
+         */
+        Parser &setPredictionDepth(unsigned depth);
+        unsigned predictionDepth() const { return prediction_depth_; }
+
+        /// \brief Forget all predictions made by previous parses
+        Parser &clearPredictions();
+
+        /**
+         * \brief Record the rules completed by subsequent parses
+         *
+         * \param [in] profile  profile to update, or \c nullptr to stop
+         *                      recording; the caller retains ownership
+         * \return `*this`
+         * \see RuleProfile::apply()
+         */
+        Parser &setRuleProfile(RuleProfile *profile);
+        RuleProfile *ruleProfile() const { return rule_profile_; }
+
+        /**
+         * \brief Count the work done at each grammar slot by subsequent
+         *      parses
+         *
+         * \param [in] profile  profile to update, or \c nullptr to stop
+         *                      recording; the caller retains ownership
+         * \return `*this`
+         * \see SlotProfile::dump()
+         */
+        Parser &setSlotProfile(SlotProfile *profile);
+        SlotProfile *slotProfile() const { return slot_profile_; }
+
+        /**
+         * \brief Record where subsequent parses find ambiguities
+         *
+         * \param [in] profile  profile to update, or \c nullptr to stop
+         *                      recording; the caller retains ownership
+         * \return `*this`
+         * \see AmbiguityProfile::report()
+         */
+        Parser &setAmbiguityProfile(AmbiguityProfile *profile);
+        AmbiguityProfile *ambiguityProfile() const
+                { return ambiguity_profile_; }
+
+        /**
+         * \brief Record the tokens read, and the calls to parse() and
+         *      reset() made, for later replay
+         *
+         * \param [in] recorder  recorder to write to, or \c nullptr to stop
+         *                       recording; the caller retains ownership
+         * \return `*this`
+         * \see ReplayLexer::replay()
+         */
+        Parser &setTokenRecorder(TokenRecorder *recorder);
+        TokenRecorder *tokenRecorder() const { return token_recorder_; }
+
+        /**
+         * \brief Work done by the most recent call to parse()
+         *
+         * The counts depend only on the grammar, the input and the parser's
+         * settings, so unlike timings they can be compared exactly between
+         * runs. Where a parse is repeated without predictions (see
+         * setPredictionDepth()), the work of every attempt is included. The
+         * CRF engine only builds the SPPF nodes reachable from the result.
+         */
+        const Statistics &statistics() const { return statistics_; }
+
+        /**
+         * \brief Set the symbol table seen by the next parse
+         *
+         * Each derivation explored begins with a copy of this table and
+         * carries forward whatever changes its predicates and parse actions
+         * make via ParseState::symbols(). Derivations reaching the same
+         * grammar slot at the same input position are merged only if their
+         * tables are the same version (see SymbolTable::version()).
+         *
+         * When a parse succeeds, the table is replaced by that of the
+         * derivation matched, so that declarations carry over to the parse
+         * of the next part of the input.
+         *
+         * \return `*this`
+         */
+        Parser &setSymbols(const SymbolTable &symbols);
+        const SymbolTable &symbols() const { return symbols_; }
+
+        /**
+         * \brief Bound the work done by subsequent parses
+         *
+         * In bounded mode each derivation has a cost: that returned by the
+         * cost function of its nonterminal (see
+         * NonTerminal::setCostFunction()) plus the costs of its parts. For
+         * each nonterminal or partial rule matched over the same input, only
+         * the \c width lowest-cost derivations are kept, and their packed
+         * nodes are listed in ascending order of cost. Work on a rule is
+         * abandoned once the cost of the part matched exceeds \c limit.
+         *
+         * Time and memory are then bounded at the expense of completeness.
+         * A derivation is compared with the others using the costs of its
+         * parts as known at the time, which may fall as cheaper derivations
+         * of them are found, so one discarded may have turned out cheaper
+         * than those kept, or have been part of the only match.
+         *
+         * \param [in] width  derivations kept per node; zero for no limit
+         * \param [in] limit  greatest cost of pending work
+         * \return `*this`
+         */
+        Parser &setBeam(size_t width,
+                        double limit = std::numeric_limits<double>::infinity());
+        size_t beamWidth() const { return beam_width_; }
+        double costLimit() const { return cost_limit_; }
+        bool isBounded() const
+                { return beam_width_
+                         || (cost_limit_
+                                < std::numeric_limits<double>::infinity()); }
+
         virtual void onDiagnostic(const Diagnostic &d) override;
+
+        /**
+         * \brief Receive a subtree matched by a commit point
+         *
+         * Called during parse() once every path still being explored has
+         * advanced beyond the input matched by a rule component marked with
+         * commit(). The subtree is complete, but it is only part of the
+         * final result if the overall parse succeeds. Each commit is
+         * reported once per parse() call: while predictions may yet cause
+         * the parse to be retried (see setPredictionDepth()), calls are
+         * held back until it is finished. If the parse fails, commit points
+         * not yet passed by every path are not reported. The default
+         * implementation does nothing.
+         *
+         * \param [in] subtree  the node matched by the commit point
+         */
+        virtual void onCommit(SPPFNode::ConstPtr subtree);
         size_t errorLimit() const noexcept { return error_limit_; }
         void setErrorLimit(size_t limit);
 
+        /**
+         * \brief Retrieve the parse workspace size limit
+         * \see setWorkspaceLimit()
+         */
+        size_t workspaceLimit() const noexcept { return workspace_limit_; }
+
+        /**
+         * \brief Set the parse workspace size limit
+         *
+         * The internal tables used by the GLL engine are kept between calls
+         * to parse() so that their storage can be reused. If any of them grew
+         * beyond \c limit elements during the most recent parse, all of
+         * them are released afterwards instead (any predictions made, see
+         * setPredictionDepth(), are kept).
+         *
+         * \param [in] limit  maximum number of elements retained per table;
+         *                    zero releases the workspace after every parse
+         * \return `*this`
+         */
+        Parser &setWorkspaceLimit(size_t limit);
+
+        /**
+         * \brief Retrieve the size of the parse workspace kept from the
+         *        most recent parse
+         *
+         * \return number of elements of the largest table retained, or zero
+         *         if the workspace was released or the GLL engine has not
+         *         been used
+         * \see setWorkspaceLimit()
+         */
+        size_t workspaceSize() const;
+
         /**
          * \brief Add receiver of diagnostic messages
          * \param [in] handler  reference to receiver object
@@ -190,6 +476,10 @@ protected:
 private:
         friend ParseState;
 
+        SPPFNode::Ptr parseGLL(const NonTerminal &start);
+        bool parseCRF(const NonTerminal &start, SPPFNode::Ptr &result);
+        void emitExpected(const Token &at, const std::set<TokenKind> &expected);
+
         struct EmittedDiagnostics
         {
                 using Key = std::pair<Diagnostic::ID, Token::Offset>;
@@ -209,8 +499,22 @@ private:
         Lexer                   *lexer_;
         TokenList                tokens_;
         bool                     debug_;
+        MatchPolicy              match_policy_;
+        Engine                   engine_;
+        const CompiledGrammar   *compiled_grammar_;
+        unsigned                 prediction_depth_;
+        RuleProfile             *rule_profile_;
+        SlotProfile             *slot_profile_;
+        AmbiguityProfile        *ambiguity_profile_;
+        TokenRecorder           *token_recorder_;
+        SymbolTable              symbols_;
+        size_t                   beam_width_;
+        double                   cost_limit_;
         size_t                   error_limit_;
         EmittedDiagnostics::Set  diagnostics_;
+        Statistics               statistics_;
+        std::unique_ptr<GLL>     gll_;              // parse workspace
+        size_t                   workspace_limit_;
 };
 
 //--------------------------------------
@@ -230,6 +534,17 @@ public:
         SPPFNode::ConstPtr parsedNode() const  { return parsed_; }
         Token *input() const                   { return input_pos_; }
 
+        /**
+         * \brief Symbols declared along the derivation being explored
+         *
+         * Changes made by a predicate or a parse action are seen only by
+         * the derivation it was invoked for, and are discarded if that
+         * predicate or action fails. Changes made by pure predicates (see
+         * pure()) are always discarded.
+         */
+        const SymbolTable &symbols() const     { return symbols_; }
+        SymbolTable &symbols()                 { return symbols_; }
+
         /**
          * \brief Emit diagnostic message for specified node's range
          * \param [in] category   message severity
@@ -265,16 +580,19 @@ public:
 private:
         friend Parser;
         friend Parser::GLL;
+        friend Parser::CRF;
 
         ParseState(const this_t &other);
 
         ParseState(Parser &parser, const NonTerminal &start, const Rule &rule,
-                   Token *input_pos, SPPFNode::ConstPtr parsed = nullptr);
+                   Token *input_pos, const SymbolTable &symbols,
+                   SPPFNode::ConstPtr parsed = nullptr);
 
         Parser             &parser_;
         const NonTerminal  &start_;
         const Rule         &rule_;
         Token              *input_pos_;
+        SymbolTable         symbols_;
         SPPFNode::ConstPtr  parsed_;
 };
 
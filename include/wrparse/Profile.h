@@ -0,0 +1,277 @@
+/**
+ * \file Profile.h
+ *
+ * \brief Recording of rule outcomes for profile-guided parsing, and of
+ *      parser work and ambiguity by grammar slot
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_PROFILE_H
+#define WRPARSE_PROFILE_H
+
+#include <stdint.h>
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <wrparse/Config.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Token.h>
+
+
+namespace wr {
+namespace parse {
+
+
+class Lexer;     // see Lexer.h
+class SPPFNode;  // see SPPF.h
+
+/**
+ * \brief Counts of rules completed, by nonterminal and first input token
+ *
+ * A profile attached to a parser with Parser::setRuleProfile() is updated
+ * each time a rule completes. It may be saved, merged with profiles from
+ * other runs and applied to a grammar so that, where several rules are
+ * candidates for the next token, those that have completed most often are
+ * explored first.
+ *
+ * Nonterminals are identified by name in saved profiles, so names should be
+ * unique within a grammar.
+ */
+class WRPARSE_API RuleProfile
+{
+public:
+        using this_t = RuleProfile;
+
+        RuleProfile() = default;
+        RuleProfile(const this_t &other) : table_(other.table_) {}
+        RuleProfile(this_t &&other) = default;
+
+        this_t &operator=(const this_t &other);
+        this_t &operator=(this_t &&other) = default;
+
+        /**
+         * \brief Note that a rule has completed
+         * \param [in] nonterminal  nonterminal owning the rule
+         * \param [in] first        kind of the token at which it began
+         * \param [in] rule         index of the rule within \c nonterminal
+         */
+        void record(const NonTerminal &nonterminal, TokenKind first,
+                    size_t rule);
+
+        /// \brief Number of times record() was called with the same values
+        uint64_t count(const NonTerminal &nonterminal, TokenKind first,
+                       size_t rule) const;
+
+        bool empty() const { return table_.empty(); }
+        void clear();
+
+        /**
+         * \brief Write the profile in a line-oriented text format
+         * \return `false` if the stream reported an error
+         */
+        bool save(std::ostream &to) const;
+        bool save(const char *file_name) const;
+
+        /**
+         * \brief Add the counts from a profile written by save()
+         * \return `false` if the input is malformed or unreadable; counts
+         *         read before the error are kept
+         */
+        bool load(std::istream &from);
+        bool load(const char *file_name);
+
+        /**
+         * \brief Order the FIRST set entries of a grammar by rule count
+         *
+         * Each nonterminal reachable from \c start that appears in the
+         * profile has the candidate rules listed for each terminal in its
+         * FIRST set sorted into ascending order of count. The parser begins
+         * candidates in that order and, as pending work is taken from a
+         * stack, explores the most successful candidate first. Ordered
+         * choice nonterminals are left unchanged.
+         *
+         * \note The ordering is lost if rules are later added to a
+         * nonterminal, as its FIRST set is then recalculated.
+         *
+         * \param [in] start  root of the grammar to reorder
+         * \return number of nonterminals reordered
+         */
+        size_t apply(const NonTerminal &start) const;
+
+private:
+        using Key = std::pair<TokenKind, size_t>;  // (first token, rule)
+        using Counts = std::map<Key, uint64_t>;
+        using Table = std::map<std::string, Counts>;  // name => counts
+        using Cache = std::unordered_map<const NonTerminal *, Counts *>;
+
+        Counts &countsFor(const NonTerminal &nonterminal);
+
+        Table table_;
+        Cache cache_;  // avoids a look-up by name in record()
+};
+
+//--------------------------------------
+/**
+ * \brief Counts of the work done by the parser at each grammar slot
+ *
+ * A profile attached to a parser with Parser::setSlotProfile() is updated
+ * as each parse proceeds, with counts kept for each rule component (and
+ * for the end of each rule) by address. dump() lists the grammar with the
+ * counts beside each component, busiest nonterminal first, to show which
+ * rules account for most of the nondeterminism on a given input.
+ *
+ * The counts refer to grammar objects by address and so must be cleared if
+ * those objects are destroyed.
+ */
+class WRPARSE_API SlotProfile
+{
+public:
+        struct Counts
+        {
+                /// descriptors processed from this slot
+                uint64_t executions_;
+                /// the next token could not begin this component
+                uint64_t mismatches_;
+                /// the component's predicate rejected the input
+                uint64_t predicate_failures_;
+                /// derivations of this nonterminal component returned to it
+                uint64_t pops_;
+                /// SPPF nodes created for this slot
+                uint64_t nodes_;
+
+                Counts &operator+=(const Counts &other);
+        };
+
+        /// \brief Counts for \c slot, created as zero if not present
+        Counts &at(const Component &slot) { return table_[&slot]; }
+
+        /// \brief Counts for \c slot, or \c nullptr if not present
+        const Counts *find(const Component &slot) const;
+
+        /// \brief Sum of the counts for all slots of \c nonterminal
+        Counts total(const NonTerminal &nonterminal) const;
+
+        bool empty() const { return table_.empty(); }
+        void clear()       { table_.clear(); }
+
+        /**
+         * \brief Write the grammar reachable from \c start annotated with
+         *      the counts for each slot
+         *
+         * Nonterminals are listed in descending order of executions, and
+         * those with no counts are omitted.
+         */
+        void dump(std::ostream &to, const NonTerminal &start,
+                  const Lexer &lexer) const;
+
+private:
+        std::unordered_map<const Component *, Counts> table_;
+};
+
+
+//--------------------------------------
+/**
+ * \brief Record of the ambiguities found by the parser, by nonterminal,
+ *      rule and input span
+ *
+ * A profile attached to a parser with Parser::setAmbiguityProfile() is
+ * updated whenever a nonterminal or partially matched rule gains a second
+ * or subsequent derivation over the same input (an SPPF symbol or
+ * intermediate node gains another packed node). report() lists the rules
+ * and input spans with the most alternative derivations, with an excerpt
+ * of the input for each span.
+ *
+ * The counts refer to grammar objects by address and so must be cleared if
+ * those objects are destroyed.
+ */
+class WRPARSE_API AmbiguityProfile
+{
+public:
+        /// \brief Derivations of a nonterminal or rule prefix over a span
+        struct Hotspot
+        {
+                const NonTerminal *nonterminal_;
+                /// for a partly matched rule, the last component matched;
+                /// \c nullptr for the whole nonterminal
+                const Component   *slot_;
+                Token::Offset      start_, end_;  ///< input byte range
+                Line               line_;
+                Column             column_;
+                std::string        excerpt_;
+                /// derivations beyond the first
+                uint64_t           alternatives_;
+                /// indices of the rules of \c nonterminal_ involved
+                std::set<size_t>   rules_;
+        };
+
+        /**
+         * \brief Note that \c node has gained another derivation
+         * \param [in] node    symbol or intermediate node
+         * \param [in] packed  packed node added to \c node
+         */
+        void record(const SPPFNode &node, const SPPFNode &packed);
+
+        /// \brief Alternative derivations added by \c rule, over all spans
+        uint64_t count(const Rule &rule) const;
+
+        /// \brief Up to \c limit hotspots, most alternatives first
+        std::vector<const Hotspot *> top(size_t limit) const;
+
+        bool empty() const { return spots_.empty(); }
+        void clear();
+
+        /**
+         * \brief Write the rules adding the most alternative derivations,
+         *      and the \c limit spans having the most
+         */
+        void report(std::ostream &to, const Lexer &lexer,
+                    size_t limit = 10) const;
+
+private:
+        struct Key
+        {
+                const void    *label_;  // nonterminal or intermediate slot
+                Token::Offset  start_, end_;
+
+                bool operator==(const Key &other) const
+                        { return (label_ == other.label_)
+                                 && (start_ == other.start_)
+                                 && (end_ == other.end_); }
+        };
+
+        struct KeyHash
+        {
+                size_t operator()(const Key &k) const;
+        };
+
+        std::unordered_map<Key, Hotspot, KeyHash>  spots_;
+        std::unordered_map<const Rule *, uint64_t> rules_;
+};
+
+
+} // namespace parse
+} // namespace wr
+
+
+#endif // !WRPARSE_PROFILE_H
@@ -0,0 +1,210 @@
+/**
+ * \file Replay.h
+ *
+ * \brief Recording and replay of the tokens consumed by parsers
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_REPLAY_H
+#define WRPARSE_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <wrparse/Config.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Token.h>
+
+
+namespace wr {
+namespace parse {
+
+
+class NonTerminal;  // see Grammar.h
+class Parser;       // see Parser.h
+
+/**
+ * \brief Writes the tokens read by a parser, and the parses made, to a
+ *      stream for later replay by ReplayLexer
+ *
+ * Attach a recorder with Parser::setTokenRecorder(). Each token lexed is
+ * written with its kind, offset, line, column and flags, in order with
+ * each call to Parser::parse() (with the name and grammarFingerprint() of
+ * its start symbol) and Parser::reset(). Values are written as
+ * variable-length integers, offsets and lines as differences from the
+ * previous token's, so most tokens take a few bytes.
+ *
+ * Spellings are not written. With \c HASH_SPELLINGS their lengths and
+ * 64-bit hashes are, so that tokens spelled alike are replayed spelled
+ * alike; note that short spellings can be recovered from their hashes by
+ * guessing. With \c REDACT_SPELLINGS only their lengths are written.
+ *
+ * The recording is written as it happens; the caller should check the
+ * stream for errors once finished.
+ */
+class WRPARSE_API TokenRecorder
+{
+public:
+        using this_t = TokenRecorder;
+
+        enum SpellingMode
+        {
+                HASH_SPELLINGS,   ///< length and hash of each spelling
+                REDACT_SPELLINGS  ///< length of each spelling only
+        };
+
+        /// \brief Begin a recording written to the binary stream \c out
+        explicit TokenRecorder(std::ostream &out,
+                               SpellingMode mode = HASH_SPELLINGS);
+
+        TokenRecorder(const this_t &) = delete;
+        this_t &operator=(const this_t &) = delete;
+
+        void recordParse(const NonTerminal &start);
+        void recordReset();
+        void recordToken(const Token &token);
+
+        SpellingMode spellingMode() const { return mode_; }
+
+        /// \brief Number of tokens recorded
+        size_t size() const { return size_; }
+
+private:
+        std::ostream  &out_;
+        SpellingMode   mode_;
+        size_t         size_;
+        Token::Offset  last_offset_;
+        Line           last_line_;
+};
+
+//--------------------------------------
+/**
+ * \brief Lexer returning the tokens of a recording made by TokenRecorder
+ *
+ * Once the recorded tokens are exhausted, \c TOK_EOF is returned. Each
+ * spelling is replaced by one of the same length in bytes: with
+ * \c HASH_SPELLINGS, letters chosen by its hash, so that tokens spelled
+ * alike in the original input are spelled alike here; otherwise \c 'x'
+ * repeated.
+ *
+ * replay() repeats the recorded parses and resets with a parser reading
+ * from this lexer, so the work done by the parser on the original input
+ * can be reproduced and profiled without that input, so long as the
+ * grammar's parse actions and predicates do not depend on spellings.
+ */
+class WRPARSE_API ReplayLexer : public Lexer
+{
+public:
+        using base_t = Lexer;
+        using this_t = ReplayLexer;
+
+        /// \brief A call to Parser::parse() or Parser::reset()
+        struct Event
+        {
+                enum Kind { PARSE, RESET };
+
+                Kind        kind_;
+                std::string start_;        ///< name of start symbol
+                uint64_t    fingerprint_;  ///< grammarFingerprint() of start
+                size_t      tokens_;       ///< tokens recorded before
+        };
+
+        /**
+         * \brief Load a recording from the binary stream \c recording
+         * \throw std::runtime_error if the recording is not valid
+         */
+        explicit ReplayLexer(std::istream &recording);
+
+        virtual Token &lex(Token &out_token) override;
+
+        /// \brief Return to the first recorded token
+        this_t &rewind() { next_ = 0; return *this; }
+
+        const std::vector<Event> &events() const { return events_; }
+
+        /// \brief Number of tokens recorded
+        size_t size() const { return tokens_.size(); }
+
+        TokenRecorder::SpellingMode spellingMode() const { return mode_; }
+
+        /**
+         * \brief Find and check the recorded start symbols
+         *
+         * Each start symbol is looked up by name among the nonterminals
+         * reachable from \c root, and its grammarFingerprint() compared
+         * with that recorded, once for each start symbol however many
+         * parses it begins. replay() does this itself when given a
+         * different \c root; call it beforehand to keep the work out of a
+         * timed replay, and again should the grammar change.
+         *
+         * \param [in] root  nonterminal from which all start symbols
+         *                   recorded are reachable
+         * \throw std::runtime_error if a start symbol is not found, or its
+         *      grammar differs from that recorded
+         */
+        void prepare(const NonTerminal &root);
+
+        /**
+         * \brief Repeat the recorded parses and resets
+         *
+         * The start symbols are found as by prepare(), unless it was last
+         * called with the same \c root. After each reset, the lexer
+         * continues from the token recorded next, so a parse reading more
+         * or fewer tokens than recorded does not disturb those following.
+         *
+         * \param [in] parser  parser reading from this lexer
+         * \param [in] root    nonterminal from which all start symbols
+         *                     recorded are reachable
+         * \return the number of parses matching their input
+         * \throw std::runtime_error if a start symbol is not found, or its
+         *      grammar differs from that recorded
+         */
+        size_t replay(Parser &parser, const NonTerminal &root);
+
+private:
+        struct RecordedToken
+        {
+                Token::Offset  offset_;
+                Line           line_;
+                Column         column_;
+                TokenKind      kind_;
+                TokenFlags     flags_;
+                uint32_t       spelling_;  // offset into spellings_
+                uint16_t       bytes_;
+        };
+
+        TokenRecorder::SpellingMode       mode_;
+        std::vector<RecordedToken>        tokens_;
+        std::vector<Event>                events_;
+        std::string                       spellings_;
+        size_t                            next_;
+        const NonTerminal                *root_;    // last prepared
+        std::vector<const NonTerminal *>  starts_;  // by event, if PARSE
+};
+
+
+} // namespace parse
+} // namespace wr
+
+
+#endif // !WRPARSE_REPLAY_H
@@ -99,6 +99,7 @@
 
 #include <iosfwd>
 #include <string>
+#include <unordered_map>
 
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
@@ -897,6 +898,53 @@ inline size_t countNonTerminals(SPPFNode::ConstPtr under)
         { return countNonTerminals(*under); }
 ///@}
 
+//--------------------------------------
+/**
+ * \brief Side table mapping SPPF nodes to their structural hash codes
+ *
+ * The table is keyed by node address, so it is valid only while the SPPF
+ * whose nodes it holds is alive: once that SPPF is released, nodes of
+ * later parses may be allocated at the same addresses. Use a new table, or
+ * clear the table, for each SPPF.
+ *
+ * \see function `structuralHash()`
+ */
+using StructuralHashes = std::unordered_map<const SPPFNode *, size_t>;
+
+///@{
+/**
+ * \brief Compute Merkle-style structural hash codes for an SPPF subtree
+ *
+ * Hash codes are computed bottom-up from each node's type, the name of its
+ * nonterminal (or the type and spelling of its terminal), its rule and
+ * component indices (for packed and intermediate nodes) and the hash codes
+ * of its children. Input offsets, node addresses and auxiliary data are not
+ * involved, so identical fragments of input matched against the same
+ * grammar yield identical hash codes across separate parses and processes.
+ * Alternative (packed) children are combined independently of their order.
+ *
+ * The nodes of a cycle (which arise from cyclic grammars) are hashed
+ * together from the collection of their labels and outside children, so a
+ * node's hash code does not depend on which node of its cycle the
+ * traversal reached first.
+ *
+ * Two subtrees whose hash codes differ are structurally different; equal
+ * hash codes imply structural equality with very high probability.
+ *
+ * \param [in]     root    root node of the subtree to be hashed
+ * \param [in,out] hashes  side table receiving the hash code of every node
+ *                         visited; nodes already present are not revisited,
+ *                         so the table may be reused for further subtrees
+ *                         of the same live SPPF (see \c StructuralHashes)
+ *
+ * \return the structural hash code of `root`
+ */
+WRPARSE_API size_t structuralHash(const SPPFNode &root,
+                                  StructuralHashes &hashes);
+
+WRPARSE_API size_t structuralHash(const SPPFNode &root);
+///@}
+
 //--------------------------------------
 /**
  * \brief Template class implementing traversal of an SPPF node's
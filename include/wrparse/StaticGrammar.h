@@ -0,0 +1,539 @@
+/**
+ * \file StaticGrammar.h
+ *
+ * \brief Grammars defined and analysed at compile time
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_STATIC_GRAMMAR_H
+#define WRPARSE_STATIC_GRAMMAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <stdexcept>
+
+#include <wrparse/Config.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Token.h>
+
+
+namespace wr {
+namespace parse {
+
+
+/**
+ * \brief Element of the rule table of a StaticGrammar
+ *
+ * A rule table lists each rule as a rule() entry naming the nonterminal it
+ * belongs to, followed by one entry for each of its components. The rules
+ * of a nonterminal are numbered in the order they appear in the table.
+ */
+struct StaticComponent
+{
+        enum : uint8_t
+        {
+                RULE     = 1U,  ///< begins a rule of nonterminal value_
+                TERMINAL = 1U << 1,
+                OPTIONAL = 1U << 2
+        };
+
+        /// \brief Begin a rule of the nonterminal with the given index
+        static constexpr StaticComponent rule(unsigned nonterminal)
+                { return { static_cast<uint16_t>(nonterminal), RULE }; }
+
+        static constexpr StaticComponent nonterminal(unsigned index)
+                { return { static_cast<uint16_t>(index), 0 }; }
+
+        /// \brief Terminal component; \c TOK_NULL matches any token
+        static constexpr StaticComponent terminal(TokenKind kind)
+                { return { kind, TERMINAL }; }
+
+        /// \brief Copy of this component made optional
+        constexpr StaticComponent opt() const
+                { return { value_, static_cast<uint8_t>(flags_
+                                                        | OPTIONAL) }; }
+
+        constexpr bool beginsRule() const { return (flags_ & RULE) != 0; }
+        constexpr bool isTerminal() const { return (flags_ & TERMINAL) != 0; }
+        constexpr bool isOptional() const { return (flags_ & OPTIONAL) != 0; }
+
+        uint16_t value_;  ///< nonterminal index or token kind
+        uint8_t  flags_;
+};
+
+/// \brief Name and flags (e.g. NonTerminal::HIDE_IF_DELEGATE) of a
+///      nonterminal of a StaticGrammar
+struct StaticNonTerminal
+{
+        const char *name_;
+        unsigned    flags_;
+};
+
+/**
+ * \brief Tables of a StaticGrammar in a form independent of its size
+ * \see class `StaticGrammarInstance`
+ */
+struct StaticGrammarData
+{
+        const StaticNonTerminal *nonterminals_;
+        size_t                   nonterminal_count_;
+        const StaticComponent   *components_;
+        const size_t            *rule_begin_;     // index in components_
+        size_t                   rule_count_;
+        const TokenKind         *terminals_;      // FIRST set bit => kind
+        size_t                   words_;          // per FIRST set
+        const uint64_t          *first_;          // by nonterminal
+        const bool              *nullable_;       // ditto
+        const bool              *any_;            // ditto
+        const bool              *ll1_;            // ditto
+        const uint64_t          *rule_first_;     // by rule
+        const bool              *rule_nullable_;  // ditto
+        const bool              *rule_any_;       // ditto
+};
+
+//--------------------------------------
+/**
+ * \brief Number of rules in a rule table, for sizing a StaticGrammar
+ */
+template <size_t M> constexpr size_t
+staticRuleCount(
+        const StaticComponent (&components)[M]
+)
+{
+        size_t count = 0;
+
+        for (size_t i = 0; i < M; ++i) {
+                count += components[i].beginsRule() ? 1 : 0;
+        }
+
+        return count;
+}
+
+/**
+ * \brief Number of distinct terminals other than \c TOK_NULL in a rule
+ *      table, for sizing a StaticGrammar
+ */
+template <size_t M> constexpr size_t
+staticTerminalCount(
+        const StaticComponent (&components)[M]
+)
+{
+        uint64_t kinds[65536 / 64] = {};
+        size_t   count = 0;
+
+        for (size_t i = 0; i < M; ++i) {
+                const StaticComponent &c    = components[i];
+                uint64_t               mask = uint64_t(1) << (c.value_ % 64);
+
+                if (c.isTerminal() && (c.value_ != TOK_NULL)
+                    && !(kinds[c.value_ / 64] & mask)) {
+                        kinds[c.value_ / 64] |= mask;
+                        ++count;
+                }
+        }
+
+        return count;
+}
+
+//--------------------------------------
+/**
+ * \brief Grammar whose FIRST sets, nullability and LL(1) property are
+ *      computed by the compiler
+ *
+ * Nonterminals are numbered from zero and described by an array of
+ * StaticNonTerminal; their rules are given by an array of StaticComponent.
+ * Both arrays must have static storage duration. For example:
+ *
+ *     using S = wr::parse::StaticComponent;
+ *
+ *     enum : unsigned { ADD, PRIMARY };
+ *
+ *     constexpr wr::parse::StaticNonTerminal calc_nonterminals[] = {
+ *             { "add", 0 }, { "primary", 0 }
+ *     };
+ *
+ *     constexpr S calc_rules[] = {
+ *             S::rule(ADD),     S::nonterminal(PRIMARY),
+ *             S::rule(ADD),     S::nonterminal(ADD), S::terminal(T_PLUS),
+ *                               S::nonterminal(PRIMARY),
+ *             S::rule(PRIMARY), S::terminal(T_NUM),
+ *             S::rule(PRIMARY), S::terminal(T_LP), S::nonterminal(ADD),
+ *                               S::terminal(T_RP)
+ *     };
+ *
+ *     constexpr auto calc = wr::parse::makeStaticGrammar<
+ *                     wr::parse::staticRuleCount(calc_rules),
+ *                     wr::parse::staticTerminalCount(calc_rules)>(
+ *                             calc_nonterminals, calc_rules);
+ *     static_assert(calc.isLL1(PRIMARY), "");
+ *
+ * A malformed table (one not beginning with a rule() entry, or naming a
+ * nonterminal out of range), or one with more than \c R rules or \c T
+ * distinct terminals, fails to compile.
+ *
+ * The tables computed take O((\c N + \c R) × \c T) bits. Computing them
+ * takes O(\c M + \c N + \c R × \c T / 64) steps per pass over the rules,
+ * and compilers limit the steps taken by a constant expression (GCC's
+ * -fconstexpr-ops-limit, Clang's -fconstexpr-steps). The rules are passed
+ * over last to first, until no FIRST set changes, so tables listing each
+ * nonterminal before those its rules begin with need few passes: a table
+ * of 400 nonterminals, 1200 rules and 100 terminals in 3600 entries
+ * compiles within GCC's default limit. A nonterminal whose FIRST set
+ * depends on one listed earlier may take a pass more for each such step.
+ * Sizing the tables by \c M, as when \c R and \c T are not given, takes
+ * O(\c M²) bits and is practical only for small tables.
+ *
+ * StaticGrammarInstance creates NonTerminal objects for use by Parser from
+ * a static grammar, with their FIRST sets taken from the tables rather
+ * than computed on first use. Predicates, commit points and parse actions
+ * may not be given in the tables, but actions may be added to the
+ * instance's nonterminals.
+ *
+ * \tparam N  number of nonterminals
+ * \tparam M  length of the rule table
+ * \tparam R  greatest number of rules (see staticRuleCount())
+ * \tparam T  greatest number of distinct terminals (see
+ *            staticTerminalCount())
+ */
+template <size_t N, size_t M, size_t R = M, size_t T = M>
+class StaticGrammar
+{
+public:
+        enum : size_t
+        {
+                WORDS = (T + 63) / 64 + (T == 0)  ///< per FIRST set
+        };
+
+        constexpr StaticGrammar(const StaticNonTerminal (&nonterminals)[N],
+                                const StaticComponent (&components)[M]);
+
+        constexpr size_t size() const      { return N; }
+        constexpr size_t ruleCount() const { return rule_count_; }
+
+        constexpr const char *name(size_t nt) const
+                { return nonterminals_[nt].name_; }
+
+        constexpr bool matchesEmpty(size_t nt) const
+                { return nullable_[nt]; }
+        constexpr bool matchesAnyToken(size_t nt) const
+                { return any_[nt]; }
+        constexpr bool isLL1(size_t nt) const
+                { return ll1_[nt]; }
+
+        /// \brief Test if a rule of \c nt may begin with \c kind
+        constexpr bool inFirstSet(size_t nt, TokenKind kind) const;
+
+        StaticGrammarData data() const;
+
+private:
+        constexpr size_t terminalIndex(TokenKind kind) const;
+        constexpr bool scan(size_t rule, uint64_t *first, bool &any) const;
+
+        static_assert(R > 0, "StaticGrammar: a grammar has rules");
+
+        const StaticNonTerminal *nonterminals_;
+        const StaticComponent   *components_;
+        size_t                   rule_begin_[R + 1];
+        size_t                   rule_count_;
+        TokenKind                terminals_[T + (T == 0)];  // sorted
+        size_t                   terminal_count_;
+        uint64_t                 first_[N][WORDS];
+        bool                     nullable_[N];
+        bool                     any_[N];
+        bool                     ll1_[N];
+        uint64_t                 rule_first_[R][WORDS];
+        bool                     rule_nullable_[R];
+        bool                     rule_any_[R];
+};
+
+//--------------------------------------
+
+template <size_t N, size_t M, size_t R, size_t T> constexpr
+StaticGrammar<N, M, R, T>::StaticGrammar(
+        const StaticNonTerminal (&nonterminals)[N],
+        const StaticComponent   (&components)[M]
+) :
+        nonterminals_  (nonterminals),
+        components_    (components),
+        rule_begin_    {},
+        rule_count_    (0),
+        terminals_     {},
+        terminal_count_(0),
+        first_         {},
+        nullable_      {},
+        any_           {},
+        ll1_           {},
+        rule_first_    {},
+        rule_nullable_ {},
+        rule_any_      {}
+{
+        if (!components[0].beginsRule()) {
+                throw std::logic_error(
+                        "StaticGrammar: rule table must begin with a rule");
+        }
+
+        uint64_t kinds[65536 / 64] = {};  // terminals seen, by token kind
+
+        for (size_t i = 0; i < M; ++i) {
+                const StaticComponent &c = components[i];
+
+                if (c.beginsRule()) {
+                        if (rule_count_ == R) {
+                                throw std::logic_error(
+                                        "StaticGrammar: more rules than R");
+                        }
+                        rule_begin_[rule_count_++] = i;
+                }
+                if (!c.isTerminal() && (c.value_ >= N)) {
+                        throw std::logic_error(
+                                "StaticGrammar: nonterminal out of range");
+                }
+                if (c.isTerminal() && (c.value_ != TOK_NULL)) {
+                        kinds[c.value_ / 64] |= uint64_t(1) << (c.value_ % 64);
+                }
+        }
+        rule_begin_[rule_count_] = M;
+
+        for (size_t w = 0; w < 65536 / 64; ++w) {
+                for (size_t b = 0; (b < 64) && (kinds[w] >> b); ++b) {
+                        if (!((kinds[w] >> b) & 1)) {
+                                continue;
+                        } else if (terminal_count_ == T) {
+                                throw std::logic_error(
+                                        "StaticGrammar: more terminals"
+                                        " than T");
+                        }
+                        terminals_[terminal_count_++]
+                                        = static_cast<TokenKind>(w * 64 + b);
+                }
+        }
+
+        /* FIRST sets and nullability, iterated to a fixed point; the rules
+           are taken last to first, so that a nonterminal listed before
+           those its rules begin with sees their FIRST sets in one pass */
+        for (bool changed = true; changed; ) {
+                changed = false;
+
+                for (size_t r = rule_count_; r-- > 0; ) {
+                        size_t nt = components_[rule_begin_[r]].value_;
+                        bool   any = rule_any_[r];
+
+                        rule_nullable_[r] = scan(r, rule_first_[r], any);
+                        rule_any_[r] = any;
+
+                        for (size_t w = 0; w < WORDS; ++w) {
+                                if (rule_first_[r][w] & ~first_[nt][w]) {
+                                        first_[nt][w] |= rule_first_[r][w];
+                                        changed = true;
+                                }
+                        }
+                        if ((rule_nullable_[r] && !nullable_[nt])
+                            || (any && !any_[nt])) {
+                                nullable_[nt] = nullable_[nt]
+                                                || rule_nullable_[r];
+                                any_[nt] = any_[nt] || any;
+                                changed = true;
+                        }
+                }
+        }
+
+        /* as NonTerminal::isLL1(): no terminal (including TOK_NULL for
+           rules matching empty) may begin more than one rule, a rule that
+           may begin with any token beginning it with every terminal */
+        uint64_t seen[N][WORDS] = {};
+        size_t   rules[N] = {}, nullable[N] = {}, any[N] = {};
+
+        for (size_t nt = 0; nt < N; ++nt) {
+                ll1_[nt] = true;
+        }
+
+        for (size_t r = 0; r < rule_count_; ++r) {
+                size_t          nt   = components_[rule_begin_[r]].value_;
+                const uint64_t *bits = rule_any_[r] ? first_[nt]
+                                                    : rule_first_[r];
+
+                for (size_t w = 0; w < WORDS; ++w) {
+                        if (seen[nt][w] & bits[w]) {
+                                ll1_[nt] = false;
+                        }
+                        seen[nt][w] |= bits[w];
+                }
+                ++rules[nt];
+                nullable[nt] += rule_nullable_[r] ? 1 : 0;
+                any[nt] += rule_any_[r] ? 1 : 0;
+        }
+
+        for (size_t nt = 0; nt < N; ++nt) {
+                if ((nullable[nt] > 1) || (any[nt] && (rules[nt] > 1))) {
+                        ll1_[nt] = false;
+                }
+        }
+}
+
+//--------------------------------------
+/*
+ * adds the terminals that may begin rule 'r' to 'first', sets 'any' if any
+ * token may begin it and returns true if it may match empty
+ */
+template <size_t N, size_t M, size_t R, size_t T> constexpr bool
+StaticGrammar<N, M, R, T>::scan(
+        size_t    r,
+        uint64_t *first,
+        bool     &any
+) const
+{
+        for (size_t i = rule_begin_[r] + 1; i < rule_begin_[r + 1]; ++i) {
+                const StaticComponent &c = components_[i];
+                bool                   skippable = c.isOptional();
+
+                if (!c.isTerminal()) {
+                        for (size_t w = 0; w < WORDS; ++w) {
+                                first[w] |= first_[c.value_][w];
+                        }
+                        any = any || any_[c.value_];
+                        skippable = skippable || nullable_[c.value_];
+                } else if (c.value_ == TOK_NULL) {
+                        any = true;
+                } else {
+                        size_t t = terminalIndex(c.value_);
+                        first[t / 64] |= uint64_t(1) << (t % 64);
+                }
+
+                if (!skippable) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+//--------------------------------------
+
+template <size_t N, size_t M, size_t R, size_t T> constexpr size_t
+StaticGrammar<N, M, R, T>::terminalIndex(
+        TokenKind kind
+) const
+{
+        size_t lo = 0, hi = terminal_count_;
+
+        while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (terminals_[mid] < kind) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+
+        return lo;  // terminal_count_ if absent
+}
+
+//--------------------------------------
+
+template <size_t N, size_t M, size_t R, size_t T> constexpr bool
+StaticGrammar<N, M, R, T>::inFirstSet(
+        size_t    nt,
+        TokenKind kind
+) const
+{
+        size_t t = terminalIndex(kind);
+
+        if ((t == terminal_count_) || (terminals_[t] != kind)) {
+                return any_[nt];
+        }
+
+        return any_[nt] || ((first_[nt][t / 64] >> (t % 64)) & 1);
+}
+
+//--------------------------------------
+
+template <size_t N, size_t M, size_t R, size_t T> StaticGrammarData
+StaticGrammar<N, M, R, T>::data() const
+{
+        return { nonterminals_, N, components_, rule_begin_, rule_count_,
+                 terminals_, WORDS, &first_[0][0], nullable_, any_, ll1_,
+                 &rule_first_[0][0], rule_nullable_, rule_any_ };
+}
+
+//--------------------------------------
+
+template <size_t N, size_t M> constexpr StaticGrammar<N, M>
+makeStaticGrammar(
+        const StaticNonTerminal (&nonterminals)[N],
+        const StaticComponent   (&components)[M]
+)
+{
+        return StaticGrammar<N, M>(nonterminals, components);
+}
+
+/// \brief Static grammar with tables sized for \c R rules and \c T
+///      distinct terminals
+template <size_t R, size_t T, size_t N, size_t M> constexpr
+StaticGrammar<N, M, R, T>
+makeStaticGrammar(
+        const StaticNonTerminal (&nonterminals)[N],
+        const StaticComponent   (&components)[M]
+)
+{
+        return StaticGrammar<N, M, R, T>(nonterminals, components);
+}
+
+//--------------------------------------
+/**
+ * \brief Nonterminals built from a StaticGrammar for use at run time
+ *
+ * Each nonterminal has its FIRST set, nullability and LL(1) property set
+ * from the static grammar's tables, so that its first use by the parser
+ * does not analyse the grammar. The grammar must not be changed by adding
+ * rules (which would discard those tables).
+ */
+class WRPARSE_API StaticGrammarInstance
+{
+public:
+        using this_t = StaticGrammarInstance;
+
+        template <size_t N, size_t M, size_t R, size_t T>
+        explicit StaticGrammarInstance(
+                        const StaticGrammar<N, M, R, T> &grammar) :
+                this_t(grammar.data()) {}
+
+        explicit StaticGrammarInstance(const StaticGrammarData &data);
+
+        StaticGrammarInstance(const this_t &other) = delete;
+        this_t &operator=(const this_t &other) = delete;
+
+        size_t size() const { return size_; }
+
+        /// \brief Nonterminal with the given index in the static grammar
+        const NonTerminal &operator[](size_t index) const
+                { return nonterminals_[index]; }
+
+private:
+        std::unique_ptr<NonTerminal[]> nonterminals_;
+        size_t                         size_;
+};
+
+
+} // namespace parse
+} // namespace wr
+
+
+#endif // !WRPARSE_STATIC_GRAMMAR_H
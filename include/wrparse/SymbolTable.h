@@ -0,0 +1,166 @@
+/**
+ * \file SymbolTable.h
+ *
+ * \brief Persistent scoped symbol table for context-sensitive parsing
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#ifndef WRPARSE_SYMBOL_TABLE_H
+#define WRPARSE_SYMBOL_TABLE_H
+
+#include <stdint.h>
+#include <string>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
+#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+
+#include <wrutil/u8string_view.h>
+#include <wrparse/Config.h>
+
+
+namespace wr {
+namespace parse {
+
+
+/**
+ * \brief Scoped symbol table with cheap copies
+ *
+ * The table is persistent: copying it takes constant time, and a change
+ * made through one copy is not seen by any other, since the parts of the
+ * table that are unchanged are shared rather than duplicated. This suits
+ * GLL parsing, in which every derivation being explored needs its own
+ * view of the symbols declared so far (such as C \c typedef names).
+ *
+ * The parser keeps a table with each pending derivation and passes it to
+ * predicates and parse actions via ParseState::symbols(). Changes made
+ * there are carried forward along that derivation only, including back
+ * to the rule that called the nonterminal concerned.
+ *
+ * Each scope is a treap keyed on the symbol name, so a definition or a
+ * look-up within one scope takes O(log n) time. A look-up searches the
+ * scopes from the innermost outwards.
+ */
+class WRPARSE_API SymbolTable
+{
+public:
+        using this_t = SymbolTable;
+
+        /// \brief user-defined data for a symbol (e.g. a kind code)
+        using Value = uintptr_t;
+
+        SymbolTable() = default;
+        SymbolTable(const this_t &other) = default;
+        SymbolTable(this_t &&other) = default;
+
+        this_t &operator=(const this_t &other) = default;
+        this_t &operator=(this_t &&other) = default;
+
+        /**
+         * \brief Define or redefine a symbol in the innermost scope
+         * \param [in] name   symbol name
+         * \param [in] value  data to associate with \c name
+         * \return `*this`
+         */
+        this_t &define(u8string_view name, Value value = 0);
+
+        /**
+         * \brief Look up a symbol, innermost scope first
+         * \param [in] name  symbol name
+         * \return pointer to the symbol's data, or \c nullptr if it is not
+         *         defined; the pointer remains valid for as long as any copy
+         *         of this table exists
+         */
+        const Value *find(u8string_view name) const;
+
+        /// \brief Look up a symbol in the innermost scope only
+        const Value *findLocal(u8string_view name) const;
+
+        bool contains(u8string_view name) const
+                { return find(name) != nullptr; }
+
+        /// \brief Begin a new innermost scope
+        this_t &enterScope();
+
+        /**
+         * \brief Discard the innermost scope and the symbols defined in it
+         * \return `false` if only the outermost scope remains, which is
+         *         never discarded
+         */
+        bool leaveScope();
+
+        /// \brief Number of scopes entered and not yet left
+        size_t depth() const;
+
+        /**
+         * \brief Identify this version of the table
+         *
+         * Copies of a table share its version until one of them is changed;
+         * tables with different versions may nevertheless hold the same
+         * symbols.
+         */
+        const void *version() const { return top_.get(); }
+
+private:
+        struct Node;
+        struct Scope;
+
+        using NodePtr = boost::intrusive_ptr<const Node>;
+        using ScopePtr = boost::intrusive_ptr<const Scope>;
+
+        struct Node :
+                boost::intrusive_ref_counter<Node, boost::thread_unsafe_counter>
+        {
+                Node(std::string key, Value value, size_t priority,
+                     NodePtr left, NodePtr right) :
+                        key_(std::move(key)), value_(value),
+                        priority_(priority), left_(std::move(left)),
+                        right_(std::move(right)) {}
+
+                const std::string key_;
+                const Value       value_;
+                const size_t      priority_;  // hash of key_
+                const NodePtr     left_,
+                                  right_;
+        };
+
+        struct Scope :
+                boost::intrusive_ref_counter<Scope,
+                                             boost::thread_unsafe_counter>
+        {
+                Scope(NodePtr symbols, ScopePtr parent) :
+                        symbols_(std::move(symbols)),
+                        parent_(std::move(parent)) {}
+
+                const NodePtr  symbols_;
+                const ScopePtr parent_;
+        };
+
+        static NodePtr insert(const NodePtr &root, u8string_view key,
+                              size_t priority, Value value);
+        static const Value *find(const NodePtr &root, u8string_view key);
+
+        ScopePtr top_;  // innermost scope; nullptr if nothing defined
+};
+
+
+} // namespace parse
+} // namespace wr
+
+
+#endif // !WRPARSE_SYMBOL_TABLE_H
@@ -0,0 +1,1154 @@
+/**
+ * \file CRF.cxx
+ *
+ * \brief GLL parsing with a call return forest and BSR sets
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdint.h>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <wrutil/uiostream.h>
+
+#include <wrparse/CodeGen.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+
+
+namespace wr {
+namespace parse {
+
+
+/*
+ * grammar slot: the component about to be matched, or the dummy component
+ * at the end of a rule once it is complete
+ */
+using Slot = const Component *;
+
+/*
+ * index of an input token, as used by Parser::GLL; the same position may be
+ * denoted by several tokens only once the parse is complete
+ */
+using Pos = uint32_t;
+
+//--------------------------------------
+
+static inline size_t
+mix(
+        uint64_t a,
+        uint64_t b
+)
+{
+        uint64_t h = (a * UINT64_C(0x9e3779b97f4a7c15)) ^ b;
+        h ^= h >> 29;
+        h *= UINT64_C(0xbf58476d1ce4e5b9);
+        h ^= h >> 32;
+        return static_cast<size_t>(h);
+}
+
+//--------------------------------------
+
+static inline Slot
+endOf(
+        const Rule &rule
+)
+{
+        return &*rule.end();
+}
+
+//--------------------------------------
+/*
+ * Clustered nonterminal parsing (CNP) after Scott, Johnstone and van
+ * Binsbergen, "Derivation representation using binary subtree sets". Where
+ * Parser::GLL creates a GSS node per (slot, input position) and builds SPPF
+ * nodes as it goes, a call to nonterminal X at input position k here only
+ * finds or creates the cluster (X, k) of the call return forest, listing
+ * the (slot, left extent) pairs to resume once X has matched. Descriptors
+ * are (slot, left extent, input position), the left extent being where the
+ * current rule began; no parse tree state is carried in them.
+ *
+ * Each step of a rule instead adds an element to the set of binary subtree
+ * representations (BSRs): (slot, i, k, j) records that the components of a
+ * rule up to and including that of 'slot' match the input from i to j, with
+ * the last of them matching from k to j. Forest converts those reachable
+ * from the result into the same SPPF nodes Parser::GLL would have built.
+ */
+class Parser::CRF
+{
+public:
+        CRF(Parser &parser);
+
+        /*
+         * returns false, having done nothing, if the grammar reachable from
+         * 'start' uses features that only Parser::GLL provides
+         */
+        bool parseMain(const NonTerminal &start, SPPFNode::Ptr &result);
+
+private:
+        struct Descriptor
+        {
+                Slot slot_;
+                Pos  left_;       // where the rule began
+                Pos  input_pos_;
+
+                bool operator==(const Descriptor &other) const
+                        { return (slot_ == other.slot_)
+                                  && (left_ == other.left_)
+                                  && (input_pos_ == other.input_pos_); }
+
+                struct Hash
+                {
+                        size_t operator()(const Descriptor &d) const
+                                { return mix(reinterpret_cast<uintptr_t>(
+                                                        d.slot_) ^ d.left_,
+                                             d.input_pos_); }
+                };
+        };
+
+        struct ClusterKey
+        {
+                const NonTerminal *nonterminal_;
+                Pos                input_pos_;
+
+                bool operator==(const ClusterKey &other) const
+                        { return (nonterminal_ == other.nonterminal_)
+                                  && (input_pos_ == other.input_pos_); }
+
+                struct Hash
+                {
+                        size_t operator()(const ClusterKey &key) const
+                                { return mix(reinterpret_cast<uintptr_t>(
+                                                        key.nonterminal_),
+                                             key.input_pos_); }
+                };
+        };
+
+        struct Return  // CRF return node
+        {
+                Slot slot_;  // the nonterminal component called
+                Pos  left_;  // where the calling rule began
+        };
+
+        struct Cluster
+        {
+                std::vector<Return> returns_;
+                std::vector<Pos>    popped_;  // right extents matched
+        };
+
+        struct EdgeKey  // identifies a cluster's return node or popped entry
+        {
+                size_t cluster_;
+                Slot   slot_;     // nullptr for popped entries
+                Pos    pos_;
+
+                bool operator==(const EdgeKey &other) const
+                        { return (cluster_ == other.cluster_)
+                                  && (slot_ == other.slot_)
+                                  && (pos_ == other.pos_); }
+
+                struct Hash
+                {
+                        size_t operator()(const EdgeKey &key) const
+                                { return mix(reinterpret_cast<uintptr_t>(
+                                                key.slot_) ^ key.cluster_,
+                                             key.pos_); }
+                };
+        };
+
+        struct BSRKey
+        {
+                Slot slot_;   // last component matched
+                Pos  left_;   // i: where the rule began
+                Pos  right_;  // j
+
+                bool operator==(const BSRKey &other) const
+                        { return (slot_ == other.slot_)
+                                  && (left_ == other.left_)
+                                  && (right_ == other.right_); }
+
+                struct Hash
+                {
+                        size_t operator()(const BSRKey &key) const
+                                { return mix(reinterpret_cast<uintptr_t>(
+                                                        key.slot_) ^ key.left_,
+                                             key.right_); }
+                };
+        };
+
+        struct Pivot
+        {
+                Pos  pos_;      // k: where the last component began
+                bool skipped_;  // optional component omitted
+        };
+
+        class Forest;
+        class Compiled;
+
+        using Descriptors = std::unordered_set<Descriptor, Descriptor::Hash>;
+        using DescriptorStack = std::vector<Descriptor>;
+        using ClusterIndex = std::unordered_map<ClusterKey, size_t,
+                                                ClusterKey::Hash>;
+        using Clusters = std::vector<Cluster>;
+        using Edges = std::unordered_set<EdgeKey, EdgeKey::Hash>;
+        using BSRSet = std::unordered_map<BSRKey, std::vector<Pivot>,
+                                          BSRKey::Hash>;
+        using Tokens = std::vector<Token *>;
+
+
+        Token *token(Pos input_pos);
+
+        static bool supported(const NonTerminal &start);
+        bool beginNonTerminal(const NonTerminal &nonterminal, Pos input_pos);
+        void beginRule(const Rule &rule, Pos input_pos);
+        void parse(Descriptor d);
+        static bool mayBegin(const NonTerminal &nonterminal,
+                             TokenKind next);
+        void call(Slot slot, Pos left, Pos input_pos);
+        void ret(const NonTerminal &nonterminal, Pos left, Pos input_pos);
+        void add(Slot slot, Pos left, Pos input_pos);
+        void addBSR(Slot slot, Pos left, Pos pivot, Pos right, bool skipped);
+        void match(Pos input_pos);
+        void expect(Pos input_pos, TokenKind terminal);
+        void expect(Pos input_pos, const NonTerminal &nonterminal);
+
+
+        Parser              &parser_;
+        const NonTerminal   *start_;
+        Compiled            *compiled_;     // generated code, if used
+        Tokens               input_;        // input position => token
+        DescriptorStack      in_progress_;  // R
+        Descriptors          visited_;      // U
+        ClusterIndex         cluster_index_;
+        Clusters             clusters_;
+        Edges                edges_;        // return nodes and popped entries
+        BSRSet               bsrs_;
+        bool                 matched_;
+        Pos                  matched_end_;
+        bool                 finished_;     // stop early per match policy
+        Pos                  error_pos_;    // furthest mismatch
+        std::set<TokenKind>  expected_;     // terminals expected there
+};
+
+//--------------------------------------
+/*
+ * builds SPPF nodes from the BSR set on demand, each node being created
+ * with all of its packed children once first asked for
+ */
+class Parser::CRF::Forest
+{
+public:
+        Forest(CRF &crf) : crf_(crf) {}
+
+        SPPFNode::Ptr symbol(const NonTerminal &nonterminal, Pos left,
+                             Pos right);
+
+private:
+        using Nodes = std::unordered_set<SPPFNode::Ptr, SPPFNode::Hash,
+                                         SPPFNode::IndirectEqual>;
+
+        /*
+         * a node whose packed nodes are being added: those of each rule of
+         * a symbol node's nonterminal in turn, or those of the slot of an
+         * intermediate node
+         */
+        struct Build
+        {
+                SPPFNode::Ptr             node_;
+                const NonTerminal        *nonterminal_;  // nullptr if none
+                size_t                    rule_;         // next rule
+                Slot                      slot_;
+                Pos                       left_;
+                Pos                       right_;
+                const std::vector<Pivot> *pivots_;       // of slot_
+                size_t                    next_;         // pivot in hand
+                SPPFNode::Ptr             lhs_;          // its children
+                SPPFNode::Ptr             rhs_;
+                bool                      lhs_found_;
+                bool                      rhs_found_;
+
+                Build(SPPFNode::Ptr node, const NonTerminal *nonterminal,
+                      Slot slot, Pos left, Pos right) :
+                        node_(std::move(node)), nonterminal_(nonterminal),
+                        rule_(0), slot_(slot), left_(left), right_(right),
+                        pivots_(nullptr), next_(0), lhs_found_(false),
+                        rhs_found_(false) {}
+        };
+
+        using Builds = std::vector<Build>;
+
+        static SPPFNode::Ptr hideDelegateOrTransparent(SPPFNode::Ptr node);
+
+        std::pair<SPPFNode::Ptr, bool> getNode(SPPFNode::Ptr key);
+        SPPFNode::Ptr terminal(Pos pos);
+        SPPFNode::Ptr emptyAt(Pos pos);
+        SPPFNode::Ptr intermediate(Slot slot, Pos left, Pos right,
+                                   Builds &builds);
+        SPPFNode::Ptr symbol(const NonTerminal &nonterminal, Pos left,
+                             Pos right, Builds &builds);
+        bool nextSlot(Build &build);
+        void addDerivations(Builds &builds);
+        void addPacked(const SPPFNode::Ptr &node, Slot slot,
+                       SPPFNode::Ptr left, SPPFNode::Ptr right);
+
+        CRF   &crf_;
+        Nodes  nodes_;
+};
+
+//--------------------------------------
+/*
+ * the CRF engine's operations, by slot and nonterminal index, for code
+ * produced by generateParser()
+ */
+class Parser::CRF::Compiled :
+        public CompiledGrammar::Engine
+{
+public:
+        Compiled(CRF &crf, const CompiledGrammar &grammar) :
+                crf_(crf), grammar_(grammar) {}
+
+        const CompiledGrammar &grammar() const { return grammar_; }
+
+        TokenKind kind(Pos pos) override
+                { return crf_.token(pos)->kind(); }
+
+        bool test(CompiledGrammar::Slot predicate, Pos pos) override;
+
+        void add(CompiledGrammar::Slot slot, Pos left, Pos pos) override
+                { crf_.add(&grammar_.slot(slot), left, pos); }
+
+        void beginRule(CompiledGrammar::Slot first, Pos pos) override
+                { crf_.beginRule(*grammar_.slot(first).rule(), pos); }
+
+        void call(CompiledGrammar::Slot slot, Pos left, Pos pos) override
+                { crf_.call(&grammar_.slot(slot), left, pos); }
+
+        bool endRule(CompiledGrammar::Slot, Pos, Pos) override
+                { return true; }  // no actions; see CRF::supported()
+
+        void ret(CompiledGrammar::NonTerminalIndex nonterminal, Pos left,
+                 Pos pos) override
+                { crf_.ret(grammar_.nonTerminal(nonterminal), left, pos); }
+
+        void addBSR(CompiledGrammar::Slot slot, Pos left, Pos pivot,
+                    Pos right, bool skipped) override
+                { crf_.addBSR(&grammar_.slot(slot), left, pivot, right,
+                              skipped); }
+
+        void expect(Pos pos, TokenKind terminal) override
+                { crf_.expect(pos, terminal); }
+
+        void expectFirst(CompiledGrammar::NonTerminalIndex nonterminal,
+                         Pos pos) override
+                { crf_.expect(pos, grammar_.nonTerminal(nonterminal)); }
+
+private:
+        CRF                   &crf_;
+        const CompiledGrammar &grammar_;
+};
+
+//--------------------------------------
+
+Parser::CRF::CRF(
+        Parser &parser
+) :
+        parser_      (parser),
+        start_       (nullptr),
+        compiled_    (nullptr),
+        matched_     (false),
+        matched_end_ (0),
+        finished_    (false),
+        error_pos_   (0)
+{
+}
+
+//--------------------------------------
+
+Token *
+Parser::CRF::token(
+        Pos input_pos
+)
+{
+        while (input_pos >= input_.size()) {
+                input_.push_back(parser_.nextToken(input_.back()));
+        }
+
+        return input_[input_pos];
+}
+
+//--------------------------------------
+
+bool
+Parser::CRF::parseMain(
+        const NonTerminal &start,
+        SPPFNode::Ptr     &result
+)
+{
+        if (parser_.isBounded() || parser_.ruleProfile()
+            || parser_.slotProfile() || parser_.ambiguityProfile()
+            || !supported(start)) {
+                if (parser_.debugEnabled()) {
+                        ulog << "PARSE with GLL engine" << std::endl;
+                }
+                return false;
+        }
+
+        Token *input_start = parser_.tokens_.begin().node();
+
+        if (!input_start) {
+                input_start = parser_.nextToken();
+        }
+
+        const CompiledGrammar *grammar = parser_.compiledGrammar();
+        std::unique_ptr<Compiled> compiled;
+
+        if (grammar && grammar->contains(start)) {
+                compiled.reset(new Compiled(*this, *grammar));
+                compiled_ = compiled.get();
+        }
+
+        start_ = &start;
+        input_.push_back(input_start);
+
+        cluster_index_.emplace(ClusterKey { start_, 0 }, 0);
+        clusters_.emplace_back();
+
+        if (!beginNonTerminal(start, 0)) {
+                expect(0, start);
+        }
+
+        while (!in_progress_.empty() && !finished_) {
+                Descriptor d = in_progress_.back();
+                in_progress_.pop_back();
+                parse(d);
+        }
+
+        if (parser_.debugEnabled()) {
+                ulog << "CRF    descriptors " << visited_.size()
+                     << ", clusters " << clusters_.size()
+                     << ", BSR keys " << bsrs_.size() << std::endl;
+        }
+
+        if (matched_) {
+                result = Forest(*this).symbol(start, 0, matched_end_);
+        } else {
+                result = nullptr;
+                if (!expected_.empty()) {
+                        parser_.emitExpected(*token(error_pos_), expected_);
+                }
+        }
+
+        return true;
+}
+
+//--------------------------------------
+/*
+ * true if the grammar reachable from 'start' has no parse actions, ordered
+ * choices, commit points or impure predicates; checked before parsing, so
+ * that nothing with side effects has run should Parser::GLL be used
+ * instead. Actions are excluded because the SPPF nodes they are given only
+ * exist once the parse is complete.
+ */
+bool
+Parser::CRF::supported(
+        const NonTerminal &start
+) // static
+{
+        for (const NonTerminal *nt: reachableNonTerminals(start)) {
+                if (nt->isOrderedChoice() || nt->hasActions()) {
+                        return false;
+                }
+                for (const Rule &rule: *nt) {
+                        for (const Component &comp: rule) {
+                                if (comp.isCommitPoint()
+                                    || (comp.predicate() && !comp.isPure())) {
+                                        return false;
+                                }
+                        }
+                }
+        }
+
+        return true;
+}
+
+//--------------------------------------
+/*
+ * ntAdd() in the CNP papers; rules are selected as by Parser::GLL
+ */
+bool
+Parser::CRF::beginNonTerminal(
+        const NonTerminal &nonterminal,
+        Pos                input_pos
+)
+{
+        auto   &terminals = nonterminal.firstSet();
+        size_t  count     = in_progress_.size() + visited_.size();
+
+        if (compiled_) {
+                const CompiledGrammar &grammar = compiled_->grammar();
+                grammar.beginNonTerminal(*compiled_,
+                                         grammar.nonTerminalIndex(nonterminal),
+                                         input_pos);
+        } else if (terminals.empty()) {
+                for (const Rule &rule: nonterminal) {
+                        beginRule(rule, input_pos);
+                }
+        } else {
+                auto i = terminals.find(token(input_pos)->kind());
+
+                if (i != terminals.end()) {
+                        for (size_t ir: i->second) {
+                                beginRule(nonterminal[ir], input_pos);
+                        }
+                } else for (size_t ir: nonterminal.anyTokenRules()) {
+                        beginRule(nonterminal[ir], input_pos);
+                }
+
+                if (nonterminal.matchesEmpty()) {
+                        i = terminals.find(TOK_NULL);
+                        if (i != terminals.end()) {
+                                for (size_t ir: i->second) {
+                                        beginRule(nonterminal[ir], input_pos);
+                                }
+                        }
+                }
+        }
+
+        return (in_progress_.size() + visited_.size()) > count;
+}
+
+//--------------------------------------
+
+void
+Parser::CRF::beginRule(
+        const Rule &rule,
+        Pos         input_pos
+)
+{
+        if (!rule.empty()) {  // not matched by Parser::GLL either
+                add(&rule.front(), input_pos, input_pos);
+        }
+}
+
+//--------------------------------------
+/*
+ * the code for each slot of a rule; like Parser::GLL::parse(), matches
+ * terminals until a nonterminal is called or the rule is complete
+ */
+void
+Parser::CRF::parse(
+        Descriptor d
+)
+{
+        if (compiled_) {
+                const CompiledGrammar &grammar = compiled_->grammar();
+                grammar.parse(*compiled_, grammar.slotIndex(*d.slot_),
+                              d.left_, d.input_pos_);
+                return;
+        }
+
+        const Rule &rule = *d.slot_->rule();
+        Slot        end  = endOf(rule);
+        Pos         pos  = d.input_pos_;
+
+        for (Slot slot = d.slot_; slot != end; ++slot) {
+                Token           *input = token(pos);
+                const Component &step  = *slot;
+
+                if (step.predicate()) {
+                        ParseState state(parser_, *start_, rule, input,
+                                         parser_.symbols());
+                        if (!step.predicate()(state) && !step.isOptional()) {
+                                return;
+                        }
+                }
+
+                if (step.isTerminal()) {
+                        TokenKind terminal = step.getAsTerminal();
+
+                        if ((terminal == TOK_NULL)
+                                        || (terminal == input->kind())) {
+                                addBSR(slot, d.left_, pos, pos + 1, false);
+                                ++pos;
+                        } else if (!step.isOptional()) {
+                                expect(pos, terminal);
+                                return;
+                        } else {
+                                addBSR(slot, d.left_, pos, pos, true);
+                        }
+                } else {
+                        const NonTerminal &called = *step.getAsNonTerminal();
+                        bool               skip   = step.isOptional()
+                                                    && !called.matchesEmpty();
+
+                        if (mayBegin(called, input->kind())) {
+                                call(slot, d.left_, pos);
+                        } else if (!skip) {
+                                expect(pos, called);
+                        }
+
+                        if (!skip) {
+                                return;  // resumed by ret()
+                        }
+
+                        // also attempt path omitting optional nonterminal
+                        addBSR(slot, d.left_, pos, pos, true);
+                }
+        }
+
+        ret(*rule.nonTerminal(), d.left_, pos);
+}
+
+//--------------------------------------
+/*
+ * false if the FIRST set of 'nonterminal' shows that it cannot match from a
+ * token of kind 'next', in which case no cluster need be created for the
+ * call; generated code makes the same test (see generateParser())
+ */
+bool
+Parser::CRF::mayBegin(
+        const NonTerminal &nonterminal,
+        TokenKind          next
+) // static
+{
+        auto &terminals = nonterminal.firstSet();
+
+        return terminals.empty() || nonterminal.matchesEmpty()
+               || nonterminal.matchesAnyToken() || terminals.count(next);
+}
+
+//--------------------------------------
+/*
+ * call(L, i, j) in the CNP papers: 'slot' calls its nonterminal at
+ * 'input_pos' on behalf of a rule that began at 'left'
+ */
+void
+Parser::CRF::call(
+        Slot slot,
+        Pos  left,
+        Pos  input_pos
+)
+{
+        const NonTerminal &called   = *slot->getAsNonTerminal();
+        size_t             cluster  = clusters_.size();
+        auto               inserted = cluster_index_.emplace(
+                                        ClusterKey { &called, input_pos },
+                                        cluster);
+
+        if (inserted.second) {
+                clusters_.emplace_back();
+                clusters_[cluster].returns_.push_back({ slot, left });
+                edges_.insert({ cluster, slot, left });
+                ++parser_.statistics_.gss_nodes_;
+                ++parser_.statistics_.gss_edges_;
+                if (!beginNonTerminal(called, input_pos)) {
+                        expect(input_pos, called);
+                }
+                return;
+        }
+
+        cluster = inserted.first->second;
+
+        if (edges_.insert({ cluster, slot, left }).second) {
+                clusters_[cluster].returns_.push_back({ slot, left });
+                ++parser_.statistics_.gss_edges_;
+
+                // resume with each right extent already matched
+                for (size_t i = 0; i < clusters_[cluster].popped_.size();
+                                                                        ++i) {
+                        Pos right = clusters_[cluster].popped_[i];
+                        add(slot + 1, left, right);
+                        addBSR(slot, left, input_pos, right, false);
+                }
+        }
+}
+
+//--------------------------------------
+/*
+ * rtn(X, k, j) in the CNP papers
+ */
+void
+Parser::CRF::ret(
+        const NonTerminal &nonterminal,
+        Pos                left,
+        Pos                input_pos
+)
+{
+        size_t cluster = cluster_index_.at({ &nonterminal, left });
+
+        if (!edges_.insert({ cluster, nullptr, input_pos }).second) {
+                return;
+        }
+
+        clusters_[cluster].popped_.push_back(input_pos);
+
+        if ((&nonterminal == start_) && (left == 0)) {
+                match(input_pos);
+        }
+
+        for (size_t i = 0; i < clusters_[cluster].returns_.size(); ++i) {
+                Return r = clusters_[cluster].returns_[i];
+                add(r.slot_ + 1, r.left_, input_pos);
+                addBSR(r.slot_, r.left_, left, input_pos, false);
+        }
+}
+
+//--------------------------------------
+/*
+ * dscAdd() in the CNP papers
+ */
+void
+Parser::CRF::add(
+        Slot slot,
+        Pos  left,
+        Pos  input_pos
+)
+{
+        Descriptor d = { slot, left, input_pos };
+
+        if (visited_.insert(d).second) {
+                in_progress_.push_back(d);
+                ++parser_.statistics_.descriptors_;
+        }
+}
+
+//--------------------------------------
+
+void
+Parser::CRF::addBSR(
+        Slot slot,
+        Pos  left,
+        Pos  pivot,
+        Pos  right,
+        bool skipped
+)
+{
+        auto &pivots = bsrs_[{ slot, left, right }];
+
+        for (const Pivot &existing: pivots) {
+                if ((existing.pos_ == pivot)
+                                && (existing.skipped_ == skipped)) {
+                        return;
+                }
+        }
+
+        pivots.push_back({ pivot, skipped });
+}
+
+//--------------------------------------
+/*
+ * records a match of the start symbol from the first input position
+ */
+void
+Parser::CRF::match(
+        Pos input_pos
+)
+{
+        if (!matched_ || (input_pos > matched_end_)) {
+                matched_ = true;
+                matched_end_ = input_pos;
+        }
+
+        switch (parser_.matchPolicy()) {
+        case Parser::LONGEST_MATCH:
+                break;
+        case Parser::FIRST_MATCH_AT_EOF:
+                if (token(input_pos)->is(TOK_EOF)) {
+                        finished_ = true;
+                }
+                break;
+        }
+}
+
+//--------------------------------------
+
+void
+Parser::CRF::expect(
+        Pos       input_pos,
+        TokenKind terminal
+)
+{
+        if (input_pos > error_pos_) {
+                error_pos_ = input_pos;
+                expected_.clear();
+        }
+
+        if (input_pos == error_pos_) {
+                expected_.insert(terminal);
+        }
+}
+
+//--------------------------------------
+
+void
+Parser::CRF::expect(
+        Pos                input_pos,
+        const NonTerminal &nonterminal
+)
+{
+        for (const auto &term: nonterminal.firstSet()) {
+                if ((term.first != TOK_EOF) && (term.first != TOK_NULL)) {
+                        expect(input_pos, term.first);
+                }
+        }
+}
+
+//--------------------------------------
+
+bool
+Parser::CRF::Compiled::test(
+        CompiledGrammar::Slot predicate,
+        Pos                   pos
+)
+{
+        const Component &step = grammar_.slot(predicate);
+        ParseState       state(crf_.parser_, *crf_.start_, *step.rule(),
+                               crf_.token(pos), crf_.parser_.symbols());
+
+        return step.predicate()(state);
+}
+
+//--------------------------------------
+/*
+ * node for 'nonterminal' matching the input from 'left' to 'right'
+ */
+SPPFNode::Ptr
+Parser::CRF::Forest::symbol(
+        const NonTerminal &nonterminal,
+        Pos                left,
+        Pos                right
+)
+{
+        Builds        builds;
+        SPPFNode::Ptr node = symbol(nonterminal, left, right, builds);
+
+        addDerivations(builds);
+        return node;
+}
+
+//--------------------------------------
+/*
+ * as symbol(), but a new node is pushed onto 'builds' to have its packed
+ * nodes added
+ */
+SPPFNode::Ptr
+Parser::CRF::Forest::symbol(
+        const NonTerminal &nonterminal,
+        Pos                left,
+        Pos                right,
+        Builds            &builds
+)
+{
+        Token *first = (right > left) ? crf_.token(left) : nullptr,
+              *last  = crf_.token((right > left) ? right - 1 : left);
+        auto   node  = getNode(new SPPFNode(nonterminal, first, *last));
+
+        if (node.second) {
+                builds.emplace_back(node.first, &nonterminal, nullptr, left,
+                                    right);
+        }
+
+        return node.first;
+}
+
+//--------------------------------------
+/*
+ * node for the components of a rule up to and including that of 'slot';
+ * a new node is pushed onto 'builds' to have its packed nodes added
+ */
+SPPFNode::Ptr
+Parser::CRF::Forest::intermediate(
+        Slot    slot,
+        Pos     left,
+        Pos     right,
+        Builds &builds
+)
+{
+        Token *first = (right > left) ? crf_.token(left) : nullptr,
+              *last  = crf_.token((right > left) ? right - 1 : left);
+        auto   node  = getNode(new SPPFNode(*slot, first, *last));
+
+        if (node.second) {
+                builds.emplace_back(node.first, nullptr, slot, left, right);
+        }
+
+        return node.first;
+}
+
+//--------------------------------------
+/*
+ * selects the BSRs (slot, left, k, right) from which 'build' next adds
+ * packed nodes; false once there are none left
+ */
+bool
+Parser::CRF::Forest::nextSlot(
+        Build &build
+)
+{
+        if (!build.nonterminal_) {
+                if (build.pivots_) {
+                        return false;
+                }
+
+                auto i = crf_.bsrs_.find({ build.slot_, build.left_,
+                                           build.right_ });
+
+                if (i == crf_.bsrs_.end()) {
+                        return false;
+                }
+                build.pivots_ = &i->second;
+                return true;
+        }
+
+        while (build.rule_ < build.nonterminal_->size()) {
+                const Rule &rule = (*build.nonterminal_)[build.rule_++];
+
+                if (rule.empty()) {
+                        continue;
+                }
+
+                auto i = crf_.bsrs_.find({ &rule.back(), build.left_,
+                                           build.right_ });
+
+                if (i != crf_.bsrs_.end()) {
+                        build.slot_ = &rule.back();
+                        build.pivots_ = &i->second;
+                        build.next_ = 0;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+//--------------------------------------
+/*
+ * adds a packed node for each BSR (slot, left, k, right) to the nodes on
+ * 'builds', and to those they lead to, each being complete before it is
+ * made the child of another; made iterative, as the SPPF may be nested as
+ * deeply as the input is long
+ */
+void
+Parser::CRF::Forest::addDerivations(
+        Builds &builds
+)
+{
+        while (!builds.empty()) {
+                Build &build = builds.back();
+
+                if ((!build.pivots_ || (build.next_ == build.pivots_->size()))
+                    && !nextSlot(build)) {
+                        builds.pop_back();
+                        continue;
+                }
+
+                size_t       top   = builds.size() - 1;
+                Slot         slot  = build.slot_;
+                const Rule  &rule  = *slot->rule();
+                auto         index = slot - &rule.front();
+                Pivot        pivot = (*build.pivots_)[build.next_];
+                Pos          left  = build.left_,
+                             right = build.right_;
+
+                if (!build.lhs_found_) {
+                        build.lhs_found_ = true;
+                        if (index == 0) {
+                                ;
+                        } else if ((index == 1) && rule.front().isTerminal()
+                                                && (pivot.pos_ == left + 1)) {
+                                /* Parser::GLL does not create an
+                                   intermediate node for a leading terminal */
+                                build.lhs_ = terminal(left);
+                        } else {
+                                // 'build' is invalidated if a node is pushed
+                                SPPFNode::Ptr lhs = intermediate(
+                                                slot - 1, left, pivot.pos_,
+                                                builds);
+
+                                builds[top].lhs_ = std::move(lhs);
+                        }
+                        continue;
+                }
+
+                if (!build.rhs_found_) {
+                        build.rhs_found_ = true;
+                        if (pivot.skipped_) {
+                                build.rhs_ = emptyAt(pivot.pos_);
+                        } else if (slot->isTerminal()) {
+                                build.rhs_ = terminal(pivot.pos_);
+                        } else {
+                                SPPFNode::Ptr rhs = symbol(
+                                                *slot->getAsNonTerminal(),
+                                                pivot.pos_, right, builds);
+
+                                builds[top].rhs_ = std::move(rhs);
+                        }
+                        continue;
+                }
+
+                SPPFNode::Ptr rhs = std::move(build.rhs_);
+
+                if (!pivot.skipped_ && !slot->isTerminal()) {
+                        rhs = hideDelegateOrTransparent(std::move(rhs));
+                }
+
+                addPacked(build.node_, slot, std::move(build.lhs_),
+                          std::move(rhs));
+                build.lhs_found_ = build.rhs_found_ = false;
+                ++build.next_;
+        }
+}
+
+//--------------------------------------
+/*
+ * as Parser::GLL::getNodeP() once 'node' has been found
+ */
+void
+Parser::CRF::Forest::addPacked(
+        const SPPFNode::Ptr &node,
+        Slot                 slot,
+        SPPFNode::Ptr        left,
+        SPPFNode::Ptr        right
+)
+{
+        const Rule &rule = *slot->rule();
+
+        if (!left && (slot != &rule.back()) && right->isNonTerminal()
+                  && (right->nonTerminal() == rule.nonTerminal())
+                  && slot->isRecursive()
+                  && !rule.nonTerminal()->keepRecursion()) {
+                for (auto child: right->children()) {
+                        node->addChild(child);
+                }
+                return;
+        }
+
+        Token *pivot = right->empty() ? right->lastToken()
+                                      : right->firstToken();
+
+        for (const SPPFNode::Ptr &child: node->children()) {
+                if (child->isPacked() && (child->component() == slot)
+                                      && (child->empty() == right->empty())) {
+                        if (right->empty() ? (child->lastToken() == pivot)
+                                           : (child->firstToken() == pivot)) {
+                                return;
+                        }
+                }
+        }
+
+        SPPFNode::Ptr packed = new SPPFNode(*slot, *pivot, right->empty());
+
+        if (left) {
+                packed->addChild(std::move(left));
+        }
+        packed->addChild(std::move(right));
+        node->addChild(std::move(packed));
+        ++crf_.parser_.statistics_.packed_nodes_;
+}
+
+//--------------------------------------
+
+std::pair<SPPFNode::Ptr, bool>
+Parser::CRF::Forest::getNode(
+        SPPFNode::Ptr key
+)
+{
+        auto inserted = nodes_.insert(std::move(key));
+
+        if (inserted.second) {
+                ++crf_.parser_.statistics_.sppf_nodes_;
+        }
+        return std::make_pair(*inserted.first, inserted.second);
+}
+
+//--------------------------------------
+
+SPPFNode::Ptr
+Parser::CRF::Forest::terminal(
+        Pos pos
+)
+{
+        return getNode(new SPPFNode(*crf_.token(pos))).first;
+}
+
+//--------------------------------------
+
+SPPFNode::Ptr
+Parser::CRF::Forest::emptyAt(
+        Pos pos
+)
+{
+        return getNode(new SPPFNode(SPPFNode::emptyNode(*crf_.token(pos))))
+                                                                        .first;
+}
+
+//--------------------------------------
+/*
+ * as Parser::GLL::hideDelegateOrTransparent()
+ */
+SPPFNode::Ptr
+Parser::CRF::Forest::hideDelegateOrTransparent(
+        SPPFNode::Ptr node
+) // static
+{
+        SPPFNode::Ptr child  = node->firstChild(),
+                      result = node;
+
+        if (child && child->isPacked() && (child == node->lastChild())) {
+                const Rule *child_rule = child->rule();
+                if (child_rule && child_rule->mustHide()) {
+                        if (child->firstChild() == child->lastChild()) {
+                                child = child->firstChild();
+                                if (child->isSymbol()) {
+                                        result = child;
+                                }
+                        }
+                }
+        }
+
+        return result;
+}
+
+//--------------------------------------
+
+bool
+Parser::parseCRF(
+        const NonTerminal &start,
+        SPPFNode::Ptr     &result
+)
+{
+        // clear recorded diagnostics on scope exit
+        struct OnExit
+        {
+                OnExit(Parser &parser) : parser_(parser) {}
+                ~OnExit() { parser_.diagnostics_.clear(); }
+
+                Parser &parser_;
+        } on_exit(*this);
+
+        return CRF(*this).parseMain(start, result);
+}
+
+
+} // namespace parse
+} // namespace wr
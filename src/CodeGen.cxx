@@ -0,0 +1,623 @@
+/**
+ * \file CodeGen.cxx
+ *
+ * \brief Generation of grammar-specific parser code
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <wrutil/CityHash.h>
+
+#include <wrparse/CodeGen.h>
+#include <wrparse/Lexer.h>
+
+
+namespace wr {
+namespace parse {
+
+
+using NonTerminals = std::vector<const NonTerminal *>;
+
+//--------------------------------------
+/*
+ * true if the grammar uses nothing the CRF engine lacks
+ */
+static bool
+compilable(
+        const NonTerminals &nonterminals
+)
+{
+        for (const NonTerminal *nt: nonterminals) {
+                if (nt->isOrderedChoice()) {
+                        return false;
+                }
+                for (const Rule &rule: *nt) {
+                        for (const Component &comp: rule) {
+                                if (comp.isCommitPoint()
+                                    || (comp.predicate() && !comp.isPure())) {
+                                        return false;
+                                }
+                        }
+                }
+        }
+
+        return true;
+}
+
+//--------------------------------------
+
+static void
+put(
+        std::string &to,
+        uint64_t     value
+)
+{
+        to.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+//--------------------------------------
+
+static uint64_t
+fingerprint(
+        const NonTerminals &nonterminals
+)
+{
+        std::unordered_map<const NonTerminal *, uint64_t> index;
+        std::string                                       key;
+
+        for (const NonTerminal *nt: nonterminals) {
+                index.emplace(nt, index.size());
+        }
+
+        for (const NonTerminal *nt: nonterminals) {
+                key.append(nt->name()).push_back('\0');
+                put(key, (nt->isTransparent() ? NonTerminal::TRANSPARENT : 0)
+                         | (nt->hideIfDelegate() ?
+                                        NonTerminal::HIDE_IF_DELEGATE : 0)
+                         | (nt->keepRecursion() ?
+                                        NonTerminal::KEEP_RECURSION : 0)
+                         | (nt->isOrderedChoice() ?
+                                        NonTerminal::ORDERED_CHOICE : 0));
+                put(key, nt->size());
+
+                for (const Rule &rule: *nt) {
+                        put(key, rule.size());
+                        put(key, rule.isEnabled());
+
+                        for (const Component &comp: rule) {
+                                uint64_t bits =  (comp.isOptional() ? 1 : 0)
+                                            | (comp.predicate() ? 2 : 0)
+                                            | (comp.isPure() ? 4 : 0)
+                                            | (comp.isCommitPoint() ? 8 : 0);
+
+                                if (comp.isTerminal()) {
+                                        put(key, comp.getAsTerminal());
+                                } else {
+                                        put(key, (uint64_t(1) << 32)
+                                           + index[comp.getAsNonTerminal()]);
+                                }
+                                put(key, bits);
+                        }
+                }
+        }
+
+        return CityHash64(key.data(), key.size());
+}
+
+//--------------------------------------
+
+WRPARSE_API uint64_t
+grammarFingerprint(
+        const NonTerminal &start
+)
+{
+        return fingerprint(reachableNonTerminals(start));
+}
+
+//--------------------------------------
+
+WRPARSE_API
+CompiledGrammar::~CompiledGrammar() = default;
+
+//--------------------------------------
+
+WRPARSE_API bool
+CompiledGrammar::bind(
+        const NonTerminal &start
+)
+{
+        start_ = nullptr;
+        slots_.clear();
+        slot_index_.clear();
+        nonterminals_.clear();
+        nonterminal_index_.clear();
+
+        NonTerminals nonterminals = reachableNonTerminals(start);
+
+        if (!compilable(nonterminals)
+            || (wr::parse::fingerprint(nonterminals) != fingerprint())) {
+                return false;
+        }
+
+        for (const NonTerminal *nt: nonterminals) {
+                nonterminal_index_.emplace(nt, nonterminals_.size());
+                nonterminals_.push_back(nt);
+
+                for (const Rule &rule: *nt) {
+                        for (auto i = rule.begin(); ; ++i) {
+                                slot_index_.emplace(&*i, slots_.size());
+                                slots_.push_back(&*i);
+                                if (i == rule.end()) {
+                                        break;
+                                }
+                        }
+                }
+        }
+
+        start_ = &start;
+        return true;
+}
+
+//--------------------------------------
+/*
+ * writes the source of the generated class; slot and nonterminal numbers
+ * follow the order in which CompiledGrammar::bind() assigns them
+ */
+class Generator
+{
+public:
+        Generator(std::ostream &out, const NonTerminals &nonterminals,
+                  const char *class_name, const Lexer *lexer);
+
+        void generate();
+
+private:
+        using Cases = std::map<std::vector<size_t>, std::vector<TokenKind>>;
+
+        void emitBeginNonTerminal();
+        void emitBeginRule(const NonTerminal &nt, size_t ir);
+        void emitParse();
+        void emitRule(const Rule &rule, CompiledGrammar::NonTerminalIndex nt);
+        void emitTerminal(const Component &comp, CompiledGrammar::Slot s);
+        bool emitNonTerminal(const Component &comp, CompiledGrammar::Slot s);
+        void emitCase(TokenKind kind, unsigned indent);
+
+        std::string kindName(TokenKind kind) const;
+
+        std::ostream                        &out_;
+        const NonTerminals                  &nonterminals_;
+        const char                          *class_name_;
+        const Lexer                         *lexer_;
+        std::unordered_map<const Component *,
+                           CompiledGrammar::Slot>       slots_;
+        std::unordered_map<const NonTerminal *,
+                           CompiledGrammar::NonTerminalIndex> indices_;
+};
+
+//--------------------------------------
+
+Generator::Generator(
+        std::ostream       &out,
+        const NonTerminals &nonterminals,
+        const char         *class_name,
+        const Lexer        *lexer
+) :
+        out_          (out),
+        nonterminals_ (nonterminals),
+        class_name_   (class_name),
+        lexer_        (lexer)
+{
+        for (const NonTerminal *nt: nonterminals_) {
+                indices_.emplace(nt, indices_.size());
+
+                for (const Rule &rule: *nt) {
+                        for (auto i = rule.begin(); ; ++i) {
+                                slots_.emplace(&*i, slots_.size());
+                                if (i == rule.end()) {
+                                        break;
+                                }
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+
+std::string
+Generator::kindName(
+        TokenKind kind
+) const
+{
+        std::string name = lexer_ ? lexer_->tokenKindName(kind) : "";
+
+        for (char &c: name) {
+                if ((c < ' ') || (c == '\\') || (c == 0x7f)) {
+                        c = '?';  // keep comment on one line
+                }
+        }
+
+        return name;
+}
+
+//--------------------------------------
+
+void
+Generator::emitCase(
+        TokenKind kind,
+        unsigned  indent
+)
+{
+        out_ << std::string(indent, ' ') << "case " << kind << ':';
+        if (lexer_) {
+                out_ << "  // " << kindName(kind);
+        }
+        out_ << '\n';
+}
+
+//--------------------------------------
+
+void
+Generator::generate()
+{
+        const NonTerminal &start = *nonterminals_.front();
+        char               hex[20];
+
+        std::string guard = class_name_;
+
+        snprintf(hex, sizeof(hex), "%016" PRIx64, fingerprint(nonterminals_));
+        for (char &c: guard) {
+                c = toupper(static_cast<unsigned char>(c));
+        }
+        guard += "_GENERATED_H";
+
+        out_ << "// Generated by wr::parse::generateParser() - do not edit\n"
+                "//\n"
+                "// start symbol: " << start.name() << "\n"
+                "// nonterminals: " << indices_.size() << "\n"
+                "// slots:        " << slots_.size() << "\n"
+                "\n"
+                "#ifndef " << guard << "\n"
+                "#define " << guard << "\n"
+                "\n"
+                "#include <wrparse/CodeGen.h>\n"
+                "\n"
+                "\n"
+                "class " << class_name_ << " :\n"
+                "        public wr::parse::CompiledGrammar\n"
+                "{\n"
+                "public:\n"
+                "        explicit " << class_name_
+                        << "(const wr::parse::NonTerminal &start)\n"
+                "                { bind(start); }\n"
+                "\n"
+                "        uint64_t fingerprint() const override\n"
+                "                { return UINT64_C(0x" << hex << "); }\n"
+                "\n"
+                "        void beginNonTerminal(Engine &engine,\n"
+                "                              NonTerminalIndex nonterminal,\n"
+                "                              Pos pos) const override;\n"
+                "\n"
+                "        void parse(Engine &engine, Slot slot, Pos left,\n"
+                "                   Pos pos) const override;\n"
+                "};\n";
+
+        emitBeginNonTerminal();
+        emitParse();
+
+        out_ << "\n"
+                "\n"
+                "#endif // !" << guard << '\n';
+}
+
+//--------------------------------------
+/*
+ * selects candidate rules as Parser::CRF::beginNonTerminal() does
+ */
+void
+Generator::emitBeginNonTerminal()
+{
+        out_ << "\n"
+                "//--------------------------------------\n"
+                "\n"
+                "inline void\n"
+             << class_name_ << "::beginNonTerminal(\n"
+                "        Engine           &engine,\n"
+                "        NonTerminalIndex  nonterminal,\n"
+                "        Pos               pos\n"
+                ") const\n"
+                "{\n"
+                "        switch (nonterminal) {\n";
+
+        for (const NonTerminal *nt: nonterminals_) {
+                auto &terminals = nt->firstSet();
+
+                out_ << "        case " << indices_[nt] << ":  // "
+                     << nt->name() << '\n';
+
+                if (terminals.empty()) {
+                        for (const Rule &rule: *nt) {
+                                if (!rule.empty()) {
+                                        out_ << "                "
+                                                "engine.beginRule("
+                                             << slots_[&rule.front()]
+                                             << ", pos);\n";
+                                }
+                        }
+                        out_ << "                return;\n";
+                        continue;
+                }
+
+                Cases cases;
+
+                for (const auto &entry: terminals) {
+                        std::vector<size_t> rules(entry.second.begin(),
+                                                  entry.second.end());
+                        cases[rules].push_back(entry.first);
+                }
+
+                out_ << "                switch (engine.kind(pos)) {\n";
+                for (const auto &c: cases) {
+                        for (TokenKind kind: c.second) {
+                                emitCase(kind, 16);
+                        }
+                        for (size_t ir: c.first) {
+                                emitBeginRule(*nt, ir);
+                        }
+                        out_ << "                        break;\n";
+                }
+                if (!nt->anyTokenRules().empty()) {
+                        out_ << "                default:\n";
+                        for (size_t ir: nt->anyTokenRules()) {
+                                emitBeginRule(*nt, ir);
+                        }
+                        out_ << "                        break;\n";
+                }
+                out_ << "                }\n";
+
+                auto empty = terminals.find(TOK_NULL);
+
+                if (nt->matchesEmpty() && (empty != terminals.end())) {
+                        for (size_t ir: empty->second) {
+                                emitBeginRule(*nt, ir);
+                        }
+                }
+                out_ << "                return;\n";
+        }
+
+        out_ << "        }\n"
+                "}\n";
+}
+
+//--------------------------------------
+
+void
+Generator::emitBeginRule(
+        const NonTerminal &nt,
+        size_t             ir
+)
+{
+        const Rule &rule = nt[ir];
+
+        if (!rule.empty()) {
+                out_ << "                        engine.beginRule("
+                     << slots_[&rule.front()] << ", pos);  // "
+                     << nt.name() << '.' << ir << '\n';
+        }
+}
+
+//--------------------------------------
+
+void
+Generator::emitParse()
+{
+        out_ << "\n"
+                "//--------------------------------------\n"
+                "\n"
+                "inline void\n"
+             << class_name_ << "::parse(\n"
+                "        Engine &engine,\n"
+                "        Slot    slot,\n"
+                "        Pos     left,\n"
+                "        Pos     pos\n"
+                ") const\n"
+                "{\n"
+                "        switch (slot) {\n";
+
+        for (const NonTerminal *nt: nonterminals_) {
+                for (const Rule &rule: *nt) {
+                        if (!rule.empty()) {
+                                emitRule(rule, indices_[nt]);
+                        }
+                }
+        }
+
+        out_ << "        }\n"
+                "}\n";
+}
+
+//--------------------------------------
+/*
+ * the slots of a rule as consecutive cases, each falling through to the
+ * next once its component has matched
+ */
+void
+Generator::emitRule(
+        const Rule                        &rule,
+        CompiledGrammar::NonTerminalIndex  nt
+)
+{
+        out_ << "\n"
+                "        // " << rule.nonTerminal()->name() << '.'
+                             << rule.index() << '\n';
+
+        for (const Component &comp: rule) {
+                CompiledGrammar::Slot s = slots_[&comp];
+
+                out_ << "        case " << s << ":\n";
+
+                if (comp.predicate() && !comp.isOptional()) {
+                        out_ << "                if (!engine.test(" << s
+                             << ", pos)) {\n"
+                                "                        return;\n"
+                                "                }\n";
+                }
+
+                bool next = true;
+
+                if (comp.isTerminal()) {
+                        emitTerminal(comp, s);
+                } else {
+                        next = emitNonTerminal(comp, s);
+                }
+
+                if (next) {
+                        out_ << "                // fall through\n";
+                }
+        }
+
+        out_ << "        case " << slots_[&*rule.end()] << ":\n"
+                "                if (engine.endRule("
+             << slots_[&*rule.end()] << ", left, pos)) {\n"
+                "                        engine.ret(" << nt
+             << ", left, pos);\n"
+                "                }\n"
+                "                return;\n";
+}
+
+//--------------------------------------
+
+void
+Generator::emitTerminal(
+        const Component       &comp,
+        CompiledGrammar::Slot  s
+)
+{
+        TokenKind kind = comp.getAsTerminal();
+
+        if (kind == TOK_NULL) {  // any token
+                out_ << "                engine.addBSR(" << s
+                     << ", left, pos, pos + 1, false);\n"
+                        "                ++pos;\n";
+                return;
+        }
+
+        out_ << "                if (engine.kind(pos) == " << kind << ") {";
+        if (lexer_) {
+                out_ << "  // " << kindName(kind);
+        }
+        out_ << "\n"
+                "                        engine.addBSR(" << s
+             << ", left, pos, pos + 1, false);\n"
+                "                        ++pos;\n";
+
+        if (comp.isOptional()) {
+                out_ << "                } else {\n"
+                        "                        engine.addBSR(" << s
+                     << ", left, pos, pos, true);\n"
+                        "                }\n";
+        } else {
+                out_ << "                } else {\n"
+                        "                        engine.expect(pos, " << kind
+                     << ");\n"
+                        "                        return;\n"
+                        "                }\n";
+        }
+}
+
+//--------------------------------------
+/*
+ * calls the nonterminal, first testing the input against its FIRST set
+ * where that is conclusive; returns true if the code continues with the
+ * next slot
+ */
+bool
+Generator::emitNonTerminal(
+        const Component       &comp,
+        CompiledGrammar::Slot  s
+)
+{
+        const NonTerminal &called    = *comp.getAsNonTerminal();
+        auto              &terminals = called.firstSet();
+        bool               skip      = comp.isOptional()
+                                       && !called.matchesEmpty();
+
+        out_ << "                // " << called.name() << '\n';
+
+        if (terminals.empty() || called.matchesEmpty()
+                              || called.matchesAnyToken()) {
+                out_ << "                engine.call(" << s
+                     << ", left, pos);\n";
+        } else {
+                out_ << "                switch (engine.kind(pos)) {\n";
+                for (const auto &entry: terminals) {
+                        emitCase(entry.first, 16);
+                }
+                out_ << "                        engine.call(" << s
+                     << ", left, pos);\n"
+                        "                        break;\n";
+                if (!skip) {
+                        out_ << "                default:\n"
+                                "                        engine.expectFirst("
+                             << indices_[&called] << ", pos);\n"
+                                "                        break;\n";
+                }
+                out_ << "                }\n";
+        }
+
+        if (skip) {  // also attempt path omitting optional nonterminal
+                out_ << "                engine.addBSR(" << s
+                     << ", left, pos, pos, true);\n";
+        } else {
+                out_ << "                return;\n";
+        }
+
+        return skip;
+}
+
+//--------------------------------------
+
+WRPARSE_API bool
+generateParser(
+        std::ostream      &out,
+        const NonTerminal &start,
+        const char        *class_name,
+        const Lexer       *lexer
+)
+{
+        NonTerminals nonterminals = reachableNonTerminals(start);
+
+        if (!compilable(nonterminals)) {
+                return false;
+        }
+
+        Generator(out, nonterminals, class_name, lexer).generate();
+        return !out.fail();
+}
+
+
+} // namespace parse
+} // namespace wr
@@ -22,6 +22,9 @@
  *
  * \endparblock
  */
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
 #include <wrparse/Config.h>
 #include <wrutil/CityHash.h>
 #include <wrutil/numeric_cast.h>
@@ -42,7 +45,9 @@ Component::Component() :
         predicate_  (nullptr),
         rule_       (nullptr),
         is_terminal_(true),
-        is_optional_(false)
+        is_optional_(false),
+        is_commit_  (false),
+        is_pure_    (false)
 {
 }
 
@@ -58,7 +63,9 @@ Component::Component(
         predicate_  (predicate),
         rule_       (nullptr),
         is_terminal_(true),
-        is_optional_(is_optional)
+        is_optional_(is_optional),
+        is_commit_  (false),
+        is_pure_    (false)
 {
 }
 
@@ -74,7 +81,9 @@ Component::Component(
         predicate_  (predicate),
         rule_       (nullptr),
         is_terminal_(false),
-        is_optional_(is_optional)
+        is_optional_(is_optional),
+        is_commit_  (false),
+        is_pure_    (false)
 {
 }
 
@@ -88,7 +97,9 @@ Component::Component(
         predicate_  (predicate),
         rule_       (nullptr),
         is_terminal_(true),
-        is_optional_(false)
+        is_optional_(false),
+        is_commit_  (false),
+        is_pure_    (false)
 {
 }
 
@@ -176,6 +187,14 @@ Component::dump(
 {
         const char *sep = "", *suffix = "";
 
+        if (is_commit_) {
+                to << "commit(";
+        }
+
+        if (is_pure_) {
+                to << "pure(";
+        }
+
         if (is_optional_) {
                 to << "opt(";
                 suffix = ")";
@@ -197,6 +216,14 @@ Component::dump(
         }
 
         to << suffix;
+
+        if (is_pure_) {
+                to << ')';
+        }
+
+        if (is_commit_) {
+                to << ')';
+        }
 }
 
 //--------------------------------------
@@ -372,6 +399,36 @@ Rule::mustHide() const
                    || (isDelegate() && nonterminal_->hideIfDelegate()));
 }
 
+//--------------------------------------
+/**
+ * \brief Determine whether this rule may be bypassed during parsing
+ *
+ * A rule that merely delegates to another nonterminal and whose own node
+ * would be hidden from the parse result (see mustHide()) need not be
+ * parsed as such; the parser may begin the nonterminal it delegates to in
+ * its place. Other rules of a \c TRANSPARENT nonterminal are hidden too,
+ * but are never bypassed, having no single nonterminal to begin instead.
+ *
+ * \return the nonterminal delegated to, or \c nullptr if this rule cannot
+ *         be bypassed
+ */
+WRPARSE_API const NonTerminal *
+Rule::inlineTarget() const
+{
+        if (!isDelegate() || !mustHide()) {
+                return nullptr;
+        }
+
+        const Component &comp = front();
+
+        if (comp.isOptional() || comp.predicate() || comp.isCommitPoint()
+                        || (comp.getAsNonTerminal() == nonterminal_)) {
+                return nullptr;
+        }
+
+        return comp.getAsNonTerminal();
+}
+
 //--------------------------------------
 
 WRPARSE_API bool
@@ -439,6 +496,7 @@ Rule::gdb(
 WRPARSE_API
 NonTerminal::NonTerminal() :
         name_ (""),
+        cost_ (nullptr),
         flags_(0)
 {
 }
@@ -475,12 +533,15 @@ NonTerminal::NonTerminal(
         Flags              flags
 ) :
         name_            (name),
+        cost_            (nullptr),
         got_first_set_   (false),
         is_ll1_          (false), // until proven otherwise
         matches_empty_   (false), // ditto
         is_transparent_  ((flags & TRANSPARENT) != 0),
         hide_if_delegate_((flags & HIDE_IF_DELEGATE) != 0),
-        keep_recursion_  ((flags & KEEP_RECURSION) != 0)
+        keep_recursion_  ((flags & KEEP_RECURSION) != 0),
+        ordered_choice_  ((flags & ORDERED_CHOICE) != 0),
+        got_shared_prefixes_(false)
 {
         if (enable) {
                 base_t::operator=(std::move(rules));
@@ -500,8 +561,10 @@ NonTerminal::operator=(
                 base_t::operator=(other);
                 initRules();
                 first_ = other.first_;
+                any_rules_ = other.any_rules_;
+                shared_prefixes_ = other.shared_prefixes_;
                 flags_ = other.flags_;
-                // don't copy actions
+                // don't copy actions or cost function
         }
 
         return *this;
@@ -520,9 +583,12 @@ NonTerminal::operator=(
                 base_t::operator=(std::move(other));
                 initRules();
                 first_ = std::move(other.first_);
+                any_rules_ = std::move(other.any_rules_);
+                shared_prefixes_ = std::move(other.shared_prefixes_);
                 flags_ = other.flags_;
                 pre_parse_actions_ = std::move(other.pre_parse_actions_);
                 post_parse_actions_ = std::move(other.post_parse_actions_);
+                cost_ = other.cost_;
         }
 
         return *this;
@@ -540,7 +606,9 @@ NonTerminal::operator+=(
                        other.base_t::end());
         initRules(i);
         first_.clear();
+        any_rules_.clear();
         got_first_set_ = false;
+        got_shared_prefixes_ = false;
         return *this;
 }
 
@@ -558,7 +626,9 @@ NonTerminal::operator+=(
                 }
         }
         first_.clear();
+        any_rules_.clear();
         got_first_set_ = false;
+        got_shared_prefixes_ = false;
         return *this;
 }
 
@@ -603,14 +673,13 @@ NonTerminal::indexOf(
 //--------------------------------------
 
 WRPARSE_API auto
-NonTerminal::firstSet() const -> const FirstSet &
+NonTerminal::sharedPrefixes() const -> const SharedPrefixes &
 {
-        if (!got_first_set_) {
-                std::set<const this_t *> visited;
-                initFirstAndLL1(visited);
+        if (!got_shared_prefixes_) {
+                initSharedPrefixes();
         }
 
-        return first_;
+        return shared_prefixes_;
 }
 
 //--------------------------------------
@@ -625,134 +694,497 @@ NonTerminal::initRules(
         }
 }
 
+//--------------------------------------
+/*
+ * computes FIRST sets and nullability for every nonterminal reachable from
+ * the one queried that has not yet been analysed. Nonterminals are grouped
+ * into strongly-connected components (by Tarjan's algorithm, made iterative
+ * so that deeply nested grammars cannot exhaust the stack) which are solved
+ * dependencies first, each by iterating to a fixed point; left recursion,
+ * whether direct or indirect, therefore needs no special treatment. A
+ * TOK_NULL terminal (e.g. a lone predicate) matches any token and is
+ * recorded as such rather than leaving the FIRST set undetermined.
+ */
+class NonTerminal::Analysis
+{
+public:
+        void run(const NonTerminal &root);
+
+private:
+        enum : size_t { UNVISITED = std::numeric_limits<size_t>::max() };
+
+        using Tokens = std::vector<TokenKind>;
+        using Ids = std::vector<size_t>;
+
+        struct Node
+        {
+                const NonTerminal *nonterminal_;
+                Ids                successors_;  // unanalysed nonterminals used
+                Ids                dependents_;  // users in the same component
+                Tokens             first_;       // sorted
+                size_t             index_,       // Tarjan's algorithm
+                                   low_link_;    // ditto
+                bool               on_stack_,
+                                   queued_,
+                                   nullable_,
+                                   any_;
+        };
+
+        size_t node(const NonTerminal &nonterminal);
+        void visit(size_t id);
+        void solve(const Ids &component);
+        bool update(size_t id);
+        bool scan(const Rule &rule, Tokens &first, bool &any) const;
+        void finish(size_t id);
+
+        std::vector<Node>                              nodes_;
+        std::unordered_map<const NonTerminal *, size_t> ids_;
+        Ids                                            stack_;
+        size_t                                         counter_ = 0;
+        Tokens                                         scratch_;
+};
+
+//--------------------------------------
+
+void
+NonTerminal::Analysis::run(
+        const NonTerminal &root
+)
+{
+        struct Call
+        {
+                size_t node_;
+                size_t next_;  // index into node_'s successors
+        };
+
+        std::vector<Call> calls;
+        Ids               component;
+
+        visit(node(root));
+        calls.push_back({ 0, 0 });
+
+        while (!calls.empty()) {
+                size_t v = calls.back().node_;
+
+                if (calls.back().next_ < nodes_[v].successors_.size()) {
+                        size_t w = nodes_[v].successors_[calls.back().next_++];
+
+                        if (nodes_[w].index_ == UNVISITED) {
+                                visit(w);
+                                calls.push_back({ w, 0 });
+                        } else if (nodes_[w].on_stack_) {
+                                nodes_[v].low_link_ = std::min(
+                                        nodes_[v].low_link_, nodes_[w].index_);
+                        }
+                        continue;
+                }
+
+                calls.pop_back();
+
+                if (!calls.empty()) {
+                        Node &parent = nodes_[calls.back().node_];
+                        parent.low_link_ = std::min(parent.low_link_,
+                                                    nodes_[v].low_link_);
+                }
+
+                if (nodes_[v].low_link_ == nodes_[v].index_) {
+                        component.clear();
+                        size_t w;
+                        do {
+                                w = stack_.back();
+                                stack_.pop_back();
+                                nodes_[w].on_stack_ = false;
+                                component.push_back(w);
+                        } while (w != v);
+
+                        solve(component);
+                }
+        }
+}
+
 //--------------------------------------
 
-auto
-NonTerminal::initFirstAndLL1(
-        std::set<const this_t *> &visited
-) const -> InitStatus
+size_t
+NonTerminal::Analysis::node(
+        const NonTerminal &nonterminal
+)
 {
-        if (visited.count(this)) {
-                return InitStatus::OK;
+        auto inserted = ids_.emplace(&nonterminal, nodes_.size());
+
+        if (inserted.second) {
+                nodes_.push_back({ &nonterminal, {}, {}, {}, UNVISITED,
+                                   UNVISITED, false, false, false, false });
         }
 
-        visited.insert(this);
-        is_ll1_ = true;          // until proven otherwise
-        matches_empty_ = false;  // ditto
+        return inserted.first->second;
+}
 
-        auto        status = InitStatus::OK;
-        RuleIndices lr_rules;  /* includes rules with 'hidden' left-recursion,
-                                  i.e. where all components preceding the
-                                  recursive one are optional or may be empty */
+//--------------------------------------
 
-        for (const Rule &rule: *this) {
+void
+NonTerminal::Analysis::visit(
+        size_t id
+)
+{
+        Ids successors;
+
+        for (const Rule &rule: *nodes_[id].nonterminal_) {
                 if (!rule.isEnabled()) {
                         continue;
                 }
+                for (const Component &comp: rule) {
+                        const NonTerminal *other = comp.getAsNonTerminal();
+                        if (other && !other->got_first_set_) {
+                                successors.push_back(node(*other));
+                        }
+                }
+        }
 
-                status = initFirstAndLL1(visited, rule);
+        std::sort(successors.begin(), successors.end());
+        successors.erase(std::unique(successors.begin(), successors.end()),
+                         successors.end());
 
-                if (status == InitStatus::IS_LR) {
-                        lr_rules.push_back(
-                                numeric_cast<size_t>(&rule - &(*this)[0]));
-                } else if (status != InitStatus::OK) {
-                        lr_rules.clear();  // don't bother processing these
-                        break;
+        Node &n = nodes_[id];  // node() may have reallocated nodes_
+        n.successors_ = std::move(successors);
+        n.index_ = n.low_link_ = counter_++;
+        n.on_stack_ = true;
+        stack_.push_back(id);
+}
+
+//--------------------------------------
+/*
+ * a nonterminal's FIRST set and nullability are recalculated whenever those
+ * of a nonterminal it uses from the same component change
+ */
+void
+NonTerminal::Analysis::solve(
+        const Ids &component
+)
+{
+        for (size_t id: component) {
+                nodes_[id].queued_ = true;  // also marks membership
+        }
+
+        for (size_t id: component) {
+                for (size_t used: nodes_[id].successors_) {
+                        if (nodes_[used].queued_) {
+                                nodes_[used].dependents_.push_back(id);
+                        }
                 }
         }
 
-        if (!lr_rules.empty()) {
-                for (auto t: first_) {
-                        auto &rules = first_[t.first];
-                        rules.insert_after(rules.last(),
-                                           lr_rules.begin(), lr_rules.end());
+        Ids work(component.rbegin(), component.rend());
+
+        while (!work.empty()) {
+                size_t id = work.back();
+                work.pop_back();
+                nodes_[id].queued_ = false;
+
+                if (update(id)) {
+                        for (size_t dependent: nodes_[id].dependents_) {
+                                if (!nodes_[dependent].queued_) {
+                                        nodes_[dependent].queued_ = true;
+                                        work.push_back(dependent);
+                                }
+                        }
                 }
         }
 
-        got_first_set_ = true;
-        return status;
+        for (size_t id: component) {
+                finish(id);
+        }
 }
 
 //--------------------------------------
 
-auto
-NonTerminal::initFirstAndLL1(
-        std::set<const this_t *> &visited,
-        const Rule               &rule
-) const -> InitStatus
+bool
+NonTerminal::Analysis::update(
+        size_t id
+)
 {
-        // assume these conditions until proven otherwise
-        bool rule_matches_empty        = true,
-             depends_on_lone_predicate = false,
-             subprod_indeterminate     = false;
+        Node &n        = nodes_[id];
+        bool  nullable = false,
+              any      = false;
+
+        scratch_.clear();
 
+        for (const Rule &rule: *n.nonterminal_) {
+                if (rule.isEnabled() && scan(rule, scratch_, any)) {
+                        nullable = true;
+                }
+        }
+
+        std::sort(scratch_.begin(), scratch_.end());
+        scratch_.erase(std::unique(scratch_.begin(), scratch_.end()),
+                       scratch_.end());
+
+        if ((nullable == n.nullable_) && (any == n.any_)
+                                      && (scratch_ == n.first_)) {
+                return false;
+        }
+
+        n.nullable_ = nullable;
+        n.any_ = any;
+        n.first_.swap(scratch_);
+        return true;
+}
+
+//--------------------------------------
+/*
+ * adds the terminals that may begin 'rule' to 'first' (unsorted), sets 'any'
+ * if any token may begin it and returns true if it may match empty
+ */
+bool
+NonTerminal::Analysis::scan(
+        const Rule &rule,
+        Tokens     &first,
+        bool       &any
+) const
+{
         for (const Component &comp: rule) {
-                const auto *other = comp.getAsNonTerminal();
+                bool skippable = comp.isOptional();
 
                 if (comp.isTerminal()) {
-                        rule_matches_empty = rule_matches_empty
-                                                && comp.isOptional();
                         TokenKind t = comp.getAsTerminal();
-
                         if (t == TOK_NULL) {
-                                if (comp.predicate()) {
-                                        depends_on_lone_predicate = true;
-                                }
+                                any = true;
                         } else {
-                                updateFirstAndLL1(t, rule);
+                                first.push_back(t);
                         }
-                } else if (other) {
-                        rule_matches_empty = rule_matches_empty
-                                                && (comp.isOptional()
-                                                    || other->matches_empty_);
-                        if (other == this) {
-                                is_ll1_ = false;
-                                return InitStatus::IS_LR;
+                } else {
+                        const NonTerminal &other = *comp.getAsNonTerminal();
+                        auto               i     = ids_.find(&other);
+
+                        if (i != ids_.end()) {
+                                const Node &o = nodes_[i->second];
+                                first.insert(first.end(), o.first_.begin(),
+                                             o.first_.end());
+                                any = any || o.any_;
+                                skippable = skippable || o.nullable_;
+                        } else {  // analysed previously
+                                for (const auto &entry: other.first_) {
+                                        if (entry.first != TOK_NULL) {
+                                                first.push_back(entry.first);
+                                        }
+                                }
+                                any = any || !other.any_rules_.empty();
+                                skippable = skippable || other.matches_empty_;
                         }
+                }
 
-                        if (!other->got_first_set_) {
-                                other->initFirstAndLL1(visited);
-                        }
+                if (!skippable) {
+                        return false;
+                }
+        }
 
-                        if (other->first_.empty()) {
-                                subprod_indeterminate = true;
-                                break;
-                        }
+        return true;
+}
 
-                        for (auto &i: other->first_) {
-                                updateFirstAndLL1(i.first, rule);
-                        }
+//--------------------------------------
+/*
+ * rules are entered in ascending order, so each list of rule indices in the
+ * FIRST set is sorted
+ */
+void
+NonTerminal::Analysis::finish(
+        size_t id
+)
+{
+        const NonTerminal &nt = *nodes_[id].nonterminal_;
+        const Tokens      &all = nodes_[id].first_;
+        size_t             enabled = 0;
+
+        nt.first_.clear();
+        nt.any_rules_.clear();
+
+        for (const Rule &rule: nt) {
+                if (!rule.isEnabled()) {
+                        continue;
                 }
 
-                if (!rule_matches_empty) {
+                bool   any = false;
+                size_t ir  = numeric_cast<size_t>(rule.index());
+
+                scratch_.clear();
+                bool nullable = scan(rule, scratch_, any);
+
+                if (any) {
+                        scratch_ = all;
+                        nt.any_rules_.push_back(ir);
+                } else {
+                        std::sort(scratch_.begin(), scratch_.end());
+                        scratch_.erase(std::unique(scratch_.begin(),
+                                                   scratch_.end()),
+                                       scratch_.end());
+                }
+
+                for (TokenKind t: scratch_) {
+                        nt.first_[t].push_back(ir);
+                }
+
+                if (nullable) {
+                        nt.first_[TOK_NULL].push_back(ir);
+                }
+
+                ++enabled;
+        }
+
+        nt.is_ll1_ = nt.any_rules_.empty() || (enabled == 1);
+
+        for (const auto &entry: nt.first_) {
+                if (entry.second.begin() != entry.second.last()) {
+                        nt.is_ll1_ = false;
                         break;
                 }
-                // otherwise the next component must be examined
         }
 
-        if (depends_on_lone_predicate || subprod_indeterminate) {
-                is_ll1_ = false;
-                first_.clear();
-                return InitStatus::INDETERMINATE;
-        } else if (rule_matches_empty) {
-                updateFirstAndLL1(TOK_NULL, rule);
-                matches_empty_ = true;
+        nt.matches_empty_ = nodes_[id].nullable_;
+        nt.got_first_set_ = true;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+NonTerminal::firstSet() const -> const FirstSet &
+{
+        if (!got_first_set_) {
+                Analysis().run(*this);
         }
 
-        return InitStatus::OK;
+        return first_;
 }
 
 //--------------------------------------
 
-void
-NonTerminal::updateFirstAndLL1(
-        TokenKind   t,
-        const Rule &rule
+WRPARSE_API const RuleIndices &
+NonTerminal::anyTokenRules() const
+{
+        if (!got_first_set_) {
+                Analysis().run(*this);
+        }
+
+        return any_rules_;
+}
+
+//--------------------------------------
+/*
+ * each follower is ranked together with its leader, which has the lower
+ * rule index and so stays ahead of it
+ */
+WRPARSE_API void
+NonTerminal::orderFirstSet(
+        const Rank &rank
 ) const
 {
-        auto &rule_indices = first_[t];
-        is_ll1_ = is_ll1_ && rule_indices.empty();
-        rule_indices.push_back(rule.index());
+        if (ordered_choice_) {
+                return;
+        }
+
+        firstSet();
+
+        std::vector<size_t>                      leader(size());
+        std::vector<uint64_t>                    group(size(), 0);
+        std::vector<std::pair<uint64_t, size_t>> keys;  // (rank, rule)
+
+        for (size_t ir = 0; ir < size(); ++ir) {
+                leader[ir] = ir;
+        }
+        for (const SharedPrefix &shared: sharedPrefixes()) {
+                leader[shared.follower_] = shared.leader_;
+        }
+
+        for (auto &entry: first_) {
+                if (entry.first == TOK_NULL) {
+                        continue;
+                }
+
+                keys.clear();
+                for (size_t ir: entry.second) {
+                        uint64_t r = rank(entry.first, ir);
+                        group[leader[ir]] = std::max(group[leader[ir]], r);
+                        keys.emplace_back(r, ir);
+                }
+
+                for (auto &key: keys) {
+                        key.first = group[leader[key.second]];
+                }
+
+                std::sort(keys.begin(), keys.end());
+
+                entry.second.clear();
+                for (const auto &key: keys) {
+                        entry.second.push_back(key.second);
+                        group[leader[key.second]] = 0;
+                }
+        }
+}
+
+//--------------------------------------
+/*
+ * each rule is paired with the first earlier rule beginning with the same
+ * component; that rule cannot itself be a follower, so no chains arise
+ */
+void
+NonTerminal::initSharedPrefixes() const
+{
+        shared_prefixes_.clear();
+        got_shared_prefixes_ = true;
+
+        if (ordered_choice_) {
+                return;
+        }
+
+        auto sharable = [](const Component &a, const Component &b) {
+                return (a == b) && (a.isOptional() == b.isOptional())
+                                && !a.predicate() && !a.isCommitPoint()
+                                && !b.isCommitPoint();
+        };
+
+        for (size_t ir = 1; ir < size(); ++ir) {
+                const Rule      &follower = (*this)[ir];
+                const Component &first    = follower.front();
+
+                if (!follower.isEnabled() || (follower.size() < 2)) {
+                        continue;
+                }
+
+                bool nullable = first.isOptional()
+                        || (first.isTerminal()
+                                ? (first.getAsTerminal() == TOK_NULL)
+                                : first.getAsNonTerminal()->matchesEmpty());
+                if (nullable) {
+                        continue;
+                }
+
+                for (size_t il = 0; il < ir; ++il) {
+                        const Rule &leader = (*this)[il];
+
+                        if (!leader.isEnabled() || (leader.size() < 2)) {
+                                continue;
+                        }
+
+                        size_t limit  = std::min(leader.size(),
+                                                 follower.size()) - 1,
+                               length = 0;
+
+                        while ((length < limit) && sharable(leader[length],
+                                                        follower[length])) {
+                                ++length;
+                        }
+
+                        if (length) {
+                                shared_prefixes_.push_back({ il, ir, length });
+                                break;
+                        }
+                }
+        }
+
+        std::sort(shared_prefixes_.begin(), shared_prefixes_.end(),
+                  [](const SharedPrefix &a, const SharedPrefix &b) {
+                          return (a.leader_ < b.leader_)
+                                  || ((a.leader_ == b.leader_)
+                                      && (a.length_ < b.length_));
+                  });
 }
 
 //--------------------------------------
@@ -771,7 +1203,9 @@ NonTerminal::dump(
                 to << '\n';
         }
 
-        if (first_.empty()) {
+        if (!any_rules_.empty()) {
+                to << "Initial terminals: any\n";
+        } else if (first_.empty()) {
                 to << "Initial terminals undetermined\n";
         } else {
                 to << "Initial terminals:\n";
@@ -827,6 +1261,31 @@ NonTerminal::invokeActions(
         return ok;
 }
 
+//--------------------------------------
+
+WRPARSE_API std::vector<const NonTerminal *>
+reachableNonTerminals(
+        const NonTerminal &start
+)
+{
+        std::vector<const NonTerminal *>        result = { &start };
+        std::unordered_set<const NonTerminal *> seen   = { &start };
+
+        for (size_t i = 0; i < result.size(); ++i) {
+                for (const Rule &rule: *result[i]) {
+                        for (const Component &comp: rule) {
+                                const NonTerminal *nt
+                                                = comp.getAsNonTerminal();
+                                if (nt && seen.insert(nt).second) {
+                                        result.push_back(nt);
+                                }
+                        }
+                }
+        }
+
+        return result;
+}
+
 
 } // namespace parse
 } // namespace wr
@@ -0,0 +1,783 @@
+/**
+ * \file GrammarImage.cxx
+ *
+ * \brief Precompiled grammars stored in binary image files
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <string.h>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#include <wrparse/Config.h>
+
+#if WR_WINDOWS
+#       include <windows.h>
+#else
+#       include <fcntl.h>
+#       include <sys/mman.h>
+#       include <sys/stat.h>
+#       include <unistd.h>
+#endif
+
+#include <wrparse/CodeGen.h>
+#include <wrparse/GrammarImage.h>
+
+
+namespace wr {
+namespace parse {
+
+
+/*
+ * Image layout: an ImageHeader followed by arrays of NonTerminalRecord,
+ * RuleRecord, ComponentRecord, EntryRecord and uint32_t (rule indices and
+ * function names), then the string table. Strings are referred to by
+ * offset into the table, whose offset 0 holds the empty string ("none").
+ */
+namespace {
+
+enum : uint32_t
+{
+        IMAGE_MAGIC      = 0x47505257,  // "WRPG" in little-endian order
+        IMAGE_VERSION    = 1,
+        IMAGE_BYTE_ORDER = 0x01020304
+};
+
+struct ImageHeader
+{
+        uint32_t magic,
+                 version,
+                 byte_order,
+                 nonterminal_count,
+                 rule_count,
+                 component_count,
+                 entry_count,
+                 index_count,
+                 string_size,
+                 reserved;
+        uint64_t fingerprint;
+};
+
+enum : uint32_t
+{
+        // NonTerminalRecord::flags_, above the NonTerminal flags
+        IMAGE_MATCHES_EMPTY = 1U << 16,
+        IMAGE_LL1           = 1U << 17,
+
+        // ComponentRecord::flags_
+        IMAGE_TERMINAL = 1U,
+        IMAGE_OPTIONAL = 1U << 1,
+        IMAGE_COMMIT   = 1U << 2,
+        IMAGE_PURE     = 1U << 3,
+
+        // RuleRecord::flags_
+        IMAGE_ENABLED  = 1U
+};
+
+struct NonTerminalRecord
+{
+        uint32_t name_,
+                 flags_,
+                 rules_,           // first RuleRecord
+                 rule_count_,
+                 entries_,         // first EntryRecord
+                 entry_count_,
+                 any_rules_,       // first index
+                 any_rule_count_,
+                 pre_actions_,     // first index (a string offset each)
+                 pre_action_count_,
+                 post_actions_,    // ditto
+                 post_action_count_,
+                 cost_;            // string offset
+};
+
+struct RuleRecord
+{
+        uint32_t components_,      // first ComponentRecord
+                 component_count_,
+                 flags_;
+};
+
+struct ComponentRecord
+{
+        uint32_t value_,           // token kind or nonterminal index
+                 flags_,
+                 predicate_;       // string offset
+};
+
+struct EntryRecord                 // FIRST set entry
+{
+        uint32_t kind_,
+                 rules_,           // first index
+                 rule_count_;
+};
+
+//--------------------------------------
+
+struct Writer
+{
+        Writer(const GrammarImage::Registry &registry) :
+                registry_(registry), strings_(1, '\0') {}
+
+        uint32_t string(const char *s);
+        uint32_t function(NonTerminal::Action fn);
+        uint32_t function(NonTerminal::CostFunction fn);
+
+        template <typename T> static void
+        put(std::ostream &out, const std::vector<T> &records)
+        {
+                out.write(reinterpret_cast<const char *>(records.data()),
+                          std::streamsize(records.size() * sizeof(T)));
+        }
+
+        const GrammarImage::Registry                &registry_;
+        std::string                                  strings_;
+        std::unordered_map<std::string, uint32_t>    string_offsets_;
+};
+
+} // anonymous namespace
+
+//--------------------------------------
+
+uint32_t
+Writer::string(
+        const char *s
+)
+{
+        if (!*s) {
+                return 0;
+        }
+
+        auto i = string_offsets_.emplace(s, uint32_t(strings_.size()));
+
+        if (i.second) {
+                strings_.append(s).push_back('\0');
+        }
+
+        return i.first->second;
+}
+
+//--------------------------------------
+
+uint32_t
+Writer::function(
+        NonTerminal::Action fn
+)
+{
+        if (!fn) {
+                return 0;
+        }
+
+        const char *name = registry_.name(fn);
+
+        if (!name) {
+                throw std::invalid_argument(
+                      "GrammarImage::write(): unregistered action or predicate");
+        }
+
+        return string(name);
+}
+
+//--------------------------------------
+
+uint32_t
+Writer::function(
+        NonTerminal::CostFunction fn
+)
+{
+        if (!fn) {
+                return 0;
+        }
+
+        const char *name = registry_.name(fn);
+
+        if (!name) {
+                throw std::invalid_argument(
+                      "GrammarImage::write(): unregistered cost function");
+        }
+
+        return string(name);
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+GrammarImage::Registry::add(
+        const char          *name,
+        NonTerminal::Action  fn
+) -> Registry &
+{
+        actions_[name] = fn;
+        action_names_[fn] = name;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+GrammarImage::Registry::add(
+        const char                *name,
+        NonTerminal::CostFunction  fn
+) -> Registry &
+{
+        costs_[name] = fn;
+        cost_names_[fn] = name;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API NonTerminal::Action
+GrammarImage::Registry::action(
+        const char *name
+) const
+{
+        auto i = actions_.find(name);
+        return (i == actions_.end()) ? nullptr : i->second;
+}
+
+//--------------------------------------
+
+WRPARSE_API NonTerminal::CostFunction
+GrammarImage::Registry::costFunction(
+        const char *name
+) const
+{
+        auto i = costs_.find(name);
+        return (i == costs_.end()) ? nullptr : i->second;
+}
+
+//--------------------------------------
+
+WRPARSE_API const char *
+GrammarImage::Registry::name(
+        NonTerminal::Action fn
+) const
+{
+        auto i = action_names_.find(fn);
+        return (i == action_names_.end()) ? nullptr : i->second.c_str();
+}
+
+//--------------------------------------
+
+WRPARSE_API const char *
+GrammarImage::Registry::name(
+        NonTerminal::CostFunction fn
+) const
+{
+        auto i = cost_names_.find(fn);
+        return (i == cost_names_.end()) ? nullptr : i->second.c_str();
+}
+
+//--------------------------------------
+
+WRPARSE_API bool
+GrammarImage::write(
+        std::ostream      &out,
+        const NonTerminal &start,
+        const Registry    &registry
+)
+{
+        Writer                                         w(registry);
+        std::vector<const NonTerminal *>               order
+                                        = reachableNonTerminals(start);
+        std::unordered_map<const NonTerminal *,
+                           uint32_t>                   index;
+        std::vector<NonTerminalRecord>                 nonterminals;
+        std::vector<RuleRecord>                        rules;
+        std::vector<ComponentRecord>                   components;
+        std::vector<EntryRecord>                       entries;
+        std::vector<uint32_t>                          indices;
+
+        // same numbering as grammarFingerprint()
+        for (const NonTerminal *nt: order) {
+                index.emplace(nt, uint32_t(index.size()));
+        }
+
+        for (const NonTerminal *nt: order) {
+                NonTerminalRecord rec = {};
+
+                const NonTerminal::FirstSet &first = nt->firstSet();
+
+                rec.name_ = w.string(nt->name());
+                rec.flags_ = (nt->isTransparent() ? NonTerminal::TRANSPARENT
+                                                  : 0)
+                             | (nt->hideIfDelegate() ?
+                                        NonTerminal::HIDE_IF_DELEGATE : 0)
+                             | (nt->keepRecursion() ?
+                                        NonTerminal::KEEP_RECURSION : 0)
+                             | (nt->isOrderedChoice() ?
+                                        NonTerminal::ORDERED_CHOICE : 0)
+                             | (nt->matchesEmpty() ? IMAGE_MATCHES_EMPTY : 0U)
+                             | (nt->isLL1() ? IMAGE_LL1 : 0U);
+                rec.rules_ = uint32_t(rules.size());
+                rec.rule_count_ = uint32_t(nt->size());
+
+                for (const Rule &rule: *nt) {
+                        rules.push_back({ uint32_t(components.size()),
+                                          uint32_t(rule.size()),
+                                          rule.isEnabled() ? IMAGE_ENABLED
+                                                           : 0U });
+
+                        for (const Component &comp: rule) {
+                                ComponentRecord c = {};
+
+                                if (comp.isTerminal()) {
+                                        c.value_ = comp.getAsTerminal();
+                                        c.flags_ = IMAGE_TERMINAL;
+                                } else {
+                                        c.value_ = index[
+                                                comp.getAsNonTerminal()];
+                                }
+                                c.flags_ |= (comp.isOptional() ?
+                                                        IMAGE_OPTIONAL : 0U)
+                                            | (comp.isCommitPoint() ?
+                                                        IMAGE_COMMIT : 0U)
+                                            | (comp.isPure() ?
+                                                        IMAGE_PURE : 0U);
+                                c.predicate_ = w.function(comp.predicate());
+                                components.push_back(c);
+                        }
+                }
+
+                rec.entries_ = uint32_t(entries.size());
+                for (const auto &entry: first) {
+                        EntryRecord e = { entry.first,
+                                          uint32_t(indices.size()), 0 };
+
+                        for (size_t ir: entry.second) {
+                                indices.push_back(uint32_t(ir));
+                                ++e.rule_count_;
+                        }
+                        entries.push_back(e);
+                }
+                rec.entry_count_ = uint32_t(entries.size() - rec.entries_);
+
+                rec.any_rules_ = uint32_t(indices.size());
+                for (size_t ir: nt->anyTokenRules()) {
+                        indices.push_back(uint32_t(ir));
+                }
+                rec.any_rule_count_ = uint32_t(indices.size()
+                                               - rec.any_rules_);
+
+                rec.pre_actions_ = uint32_t(indices.size());
+                for (NonTerminal::Action action: nt->pre_parse_actions_) {
+                        indices.push_back(w.function(action));
+                }
+                rec.pre_action_count_ = uint32_t(indices.size()
+                                                 - rec.pre_actions_);
+
+                rec.post_actions_ = uint32_t(indices.size());
+                for (NonTerminal::Action action: nt->post_parse_actions_) {
+                        indices.push_back(w.function(action));
+                }
+                rec.post_action_count_ = uint32_t(indices.size()
+                                                  - rec.post_actions_);
+
+                rec.cost_ = w.function(nt->costFunction());
+                nonterminals.push_back(rec);
+        }
+
+        ImageHeader header = {};
+
+        header.magic = IMAGE_MAGIC;
+        header.version = IMAGE_VERSION;
+        header.byte_order = IMAGE_BYTE_ORDER;
+        header.nonterminal_count = uint32_t(nonterminals.size());
+        header.rule_count = uint32_t(rules.size());
+        header.component_count = uint32_t(components.size());
+        header.entry_count = uint32_t(entries.size());
+        header.index_count = uint32_t(indices.size());
+        header.string_size = uint32_t(w.strings_.size());
+        header.fingerprint = grammarFingerprint(start);
+
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        Writer::put(out, nonterminals);
+        Writer::put(out, rules);
+        Writer::put(out, components);
+        Writer::put(out, entries);
+        Writer::put(out, indices);
+        out.write(w.strings_.data(), std::streamsize(w.strings_.size()));
+
+        return !out.fail();
+}
+
+//--------------------------------------
+
+WRPARSE_API
+GrammarImage::GrammarImage(
+        const char     *path,
+        const Registry &registry
+) :
+        image_      (nullptr),
+        image_size_ (0),
+        mapping_    (nullptr),
+        size_       (0),
+        fingerprint_(0)
+{
+#if WR_WINDOWS
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+
+        if ((file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file, &size)) {
+                if (file != INVALID_HANDLE_VALUE) {
+                        CloseHandle(file);
+                }
+                throw std::runtime_error(std::string(
+                                "GrammarImage: cannot open ") + path);
+        }
+
+        HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0,
+                                        nullptr);
+        CloseHandle(file);
+
+        if (map) {
+                mapping_ = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(map);
+        }
+        image_size_ = size_t(size.QuadPart);
+#else
+        int         fd = open(path, O_RDONLY);
+        struct stat st;
+
+        if ((fd < 0) || (fstat(fd, &st) != 0)) {
+                if (fd >= 0) {
+                        close(fd);
+                }
+                throw std::runtime_error(std::string(
+                                "GrammarImage: cannot open ") + path);
+        }
+
+        image_size_ = size_t(st.st_size);
+        mapping_ = mmap(nullptr, image_size_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (mapping_ == MAP_FAILED) {
+                mapping_ = nullptr;
+        }
+#endif
+        if (!mapping_) {
+                throw std::runtime_error(std::string(
+                                "GrammarImage: cannot map ") + path);
+        }
+
+        image_ = static_cast<const char *>(mapping_);
+
+        try {
+                load(registry);
+        } catch (...) {
+                unmap();
+                throw;
+        }
+}
+
+//--------------------------------------
+
+WRPARSE_API
+GrammarImage::GrammarImage(
+        const void     *data,
+        size_t          size,
+        const Registry &registry
+) :
+        image_      (static_cast<const char *>(data)),
+        image_size_ (size),
+        mapping_    (nullptr),
+        size_       (0),
+        fingerprint_(0)
+{
+        load(registry);
+}
+
+//--------------------------------------
+
+WRPARSE_API
+GrammarImage::~GrammarImage()
+{
+        nonterminals_.reset();  // before the names they refer to
+        unmap();
+}
+
+//--------------------------------------
+
+void
+GrammarImage::unmap()
+{
+        if (mapping_) {
+#if WR_WINDOWS
+                UnmapViewOfFile(mapping_);
+#else
+                munmap(mapping_, image_size_);
+#endif
+                mapping_ = nullptr;
+        }
+}
+
+//--------------------------------------
+
+WRPARSE_API const NonTerminal *
+GrammarImage::find(
+        const char *name
+) const
+{
+        for (size_t i = 0; i < size_; ++i) {
+                if (strcmp(nonterminals_[i].name(), name) == 0) {
+                        return &nonterminals_[i];
+                }
+        }
+
+        return nullptr;
+}
+
+//--------------------------------------
+/*
+ * rebuilds the nonterminals, checking every offset and index against the
+ * image bounds so that a damaged file is reported rather than followed
+ */
+void
+GrammarImage::load(
+        const Registry &registry
+)
+{
+        static const char corrupt[] = "GrammarImage: invalid image";
+
+        ImageHeader header;
+
+        if (image_size_ < sizeof(header)) {
+                throw std::runtime_error(corrupt);
+        }
+        memcpy(&header, image_, sizeof(header));
+
+        if ((header.magic != IMAGE_MAGIC)
+            || (header.version != IMAGE_VERSION)
+            || (header.byte_order != IMAGE_BYTE_ORDER)
+            || (header.nonterminal_count == 0)
+            || (header.string_size == 0)) {
+                throw std::runtime_error(corrupt);
+        }
+
+        const uint64_t expected_size = sizeof(header)
+                + uint64_t(header.nonterminal_count)
+                                * sizeof(NonTerminalRecord)
+                + uint64_t(header.rule_count) * sizeof(RuleRecord)
+                + uint64_t(header.component_count) * sizeof(ComponentRecord)
+                + uint64_t(header.entry_count) * sizeof(EntryRecord)
+                + uint64_t(header.index_count) * sizeof(uint32_t)
+                + header.string_size;
+
+        if (expected_size != image_size_) {
+                throw std::runtime_error(corrupt);
+        }
+
+        /* records are 4-byte aligned in the image, which is itself at
+           least 4-byte aligned when mapped or supplied by the caller */
+        auto nt_recs = reinterpret_cast<const NonTerminalRecord *>(
+                                                image_ + sizeof(header));
+        auto rule_recs = reinterpret_cast<const RuleRecord *>(
+                                        nt_recs + header.nonterminal_count);
+        auto comp_recs = reinterpret_cast<const ComponentRecord *>(
+                                        rule_recs + header.rule_count);
+        auto entry_recs = reinterpret_cast<const EntryRecord *>(
+                                        comp_recs + header.component_count);
+        auto indices = reinterpret_cast<const uint32_t *>(
+                                        entry_recs + header.entry_count);
+        auto strings = reinterpret_cast<const char *>(
+                                        indices + header.index_count);
+
+        if (strings[header.string_size - 1] != '\0') {
+                throw std::runtime_error(corrupt);
+        }
+
+        auto in_range = [](uint32_t first, uint32_t count, uint32_t limit) {
+                return (first <= limit) && (count <= limit - first);
+        };
+
+        auto function_name = [&](uint32_t offset) -> const char * {
+                if (offset >= header.string_size) {
+                        throw std::runtime_error(corrupt);
+                }
+                return strings + offset;
+        };
+
+        auto action = [&](uint32_t offset) {
+                const char          *name = function_name(offset);
+                NonTerminal::Action  fn   = registry.action(name);
+
+                if (!fn) {
+                        throw std::runtime_error(std::string(
+                                "GrammarImage: unregistered action or "
+                                "predicate ") + name);
+                }
+                return fn;
+        };
+
+        size_ = header.nonterminal_count;
+        nonterminals_.reset(new NonTerminal[size_]);
+
+        for (size_t i = 0; i < size_; ++i) {
+                const NonTerminalRecord &rec = nt_recs[i];
+                Rules                    rules;
+
+                if (!in_range(rec.rules_, rec.rule_count_,
+                              header.rule_count)
+                    || !in_range(rec.entries_, rec.entry_count_,
+                                 header.entry_count)
+                    || !in_range(rec.any_rules_, rec.any_rule_count_,
+                                 header.index_count)
+                    || !in_range(rec.pre_actions_, rec.pre_action_count_,
+                                 header.index_count)
+                    || !in_range(rec.post_actions_, rec.post_action_count_,
+                                 header.index_count)) {
+                        throw std::runtime_error(corrupt);
+                }
+
+                rules.reserve(rec.rule_count_);
+
+                for (uint32_t r = 0; r < rec.rule_count_; ++r) {
+                        const RuleRecord &rule_rec = rule_recs[rec.rules_
+                                                               + r];
+
+                        if (!in_range(rule_rec.components_,
+                                      rule_rec.component_count_,
+                                      header.component_count)) {
+                                throw std::runtime_error(corrupt);
+                        }
+
+                        rules.emplace_back(std::initializer_list<Component>(),
+                                        (rule_rec.flags_ & IMAGE_ENABLED) != 0);
+                        Rule &rule = rules.back();
+
+                        rule.base_t::reserve(rule_rec.component_count_ + 1);
+
+                        for (uint32_t c = 0; c < rule_rec.component_count_;
+                                                                        ++c) {
+                                const ComponentRecord &comp_rec
+                                        = comp_recs[rule_rec.components_ + c];
+                                bool optional = (comp_rec.flags_
+                                                 & IMAGE_OPTIONAL) != 0;
+                                Component::Predicate predicate = nullptr;
+
+                                if (comp_rec.predicate_) {
+                                        predicate = action(
+                                                        comp_rec.predicate_);
+                                }
+
+                                if (comp_rec.flags_ & IMAGE_TERMINAL) {
+                                        if (comp_rec.value_ > UINT16_MAX) {
+                                                throw std::runtime_error(
+                                                                corrupt);
+                                        }
+                                        rule.base_t::insert(rule.end() - 1,
+                                                Component(TokenKind(
+                                                        comp_rec.value_),
+                                                        optional, predicate));
+                                } else {
+                                        if (comp_rec.value_ >= size_) {
+                                                throw std::runtime_error(
+                                                                corrupt);
+                                        }
+                                        rule.base_t::insert(rule.end() - 1,
+                                                Component(nonterminals_[
+                                                        comp_rec.value_],
+                                                        optional, predicate));
+                                }
+
+                                Component &comp = *(rule.end() - 2);
+                                comp.setCommitPoint((comp_rec.flags_
+                                                     & IMAGE_COMMIT) != 0);
+                                comp.setPure((comp_rec.flags_
+                                              & IMAGE_PURE) != 0);
+                        }
+                        rule.updateComponents();
+                }
+
+                NonTerminal &nt = nonterminals_[i];
+
+                nt = NonTerminal(function_name(rec.name_), std::move(rules),
+                                 rec.flags_ & 0xffff);
+
+                /* analysis results, exactly as written; rule indices
+                   within each list are left as recorded so that any
+                   ordering by NonTerminal::orderFirstSet() survives */
+                for (uint32_t e = 0; e < rec.entry_count_; ++e) {
+                        const EntryRecord &entry = entry_recs[rec.entries_
+                                                              + e];
+                        if ((entry.kind_ > UINT16_MAX)
+                            || !in_range(entry.rules_, entry.rule_count_,
+                                         header.index_count)) {
+                                throw std::runtime_error(corrupt);
+                        }
+
+                        RuleIndices &list = nt.first_[TokenKind(entry.kind_)];
+
+                        for (uint32_t k = 0; k < entry.rule_count_; ++k) {
+                                if (indices[entry.rules_ + k]
+                                                >= rec.rule_count_) {
+                                        throw std::runtime_error(corrupt);
+                                }
+                                list.push_back(indices[entry.rules_ + k]);
+                        }
+                }
+
+                for (uint32_t k = 0; k < rec.any_rule_count_; ++k) {
+                        if (indices[rec.any_rules_ + k] >= rec.rule_count_) {
+                                throw std::runtime_error(corrupt);
+                        }
+                        nt.any_rules_.push_back(indices[rec.any_rules_ + k]);
+                }
+
+                for (uint32_t k = 0; k < rec.pre_action_count_; ++k) {
+                        nt.pre_parse_actions_.push_back(
+                                        action(indices[rec.pre_actions_ + k]));
+                }
+                for (uint32_t k = 0; k < rec.post_action_count_; ++k) {
+                        nt.post_parse_actions_.push_back(
+                                        action(indices[rec.post_actions_
+                                                       + k]));
+                }
+
+                if (rec.cost_) {
+                        const char *name = function_name(rec.cost_);
+                        auto        cost = registry.costFunction(name);
+
+                        if (!cost) {
+                                throw std::runtime_error(std::string(
+                                        "GrammarImage: unregistered cost "
+                                        "function ") + name);
+                        }
+                        nt.setCostFunction(cost);
+                }
+
+                nt.matches_empty_ = (rec.flags_ & IMAGE_MATCHES_EMPTY) != 0;
+                nt.is_ll1_ = (rec.flags_ & IMAGE_LL1) != 0;
+                nt.got_first_set_ = true;
+        }
+
+        fingerprint_ = grammarFingerprint(nonterminals_[0]);
+
+        if (fingerprint_ != header.fingerprint) {
+                throw std::runtime_error(corrupt);
+        }
+}
+
+
+} // namespace parse
+} // namespace wr
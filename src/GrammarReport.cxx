@@ -0,0 +1,527 @@
+/**
+ * \file GrammarReport.cxx
+ *
+ * \brief Static analysis of grammars for nondeterminism and parsing cost
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <stdio.h>
+#include <algorithm>
+#include <ostream>
+#include <string>
+
+#include <wrparse/GrammarReport.h>
+#include <wrparse/Lexer.h>
+
+
+namespace wr {
+namespace parse {
+
+
+namespace {
+
+/*
+ * directed graph over nonterminal indices, with the strongly connected
+ * components found by Tarjan's algorithm; components are numbered in
+ * reverse topological order (a component only reaches those numbered
+ * no higher than itself)
+ */
+struct Graph
+{
+        struct Edge
+        {
+                size_t to_;
+                bool   hidden_;  // left corner reached past a nullable prefix
+        };
+
+        Graph(size_t size) : edges_(size), scc_(size, NONE),
+                             self_loop_(size, false) {}
+
+        void add(size_t from, size_t to, bool hidden = false)
+        {
+                edges_[from].push_back({ to, hidden });
+                if (from == to) {
+                        self_loop_[from] = true;
+                }
+        }
+
+        void findComponents();
+
+        /// true if 'node' lies on a cycle
+        bool cyclic(size_t node) const
+                { return self_loop_[node] || (scc_size_[scc_[node]] > 1); }
+
+        enum : size_t { NONE = ~size_t(0) };
+
+        std::vector<std::vector<Edge>> edges_;
+        std::vector<size_t>            scc_;
+        std::vector<size_t>            scc_size_;
+        std::vector<bool>              self_loop_;
+
+private:
+        void visit(size_t root);
+        void enter(size_t node);
+
+        std::vector<size_t> low_, order_, stack_;
+        std::vector<bool>   on_stack_;
+        size_t              next_ = 0;
+};
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+Graph::findComponents()
+{
+        low_.assign(edges_.size(), 0);
+        order_.assign(edges_.size(), NONE);
+        on_stack_.assign(edges_.size(), false);
+
+        for (size_t i = 0; i < edges_.size(); ++i) {
+                if (order_[i] == NONE) {
+                        visit(i);
+                }
+        }
+}
+
+//--------------------------------------
+
+/*
+ * Tarjan's algorithm from 'root', made iterative so that deeply nested
+ * grammars cannot exhaust the stack (as NonTerminal::Analysis)
+ */
+void
+Graph::visit(
+        size_t root
+)
+{
+        struct Call
+        {
+                size_t node_;
+                size_t next_;  // index into node_'s edges
+        };
+
+        std::vector<Call> calls;
+
+        enter(root);
+        calls.push_back({ root, 0 });
+
+        while (!calls.empty()) {
+                size_t node = calls.back().node_;
+
+                if (calls.back().next_ < edges_[node].size()) {
+                        size_t to = edges_[node][calls.back().next_++].to_;
+
+                        if (order_[to] == NONE) {
+                                enter(to);
+                                calls.push_back({ to, 0 });
+                        } else if (on_stack_[to]) {
+                                low_[node] = std::min(low_[node], order_[to]);
+                        }
+                        continue;
+                }
+
+                calls.pop_back();
+
+                if (!calls.empty()) {
+                        size_t parent = calls.back().node_;
+
+                        low_[parent] = std::min(low_[parent], low_[node]);
+                }
+
+                if (low_[node] == order_[node]) {
+                        size_t id = scc_size_.size(), member;
+
+                        scc_size_.push_back(0);
+                        do {
+                                member = stack_.back();
+                                stack_.pop_back();
+                                on_stack_[member] = false;
+                                scc_[member] = id;
+                                ++scc_size_[id];
+                        } while (member != node);
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+Graph::enter(
+        size_t node
+)
+{
+        order_[node] = low_[node] = next_++;
+        stack_.push_back(node);
+        on_stack_[node] = true;
+}
+
+//--------------------------------------
+
+static bool
+skippable(
+        const Component &comp
+)
+{
+        return comp.isOptional()
+               || (comp.isNonTerminal()
+                   && comp.getAsNonTerminal()->matchesEmpty());
+}
+
+//--------------------------------------
+
+static bool
+sameComponents(
+        const Rule &a,
+        const Rule &b
+)
+{
+        if (a.size() != b.size()) {
+                return false;
+        }
+
+        for (size_t i = 0; i < a.size(); ++i) {
+                const Component &x = a[i], &y = b[i];
+
+                if ((x.isTerminal() != y.isTerminal())
+                    || (x.isOptional() != y.isOptional())
+                    || (x.predicate() != y.predicate())
+                    || (x.getAsTerminal() != y.getAsTerminal())
+                    || (x.getAsNonTerminal() != y.getAsNonTerminal())) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+//--------------------------------------
+
+WRPARSE_API
+GrammarReport::GrammarReport(
+        const NonTerminal &start
+)
+{
+        std::vector<const NonTerminal *> order = reachableNonTerminals(start);
+
+        for (const NonTerminal *nt: order) {
+                index_.emplace(nt, index_.size());
+        }
+
+        const size_t n = order.size();
+        Graph        refs(n),          // A -> B if B in a rule of A
+                     left_corner(n),   // A -> B if a rule of A may begin
+                                       // with B
+                     nullable(n);      // A -> B if A =>+ B consuming nothing
+
+        entries_.resize(n);
+
+        for (size_t a = 0; a < n; ++a) {
+                const NonTerminal &nt = *order[a];
+                Entry             &entry = entries_[a];
+
+                entry.nonterminal_ = &nt;
+                entry.ambiguity_ = 0;
+                entry.is_ll1_ = nt.isLL1();
+                entry.matches_empty_ = nt.matchesEmpty();
+                entry.left_recursive_ = false;
+                entry.hidden_left_recursive_ = false;
+
+                for (const auto &first: nt.firstSet()) {
+                        if (first.second.begin() == first.second.last()) {
+                                continue;
+                        }
+
+                        Conflict c = { first.first, {} };
+
+                        for (size_t ir: first.second) {
+                                c.rules_.push_back(ir);
+                        }
+                        std::sort(c.rules_.begin(), c.rules_.end());
+                        entry.conflicts_.push_back(std::move(c));
+
+                        if (first.first == TOK_NULL) {
+                                entry.ambiguity_ |= MULTIPLE_EMPTY_RULES;
+                        }
+                }
+
+                for (size_t ir = 0; ir < nt.size(); ++ir) {
+                        const Rule &rule = nt[ir];
+
+                        if (!rule.isEnabled()) {
+                                continue;
+                        }
+
+                        for (size_t jr = 0; jr < ir; ++jr) {
+                                if (nt[jr].isEnabled()
+                                    && sameComponents(rule, nt[jr])) {
+                                        entry.ambiguity_ |= DUPLICATE_RULES;
+                                }
+                        }
+
+                        size_t required = 0,
+                               self_at = Graph::NONE;  // in left corner
+                        bool   in_prefix = true;  // all before skippable
+
+                        for (size_t i = 0; i < rule.size(); ++i) {
+                                const Component   &comp = rule[i];
+                                const NonTerminal *other
+                                                = comp.getAsNonTerminal();
+                                size_t             b = other ? index_[other]
+                                                             : 0;
+
+                                if (other) {
+                                        refs.add(a, b);
+                                        if (in_prefix) {
+                                                left_corner.add(a, b, i > 0);
+                                                if ((b == a)
+                                                    && (self_at
+                                                        == Graph::NONE)) {
+                                                        self_at = i;
+                                                }
+                                        }
+                                }
+                                if (!skippable(comp)) {
+                                        in_prefix = false;
+                                        ++required;
+                                }
+                        }
+
+                        /* A =>+ B without input if every other component
+                           may be skipped */
+                        for (size_t i = 0; i < rule.size(); ++i) {
+                                const NonTerminal *other
+                                                = rule[i].getAsNonTerminal();
+
+                                if (other && ((required == 0)
+                                              || ((required == 1)
+                                                  && !skippable(rule[i])))) {
+                                        nullable.add(a, index_[other]);
+                                }
+                        }
+
+                        if (self_at != Graph::NONE) {
+                                for (size_t i = rule.size();
+                                     i-- > self_at + 1; ) {
+                                        if (rule[i].getAsNonTerminal()
+                                                        == &nt) {
+                                                entry.ambiguity_
+                                                        |= BINARY_RECURSION;
+                                                break;
+                                        }
+                                        if (!skippable(rule[i])) {
+                                                break;
+                                        }
+                                }
+                        }
+                }
+        }
+
+        refs.findComponents();
+        left_corner.findComponents();
+        nullable.findComponents();
+
+        for (size_t a = 0; a < n; ++a) {
+                Entry &entry = entries_[a];
+
+                entry.left_recursive_ = left_corner.cyclic(a);
+                if (nullable.cyclic(a)) {
+                        entry.ambiguity_ |= NULLABLE_CYCLE;
+                }
+        }
+
+        /* a hidden left-corner edge within a cycle makes every member of
+           that cycle's component hidden left recursive */
+        for (size_t a = 0; a < n; ++a) {
+                for (const Graph::Edge &e: left_corner.edges_[a]) {
+                        if (!e.hidden_
+                            || (left_corner.scc_[e.to_]
+                                != left_corner.scc_[a])) {
+                                continue;
+                        }
+                        for (size_t b = 0; b < n; ++b) {
+                                if (left_corner.scc_[b]
+                                                == left_corner.scc_[a]) {
+                                        entries_[b].hidden_left_recursive_
+                                                = true;
+                                }
+                        }
+                }
+        }
+
+        /* complexity is the worst over everything reachable; components
+           are numbered so that successors are complete before use */
+        std::vector<Complexity> worst(refs.scc_size_.size(), LINEAR);
+
+        for (size_t a = 0; a < n; ++a) {
+                const Entry &entry = entries_[a];
+                Complexity   own = entry.ambiguity_ ? CUBIC
+                                   : !entry.is_ll1_ ? QUADRATIC : LINEAR;
+                Complexity  &w = worst[refs.scc_[a]];
+
+                w = std::max(w, own);
+        }
+
+        std::vector<std::vector<size_t>> members(refs.scc_size_.size());
+
+        for (size_t a = 0; a < n; ++a) {
+                members[refs.scc_[a]].push_back(a);
+        }
+
+        for (size_t id = 0; id < members.size(); ++id) {
+                for (size_t a: members[id]) {
+                        for (const Graph::Edge &e: refs.edges_[a]) {
+                                worst[id] = std::max(worst[id],
+                                                     worst[refs.scc_[e.to_]]);
+                        }
+                }
+                for (size_t a: members[id]) {
+                        entries_[a].complexity_ = worst[id];
+                }
+        }
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+GrammarReport::find(
+        const NonTerminal &nt
+) const -> const Entry *
+{
+        auto i = index_.find(&nt);
+        return (i == index_.end()) ? nullptr : &entries_[i->second];
+}
+
+//--------------------------------------
+
+WRPARSE_API const char *
+GrammarReport::complexityName(
+        Complexity complexity
+)
+{
+        switch (complexity) {
+        case LINEAR:    return "linear";
+        case QUADRATIC: return "quadratic";
+        case CUBIC:     return "cubic";
+        }
+        return "";
+}
+
+//--------------------------------------
+
+static void
+writeString(
+        std::ostream &out,
+        const char   *s
+)
+{
+        out << '"';
+        for (; *s; ++s) {
+                unsigned char c = static_cast<unsigned char>(*s);
+
+                if ((c == '"') || (c == '\\')) {
+                        out << '\\' << *s;
+                } else if (c < 0x20) {
+                        char buf[8];
+                        snprintf(buf, sizeof(buf), "\\u%04x", c);
+                        out << buf;
+                } else {
+                        out << *s;
+                }
+        }
+        out << '"';
+}
+
+//--------------------------------------
+
+WRPARSE_API bool
+GrammarReport::writeJSON(
+        std::ostream &out,
+        const Lexer  *lexer
+) const
+{
+        static const struct { unsigned flag; const char *name; } reasons[] = {
+                { MULTIPLE_EMPTY_RULES, "multiple_empty_rules" },
+                { DUPLICATE_RULES,      "duplicate_rules" },
+                { BINARY_RECURSION,     "binary_recursion" },
+                { NULLABLE_CYCLE,       "nullable_cycle" }
+        };
+
+        out << "{\n  \"nonterminals\": [";
+
+        const char *sep = "\n";
+
+        for (const Entry &entry: entries_) {
+                out << sep << "    {\n      \"name\": ";
+                writeString(out, entry.nonterminal_->name());
+                out << ",\n      \"ll1\": "
+                    << (entry.is_ll1_ ? "true" : "false")
+                    << ",\n      \"conflicts\": [";
+
+                const char *sep2 = "";
+
+                for (const Conflict &c: entry.conflicts_) {
+                        out << sep2 << "{\"token\": ";
+                        if (c.token_ == TOK_NULL) {
+                                out << "null";
+                        } else if (lexer) {
+                                writeString(out,
+                                            lexer->tokenKindName(c.token_));
+                        } else {
+                                out << c.token_;
+                        }
+                        out << ", \"rules\": [";
+                        for (size_t i = 0; i < c.rules_.size(); ++i) {
+                                out << (i ? ", " : "") << c.rules_[i];
+                        }
+                        out << "]}";
+                        sep2 = ", ";
+                }
+
+                out << "],\n      \"matches_empty\": "
+                    << (entry.matches_empty_ ? "true" : "false")
+                    << ",\n      \"left_recursive\": "
+                    << (entry.left_recursive_ ? "true" : "false")
+                    << ",\n      \"hidden_left_recursive\": "
+                    << (entry.hidden_left_recursive_ ? "true" : "false")
+                    << ",\n      \"ambiguity\": [";
+
+                sep2 = "";
+                for (const auto &reason: reasons) {
+                        if (entry.ambiguity_ & reason.flag) {
+                                out << sep2 << '"' << reason.name << '"';
+                                sep2 = ", ";
+                        }
+                }
+
+                out << "],\n      \"complexity\": \""
+                    << complexityName(entry.complexity_) << "\"\n    }";
+                sep = ",\n";
+        }
+
+        out << "\n  ]\n}\n";
+
+        return !out.fail();
+}
+
+
+} // namespace parse
+} // namespace wr
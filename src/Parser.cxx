@@ -22,12 +22,14 @@
  *
  * \endparblock
  */
+#include <algorithm>
 #include <assert.h>
 #include <fstream>
 #include <iomanip>
 #include <limits>
 #include <set>
 #include <stdexcept>
+#include <stdint.h>
 #include <vector>
 #include <unordered_map>
 #include <wrutil/circ_fwd_list.h>
@@ -38,6 +40,8 @@
 
 #include <wrparse/Lexer.h>
 #include <wrparse/Parser.h>
+#include <wrparse/Profile.h>
+#include <wrparse/Replay.h>
 
 
 using namespace std;
@@ -48,6 +52,8 @@ namespace parse {
 
 
 enum { DEBUG_INDENT = 4 };
+enum { COMMIT_INTERVAL = 256 };  // main loop iterations between commit checks
+enum { MAX_INLINE_DEPTH = 16 };  // limit for delegate chains (may be cyclic)
 
 /**
  * \brief reference to a specific point in a grammar
@@ -64,137 +70,260 @@ bool operator==(GrammarAddress addr, Rule::const_iterator i)
 bool operator!=(GrammarAddress addr, Rule::const_iterator i)
         { return addr != &*i; }
 
+/**
+ * \brief dense 32-bit reference to a per-parse entity
+ *
+ * Input positions, grammar slots, GSS nodes and SPPF nodes are referred to
+ * during a parse by their index into per-parse tables held by Parser::GLL
+ * rather than by pointer. Index 0 is reserved in each table: it denotes the
+ * first input token, L0, the bottom-of-stack GSS node (u0) and 'no SPPF node'
+ * respectively.
+ */
+using Handle = uint32_t;
+using HandleSet = std::unordered_set<Handle>;
+
+//--------------------------------------
+/*
+ * cheap mixing function for keys made up of handles; the full CityHash
+ * function is unnecessary since handles are small, dense integers
+ */
+static inline size_t
+mixHandles(
+        uint64_t a,
+        uint64_t b
+)
+{
+        uint64_t h = (a * UINT64_C(0x9e3779b97f4a7c15)) ^ b;
+        h ^= h >> 29;
+        h *= UINT64_C(0xbf58476d1ce4e5b9);
+        h ^= h >> 32;
+        return static_cast<size_t>(h);
+}
+
 //--------------------------------------
 
 class Parser::GSS
 {
 public:
-        struct Edge;
-
-        class Node
+        struct Edge
         {
-        public:
-                using this_t = Node;
+                Handle child_;      // GSS node
+                Handle sppf_node_;
+        };
 
-                Node() : input_pos_(nullptr) {}
-                Node(const this_t &other) = delete;
-                Node(this_t &&other) = default;
+        struct Popped
+        {
+                Handle parsed_node_;  // z in GLL paper
+                Handle input_pos_;    // input position following z
+                Handle symbols_;      // symbol table following z
+        };
 
-                Node(GrammarAddress return_address, Token *input_pos) :
-                        return_addr_(return_address), input_pos_(input_pos) {}
+        struct Node
+        {
+                Handle              return_addr_;  // grammar slot
+                Handle              input_pos_;
+                unsigned short      depth_;        // for debug output only
+                std::vector<Edge>   children_;
+                std::vector<Popped> popped_;       // this node's part of P
+
+                bool addChild(Handle child, Handle sppf_node);
+                bool addPopped(Handle parsed_node, Handle input_pos,
+                               Handle symbols);
+        };
 
-                this_t &operator=(const this_t &other) = delete;
-                this_t &operator=(this_t &&other) = default;
+        static constexpr Handle BOTTOM = 0;  ///< u0 in GLL papers
 
-                explicit operator bool() const { return input_pos_ != nullptr; }
+        GSS() : size_(0) { clear(); }
 
-                GrammarAddress returnAddress() const { return return_addr_; }
+        void clear();
 
-                const Rule *fromRule() const { return return_addr_->rule(); }
+        size_t size() const { return size_; }
 
-                const NonTerminal *fromNonTerminal() const;
+        Node &operator[](Handle node) { return nodes_[node]; }
+        const Node &operator[](Handle node) const { return nodes_[node]; }
 
-                Token *inputPos() const { return input_pos_; }
+        std::pair<Handle, bool> emplace(Handle return_address,
+                                        Handle input_pos, Handle symbols,
+                                        unsigned short depth);
 
-                using ChildList = circ_fwd_list<Edge>;
+        void retire(Handle input_pos, const HandleSet &live);
 
-                const ChildList &children() const { return children_; }
+        template <typename Fn> void forEachIndexed(Fn fn) const
+        {
+                for (const auto &entry: index_) { fn(entry.second); }
+                for (const auto &entry: symbols_index_) { fn(entry.second); }
+        }
 
-                std::pair<const Edge *, bool>
-                        addChild(const this_t &child,
-                                 SPPFNode::Ptr sppf_node) const;
+private:
+        struct Key
+        {
+                uint64_t label_;    // (return_addr_, input_pos_)
+                Handle   symbols_;  // symbol table on entry
 
-                bool operator==(const this_t &other) const
-                        { return (return_addr_ == other.return_addr_)
-                                && (input_pos_ == other.input_pos_); }
+                bool operator==(const Key &other) const
+                        { return (label_ == other.label_)
+                                  && (symbols_ == other.symbols_); }
+        };
 
-                bool operator!=(const this_t &other) const
-                        { return (return_addr_ != other.return_addr_)
-                                || (input_pos_ != other.input_pos_); }
+        struct KeyHash
+        {
+                size_t operator()(uint64_t label) const
+                        { return mixHandles(label, 0); }
+                size_t operator()(const Key &key) const
+                        { return mixHandles(key.label_, key.symbols_); }
+        };
 
-                bool operator<(const this_t &other) const
-                        { return (return_addr_ < other.return_addr_) ||
-                                  ((return_addr_ == other.return_addr_)
-                                  && (input_pos_ < other.input_pos_)); }
+        using Nodes = std::vector<Node>;
+        using Index = std::unordered_map<uint64_t, Handle, KeyHash>;
+        using SymbolsIndex = std::unordered_map<Key, Handle, KeyHash>;
 
-                size_t hash() const
-                       { return stdHash(this, offsetof(this_t, children_) -
-                                              offsetof(this_t, return_addr_)); }
+        Nodes        nodes_;          // includes retired nodes for reuse
+        size_t       size_;
+        Index        index_;          // (return_addr_, input_pos_) => node
+        SymbolsIndex symbols_index_;  // as index_, for symbol tables but 0
+};
 
-                struct Hash
-                {
-                        size_t operator()(const Node &node) const
-                                { return node.hash(); }
-                };
+//--------------------------------------
 
-        private:
-                GrammarAddress     return_addr_;
-                Token             *input_pos_;
-                mutable ChildList  children_;  // not involved in hash()
-        };
+constexpr Handle Parser::GSS::BOTTOM;
 
-        struct Edge
-        {
-                const Node    *child_;
-                SPPFNode::Ptr  sppf_node_;
+//--------------------------------------
 
-                bool operator<(const Edge &other) const;
-        };
+/*
+ * nodes are retired rather than destroyed so that their edge and popped
+ * lists keep their capacity for the next parse
+ */
+void
+Parser::GSS::clear()
+{
+        for (size_t i = 0; i < size_; ++i) {
+                nodes_[i].children_.clear();
+                nodes_[i].popped_.clear();
+        }
 
-        void clear() { nodes_.clear(); }
+        index_.clear();
+        symbols_index_.clear();
 
-        template <typename ...Args>
-        std::pair<const Node *, bool>
-        emplace(
-                Args &&...args
-        )
-        {
-                auto inserted = nodes_.emplace(std::forward<Args>(args)...);
-                return std::make_pair(&*inserted.first, inserted.second);
+        if (nodes_.empty()) {
+                nodes_.push_back({ 0, 0, 0, {}, {} });
         }
 
-private:
-        using Nodes = std::unordered_set<Node, Node::Hash>;
-        Nodes nodes_;
-};
+        size_ = 1;  // u0
+}
 
 //--------------------------------------
 
-const NonTerminal *
-Parser::GSS::Node::fromNonTerminal() const
+auto
+Parser::GSS::emplace(
+        Handle         return_address,
+        Handle         input_pos,
+        Handle         symbols,
+        unsigned short depth
+) -> std::pair<Handle, bool>
 {
-        return fromRule() ? fromRule()->nonTerminal() : nullptr;
+        uint64_t                label = (static_cast<uint64_t>(
+                                                return_address) << 32)
+                                        | input_pos;
+        Handle                  next  = static_cast<Handle>(size_);
+        std::pair<Handle, bool> inserted;
+
+        /* most grammars never change the symbol table, so the index for
+           table 0 is keyed on the label alone */
+        if (symbols) {
+                auto i = symbols_index_.emplace(Key { label, symbols }, next);
+                inserted = std::make_pair(i.first->second, i.second);
+        } else {
+                auto i = index_.emplace(label, next);
+                inserted = std::make_pair(i.first->second, i.second);
+        }
+
+        if (inserted.second) {
+                if (size_ == nodes_.size()) {
+                        nodes_.push_back({ return_address, input_pos, depth,
+                                           {}, {} });
+                } else {  // reuse retired node
+                        Node &node = nodes_[size_];
+                        node.return_addr_ = return_address;
+                        node.input_pos_ = input_pos;
+                        node.depth_ = depth;
+                }
+                ++size_;
+        }
+
+        return inserted;
 }
 
 //--------------------------------------
+/*
+ * drop nodes labelled with an input position before 'input_pos' from the
+ * index; create() can no longer reach them, so neither are their popped
+ * lists needed, but those in 'live' remain valid as targets of pop()
+ */
+void
+Parser::GSS::retire(
+        Handle           input_pos,
+        const HandleSet &live
+)
+{
+        auto retireFrom = [&](auto &index) {
+                for (auto i = index.begin(); i != index.end(); ) {
+                        Node &node = nodes_[i->second];
+
+                        if (node.input_pos_ < input_pos) {
+                                node.popped_.clear();
+                                node.popped_.shrink_to_fit();
+                                if (!live.count(i->second)) {
+                                        node.children_.clear();
+                                        node.children_.shrink_to_fit();
+                                }
+                                i = index.erase(i);
+                        } else {
+                                ++i;
+                        }
+                }
+        };
 
-auto
+        retireFrom(index_);
+        retireFrom(symbols_index_);
+}
+
+//--------------------------------------
+
+bool
 Parser::GSS::Node::addChild(
-        const this_t  &child,
-        SPPFNode::Ptr  sppf_node
-) const -> std::pair<const Edge *, bool>
+        Handle child,
+        Handle sppf_node
+)
 {
         for (const Edge &existing: children_) {
-                if (existing.child_ == &child) {
-                        if (existing.sppf_node_ == sppf_node) {
-                                return std::make_pair(&existing, false);
-                        }
+                if ((existing.child_ == child)
+                                && (existing.sppf_node_ == sppf_node)) {
+                        return false;
                 }
         }
 
-        children_.push_back({ &child, sppf_node });
-        return std::make_pair(&children_.back(), true);
+        children_.push_back({ child, sppf_node });
+        return true;
 }
 
 //--------------------------------------
 
 bool
-Parser::GSS::Edge::operator<(
-        const Edge &other
-) const
+Parser::GSS::Node::addPopped(
+        Handle parsed_node,
+        Handle input_pos,
+        Handle symbols
+)
 {
-        return (child_ < other.child_) || ((child_ == other.child_)
-                                           && (sppf_node_ < other.sppf_node_));
+        for (const Popped &existing: popped_) {
+                if ((existing.parsed_node_ == parsed_node)
+                                && (existing.symbols_ == symbols)) {
+                        return false;
+                }
+        }
+
+        popped_.push_back({ parsed_node, input_pos, symbols });
+        return true;
 }
 
 //--------------------------------------
@@ -202,10 +331,26 @@ Parser::GSS::Edge::operator<(
 class Parser::GLL
 {
 public:
-        GLL(Parser &parser, const NonTerminal &start) :
-                parser_(parser), start_(start), recovery_pos_(nullptr) {}
+        GLL(Parser &parser) :
+                parser_(parser), start_(nullptr), recovery_pos_(nullptr),
+                busy_(false), footprint_(0), predict_(false),
+                predicted_(false) {}
+
+        SPPFNode::Ptr parseMain(const NonTerminal &start, Token *input_start);
+
+        /// \brief true while parseMain() is executing
+        bool busy() const { return busy_; }
 
-        SPPFNode::Ptr parseMain(Token *input_start);
+        /**
+         * \brief size of the largest per-parse table used by the most
+         *        recent parse, in elements; zero once released
+         */
+        size_t footprint() const { return footprint_; }
+
+        /// \brief free per-parse table storage (predictions are retained)
+        void release();
+
+        void clearPredictions() { predictions_.clear(); }
 
 #ifndef NDEBUG
         void gdb_R() const;
@@ -220,48 +365,39 @@ private:
                         { return stdHash(&ptr, sizeof(ptr)); }
         };
 
-        struct Popped
-        {
-                const GSS::Node *stack_head_;   // u in GLL paper
-                SPPFNode::Ptr    parsed_node_;  // z in GLL paper
-
-                bool operator<(const Popped &other) const;
-        };
-
-        using PoppedSet = std::set<Popped>;
-
         struct Descriptor
         {
-                GrammarAddress   address_;    // L in GLL paper
-                const GSS::Node *gss_head_;   // u in GLL paper
-                Token           *input_pos_;  // j in GLL paper
-                SPPFNode::Ptr    sppf_node_;  // w in GLL paper
-                unsigned short   depth_;
-                bool             advance_;
+                Handle slot_;       // L in GLL paper
+                Handle gss_head_;   // u in GLL paper
+                Handle input_pos_;  // j in GLL paper
+                Handle sppf_node_;  // w in GLL paper
+                Handle symbols_;    // see SymbolTable
         };
 
-        using DescriptorStack = std::vector<Descriptor>;
-
+        /* a descriptor as held in R and U, with its GSS node and symbol
+           table handle packed into one context handle (see context()) */
         struct VisitedItem
         {
-                Token              *input_pos_;
-                GrammarAddress      address_;    // L in GLL paper
-                const GSS::Node    *gss_head_;   // u in GLL paper
-                SPPFNode::ConstPtr  sppf_node_;  // w in GLL paper
+                Handle slot_;       // L in GLL paper
+                Handle context_;    // u in GLL paper, with symbol table
+                Handle input_pos_;  // j in GLL paper
+                Handle sppf_node_;  // w in GLL paper
 
                 bool operator==(const VisitedItem &other) const
-                        { return (input_pos_ == other.input_pos_)
-                                  && (address_ == other.address_)
-                                  && (gss_head_ == other.gss_head_)
+                        { return (slot_ == other.slot_)
+                                  && (context_ == other.context_)
+                                  && (input_pos_ == other.input_pos_)
                                   && (sppf_node_ == other.sppf_node_); }
 
                 bool operator!=(const VisitedItem &other) const
-                        { return (input_pos_ != other.input_pos_)
-                                  || (address_ != other.address_)
-                                  || (gss_head_ != other.gss_head_)
-                                  || (sppf_node_ != other.sppf_node_); }
+                        { return !(*this == other); }
 
-                size_t hash() const { return stdHash(this, sizeof(*this)); }
+                size_t hash() const
+                        { return mixHandles(
+                                (static_cast<uint64_t>(slot_) << 32)
+                                        | context_,
+                                (static_cast<uint64_t>(input_pos_) << 32)
+                                        | sppf_node_); }
 
                 struct Hash
                 {
@@ -270,6 +406,31 @@ private:
                 };
         };
 
+        static_assert(sizeof(VisitedItem) == 16,
+                      "R and U entries should be four handles");
+
+        using DescriptorStack = std::vector<VisitedItem>;
+
+        /* contexts other than a GSS node with symbol table 0 are indices
+           into contexts_ marked by CONTEXT_BIT */
+        static constexpr Handle CONTEXT_BIT = UINT32_C(1) << 31;
+
+        struct Context
+        {
+                Handle gss_head_;
+                Handle symbols_;
+        };
+
+        struct ContextHash
+        {
+                size_t operator()(uint64_t key) const
+                        { return mixHandles(key, 0); }
+        };
+
+        using Contexts = std::vector<Context>;
+        // (GSS node, symbol table handle) => context handle
+        using ContextIds = std::unordered_map<uint64_t, Handle, ContextHash>;
+
         struct Mismatch
         {
                 enum Kind : uint8_t
@@ -287,27 +448,204 @@ private:
 
         using Mismatches = circ_fwd_list<Mismatch>;
         using VisitedItems = std::unordered_set<VisitedItem, VisitedItem::Hash>;
-        using SPPFNodes = std::unordered_set<SPPFNode::Ptr, SPPFNode::Hash,
+        using Tokens = std::vector<Token *>;
+        using Slots = std::vector<GrammarAddress>;
+        using RuleSlots = std::unordered_map<const Rule *, Handle, PtrHash>;
+        using SPPFTable = std::vector<SPPFNode::Ptr>;
+        struct NodeHash
+        {
+                size_t operator()(const SPPFNode::Ptr &node) const
+                        { return PtrHash()(node.get()); }
+        };
+
+        /* in bounded mode (see Parser::setBeam()), the cost of the
+           derivation a packed node represents excluding its children, or
+           the lowest cost of any other node's derivations; users_ are the
+           nodes directly above, whose costs depend on this one */
+        struct Cost
+        {
+                double                  cost_;
+                std::vector<SPPFNode *> users_;
+        };
+
+        using Costs = std::unordered_map<SPPFNode::Ptr, Cost, NodeHash>;
+        using SymbolTables = std::vector<SymbolTable>;
+        using SymbolTableIds = std::unordered_map<const void *, Handle,
+                                                  PtrHash>;
+        using SPPFNodes = std::unordered_map<SPPFNode::Ptr, Handle,
+                                             SPPFNode::Hash,
                                              SPPFNode::IndirectEqual>;
 
+        struct ChoiceKey
+        {
+                const NonTerminal *nonterminal_;
+                Handle             input_pos_;  // where nonterminal_ began
+
+                bool operator==(const ChoiceKey &other) const
+                        { return (nonterminal_ == other.nonterminal_)
+                                  && (input_pos_ == other.input_pos_); }
+
+                struct Hash
+                {
+                        size_t operator()(const ChoiceKey &key) const
+                                { return mixHandles(reinterpret_cast<uintptr_t>(
+                                                        key.nonterminal_),
+                                                    key.input_pos_); }
+                };
+        };
+
+        struct Commit
+        {
+                Handle        input_pos_;  // input position following subtree_
+                SPPFNode::Ptr subtree_;
+        };
+
+        using Commits = std::vector<Commit>;
+
+        // ordered choice nonterminal instance => lowest rule index completed
+        using Choices = std::unordered_map<ChoiceKey, size_t, ChoiceKey::Hash>;
+
+        struct Decision
+        {
+                uint64_t lookahead_;  // see lookahead()
+                uint64_t tried_;      // bit mask of rules begun
+                uint64_t succeeded_;  // bit mask of rules completed
+        };
+
+        // nonterminal instance => rules begun and completed
+        using Decisions = std::unordered_map<ChoiceKey, Decision,
+                                             ChoiceKey::Hash>;
+
+        struct PredictionKey
+        {
+                const NonTerminal *nonterminal_;
+                uint64_t           lookahead_;
+
+                bool operator==(const PredictionKey &other) const
+                        { return (nonterminal_ == other.nonterminal_)
+                                  && (lookahead_ == other.lookahead_); }
+
+                struct Hash
+                {
+                        size_t operator()(const PredictionKey &key) const
+                                { return mixHandles(reinterpret_cast<uintptr_t>(
+                                                        key.nonterminal_),
+                                                    key.lookahead_); }
+                };
+        };
+
+        struct PredicateKey
+        {
+                Component::Predicate predicate_;
+                const Rule          *rule_;
+                Handle               input_pos_;
+
+                bool operator==(const PredicateKey &other) const
+                        { return (predicate_ == other.predicate_)
+                                  && (rule_ == other.rule_)
+                                  && (input_pos_ == other.input_pos_); }
+
+                struct Hash
+                {
+                        size_t operator()(const PredicateKey &key) const
+                                { return mixHandles(
+                                        reinterpret_cast<uintptr_t>(key.rule_)
+                                        ^ reinterpret_cast<uintptr_t>(
+                                                        key.predicate_),
+                                        key.input_pos_); }
+                };
+        };
+
+        // results of pure predicates (see wr::parse::pure())
+        using PredicateResults = std::unordered_map<PredicateKey, bool,
+                                                    PredicateKey::Hash>;
+
+        struct Prediction
+        {
+                uint64_t succeeded_;  // bit mask of rules seen to complete
+                uint64_t failed_;     // bit mask of rules seen not to
+        };
+
+        // (nonterminal, lookahead) => outcomes of rules in previous parses
+        using Predictions = std::unordered_map<PredictionKey, Prediction,
+                                               PredictionKey::Hash>;
+        using Indices = std::vector<size_t>;
+
+
+        Token *token(Handle input_pos);
+        Token::Offset offset(Handle input_pos) const;
+        Handle slotOf(const Rule &rule);
+        GrammarAddress address(Handle slot) const { return slots_[slot]; }
+        SlotProfile::Counts *profiled(GrammarAddress slot) const
+                { return parser_.slotProfile()
+                         ? &parser_.slotProfile()->at(*slot) : nullptr; }
+        unsigned short depth(const Descriptor &d) const
+                { return gss_[d.gss_head_].depth_; }
 
         const NonTerminal &getNonTerminal(const Descriptor &d) const;
         void report(const Mismatch &err);
 
-        bool beginNonTerminal(const NonTerminal &nonterminal,
-                              const GSS::Node *gss_head,
-                              Token *input_pos, unsigned short depth);
+        const NonTerminal &inlineDelegates(const NonTerminal &nonterminal,
+                                           Handle input_pos,
+                                           unsigned short depth);
+
+        bool beginNonTerminal(const NonTerminal &nonterminal, Handle gss_head,
+                              Handle input_pos, Handle symbols,
+                              unsigned short depth);
+
+        bool beginOrderedChoice(const NonTerminal &nonterminal,
+                                Handle gss_head, Handle input_pos,
+                                Handle symbols, unsigned short depth);
+
+        size_t committedChoice(const NonTerminal &nonterminal,
+                               Handle input_pos) const;
+
+        bool leaderBegun(const NonTerminal &nonterminal, size_t ir,
+                         uint64_t begun) const;
+        bool leadsSharedPrefix(const Rule &rule) const;
+        void resumeFollowers(const Descriptor &d, const Rule &leader,
+                             size_t length);
+        bool candidate(const NonTerminal &nonterminal, size_t ir,
+                       Handle input_pos);
+        void shareDerivation(GrammarAddress slot, Handle left,
+                             const SPPFNode::Ptr &right);
+        Handle followerNode(const Rule &follower, Handle node);
+
+        bool overruled(const Descriptor &d, const Rule &rule) const;
+        void commitChoice(const Descriptor &d, const Rule &rule);
+
+        void reset(const NonTerminal &start);
+        void run();
 
-        bool beginRule(const Rule &rule, const GSS::Node *gss_head,
-                       Token *input_pos, unsigned short depth, bool immediate);
+        uint64_t lookahead(Handle input_pos);
+        uint64_t predict(const NonTerminal &nonterminal, Handle input_pos,
+                         Decision *&decision);
+        void recordSuccess(const Descriptor &d, const Rule &rule);
+        void updatePredictions();
+
+        void addCommit(Handle input_pos, SPPFNode::Ptr subtree);
+        void applyCommits();
+        bool pendingAlternative(Handle slot) const;
+        void prune(Handle input_pos);
+
+        bool beginRule(const Rule &rule, Handle gss_head, Handle input_pos,
+                       Handle symbols, bool immediate);
+
+        bool evaluate(const Component &step, Descriptor &d);
+
+        Handle symbolsOf(const SymbolTable &symbols);
+
+        Handle context(Handle gss_head, Handle symbols);
+        VisitedItem pack(const Descriptor &d);
+        Descriptor unpack(const VisitedItem &item) const;
 
         void parse(Descriptor &d);
 
         bool endRule(Descriptor &d,
                      Mismatch::Kind mismatch_kind = Mismatch::NONE);
 
-        bool visited(GrammarAddress address, const GSS::Node *gss_head,
-                     Token *input_pos, SPPFNode::ConstPtr sppf_node) const;
+        bool visited(Handle slot, Handle gss_head, Handle input_pos,
+                     Handle sppf_node, Handle symbols) const;
 
         bool test(const Token *input_pos, const NonTerminal &nonterminal,
                   GrammarAddress trailing_terms) const;
@@ -317,50 +655,70 @@ private:
 
         void add(Descriptor d);
 
-        void pop(const GSS::Node *gss_head, SPPFNode::Ptr parsed_node,
-                 unsigned short depth);
+        void pop(Handle gss_head, Handle parsed_node, Handle input_pos,
+                 Handle symbols);
 
-        const GSS::Node *create(GrammarAddress return_address,
-                                const GSS::Node *gss_head, Token *input_pos,
-                                SPPFNode::Ptr sppf_node, unsigned short depth);
+        Handle create(Handle return_address, Handle gss_head, Handle input_pos,
+                      Handle symbols, Handle sppf_node, unsigned short depth);
 
         static SPPFNode::Ptr hideRecursion(SPPFNode::Ptr parsed_node);
         static SPPFNode::Ptr
                 hideDelegateOrTransparent(SPPFNode::Ptr parsed_node);
 
-        std::pair<SPPFNode::Ptr, bool> getNode(SPPFNode::Ptr key);
+        std::pair<Handle, bool> getNode(SPPFNode::Ptr key);
         std::pair<SPPFNode::Ptr, bool> getPackedNode(SPPFNode::Ptr parent,
                                                      GrammarAddress slot,
                                                      Token *pivot, bool empty);
-        SPPFNode::Ptr getNodeT(Token &terminal);
-        SPPFNode::Ptr getNodeP(GrammarAddress slot,
-                               SPPFNode::Ptr left, SPPFNode::Ptr right);
-        SPPFNode::Ptr getEmptyNodeAt(Token &pos);
+        Handle getNodeT(Token &terminal);
+        Handle getNodeP(GrammarAddress slot, Handle left, SPPFNode::Ptr right);
+        Handle getEmptyNodeAt(Token &pos);
+
+        double cost(const SPPFNode::Ptr &node) const;
+        void addDerivation(const SPPFNode::Ptr &parent,
+                           const SPPFNode::Ptr &packed);
+        void dropDerivation(const SPPFNode::Ptr &parent,
+                            const SPPFNode::Ptr &packed);
+        void rankDerivations(SPPFNode &parent);
+        void forgetCost(const SPPFNode::Ptr &node);
 
 
         Parser            &parser_;
-        const NonTerminal &start_;
+        const NonTerminal *start_;
+        Tokens             input_;        // input position => token
+        Slots              slots_;        // slot handle => grammar slot
+        RuleSlots          rule_slots_;   // rule => handle of its first slot
         GSS                gss_;
-        SPPFNodes          sppf_nodes_;
-        SPPFNode::Ptr      matched_;      // longest top-level match
-        PoppedSet          popped_;       // P in GLL paper
+        SPPFTable          sppf_;         // SPPF handle => node
+        SPPFNodes          sppf_nodes_;   // node => SPPF handle
+        SymbolTables       symbols_;      // symbol table handle => table
+        SymbolTableIds     symbol_ids_;   // table version => handle
+        Contexts           contexts_;     // see context()
+        ContextIds         context_ids_;
+        Handle             matched_;      // longest top-level match
+        Handle             matched_end_;  // input position following matched_
+        Handle             matched_symbols_;
+        bool               finished_;     // stop early per match policy
         DescriptorStack    in_progress_;  // R in GLL paper
         VisitedItems       visited_;      // U in GLL paper
+        Choices            committed_;
+        Commits            commits_;      // pending commit points
+        Commits            deferred_;     // commits made while predicting
+        Decisions          decisions_;
+        PredicateResults   predicate_results_;
+        Costs              costs_;        // SPPF node => cost
+        Predictions        predictions_;  // kept between parses
+        Indices            choices_;      // scratch for beginOrderedChoice()
         const Token       *recovery_pos_;
         Mismatches         poss_errors_;
+        bool               busy_;
+        size_t             footprint_;
+        bool               predict_;      // apply predictions_
+        bool               predicted_;    // predictions_ excluded some rule
 };
 
 //--------------------------------------
 
-bool
-Parser::GLL::Popped::operator<(
-        const Popped &other
-) const
-{
-        return (stack_head_ < other.stack_head_)
-                || ((stack_head_ == other.stack_head_)
-                        && (parsed_node_ < other.parsed_node_));
-}
+constexpr Handle Parser::GLL::CONTEXT_BIT;
 
 //--------------------------------------
 
@@ -378,16 +736,18 @@ Parser::GLL::gdb_R() const
 
         ulog << '\n';
 
-        for (const Descriptor &d: in_progress_) {
+        for (const VisitedItem &item: in_progress_) {
+                Descriptor d = unpack(item);
+
                 ulog << setw(DEBUG_INDENT) << "" << getNonTerminal(d).name();
 
-                if (d.address_) {
-                        const Rule &rule = *d.address_->rule();
-                        ulog << '.' << rule.index()
-                             << '[' << d.address_->index() << ']';
+                if (d.slot_) {
+                        GrammarAddress addr = address(d.slot_);
+                        ulog << '.' << addr->rule()->index()
+                             << '[' << addr->index() << ']';
                 }
 
-                ulog << " @ " << d.input_pos_->offset() << '\n';
+                ulog << " @ " << offset(d.input_pos_) << '\n';
         }
 
         ulog.flush();
@@ -411,13 +771,17 @@ Parser::GLL::sppfToDOTFile(
         output << "digraph {\n"
                << "    graph [ordering=out]\n";
 
-        for (SPPFNode::ConstPtr node: sppf_nodes_) {
+        for (SPPFNode::ConstPtr node: sppf_) {
+                if (!node) {  // reserved handle 0
+                        continue;
+                }
+
                 output << "    ";
                 node->writeDOTNode(output);
                 output << '\n';
 
                 /* output packed node children which are not stored
-                   in sppf_nodes_ */
+                   in sppf_ */
                 for (SPPFNode::ConstPtr child: node->children()) {
                         if (child->isPacked()) {
                                 output << "    ";
@@ -431,6 +795,68 @@ Parser::GLL::sppfToDOTFile(
         return true;
 }
 
+//--------------------------------------
+/*
+ * fetches the token at input position 'input_pos', reading tokens from the
+ * lexer as required; tokens are only read when first examined so that
+ * interactive input is not consumed ahead of time
+ */
+Token *
+Parser::GLL::token(
+        Handle input_pos
+)
+{
+        while (input_pos >= input_.size()) {
+                input_.push_back(parser_.nextToken(input_.back()));
+        }
+
+        return input_[input_pos];
+}
+
+//--------------------------------------
+/*
+ * byte offset of input position 'input_pos' for debug output; unlike token()
+ * this never reads from the lexer
+ */
+Token::Offset
+Parser::GLL::offset(
+        Handle input_pos
+) const
+{
+        if (input_pos < input_.size()) {
+                return input_[input_pos]->offset();
+        } else {
+                const Token *last = input_.back();
+                return static_cast<Token::Offset>(last->offset()
+                                                  + last->bytes());
+        }
+}
+
+//--------------------------------------
+/*
+ * slot handles for each rule are allocated contiguously on first use, so
+ * stepping through a rule's components increments its slot handle in step
+ */
+Handle
+Parser::GLL::slotOf(
+        const Rule &rule
+)
+{
+        auto inserted = rule_slots_.emplace(&rule,
+                                            static_cast<Handle>(slots_.size()));
+
+        if (inserted.second) {
+                for (auto i = rule.begin(); ; ++i) {
+                        slots_.push_back(&*i);
+                        if (i == rule.end()) {
+                                break;
+                        }
+                }
+        }
+
+        return inserted.first->second;
+}
+
 //--------------------------------------
 
 const NonTerminal &
@@ -438,10 +864,10 @@ Parser::GLL::getNonTerminal(
         const Descriptor &d
 ) const
 {
-        if (d.address_) {
-                return *d.address_->rule()->nonTerminal();
+        if (d.slot_) {
+                return *address(d.slot_)->rule()->nonTerminal();
         } else {
-                return start_;
+                return *start_;
         }
 }
 
@@ -449,51 +875,182 @@ Parser::GLL::getNonTerminal(
 
 SPPFNode::Ptr
 Parser::GLL::parseMain(
-        Token *input_start
+        const NonTerminal &start,
+        Token             *input_start
 )
 {
         if (!input_start) {
                 input_start = parser_.nextToken();
         }
 
+        /* release per-parse references on exit, including when a fatal
+           diagnostic is thrown; table capacity is retained */
+        struct OnExit
+        {
+                OnExit(GLL &gll) : gll_(gll) { gll_.busy_ = true; }
+                ~OnExit()
+                {
+                        gll_.footprint_ = std::max({ gll_.gss_.size(),
+                                                     gll_.sppf_.size(),
+                                                     gll_.visited_.size() });
+                        gll_.input_.clear();
+                        gll_.sppf_.clear();
+                        gll_.sppf_nodes_.clear();
+                        gll_.costs_.clear();
+                        gll_.symbols_.clear();
+                        gll_.symbol_ids_.clear();
+                        gll_.contexts_.clear();
+                        gll_.context_ids_.clear();
+                        gll_.in_progress_.clear();
+                        gll_.commits_.clear();
+                        gll_.deferred_.clear();
+                        gll_.busy_ = false;
+                }
+
+                GLL &gll_;
+        } on_exit(*this);
+
+        input_.clear();
+        input_.push_back(input_start);
+        predict_ = parser_.predictionDepth() > 0;
+
+        for (;;) {
+                reset(start);
+                run();
+
+                if (parser_.predictionDepth()) {
+                        updatePredictions();
+                }
+
+                if (!predicted_
+                    || (matched_ && token(matched_end_)->is(TOK_EOF))) {
+                        break;
+                }
+
+                /* failure, or a match ending before the input does, may be
+                   due to a rule wrongly excluded by prediction so retry,
+                   exploring all rules */
+                if (parser_.debugEnabled()) {
+                        ulog << "RETRY without prediction" << std::endl;
+                }
+                predict_ = false;
+        }
+
+        /* commits made by an attempt that might have been retried are only
+           reported now that it is final; those still pending if the parse
+           failed never took effect */
+        for (const Commit &c: deferred_) {
+                parser_.onCommit(c.subtree_);
+        }
+        if (matched_) {
+                for (const Commit &c: commits_) {
+                        parser_.onCommit(c.subtree_);
+                }
+                parser_.symbols_ = symbols_[matched_symbols_];
+        }
+
+        if (!matched_ && recovery_pos_ && !poss_errors_.empty()) {
+                report(poss_errors_.front());
+                poss_errors_.pop_front();
+
+                /* TODO: re-synchronise input token stream from recovery_pos_
+                         and re-enter main loop */
+        }
+
+        return sppf_[matched_];
+}
+
+//--------------------------------------
+
+void
+Parser::GLL::reset(
+        const NonTerminal &start
+)
+{
+        start_ = &start;
+        recovery_pos_ = nullptr;
+        poss_errors_.clear();
+        slots_.clear();
+        slots_.push_back(nullptr);  // L0
+        rule_slots_.clear();
         gss_.clear();
+        sppf_.clear();
+        sppf_.push_back(nullptr);
         sppf_nodes_.clear();
-        matched_ = nullptr;
-        popped_.clear();
+        symbols_.clear();
+        symbols_.push_back(parser_.symbols());
+        symbol_ids_.clear();
+        symbol_ids_.emplace(symbols_[0].version(), 0);
+        contexts_.clear();
+        context_ids_.clear();
+        matched_ = matched_end_ = matched_symbols_ = 0;
+        finished_ = false;
         in_progress_.clear();
         visited_.clear();
+        committed_.clear();
+        commits_.clear();
+        deferred_.clear();
+        decisions_.clear();
+        predicate_results_.clear();
+        costs_.clear();
+        predicted_ = false;
+}
 
-        const GSS::Node *u1 = gss_.emplace(GrammarAddress(), input_start).first,
-                        *u0 = gss_.emplace().first;
+//--------------------------------------
+
+void
+Parser::GLL::run()
+{
+        Handle u1 = gss_.emplace(0, 0, 0, 0).first;
 
-        u1->addChild(*u0, nullptr);
-        if (!beginNonTerminal(start_, u1, input_start, 0)) {
-                recovery_pos_ = input_start;
+        gss_[u1].addChild(GSS::BOTTOM, 0);
+        if (!beginNonTerminal(*start_, u1, 0, 0, 0)) {
+                recovery_pos_ = input_[0];
                 poss_errors_.push_front(Mismatch {
-                        { nullptr, u1, input_start, nullptr, 0, false },
-                        Mismatch::NO_RULE
+                        { 0, u1, 0, 0, 0 }, Mismatch::NO_RULE
                 });
         }
 
         /*
          * L0: main parsing loop
          */
-        while (!in_progress_.empty()) {
-                Descriptor d = in_progress_.back();
+        for (size_t n = 1; !in_progress_.empty() && !finished_; ++n) {
+                Descriptor d = unpack(in_progress_.back());
                 in_progress_.pop_back();
                 parse(d);
-        }
-
-        if (!matched_ && recovery_pos_ && !poss_errors_.empty()) {
-                report(poss_errors_.front());
-                poss_errors_.pop_front();
 
-                /* TODO: re-synchronise input token stream from recovery_pos_
-                         and re-enter main loop */
+                if (!commits_.empty() && !(n % COMMIT_INTERVAL)) {
+                        applyCommits();
+                }
         }
+}
 
-        sppf_nodes_.clear();
-        return std::move(matched_);
+//--------------------------------------
+
+void
+Parser::GLL::release()
+{
+        assert(!busy_);
+
+        footprint_ = 0;
+        Tokens().swap(input_);
+        Slots().swap(slots_);
+        RuleSlots().swap(rule_slots_);
+        gss_ = GSS();
+        SPPFTable().swap(sppf_);
+        SPPFNodes().swap(sppf_nodes_);
+        SymbolTables().swap(symbols_);
+        SymbolTableIds().swap(symbol_ids_);
+        Contexts().swap(contexts_);
+        ContextIds().swap(context_ids_);
+        DescriptorStack().swap(in_progress_);
+        VisitedItems().swap(visited_);
+        Choices().swap(committed_);
+        Indices().swap(choices_);
+        Commits().swap(commits_);
+        Decisions().swap(decisions_);
+        PredicateResults().swap(predicate_results_);
+        Costs().swap(costs_);
 }
 
 //--------------------------------------
@@ -512,10 +1069,10 @@ Parser::GLL::report(
         case Mismatch::POST_ACTION_FAILED:  // ditto
                 return;
         case Mismatch::NO_RULE:
-                if (err.d.address_) {
-                        nonterm = err.d.address_->getAsNonTerminal();
+                if (err.d.slot_) {
+                        nonterm = address(err.d.slot_)->getAsNonTerminal();
                 } else {
-                        nonterm = &start_;
+                        nonterm = start_;
                 }
                 for (auto term: nonterm->firstSet()) {
                         if (term.first != TOK_EOF) {
@@ -524,40 +1081,13 @@ Parser::GLL::report(
                 }
                 break;
         case Mismatch::TERMINAL_MISMATCH:
-                expected_terminals.insert(err.d.address_
+                expected_terminals.insert(address(err.d.slot_)
                                                 ->getAsTerminal());
                 break;
         }
 
-        size_t       count = expected_terminals.size();
-        std::string  expect;
-        const char  *sep = "";
-
-        for (const auto &term: expected_terminals) {
-                expect += sep;
-                u8string_view term_name
-                                = parser_.lexer()->tokenKindName(term);
-
-                if (term_name.size() == 1) {
-                        expect += "'";
-                        if (term_name == "'") {
-                                expect += "\\";
-                        }
-                        expect += term_name.char_data();
-                        expect += "'";
-                } else {
-                        expect += term_name.char_data();
-                }
-
-                if (--count > 1) {
-                        sep = ", ";
-                } else {
-                        sep = " or ";
-                }
-        }
-
-        parser_.emit(Diagnostic::ERROR, *recovery_pos_, "expected %s", expect);
-}
+        parser_.emitExpected(*recovery_pos_, expected_terminals);
+}
 
 //--------------------------------------
 /*
@@ -566,49 +1096,80 @@ Parser::GLL::report(
  */
 bool
 Parser::GLL::beginNonTerminal(
-        const NonTerminal &nonterminal,
-        const GSS::Node   *gss_head,
-        Token             *input_pos,
+        const NonTerminal &called,
+        Handle             gss_head,
+        Handle             input_pos,
+        Handle             symbols,
         unsigned short     depth
 )
 {
-        auto   &terminals = nonterminal.firstSet();
-        size_t  count = 0;
+        const NonTerminal &nonterminal = inlineDelegates(called, input_pos,
+                                                         depth);
 
-        if (terminals.empty()) {
-                for (const Rule &rule: nonterminal) {
-                        if (beginRule(rule, gss_head, input_pos,
-                                      depth, false)) {
-                                ++count;
+        if (nonterminal.isOrderedChoice()) {
+                return beginOrderedChoice(nonterminal, gss_head, input_pos,
+                                          symbols, depth);
+        }
+
+        auto     &terminals = nonterminal.firstSet();
+        size_t    count = 0;
+        uint64_t  allowed = 0,
+                  begun = 0;
+        bool      decided = false;
+        Decision *decision = nullptr;
+
+        /* begin rule 'ir' as one of several candidates, if predicted and
+           not to be resumed from the leader of a shared prefix */
+        auto beginCandidate = [&](size_t ir) {
+                if (!decided) {
+                        allowed = predict(nonterminal, input_pos, decision);
+                        decided = true;
+                }
+                if ((ir < 64) && !(allowed & (UINT64_C(1) << ir))) {
+                        predicted_ = true;
+                        return;
+                }
+                if (decision) {
+                        decision->tried_ |= UINT64_C(1) << ir;
+                }
+                if (leaderBegun(nonterminal, ir, begun)) {
+                        ;
+                } else if (beginRule(nonterminal[ir], gss_head, input_pos,
+                                     symbols, false)) {
+                        ++count;
+                        if (ir < 64) {
+                                begun |= UINT64_C(1) << ir;
                         }
                 }
+        };
+
+        if (terminals.empty()) {
+                for (size_t ir = 0; ir < nonterminal.size(); ++ir) {
+                        beginCandidate(ir);
+                }
         } else {
-                auto i = terminals.find(input_pos->kind());
+                auto i = terminals.find(token(input_pos)->kind());
 
                 if (i != terminals.end()) {
                         if (!nonterminal.matchesEmpty() &&
                                       (i->second.begin() == i->second.last())) {
                                 size_t ir = i->second.front();
                                 if (beginRule(nonterminal[ir], gss_head,
-                                              input_pos, depth, true)) {
+                                              input_pos, symbols, true)) {
                                         return true;
                                 }
                         } else for (size_t ir: i->second) {
-                                if (beginRule(nonterminal[ir], gss_head,
-                                              input_pos, depth, false)) {
-                                        ++count;
-                                }
+                                beginCandidate(ir);
                         }
+                } else for (size_t ir: nonterminal.anyTokenRules()) {
+                        beginCandidate(ir);
                 }
 
                 if (nonterminal.matchesEmpty()) {
                         i = terminals.find(TOK_NULL);
                         if (i != terminals.end()) {
                                 for (size_t ir: i->second) {
-                                        if (beginRule(nonterminal[ir], gss_head,
-                                                     input_pos, depth, false)) {
-                                                ++count;
-                                        }
+                                        beginCandidate(ir);
                                 }
                         }
                 }
@@ -617,403 +1178,1307 @@ Parser::GLL::beginNonTerminal(
         if (parser_.debugEnabled() && !count) {
                 ulog << setw(depth * DEBUG_INDENT) << ""
                      << "NORULE " << nonterminal.name()
-                     << " @ " << input_pos->offset() << std::endl;
+                     << " @ " << offset(input_pos) << std::endl;
         }
 
         return count > 0;
 }
 
 //--------------------------------------
-
-bool
-Parser::GLL::beginRule(
-        const Rule      &rule,
-        const GSS::Node *gss_head,
-        Token           *input_pos,
-        unsigned short   depth,
-        bool             immediate
+/*
+ * follows chains of delegate rules that would be hidden from the SPPF anyway
+ * (e.g. 'unary' -> 'primary' in an expression grammar when the next token is
+ * a number), so that no GSS node, descriptor or SPPF node is created for the
+ * intermediate nonterminals; the caller receives the same node from pop()
+ * as hideDelegateOrTransparent() would have given it. Only nonterminals that
+ * have a single candidate rule for the next token, do not match empty and
+ * have no parse actions are bypassed.
+ */
+const NonTerminal &
+Parser::GLL::inlineDelegates(
+        const NonTerminal &nonterminal,
+        Handle             input_pos,
+        unsigned short     depth
 )
 {
-        ParseState state(parser_, start_, rule, input_pos);
+        const NonTerminal *result = &nonterminal;
 
-        if (!rule.nonTerminal()->invokePreParseActions(state)) {
-                return false;
-        }
+        for (int n = 0; n < MAX_INLINE_DEPTH; ++n) {
+                const NonTerminal &from = *result;
 
-        Descriptor d = { &rule[0], gss_head, input_pos, nullptr, depth, false };
+                if (from.matchesEmpty() || from.isOrderedChoice()
+                                        || from.hasActions()) {
+                        break;
+                }
 
-        if (immediate) {
-                parse(d);
-        } else {
-                add(d);
+                auto &terminals = from.firstSet();
+                auto  i         = terminals.find(token(input_pos)->kind());
+
+                if ((i == terminals.end())
+                                || (i->second.begin() != i->second.last())) {
+                        break;
+                }
+
+                const NonTerminal *target = from[i->second.front()]
+                                                        .inlineTarget();
+                if (!target) {
+                        break;
+                }
+
+                if (parser_.debugEnabled()) {
+                        ulog << setw(depth * DEBUG_INDENT) << ""
+                             << "INLINE " << from.name() << '.'
+                             << i->second.front() << " -> " << target->name()
+                             << " @ " << offset(input_pos) << std::endl;
+                }
+
+                result = target;
         }
 
-        return true;
+        return *result;
 }
 
 //--------------------------------------
-
-void
-Parser::GLL::parse(
-        Descriptor &d
+/*
+ * candidate rules of an ordered choice nonterminal are added to R in reverse
+ * so that, R being a stack, each is explored in full before the next; rules
+ * ordered after one that has already completed at input_pos are not begun
+ */
+bool
+Parser::GLL::beginOrderedChoice(
+        const NonTerminal &nonterminal,
+        Handle             gss_head,
+        Handle             input_pos,
+        Handle             symbols,
+        unsigned short     depth
 )
 {
-        if (!d.address_) {  // null address equivalent to L0
-                return;
-        }
+        auto   &terminals = nonterminal.firstSet();
+        size_t  limit     = committedChoice(nonterminal, input_pos),
+                count     = 0;
 
-        const Rule &rule = *d.address_->rule();
+        choices_.clear();
 
-        if (parser_.debugEnabled() && (d.address_ != rule.end())) {
-                if (d.advance_) {
-                        // do this now to report the correct input offset
-                        d.input_pos_ = parser_.nextToken(d.input_pos_);
-                        d.advance_ = false;
+        if (terminals.empty()) {
+                for (size_t ir = 0; ir < nonterminal.size(); ++ir) {
+                        choices_.push_back(ir);
                 }
+        } else {
+                auto i = terminals.find(token(input_pos)->kind());
 
-                ulog << setw(d.depth_ * DEBUG_INDENT) << "";
-
-                // these variables make setting conditional breakpoints easy
-                auto *nonterminal = rule.nonTerminal();
-                auto  i_rule      = rule.index(),
-                      i_comp      = d.address_->index();
-                auto  offset      = d.input_pos_->offset();
-
-                if (i_comp == 0) {
-                        ulog << "ENTER  ";
+                if (i != terminals.end()) {
+                        choices_.insert(choices_.end(), i->second.begin(),
+                                        i->second.end());
                 } else {
-                        ulog << "RESUME ";
+                        auto &any = nonterminal.anyTokenRules();
+                        choices_.insert(choices_.end(), any.begin(),
+                                        any.end());
                 }
-                ulog << nonterminal->name() << '.' << i_rule
-                     << '[' << i_comp << "] @ " << offset << std::endl;
+
+                if (nonterminal.matchesEmpty()) {
+                        i = terminals.find(TOK_NULL);
+                        if (i != terminals.end()) {
+                                choices_.insert(choices_.end(),
+                                                i->second.begin(),
+                                                i->second.end());
+                        }
+                }
+
+                std::sort(choices_.begin(), choices_.end());
+                choices_.erase(std::unique(choices_.begin(), choices_.end()),
+                               choices_.end());
         }
 
-        for (; d.address_ != rule.end(); ++d.address_) {
-                if (d.advance_) {
-                        d.input_pos_ = parser_.nextToken(d.input_pos_);
-                        d.advance_ = false;
+        for (auto ir = choices_.rbegin(); ir != choices_.rend(); ++ir) {
+                if ((*ir <= limit) && beginRule(nonterminal[*ir], gss_head,
+                                                input_pos, symbols, false)) {
+                        ++count;
                 }
+        }
 
-                const Component &step = *d.address_;
+        if (parser_.debugEnabled() && !count) {
+                ulog << setw(depth * DEBUG_INDENT) << ""
+                     << "NORULE " << nonterminal.name()
+                     << " @ " << offset(input_pos) << std::endl;
+        }
 
-                if (d.address_->predicate()) {
-                        ParseState state(parser_, start_, rule,
-                                         d.input_pos_, d.sppf_node_);
+        return count > 0;
+}
 
-                        bool result = d.address_->predicate()(state);
+//--------------------------------------
+/*
+ * true if rule 'ir' of 'nonterminal' shares a prefix with a rule that has
+ * been begun (as recorded in the bit mask 'begun'), in which case the rule
+ * is resumed by resumeFollowers() rather than begun separately; since the
+ * leader has the lower index, it is always considered first
+ */
+bool
+Parser::GLL::leaderBegun(
+        const NonTerminal &nonterminal,
+        size_t             ir,
+        uint64_t           begun
+) const
+{
+        if (!begun || nonterminal.hasActions()) {
+                return false;  // pre-parse actions expect every rule begun
+        }
 
-                        if (!result && !d.address_->isOptional()) {
-                                endRule(d, Mismatch::PREDICATE_FAILED);
-                                return;
-                        }
+        for (const auto &shared: nonterminal.sharedPrefixes()) {
+                if (shared.follower_ == ir) {
+                        return (shared.leader_ < 64)
+                                && (begun & (UINT64_C(1) << shared.leader_));
                 }
+        }
 
-                if (d.address_->isTerminal()) {
-                        TokenKind terminal = d.address_->getAsTerminal();
+        return false;
+}
 
-                        if ((terminal == TOK_NULL)
-                                        || (terminal == d.input_pos_->kind())) {
-                                auto t_node = getNodeT(*d.input_pos_);
-                                if ((d.address_ == rule.begin())
-                                    && std::next(d.address_) != rule.end()) {
-                                        /* rule.size() >= 2
-                                           and *rule.begin() is a terminal */
-                                        d.sppf_node_ = t_node;
-                                } else {
-                                        d.sppf_node_ = getNodeP(d.address_,
-                                                                d.sppf_node_,
-                                                                t_node);
-                                }
-                                d.advance_ = true;
-                        } else if (!step.isOptional()) {
-                                endRule(d, Mismatch::TERMINAL_MISMATCH);
-                                return;
-                        } else {
-                                d.sppf_node_ = getNodeP(d.address_,
-                                                d.sppf_node_,
-                                                getEmptyNodeAt(*d.input_pos_));
-                        }
-                } else if (step.isNonTerminal()) {
-                        GrammarAddress return_addr = std::next(d.address_);
-                        auto           nonterminal = step.getAsNonTerminal();
+//--------------------------------------
 
-                        bool skip_optional = step.isOptional()
-                                        && !nonterminal->matchesEmpty()
-                                        && !visited(return_addr, d.gss_head_,
-                                                    d.input_pos_, d.sppf_node_),
-                             ok = false;
+bool
+Parser::GLL::leadsSharedPrefix(
+        const Rule &rule
+) const
+{
+        const NonTerminal &nonterminal = *rule.nonTerminal();
 
-                        if (test(d.input_pos_, *nonterminal, return_addr)) {
-                                auto *new_gss_head = create(d.address_,
-                                                            d.gss_head_,
-                                                            d.input_pos_,
-                                                            d.sppf_node_,
-                                                            d.depth_ + 1);
+        if (nonterminal.hasActions()) {
+                return false;
+        }
 
-                                ok = beginNonTerminal(*nonterminal,
-                                                    new_gss_head, d.input_pos_,
-                                                    d.depth_ + 1);
-                        } else if (parser_.debugEnabled()) {
-                                ulog << setw(d.depth_ * DEBUG_INDENT) << ""
-                                     << "NORULE " << nonterminal->name()
-                                     << " @ " << d.input_pos_->offset()
-                                     << std::endl;
-                        }
+        size_t ir = rule.index();
 
-                        ok = ok || skip_optional;
+        for (const auto &shared: nonterminal.sharedPrefixes()) {
+                if (shared.leader_ == ir) {
+                        return true;
+                }
+        }
 
-                        if (!ok) {
-                                endRule(d, Mismatch::NO_RULE);
-                                return;
-                        }
+        return false;
+}
 
-                        if (!skip_optional) {
-                                /* must return directly to main loop
-                                   (equivalent of goto L0 in GLL paper) */
-                                break;
-                        } /* else optional nonterminal that doesn't match empty:
-                             attempt path omitting that nonterminal */
+//--------------------------------------
+/*
+ * 'd' has matched the first 'length' components of rule 'leader', so each
+ * rule sharing just those components continues from the same point,
+ * reusing the GSS node that 'd' has built and the follower's own copy of
+ * its SPPF node (see shareDerivation()); as when beginNonTerminal() begins
+ * rules, a follower is only resumed if it is a candidate for the token at
+ * the nonterminal's start position and is not excluded by prediction
+ */
+void
+Parser::GLL::resumeFollowers(
+        const Descriptor &d,
+        const Rule       &leader,
+        size_t            length
+)
+{
+        const NonTerminal &nonterminal = *leader.nonTerminal();
+        size_t             ir          = leader.index();
+        Handle             start       = gss_[d.gss_head_].input_pos_;
+        uint64_t           allowed     = 0;
+        bool               decided     = false;
+        Decision          *decision    = nullptr;
+
+        for (const auto &shared: nonterminal.sharedPrefixes()) {
+                if ((shared.leader_ != ir) || (shared.length_ != length)
+                    || !candidate(nonterminal, shared.follower_, start)) {
+                        continue;
+                }
 
-                        d.sppf_node_ = getNodeP(d.address_, d.sppf_node_,
-                                                getEmptyNodeAt(*d.input_pos_));
+                if (!decided) {
+                        allowed = predict(nonterminal, start, decision);
+                        decided = true;
+                }
+                if ((shared.follower_ < 64)
+                    && !(allowed & (UINT64_C(1) << shared.follower_))) {
+                        predicted_ = true;
+                        continue;
                 }
-        }
 
-        if (d.address_ == rule.end()) {  // complete
-                if (endRule(d)) {
-                        pop(d.gss_head_, d.sppf_node_, d.depth_);
+                if (parser_.debugEnabled()) {
+                        ulog << setw(depth(d) * DEBUG_INDENT) << ""
+                             << "SHARE  " << nonterminal.name() << '.' << ir
+                             << " -> " << nonterminal.name() << '.'
+                             << shared.follower_ << '[' << length << "] @ "
+                             << offset(d.input_pos_) << std::endl;
                 }
+
+                const Rule &follower = nonterminal[shared.follower_];
+
+                add({ static_cast<Handle>(slotOf(follower) + length),
+                      d.gss_head_, d.input_pos_,
+                      followerNode(follower, d.sppf_node_), d.symbols_ });
         }
 }
 
 //--------------------------------------
-
+/*
+ * true if rule 'ir' of 'nonterminal' is among those beginNonTerminal()
+ * considers for the token at 'input_pos'
+ */
 bool
-Parser::GLL::endRule(
-        Descriptor     &d,
-        Mismatch::Kind  mismatch_kind
+Parser::GLL::candidate(
+        const NonTerminal &nonterminal,
+        size_t             ir,
+        Handle             input_pos
 )
 {
-        assert(d.address_);
+        auto &terminals = nonterminal.firstSet();
 
-        const char *dbg_prefix = nullptr;
-        const Rule &rule       = *d.address_->rule();
+        if (terminals.empty()) {
+                return true;
+        }
 
-        if (!mismatch_kind) {
-                ParseState state(parser_, start_, rule, d.input_pos_,
-                                 d.sppf_node_);
-                if (!rule.nonTerminal()->invokePostParseActions(state)) {
-                        mismatch_kind = Mismatch::POST_ACTION_FAILED;
-                        dbg_prefix = "XCFAIL ";
-                }
+        auto               i     = terminals.find(token(input_pos)->kind());
+        const RuleIndices &rules = (i != terminals.end())
+                                   ? i->second : nonterminal.anyTokenRules();
+
+        if (std::find(rules.begin(), rules.end(), ir) != rules.end()) {
+                return true;
         }
 
-        if (mismatch_kind) {
-                if (!recovery_pos_ ||
-                          (d.input_pos_->offset() >= recovery_pos_->offset())) {
-                        recovery_pos_ = d.input_pos_;
-                        poss_errors_.emplace_front(
-                                                Mismatch { d, mismatch_kind });
-                }
+        if (nonterminal.matchesEmpty()) {
+                i = terminals.find(TOK_NULL);
+                return (i != terminals.end())
+                        && (std::find(i->second.begin(), i->second.end(), ir)
+                                != i->second.end());
         }
 
-        if (parser_.debugEnabled()) {
-                // these variables make setting conditional breakpoints easy
-                bool log_comp_ix = false;
-                auto i_rule      = rule.index(),
-                     i_comp      = rule.indexOf(*d.address_);
-                auto offset      = d.input_pos_->offset();
+        return false;
+}
 
-                if (!mismatch_kind) {
-                        dbg_prefix = "FINISH ";
-                        offset = d.sppf_node_->endOffset();
-                } else if (!dbg_prefix) {
-                        dbg_prefix = "FAIL   ";
-                        log_comp_ix = true;
+//--------------------------------------
+/*
+ * called by getNodeP() as the leader of a shared prefix matches the
+ * component at 'slot' within that prefix, so that each follower gains an
+ * intermediate node of its own for the same derivation; the derivations
+ * resumed by resumeFollowers() are thus labelled with the follower's rule
+ * throughout, and later derivations of the prefix reach them too
+ */
+void
+Parser::GLL::shareDerivation(
+        GrammarAddress       slot,
+        Handle               left,
+        const SPPFNode::Ptr &right
+)
+{
+        const Rule        &leader      = *slot->rule();
+        const NonTerminal &nonterminal = *leader.nonTerminal();
+        size_t             ir          = leader.index(),
+                           index       = leader.indexOf(*slot);
+
+        for (const auto &shared: nonterminal.sharedPrefixes()) {
+                if ((shared.leader_ != ir) || (shared.length_ <= index)) {
+                        continue;
                 }
 
-                ulog << setw(d.depth_ * DEBUG_INDENT) << "" << dbg_prefix
-                     << rule.nonTerminal()->name() << '.' << i_rule;
+                const Rule &follower = nonterminal[shared.follower_];
 
-                if (log_comp_ix) {
-                        ulog << '[' << i_comp << ']';
-                }
+                getNodeP(address(slotOf(follower) + index),
+                         followerNode(follower, left), right);
+        }
+}
 
-                ulog << " @ " << offset << std::endl;
+//--------------------------------------
+/*
+ * the node of rule 'follower' corresponding to 'node', an SPPF node
+ * matching part of the prefix it shares with its leader; symbol nodes are
+ * common to both, intermediate nodes having been copied by shareDerivation()
+ */
+Handle
+Parser::GLL::followerNode(
+        const Rule &follower,
+        Handle      node
+)
+{
+        const SPPFNode::Ptr &n = sppf_[node];
+
+        if (!n || !n->isIntermediate()) {
+                return node;
         }
 
-        return !mismatch_kind;
+        const Rule &leader = *n->rule();
+        Handle      slot   = static_cast<Handle>(slotOf(follower)
+                                        + leader.indexOf(*n->component()));
+
+        // shared prefixes are never empty, so neither is 'n'
+        return getNode(new SPPFNode(*address(slot), n->firstToken(),
+                                    *n->lastToken())).first;
 }
+
 //--------------------------------------
+/*
+ * index of the first rule of ordered choice 'nonterminal' to have completed
+ * from 'input_pos', or SIZE_MAX if none has yet
+ */
+size_t
+Parser::GLL::committedChoice(
+        const NonTerminal &nonterminal,
+        Handle             input_pos
+) const
+{
+        auto i = committed_.find({ &nonterminal, input_pos });
+        return (i != committed_.end()) ? i->second
+                                       : std::numeric_limits<size_t>::max();
+}
 
+//--------------------------------------
+/*
+ * true if 'd' (within 'rule') need not continue because an earlier rule of
+ * the same ordered choice has completed from the same input position; the
+ * nonterminal's start position is that of its GSS node
+ */
 bool
-Parser::GLL::visited(
-        GrammarAddress      address,
-        const GSS::Node    *gss_head,
-        Token              *input_pos,
-        SPPFNode::ConstPtr  sppf_node
+Parser::GLL::overruled(
+        const Descriptor &d,
+        const Rule       &rule
 ) const
 {
-        return visited_.count(
-                VisitedItem { input_pos, address, gss_head, sppf_node }) > 0;
+        const NonTerminal &nonterminal = *rule.nonTerminal();
+
+        return nonterminal.isOrderedChoice()
+                && (committedChoice(nonterminal, gss_[d.gss_head_].input_pos_)
+                        < static_cast<size_t>(rule.index()));
 }
 
 //--------------------------------------
 
-bool
-Parser::GLL::test(
-        const Token       *input_pos,
-        const NonTerminal &nonterminal,
-        GrammarAddress     trailing_terms
-) const
+void
+Parser::GLL::commitChoice(
+        const Descriptor &d,
+        const Rule       &rule
+)
 {
-        return nonterminal.firstSet().empty()
-                || nonterminal.firstSet().count(input_pos->kind())
-                || (nonterminal.matchesEmpty()
-                        && testFollow(input_pos, trailing_terms));
+        const NonTerminal &nonterminal = *rule.nonTerminal();
+
+        if (nonterminal.isOrderedChoice()) {
+                size_t ir       = rule.index();
+                auto   inserted = committed_.emplace(
+                        ChoiceKey { &nonterminal,
+                                    gss_[d.gss_head_].input_pos_ }, ir);
+
+                if (!inserted.second && (ir < inserted.first->second)) {
+                        inserted.first->second = ir;
+                }
+        }
 }
 
 //--------------------------------------
 
 bool
-Parser::GLL::testFollow(
-        const Token    *input_pos,
-        GrammarAddress  trailing_terms
-) const
+Parser::GLL::beginRule(
+        const Rule     &rule,
+        Handle          gss_head,
+        Handle          input_pos,
+        Handle          symbols,
+        bool            immediate
+)
 {
-        if (!trailing_terms) {
-                return true;
+        ParseState state(parser_, *start_, rule, token(input_pos),
+                         symbols_[symbols]);
+
+        if (!rule.nonTerminal()->invokePreParseActions(state)) {
+                return false;
+        }
+
+        Descriptor d = { slotOf(rule), gss_head, input_pos, 0,
+                         symbolsOf(state.symbols()) };
+
+        if (immediate) {
+                parse(d);
+        } else {
+                add(d);
+        }
+
+        return true;
+}
+
+//--------------------------------------
+/*
+ * invokes the predicate of 'step', the component 'd' has reached; results
+ * of pure predicates are kept for the rest of the parse, while other
+ * predicates may change the symbol table carried by 'd'
+ */
+bool
+Parser::GLL::evaluate(
+        const Component &step,
+        Descriptor      &d
+)
+{
+        const Rule   &rule = *step.rule();
+        PredicateKey  key  = { step.predicate(), &rule, d.input_pos_ };
+
+        if (step.isPure()) {
+                auto i = predicate_results_.find(key);
+                if (i != predicate_results_.end()) {
+                        return i->second;
+                }
+        }
+
+        ParseState state(parser_, *start_, rule, token(d.input_pos_),
+                         symbols_[d.symbols_], sppf_[d.sppf_node_]);
+
+        bool result = step.predicate()(state);
+
+        if (step.isPure()) {
+                predicate_results_.emplace(key, result);
+        } else if (result) {
+                d.symbols_ = symbolsOf(state.symbols());
+        }
+
+        return result;
+}
+
+//--------------------------------------
+/*
+ * returns the handle of 'symbols', allocating one if this version of the
+ * table has not been seen before in this parse
+ */
+auto
+Parser::GLL::symbolsOf(
+        const SymbolTable &symbols
+) -> Handle
+{
+        auto i = symbol_ids_.emplace(symbols.version(),
+                                     static_cast<Handle>(symbols_.size()));
+        if (i.second) {
+                symbols_.push_back(symbols);
+        }
+        return i.first->second;
+}
+
+//--------------------------------------
+/*
+ * a single handle standing for GSS node 'gss_head' with symbol table
+ * 'symbols': the GSS node itself for table 0, which is all that grammars
+ * not using symbol tables ever see, or else an index allocated in contexts_
+ */
+Handle
+Parser::GLL::context(
+        Handle gss_head,
+        Handle symbols
+)
+{
+        if (!symbols && !(gss_head & CONTEXT_BIT)) {
+                return gss_head;
+        }
+
+        auto i = context_ids_.emplace(
+                        (static_cast<uint64_t>(gss_head) << 32) | symbols,
+                        static_cast<Handle>(contexts_.size() | CONTEXT_BIT));
+        if (i.second) {
+                contexts_.push_back({ gss_head, symbols });
+        }
+        return i.first->second;
+}
+
+//--------------------------------------
+
+auto
+Parser::GLL::pack(
+        const Descriptor &d
+) -> VisitedItem
+{
+        return { d.slot_, context(d.gss_head_, d.symbols_), d.input_pos_,
+                 d.sppf_node_ };
+}
+
+//--------------------------------------
+
+auto
+Parser::GLL::unpack(
+        const VisitedItem &item
+) const -> Descriptor
+{
+        if (!(item.context_ & CONTEXT_BIT)) {
+                return { item.slot_, item.context_, item.input_pos_,
+                         item.sppf_node_, 0 };
+        }
+
+        const Context &c = contexts_[item.context_ & ~CONTEXT_BIT];
+
+        return { item.slot_, c.gss_head_, item.input_pos_, item.sppf_node_,
+                 c.symbols_ };
+}
+
+//--------------------------------------
+
+void
+Parser::GLL::parse(
+        Descriptor &d
+)
+{
+        if (!d.slot_) {  // null slot equivalent to L0
+                return;
+        }
+
+        GrammarAddress addr = address(d.slot_);
+        const Rule    &rule = *addr->rule();
+
+        if (auto counts = profiled(addr)) {
+                ++counts->executions_;
+        }
+
+        if (overruled(d, rule)) {
+                if (parser_.debugEnabled()) {
+                        ulog << setw(depth(d) * DEBUG_INDENT) << ""
+                             << "CUT    " << rule.nonTerminal()->name()
+                             << '.' << rule.index() << " @ "
+                             << offset(d.input_pos_) << std::endl;
+                }
+                return;
+        }
+
+        if (parser_.debugEnabled() && (addr != rule.end())) {
+                ulog << setw(depth(d) * DEBUG_INDENT) << "";
+
+                // these variables make setting conditional breakpoints easy
+                auto *nonterminal = rule.nonTerminal();
+                auto  i_rule      = rule.index(),
+                      i_comp      = addr->index();
+                // fetch now to report the correct input offset
+                auto  offset      = token(d.input_pos_)->offset();
+
+                if (i_comp == 0) {
+                        ulog << "ENTER  ";
+                } else {
+                        ulog << "RESUME ";
+                }
+                ulog << nonterminal->name() << '.' << i_rule
+                     << '[' << i_comp << "] @ " << offset << std::endl;
+        }
+
+        bool leads = leadsSharedPrefix(rule);
+
+        for (; addr != rule.end(); ++addr, ++d.slot_) {
+                if (leads && (addr != rule.begin())) {
+                        resumeFollowers(d, rule, rule.indexOf(*addr));
+                }
+
+                Token           *input = token(d.input_pos_);
+                const Component &step  = *addr;
+
+                if (step.predicate()) {
+                        bool result = evaluate(step, d);
+
+                        if (!result && !step.isOptional()) {
+                                if (auto counts = profiled(addr)) {
+                                        ++counts->predicate_failures_;
+                                }
+                                endRule(d, Mismatch::PREDICATE_FAILED);
+                                return;
+                        }
+                }
+
+                if (step.isTerminal()) {
+                        TokenKind terminal = step.getAsTerminal();
+
+                        if ((terminal == TOK_NULL)
+                                        || (terminal == input->kind())) {
+                                Handle t_node = getNodeT(*input);
+                                if ((addr == rule.begin())
+                                    && std::next(addr) != rule.end()) {
+                                        /* rule.size() >= 2
+                                           and *rule.begin() is a terminal */
+                                        d.sppf_node_ = t_node;
+                                } else {
+                                        d.sppf_node_ = getNodeP(addr,
+                                                                d.sppf_node_,
+                                                                sppf_[t_node]);
+                                }
+                                ++d.input_pos_;
+                                if (step.isCommitPoint()) {
+                                        addCommit(d.input_pos_, sppf_[t_node]);
+                                }
+                        } else if (!step.isOptional()) {
+                                if (auto counts = profiled(addr)) {
+                                        ++counts->mismatches_;
+                                }
+                                endRule(d, Mismatch::TERMINAL_MISMATCH);
+                                return;
+                        } else {
+                                d.sppf_node_ = getNodeP(addr, d.sppf_node_,
+                                                sppf_[getEmptyNodeAt(*input)]);
+                        }
+                } else if (step.isNonTerminal()) {
+                        GrammarAddress return_addr = std::next(addr);
+                        auto           nonterminal = step.getAsNonTerminal();
+
+                        bool skip_optional = step.isOptional()
+                                        && !nonterminal->matchesEmpty()
+                                        && !visited(d.slot_ + 1, d.gss_head_,
+                                                    d.input_pos_, d.sppf_node_,
+                                                    d.symbols_),
+                             ok = false;
+
+                        if (test(input, *nonterminal, return_addr)) {
+                                Handle new_gss_head = create(d.slot_,
+                                                             d.gss_head_,
+                                                             d.input_pos_,
+                                                             d.symbols_,
+                                                             d.sppf_node_,
+                                                             depth(d) + 1);
+
+                                ok = beginNonTerminal(*nonterminal,
+                                                    new_gss_head, d.input_pos_,
+                                                    d.symbols_, depth(d) + 1);
+                        } else if (parser_.debugEnabled()) {
+                                ulog << setw(depth(d) * DEBUG_INDENT) << ""
+                                     << "NORULE " << nonterminal->name()
+                                     << " @ " << input->offset()
+                                     << std::endl;
+                        }
+
+                        ok = ok || skip_optional;
+
+                        if (!ok) {
+                                if (auto counts = profiled(addr)) {
+                                        ++counts->mismatches_;
+                                }
+                                endRule(d, Mismatch::NO_RULE);
+                                return;
+                        }
+
+                        if (!skip_optional) {
+                                /* must return directly to main loop
+                                   (equivalent of goto L0 in GLL paper) */
+                                break;
+                        } /* else optional nonterminal that doesn't match empty:
+                             attempt path omitting that nonterminal */
+
+                        d.sppf_node_ = getNodeP(addr, d.sppf_node_,
+                                                sppf_[getEmptyNodeAt(*input)]);
+                }
+        }
+
+        if (addr == rule.end()) {  // complete
+                if (!overruled(d, rule) && endRule(d)) {
+                        commitChoice(d, rule);
+                        recordSuccess(d, rule);
+                        pop(d.gss_head_, d.sppf_node_, d.input_pos_,
+                            d.symbols_);
+                }
+        }
+}
+
+//--------------------------------------
+
+bool
+Parser::GLL::endRule(
+        Descriptor     &d,
+        Mismatch::Kind  mismatch_kind
+)
+{
+        assert(d.slot_);
+
+        const char    *dbg_prefix = nullptr;
+        GrammarAddress addr       = address(d.slot_);
+        const Rule    &rule       = *addr->rule();
+        Token         *input;
+
+        if (!mismatch_kind && d.sppf_node_) {
+                /* report the last token matched rather than reading the
+                   token following it, which may not be available yet */
+                input = sppf_[d.sppf_node_]->lastToken();
+        } else {
+                input = token(d.input_pos_);
+        }
+
+        if (!mismatch_kind) {
+                ParseState state(parser_, *start_, rule, input,
+                                 symbols_[d.symbols_], sppf_[d.sppf_node_]);
+                if (!rule.nonTerminal()->invokePostParseActions(state)) {
+                        mismatch_kind = Mismatch::POST_ACTION_FAILED;
+                        dbg_prefix = "XCFAIL ";
+                } else {
+                        d.symbols_ = symbolsOf(state.symbols());
+                }
+        }
+
+        if (mismatch_kind) {
+                if (!recovery_pos_ ||
+                                (input->offset() >= recovery_pos_->offset())) {
+                        recovery_pos_ = input;
+                        poss_errors_.emplace_front(
+                                                Mismatch { d, mismatch_kind });
+                }
+        }
+
+        if (parser_.debugEnabled()) {
+                // these variables make setting conditional breakpoints easy
+                bool log_comp_ix = false;
+                auto i_rule      = rule.index(),
+                     i_comp      = rule.indexOf(*addr);
+                auto offset      = input->offset();
+
+                if (!mismatch_kind) {
+                        dbg_prefix = "FINISH ";
+                        if (d.sppf_node_) {
+                                offset = sppf_[d.sppf_node_]->endOffset();
+                        }
+                } else if (!dbg_prefix) {
+                        dbg_prefix = "FAIL   ";
+                        log_comp_ix = true;
+                }
+
+                ulog << setw(depth(d) * DEBUG_INDENT) << "" << dbg_prefix
+                     << rule.nonTerminal()->name() << '.' << i_rule;
+
+                if (log_comp_ix) {
+                        ulog << '[' << i_comp << ']';
+                }
+
+                ulog << " @ " << offset << std::endl;
+        }
+
+        return !mismatch_kind;
+}
+//--------------------------------------
+
+bool
+Parser::GLL::visited(
+        Handle slot,
+        Handle gss_head,
+        Handle input_pos,
+        Handle sppf_node,
+        Handle symbols
+) const
+{
+        Handle context = gss_head;
+
+        if (symbols || (gss_head & CONTEXT_BIT)) {
+                auto i = context_ids_.find(
+                        (static_cast<uint64_t>(gss_head) << 32) | symbols);
+                if (i == context_ids_.end()) {
+                        return false;
+                }
+                context = i->second;
+        }
+
+        return visited_.count(VisitedItem {
+                slot, context, input_pos, sppf_node }) > 0;
+}
+
+//--------------------------------------
+
+bool
+Parser::GLL::test(
+        const Token       *input_pos,
+        const NonTerminal &nonterminal,
+        GrammarAddress     trailing_terms
+) const
+{
+        return nonterminal.firstSet().empty()
+                || nonterminal.firstSet().count(input_pos->kind())
+                || nonterminal.matchesAnyToken()
+                || (nonterminal.matchesEmpty()
+                        && testFollow(input_pos, trailing_terms));
+}
+
+//--------------------------------------
+
+bool
+Parser::GLL::testFollow(
+        const Token    *input_pos,
+        GrammarAddress  trailing_terms
+) const
+{
+        if (!trailing_terms) {
+                return true;
         }
 
         const Rule &rule = *trailing_terms->rule();
 
-        for (; trailing_terms != rule.end(); ++trailing_terms) {
-                const Component &comp = *trailing_terms;
+        for (; trailing_terms != rule.end(); ++trailing_terms) {
+                const Component &comp = *trailing_terms;
+
+                if (comp.isTerminal()) {
+                        TokenKind t = comp.getAsTerminal();
+                        if ((t == TOK_NULL) || (t == input_pos->kind())) {
+                                return true;
+                        } else if (!comp.isOptional()) {
+                                return false;
+                        }
+                } else if (comp.isNonTerminal()) {
+                        return test(input_pos, *comp.getAsNonTerminal(),
+                                    ++trailing_terms);
+                } else if (!comp.isOptional()) {
+                        return true;  // don't know, err on side of caution
+                }
+        }
+
+        return true;
+}
+
+//--------------------------------------
+
+void
+Parser::GLL::add(
+        Descriptor d
+)
+{
+        if (parser_.isBounded()
+                        && (cost(sppf_[d.sppf_node_]) > parser_.costLimit())) {
+                if (parser_.debugEnabled()) {
+                        ulog << setw(depth(d) * DEBUG_INDENT) << ""
+                             << "BEAM   @ " << offset(d.input_pos_)
+                             << std::endl;
+                }
+                return;
+        }
+
+        // if {L, u, w} not in Uj (visited_[j]) add {L, u, w} to Uj
+        VisitedItem item = pack(d);
+        bool        ok   = visited_.insert(item).second;
+
+        if (ok) {
+                in_progress_.push_back(item);  // add {L, u, i, w} to R
+                ++parser_.statistics_.descriptors_;
+        } else if (parser_.debugEnabled()) {
+                ulog << setw(depth(d) * DEBUG_INDENT) << "" << "IGNORE ";
+
+                if (d.slot_) {
+                        GrammarAddress addr = address(d.slot_);
+                        const Rule &rule = *addr->rule();
+                        auto *nonterminal = rule.nonTerminal();
+                        auto  i_rule = rule.index(),
+                              i_comp = addr->index();
+                        ulog << nonterminal->name() << '.' << i_rule
+                             << '[' << i_comp << ']';
+                } else {
+                        ulog << start_->name();
+                }
+
+                ulog << " @ " << offset(d.input_pos_) << std::endl;
+        }
+}
+
+//--------------------------------------
+
+void
+Parser::GLL::pop(
+        Handle gss_head,     // a.k.a. 'u'
+        Handle parsed_node,  // a.k.a. 'z'
+        Handle input_pos,    // a.k.a. 'i'
+        Handle symbols
+)
+{
+        assert(parsed_node);
+
+        gss_[gss_head].addPopped(parsed_node, input_pos, symbols);
+
+        /* GSS nodes are not created below here, so references into gss_
+           remain valid */
+        const GSS::Node &u              = gss_[gss_head];
+        Handle           return_address = u.return_addr_;
+        SPPFNode::Ptr    hidden;
+
+        if (return_address) {
+                if (auto counts = profiled(address(return_address))) {
+                        ++counts->pops_;
+                }
+                hidden = hideDelegateOrTransparent(sppf_[parsed_node]);
+                if (address(return_address)->isCommitPoint()) {
+                        addCommit(input_pos, hidden);
+                }
+        }
+
+        for (const GSS::Edge &gss_edge: u.children_) {
+                Handle y = 0;
+
+                if (return_address) {
+                        y = getNodeP(address(return_address),
+                                     gss_edge.sppf_node_, hidden);
+                } else {  // top-level match
+                        if (!matched_ || (input_pos > matched_end_)) {
+                                matched_ = parsed_node;
+                                matched_end_ = input_pos;
+                                matched_symbols_ = symbols;
+                        } /* else match is too short (so ignore it)
+                             or equal length (will already be set) */
+
+                        switch (parser_.matchPolicy()) {
+                        case Parser::LONGEST_MATCH:
+                                break;
+                        case Parser::FIRST_MATCH_AT_EOF:
+                                if (token(input_pos)->is(TOK_EOF)) {
+                                        finished_ = true;
+                                }
+                                break;
+                        }
+                }
+
+                add({ return_address ? return_address + 1 : 0,
+                      gss_edge.child_, input_pos, y, symbols });
+        }
+}
+
+//--------------------------------------
+
+Handle
+Parser::GLL::create(
+        Handle         return_address,
+        Handle         gss_head,
+        Handle         input_pos,
+        Handle         symbols,
+        Handle         sppf_node,
+        unsigned short depth
+)
+{
+        assert(return_address);
+
+        auto gss_insert = gss_.emplace(return_address, input_pos, symbols,
+                                       depth);
+                // if there is not already a GSS node labelled (L, i, S)
+                // create one
+        Handle v = gss_insert.first;
+                // let v be the GSS node labelled (L, i, S)
+
+        if (gss_insert.second) {
+                ++parser_.statistics_.gss_nodes_;
+        }
+
+        if (!gss_[v].addChild(gss_head, sppf_node)) {
+                return v;
+        }
+
+        ++parser_.statistics_.gss_edges_;
+
+        if (!gss_insert.second) {
+                // new edge to pre-existing GSS head node
+                // for all (v, z) in P (a.k.a. gss_[v].popped_)
+                for (const GSS::Popped &popped: gss_[v].popped_) {
+                        // apply previously-parsed node(s) down the new edge
+                        SPPFNode::Ptr hidden = hideDelegateOrTransparent(
+                                                sppf_[popped.parsed_node_]);
+                        Handle y = getNodeP(address(return_address), sppf_node,
+                                            hidden);
+
+                        if (address(return_address)->isCommitPoint()) {
+                                addCommit(popped.input_pos_, hidden);
+                        }
+
+                        add({ return_address + 1, gss_head,
+                              popped.input_pos_, y, popped.symbols_ });
+                }
+        }
+
+        return v;
+}
+
+//--------------------------------------
+/*
+ * kinds of the next (up to) 4 tokens from 'input_pos' packed into 64 bits,
+ * stopping at end of input
+ */
+uint64_t
+Parser::GLL::lookahead(
+        Handle input_pos
+)
+{
+        uint64_t result = 0;
+
+        for (unsigned i = 0; i < parser_.predictionDepth(); ++i) {
+                const Token *t = token(input_pos + i);
+                result |= static_cast<uint64_t>(t->kind()) << (i * 16);
+                if (t->is(TOK_EOF)) {
+                        break;
+                }
+        }
+
+        return result;
+}
+
+//--------------------------------------
+/*
+ * bit mask of the rules of 'nonterminal' worth beginning at 'input_pos',
+ * leaving out only those that previous parses saw fail, and never complete,
+ * after the same lookahead. The decision is recorded in 'decision' so that
+ * the rules begun and those going on to complete from here can be noted.
+ */
+uint64_t
+Parser::GLL::predict(
+        const NonTerminal  &nonterminal,
+        Handle              input_pos,
+        Decision          *&decision
+)
+{
+        static constexpr uint64_t ALL = ~UINT64_C(0);
+
+        if (!parser_.predictionDepth() || (nonterminal.size() > 64)) {
+                return ALL;
+        }
 
-                if (comp.isTerminal()) {
-                        if (comp.getAsTerminal() == input_pos->kind()) {
-                                return true;
-                        } else if (!comp.isOptional()) {
-                                return false;
-                        }
-                } else if (comp.isNonTerminal()) {
-                        return test(input_pos, *comp.getAsNonTerminal(),
-                                    ++trailing_terms);
-                } else if (!comp.isOptional()) {
-                        return true;  // don't know, err on side of caution
+        uint64_t lookahead = this->lookahead(input_pos);
+
+        decision = &decisions_.emplace(ChoiceKey { &nonterminal, input_pos },
+                                       Decision { lookahead, 0, 0 })
+                                                        .first->second;
+
+        if (predict_) {
+                auto i = predictions_.find({ &nonterminal, lookahead });
+                if (i != predictions_.end()) {
+                        return ~(i->second.failed_ & ~i->second.succeeded_);
                 }
         }
 
-        return true;
+        return ALL;
 }
 
 //--------------------------------------
 
 void
-Parser::GLL::add(
-        Descriptor d
+Parser::GLL::recordSuccess(
+        const Descriptor &d,
+        const Rule       &rule
 )
 {
-        assert(d.gss_head_);
-        assert(d.input_pos_);
+        RuleProfile *profile = parser_.ruleProfile();
 
-        // if {L, u, w} not in Uj (visited_[j]) add {L, u, w} to Uj
-        bool ok = visited_.emplace(VisitedItem {
-                d.input_pos_, d.address_, d.gss_head_, d.sppf_node_ }).second;
+        if (decisions_.empty() && !profile) {
+                return;
+        }
 
-        if (ok) {
-                in_progress_.push_back(d);  // add {L, u, i, w} to R
-        } else if (parser_.debugEnabled()) {
-                ulog << setw(d.depth_ * DEBUG_INDENT) << "" << "IGNORE ";
+        const NonTerminal &nonterminal = *rule.nonTerminal();
+        Handle             start       = gss_[d.gss_head_].input_pos_;
 
-                if (d.address_) {
-                        const Rule &rule = *d.address_->rule();
-                        auto *nonterminal = rule.nonTerminal();
-                        auto  i_rule = rule.index(),
-                              i_comp = d.address_->index();
-                        ulog << nonterminal->name() << '.' << i_rule
-                             << '[' << i_comp << ']';
-                } else {
-                        ulog << start_.name();
-                }
+        if (profile) {
+                profile->record(nonterminal, token(start)->kind(),
+                                rule.index());
+        }
+
+        auto i = decisions_.find({ &nonterminal, start });
+
+        if (i != decisions_.end()) {
+                i->second.succeeded_ |= UINT64_C(1) << rule.index();
+        }
+}
+
+//--------------------------------------
+/*
+ * decisions in which no rule completed are not recorded, as the same
+ * lookahead may well succeed in another context; a rule seen both to
+ * complete and to fail after the same lookahead is never left out
+ */
+void
+Parser::GLL::updatePredictions()
+{
+        for (const auto &decision: decisions_) {
+                const Decision &d = decision.second;
 
-                ulog << " @ " << d.input_pos_->offset() << std::endl;
+                if (d.succeeded_) {
+                        Prediction &p = predictions_[{
+                                                decision.first.nonterminal_,
+                                                d.lookahead_ }];
+
+                        p.succeeded_ |= d.succeeded_;
+                        p.failed_ |= d.tried_ & ~d.succeeded_;
+                }
         }
 }
 
 //--------------------------------------
 
 void
-Parser::GLL::pop(
-        const GSS::Node *gss_head,     // a.k.a. 'u'
-        SPPFNode::Ptr    parsed_node,  // a.k.a. 'i'
-        unsigned short   depth         // a.k.a. 'z'
+Parser::GLL::addCommit(
+        Handle        input_pos,
+        SPPFNode::Ptr subtree
 )
 {
-        assert(gss_head);
-        assert(parsed_node);
+        for (const Commit &existing: commits_) {
+                if ((existing.input_pos_ == input_pos)
+                                && (existing.subtree_ == subtree)) {
+                        return;
+                }
+        }
+
+        commits_.push_back({ input_pos, std::move(subtree) });
+}
 
-        popped_.insert(Popped { gss_head, parsed_node });
+//--------------------------------------
+/*
+ * no descriptor can be created for an input position before the lowest
+ * among those in R, so commit points up to there take effect, though while
+ * predictions are applied they are only reported once the parse cannot be
+ * retried; descriptors holding back the remaining commit points are moved to
+ * the top of R so that they are processed first, except those beginning an
+ * ordered choice's later rules, which stay below the descriptors of the
+ * rules ordered ahead of them
+ */
+void
+Parser::GLL::applyCommits()
+{
+        Handle horizon  = std::numeric_limits<Handle>::max(),
+               pending  = 0,
+               prune_to = 0;
 
-        for (const GSS::Edge &gss_edge: gss_head->children()) {
-                GrammarAddress  return_address = gss_head->returnAddress();
-                SPPFNode::Ptr   y;
+        for (const VisitedItem &d: in_progress_) {
+                horizon = std::min(horizon, d.input_pos_);
+        }
 
-                if (return_address) {
-                        y = getNodeP(return_address, gss_edge.sppf_node_,
-                                     hideDelegateOrTransparent(parsed_node));
-                        ++return_address;
-                } else {  // top-level match
-                        if (!matched_ || (parsed_node->lastToken()->offset()
-                                          > matched_->lastToken()->offset())) {
-                                matched_ = parsed_node;
-                        } /* else match is too short (so ignore it)
-                             or equal length (will already be set) */
+        auto keep = commits_.begin();
+
+        for (Commit &c: commits_) {
+                if (c.input_pos_ <= horizon) {
+                        if (predict_) {
+                                deferred_.push_back(c);
+                        } else {
+                                parser_.onCommit(c.subtree_);
+                        }
+                        prune_to = std::max(prune_to, c.input_pos_);
+                } else {
+                        pending = std::max(pending, c.input_pos_);
+                        *keep++ = std::move(c);
                 }
+        }
 
-                add({ return_address, gss_edge.child_, parsed_node->lastToken(),
-                        y, static_cast<unsigned short>(depth - 1),
-                        !parsed_node->empty() });
+        commits_.erase(keep, commits_.end());
+
+        if (prune_to) {
+                prune(prune_to);
+        }
+
+        if (!commits_.empty()) {
+                std::stable_partition(in_progress_.begin(), in_progress_.end(),
+                                      [this, pending](const VisitedItem &d) {
+                                              return (d.input_pos_ >= pending)
+                                                  || pendingAlternative(
+                                                                d.slot_);
+                                      });
         }
 }
 
 //--------------------------------------
+/*
+ * true if 'slot' begins a rule of an ordered choice other than its first,
+ * which must not be explored before the rules ordered ahead of it
+ */
+bool
+Parser::GLL::pendingAlternative(
+        Handle slot
+) const
+{
+        if (!slot) {
+                return false;
+        }
 
-auto
-Parser::GLL::create(
-        GrammarAddress   return_address,
-        const GSS::Node *gss_head,
-        Token           *input_pos,
-        SPPFNode::Ptr    sppf_node,
-        unsigned short   depth
-) -> const GSS::Node *
+        GrammarAddress addr = address(slot);
+        const Rule    &rule = *addr->rule();
+
+        return (addr == rule.begin()) && (rule.index() > 0)
+                && rule.nonTerminal()->isOrderedChoice();
+}
+
+//--------------------------------------
+/*
+ * discard state that can no longer be looked up once all descriptors are at
+ * or beyond 'input_pos'; tokens are retained as the result refers to them
+ */
+void
+Parser::GLL::prune(
+        Handle input_pos
+)
 {
-        assert(return_address);
-        assert(gss_head);
-        assert(input_pos);
+        if (parser_.debugEnabled()) {
+                ulog << "COMMIT @ " << offset(input_pos) << std::endl;
+        }
+
+        for (auto i = visited_.begin(); i != visited_.end(); ) {
+                if (i->input_pos_ < input_pos) {
+                        i = visited_.erase(i);
+                } else {
+                        ++i;
+                }
+        }
 
-        auto gss_insert = gss_.emplace(return_address, input_pos);
-                // if there is not already a GSS node labelled (L, i) create one
-        const GSS::Node *v = gss_insert.first;
-                // let v be the GSS node labelled (L, i)
+        for (auto i = predicate_results_.begin();
+                                        i != predicate_results_.end(); ) {
+                if (i->first.input_pos_ < input_pos) {
+                        i = predicate_results_.erase(i);
+                } else {
+                        ++i;
+                }
+        }
 
-        if (v->addChild(*gss_head, sppf_node).second && !gss_insert.second) {
-                // new edge to pre-existing GSS head node
-                auto i = popped_.lower_bound({ v, nullptr });
-                // for all (v, z) in P (a.k.a. popped_)
-                for (; (i != popped_.end()) && (i->stack_head_ == v); ++i) {
-                        // apply previously-parsed node(s) down the new edge
-                        auto y = getNodeP(return_address, sppf_node,
-                                hideDelegateOrTransparent(i->parsed_node_));
+        /* GSS nodes reachable from R or from the index may yet be popped;
+           the SPPF nodes they and R refer to must be kept */
+        HandleSet           live_gss, live_sppf;
+        std::vector<Handle> pending;
 
-                        add({ std::next(return_address), gss_head,
-                                i->parsed_node_->lastToken(), y,
-                                static_cast<unsigned short>(depth - 1),
-                                !i->parsed_node_->empty() });
+        for (const VisitedItem &item: in_progress_) {
+                pending.push_back(unpack(item).gss_head_);
+                live_sppf.insert(item.sppf_node_);
+        }
+
+        gss_.forEachIndexed([&pending](Handle node) {
+                pending.push_back(node);
+        });
+
+        while (!pending.empty()) {
+                Handle node = pending.back();
+                pending.pop_back();
+
+                if (live_gss.insert(node).second) {
+                        for (const GSS::Edge &edge: gss_[node].children_) {
+                                live_sppf.insert(edge.sppf_node_);
+                                pending.push_back(edge.child_);
+                        }
+                        for (const GSS::Popped &popped: gss_[node].popped_) {
+                                live_sppf.insert(popped.parsed_node_);
+                        }
                 }
         }
 
-        return v;
+        /* a live GSS node may head the descriptors of an ordered choice's
+           later rules, which an earlier rule completing from the node's
+           position must still cut, however far they have got */
+        HandleSet live_starts;
+
+        for (Handle node: live_gss) {
+                live_starts.insert(gss_[node].input_pos_);
+        }
+
+        for (auto i = committed_.begin(); i != committed_.end(); ) {
+                if ((i->first.input_pos_ < input_pos)
+                                && !live_starts.count(i->first.input_pos_)) {
+                        i = committed_.erase(i);
+                } else {
+                        ++i;
+                }
+        }
+
+        gss_.retire(input_pos, live_gss);
+        live_sppf.insert(matched_);
+
+        /* SPPF nodes ending before the last token preceding input_pos can
+           no longer be produced by getNode(); release those not in use,
+           leaving any that form part of a larger subtree to their parents */
+        Token::Offset limit = token(input_pos - 1)->offset();
+
+        for (auto i = sppf_nodes_.begin(); i != sppf_nodes_.end(); ) {
+                if (!live_sppf.count(i->second)
+                                && (i->first->lastToken()->offset() < limit)) {
+                        sppf_[i->second] = nullptr;
+                        i = sppf_nodes_.erase(i);
+                } else {
+                        ++i;
+                }
+        }
+
+        /* nodes referred to only by costs_ are no longer in use; freeing
+           one may leave others referred to only by costs_ */
+        for (size_t erased = 1; erased; ) {
+                erased = 0;
+                for (auto i = costs_.begin(); i != costs_.end(); ) {
+                        if (i->first->use_count() == 1) {
+                                forgetCost((i++)->first);
+                                ++erased;
+                        } else {
+                                ++i;
+                        }
+                }
+        }
 }
 
 //--------------------------------------
@@ -1047,22 +2512,20 @@ Parser::GLL::hideDelegateOrTransparent(
 
 //--------------------------------------
 
-std::pair<SPPFNode::Ptr, bool>
+std::pair<Handle, bool>
 Parser::GLL::getNode(
         SPPFNode::Ptr key
 )
 {
-        auto i      = sppf_nodes_.find(key);
-        bool insert = false;
+        auto inserted = sppf_nodes_.emplace(key,
+                                            static_cast<Handle>(sppf_.size()));
 
-        if (i == sppf_nodes_.end()) {
-                insert = true;
-                sppf_nodes_.insert(key);
-        } else {
-                key = *i;
+        if (inserted.second) {
+                sppf_.push_back(std::move(key));
+                ++parser_.statistics_.sppf_nodes_;
         }
 
-        return std::make_pair(key, insert);
+        return std::make_pair(inserted.first->second, inserted.second);
 }
 
 //--------------------------------------
@@ -1086,105 +2549,326 @@ Parser::GLL::getPackedNode(
                         }
                 }
         }
-
-        return std::make_pair(new SPPFNode(*slot, *pivot, empty), true);
+
+        return std::make_pair(new SPPFNode(*slot, *pivot, empty), true);
+}
+
+//--------------------------------------
+
+Handle
+Parser::GLL::getNodeT(
+        Token &terminal
+)
+{
+        return getNode(new SPPFNode(terminal)).first;
+}
+
+//--------------------------------------
+
+Handle
+Parser::GLL::getNodeP(
+        GrammarAddress slot,
+        Handle         left_node,
+        SPPFNode::Ptr  right
+)
+{
+        assert(slot);
+        assert(right);
+
+        const Rule &rule = *slot->rule();
+
+        assert(slot != rule.end());
+
+        SPPFNode::Ptr left         = sppf_[left_node];
+        bool          on_last_slot = std::next(slot) == rule.end();
+        Token        *left_extent;
+
+        if (!on_last_slot && leadsSharedPrefix(rule)) {
+                shareDerivation(slot, left_node, right);
+        }
+
+        if (left) {
+                if (!left->empty()) {
+                        left_extent = left->firstToken();
+                } else if (!right->empty()) {
+                        left_extent = left->lastToken();
+                } else {
+                        left_extent = nullptr;  // completely empty
+                }
+        } else {
+                if (!right->empty()) {
+                        left_extent = right->firstToken();
+                } else {
+                        left_extent = nullptr;
+                }
+        }
+
+        Token *right_extent, *pivot;
+
+        if (right->empty()) {
+                pivot = right->lastToken();
+                if (left) {
+                        right_extent = left->lastToken();
+                } else {
+                        right_extent = right->lastToken();
+                }
+        } else {
+                pivot = right->firstToken();
+                right_extent = right->lastToken();
+        }
+
+        SlotProfile::Counts *counts = profiled(slot);
+        Handle               ret;
+
+        if (on_last_slot) {
+                auto node = getNode(new SPPFNode(*rule.nonTerminal(),
+                                                 left_extent, *right_extent));
+                ret = node.first;
+                if (counts && node.second) {
+                        ++counts->nodes_;
+                }
+        } else {
+                auto node = getNode(new SPPFNode(*slot, left_extent,
+                                                 *right_extent));
+                ret = node.first;
+                if (counts && node.second) {
+                        ++counts->nodes_;
+                }
+
+                if (!left && right->isNonTerminal()
+                          && (right->nonTerminal() == rule.nonTerminal())
+                          && slot->isRecursive()
+                          && !rule.nonTerminal()->keepRecursion()) {
+                        for (auto child: right->children()) {
+                                if (parser_.isBounded()) {
+                                        addDerivation(sppf_[ret], child);
+                                } else {
+                                        sppf_[ret]->addChild(child);
+                                }
+                        }
+                        return ret;
+                }
+        }
+
+        SPPFNode::Ptr node   = sppf_[ret];
+        auto          packed = getPackedNode(node, slot, pivot, right->empty());
+
+        if (packed.second) {
+                ++parser_.statistics_.packed_nodes_;
+                if (counts) {
+                        ++counts->nodes_;
+                }
+                if (left) {
+                        packed.first->addChild(left);
+                }
+                packed.first->addChild(right);
+
+                if (parser_.isBounded()) {
+                        auto  rate  = rule.nonTerminal()->costFunction();
+                        Cost &entry = costs_[packed.first];
+
+                        entry.cost_ = (on_last_slot && rate)
+                                                ? rate(*packed.first) : 0;
+                        for (auto &child: packed.first->children()) {
+                                costs_[child].users_.push_back(
+                                                        packed.first.get());
+                        }
+                        addDerivation(node, packed.first);
+                } else {
+                        node->addChild(packed.first);
+                }
+
+                if (parser_.ambiguityProfile()
+                    && (node->countChildren() > 1)) {
+                        parser_.ambiguityProfile()->record(*node,
+                                                           *packed.first);
+                }
+        }
+
+        return ret;
+}
+
+//--------------------------------------
+/*
+ * cost of 'node' in bounded mode: the lowest cost of the derivations kept
+ */
+double
+Parser::GLL::cost(
+        const SPPFNode::Ptr &node
+) const
+{
+        if (!node) {
+                return 0;
+        }
+
+        auto i = costs_.find(node);
+
+        if (i == costs_.end()) {
+                return 0;  // terminal or empty node
+        }
+
+        double result = i->second.cost_;
+
+        if (node->isPacked()) {
+                for (const SPPFNode::Ptr &child: node->children()) {
+                        result += cost(child);
+                }
+        }
+
+        return result;
+}
+
+//--------------------------------------
+/*
+ * inserts 'packed', whose cost is known, among the packed children of
+ * 'parent' in ascending order of cost, discarding the most costly if there
+ * are then more than the beam width; if the lowest cost of 'parent' falls,
+ * so do the costs of the nodes above it
+ */
+void
+Parser::GLL::addDerivation(
+        const SPPFNode::Ptr &parent,
+        const SPPFNode::Ptr &packed
+)
+{
+        auto  &children = parent->children();
+        auto   prev     = children.before_begin();
+        double total    = cost(packed);
+        size_t count    = 0,
+               width    = parser_.beamWidth();
+
+        for (; prev != children.last(); ++prev, ++count) {
+                if (cost(*std::next(prev)) > total) {
+                        break;
+                }
+        }
+
+        if (width && (count >= width)) {
+                // no better than the derivations already kept
+                if (costs_[packed].users_.empty()) {
+                        forgetCost(packed);
+                }
+                return;
+        }
+
+        children.insert_after(prev, packed);
+        costs_[packed].users_.push_back(parent.get());
+
+        if (width && (children.size() > width)) {
+                auto last = children.before_begin();
+                for (size_t i = 0; i < width; ++i) {
+                        ++last;
+                }
+                dropDerivation(parent, *std::next(last));
+                children.erase_after(last);
+        }
+
+        auto inserted = costs_.emplace(parent, Cost { total, {} });
+
+        if (!inserted.second && (total < inserted.first->second.cost_)) {
+                inserted.first->second.cost_ = total;
+
+                std::vector<SPPFNode *> lowered = { parent.get() };
+
+                while (!lowered.empty()) {
+                        SPPFNode *node = lowered.back();
+                        lowered.pop_back();
+
+                        for (SPPFNode *derivation: costs_[node].users_) {
+                                for (SPPFNode *user:
+                                                costs_[derivation].users_) {
+                                        Cost  &entry = costs_[user];
+                                        double was   = entry.cost_;
+
+                                        rankDerivations(*user);
+                                        if (entry.cost_ < was) {
+                                                lowered.push_back(user);
+                                        }
+                                }
+                        }
+                }
+        }
 }
 
 //--------------------------------------
-
-SPPFNode::Ptr
-Parser::GLL::getNodeT(
-        Token &terminal
+/*
+ * detaches 'packed' from 'parent' for the purpose of cost tracking; the
+ * caller removes it from the children of 'parent'
+ */
+void
+Parser::GLL::dropDerivation(
+        const SPPFNode::Ptr &parent,
+        const SPPFNode::Ptr &packed
 )
 {
-        return getNode(new SPPFNode(terminal)).first;
+        auto &users = costs_[packed].users_;
+
+        users.erase(std::remove(users.begin(), users.end(), parent.get()),
+                    users.end());
+        if (users.empty()) {
+                forgetCost(packed);
+        }
 }
 
 //--------------------------------------
-
-SPPFNode::Ptr
-Parser::GLL::getNodeP(
-        GrammarAddress slot,
-        SPPFNode::Ptr  left,
-        SPPFNode::Ptr  right
+/*
+ * restores the order of the packed children of 'parent' after the cost of
+ * one of them has fallen, and updates the cost of 'parent'
+ */
+void
+Parser::GLL::rankDerivations(
+        SPPFNode &parent
 )
 {
-        assert(slot);
-        assert(right);
-
-        const Rule &rule = *slot->rule();
-
-        assert(slot != rule.end());
-
-        bool   on_last_slot = std::next(slot) == rule.end();
-        Token *left_extent;
+        std::vector<std::pair<double, SPPFNode::Ptr>> ranked;
 
-        if (left) {
-                if (!left->empty()) {
-                        left_extent = left->firstToken();
-                } else if (!right->empty()) {
-                        left_extent = left->lastToken();
-                } else {
-                        left_extent = nullptr;  // completely empty
-                }
-        } else {
-                if (!right->empty()) {
-                        left_extent = right->firstToken();
-                } else {
-                        left_extent = nullptr;
-                }
+        for (const SPPFNode::Ptr &child: parent.children()) {
+                ranked.emplace_back(cost(child), child);
         }
 
-        Token *right_extent, *pivot;
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const std::pair<double, SPPFNode::Ptr> &a,
+                            const std::pair<double, SPPFNode::Ptr> &b) {
+                return a.first < b.first;
+        });
 
-        if (right->empty()) {
-                pivot = right->lastToken();
-                if (left) {
-                        right_extent = left->lastToken();
-                } else {
-                        right_extent = right->lastToken();
-                }
-        } else {
-                pivot = right->firstToken();
-                right_extent = right->lastToken();
+        parent.children().clear();
+        for (auto &child: ranked) {
+                parent.children().push_back(std::move(child.second));
         }
 
-        SPPFNode::Ptr ret;
-
-        if (on_last_slot) {
-                ret = getNode(new SPPFNode(*rule.nonTerminal(), left_extent,
-                                           *right_extent)).first;
-        } else {
-                ret = getNode(new SPPFNode(*slot, left_extent,
-                                           *right_extent)).first;
-
-                if (!left && right->isNonTerminal()
-                          && (right->nonTerminal() == rule.nonTerminal())
-                          && slot->isRecursive()
-                          && !rule.nonTerminal()->keepRecursion()) {
-                        for (auto child: right->children()) {
-                                ret->addChild(child);
-                        }
-                        return ret;
-                }
+        if (!ranked.empty()) {
+                costs_[&parent].cost_ = ranked.front().first;
         }
+}
 
-        auto packed = getPackedNode(ret, slot, pivot, right->empty());
-
-        if (packed.second) {
-                if (left) {
-                        packed.first->addChild(left);
+//--------------------------------------
+/*
+ * removes the cost of 'node', and 'node' from the users of the nodes below
+ */
+void
+Parser::GLL::forgetCost(
+        const SPPFNode::Ptr &node
+)
+{
+        SPPFNode::Ptr keep = node;  // 'node' may refer to the key erased
+
+        for (const SPPFNode::Ptr &child: keep->children()) {
+                auto i = costs_.find(child);
+                if (i != costs_.end()) {
+                        auto &users = i->second.users_;
+                        users.erase(std::remove(users.begin(), users.end(),
+                                                keep.get()),
+                                    users.end());
                 }
-                packed.first->addChild(right);
-                ret->addChild(packed.first);
         }
 
-        return ret;
+        costs_.erase(keep);
 }
 
 //--------------------------------------
 
-SPPFNode::Ptr
+Handle
 Parser::GLL::getEmptyNodeAt(
         Token &pos
 )
@@ -1198,9 +2882,21 @@ Parser::GLL::getEmptyNodeAt(
  */
 WRPARSE_API
 Parser::Parser() :
-        lexer_      (nullptr),
-        debug_      (false),
-        error_limit_(DEFAULT_ERROR_LIMIT)
+        lexer_            (nullptr),
+        debug_            (false),
+        match_policy_     (LONGEST_MATCH),
+        engine_           (GLL_ENGINE),
+        compiled_grammar_ (nullptr),
+        prediction_depth_ (0),
+        rule_profile_     (nullptr),
+        slot_profile_     (nullptr),
+        ambiguity_profile_(nullptr),
+        token_recorder_   (nullptr),
+        beam_width_       (0),
+        cost_limit_       (std::numeric_limits<double>::infinity()),
+        error_limit_      (DEFAULT_ERROR_LIMIT),
+        statistics_       (),
+        workspace_limit_  (DEFAULT_WORKSPACE_LIMIT)
 {
 }
 
@@ -1278,6 +2974,9 @@ Parser::nextToken(
                                 orig_error_count = errorCount();
                         }
                 }
+                if (token_recorder_) {
+                        token_recorder_->recordToken(*next);
+                }
         } else if (pos) {
                 next = const_cast<Token *>(pos)->next();
         } else {
@@ -1300,6 +2999,9 @@ Parser::lastToken()
 WRPARSE_API Parser &
 Parser::reset()
 {
+        if (token_recorder_) {
+                token_recorder_->recordReset();
+        }
         tokens_.clear();
         diagnostics_.clear();
         DiagnosticCounter::reset();
@@ -1319,11 +3021,159 @@ Parser::enableDebug(
 
 //--------------------------------------
 
+WRPARSE_API Parser &
+Parser::setMatchPolicy(
+        MatchPolicy policy
+)
+{
+        match_policy_ = policy;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setEngine(
+        Engine engine
+)
+{
+        engine_ = engine;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setCompiledGrammar(
+        const CompiledGrammar *grammar
+)
+{
+        compiled_grammar_ = grammar;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setPredictionDepth(
+        unsigned depth
+)
+{
+        prediction_depth_ = std::min<unsigned>(depth, MAX_PREDICTION_DEPTH);
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::clearPredictions()
+{
+        if (gll_) {
+                gll_->clearPredictions();
+        }
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setRuleProfile(
+        RuleProfile *profile
+)
+{
+        rule_profile_ = profile;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setSlotProfile(
+        SlotProfile *profile
+)
+{
+        slot_profile_ = profile;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setAmbiguityProfile(
+        AmbiguityProfile *profile
+)
+{
+        ambiguity_profile_ = profile;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setTokenRecorder(
+        TokenRecorder *recorder
+)
+{
+        token_recorder_ = recorder;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setSymbols(
+        const SymbolTable &symbols
+)
+{
+        symbols_ = symbols;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setBeam(
+        size_t width,
+        double limit
+)
+{
+        beam_width_ = width;
+        cost_limit_ = limit;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API Parser &
+Parser::setWorkspaceLimit(
+        size_t limit
+)
+{
+        workspace_limit_ = limit;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API size_t
+Parser::workspaceSize() const
+{
+        return gll_ ? gll_->footprint() : 0;
+}
+
+//--------------------------------------
+
 WRPARSE_API SPPFNode::Ptr
 Parser::parse(
         const NonTerminal &start
 )
 try {
+        statistics_ = Statistics();
+
+        if (token_recorder_) {
+                token_recorder_->recordParse(start);
+        }
+
         if (!lexer_) {
                 throw std::logic_error("Parser::parse(): no lexer set\n");
         } else if (start.empty()) {
@@ -1334,18 +3184,11 @@ try {
                 return nullptr;
         }
 
-        GLL gll(*this, start);
+        SPPFNode::Ptr result;
 
-        // clear recorded diagnostics on scope exit
-        struct OnExit
-        {
-                OnExit(EmittedDiagnostics::Set &diags) : diagnostics_(diags) {}
-                ~OnExit() { diagnostics_.clear(); }
-
-                EmittedDiagnostics::Set &diagnostics_;
-        } on_exit(diagnostics_);
-
-        SPPFNode::Ptr result = gll.parseMain(tokens_.begin().node());
+        if ((engine_ != CRF_ENGINE) || !parseCRF(start, result)) {
+                result = parseGLL(start);
+        }
 
         if (result) {
                 TokenList::iterator next = tokens_.begin(),
@@ -1387,6 +3230,87 @@ try {
 
 //--------------------------------------
 
+SPPFNode::Ptr
+Parser::parseGLL(
+        const NonTerminal &start
+)
+{
+        /* reuse the persistent workspace unless parse() has been re-entered
+           from a parse action, in which case a temporary one is needed */
+        std::unique_ptr<GLL>  nested;
+        GLL                  *gll;
+
+        if (!gll_) {
+                gll_.reset(new GLL(*this));
+        }
+
+        if (!gll_->busy()) {
+                gll = gll_.get();
+        } else {
+                nested.reset(new GLL(*this));
+                gll = nested.get();
+        }
+
+        // clear recorded diagnostics and trim workspace on scope exit
+        struct OnExit
+        {
+                OnExit(Parser &parser, GLL &gll) : parser_(parser), gll_(gll) {}
+
+                ~OnExit()
+                {
+                        parser_.diagnostics_.clear();
+                        if ((&gll_ == parser_.gll_.get())
+                            && (gll_.footprint() > parser_.workspace_limit_)) {
+                                gll_.release();
+                        }
+                }
+
+                Parser &parser_;
+                GLL    &gll_;
+        } on_exit(*this, *gll);
+
+        return gll->parseMain(start, tokens_.begin().node());
+}
+
+//--------------------------------------
+
+void
+Parser::emitExpected(
+        const Token               &at,
+        const std::set<TokenKind> &expected
+)
+{
+        size_t       count = expected.size();
+        std::string  expect;
+        const char  *sep = "";
+
+        for (const auto &term: expected) {
+                expect += sep;
+                u8string_view term_name = lexer_->tokenKindName(term);
+
+                if (term_name.size() == 1) {
+                        expect += "'";
+                        if (term_name == "'") {
+                                expect += "\\";
+                        }
+                        expect += term_name.char_data();
+                        expect += "'";
+                } else {
+                        expect += term_name.char_data();
+                }
+
+                if (--count > 1) {
+                        sep = ", ";
+                } else {
+                        sep = " or ";
+                }
+        }
+
+        emit(Diagnostic::ERROR, at, "expected %s", expect);
+}
+
+//--------------------------------------
+
 WRPARSE_API void
 Parser::onDiagnostic(
         const Diagnostic &d
@@ -1405,6 +3329,15 @@ Parser::onDiagnostic(
 
 //--------------------------------------
 
+WRPARSE_API void
+Parser::onCommit(
+        SPPFNode::ConstPtr /* subtree */
+)
+{
+}
+
+//--------------------------------------
+
 WRPARSE_API void
 Parser::setErrorLimit(
         size_t limit
@@ -1437,12 +3370,14 @@ ParseState::ParseState(
         const NonTerminal   &start,
         const Rule          &rule,
         Token               *input_pos,
+        const SymbolTable   &symbols,
         SPPFNode::ConstPtr   parsed
 ) :
         parser_    (parser),
         start_     (start),
         rule_      (rule),
         input_pos_ (input_pos),
+        symbols_   (symbols),
         parsed_    (parsed)
 {
 }
@@ -0,0 +1,523 @@
+/**
+ * \file Profile.cxx
+ *
+ * \brief Recording of rule outcomes for profile-guided parsing, and of
+ *      parser work and ambiguity by grammar slot
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <wrutil/CityHash.h>
+
+#include <wrparse/Lexer.h>
+#include <wrparse/Profile.h>
+#include <wrparse/SPPF.h>
+
+
+namespace wr {
+namespace parse {
+
+
+static const char PROFILE_HEADER[] = "# wrparse rule profile 1";
+
+static const int MAX_EXCERPT_TOKENS = 16;
+
+//--------------------------------------
+
+WRPARSE_API auto
+RuleProfile::operator=(
+        const this_t &other
+) -> this_t &
+{
+        if (&other != this) {
+                table_ = other.table_;
+                cache_.clear();
+        }
+        return *this;
+}
+
+//--------------------------------------
+
+auto
+RuleProfile::countsFor(
+        const NonTerminal &nonterminal
+) -> Counts &
+{
+        auto i = cache_.find(&nonterminal);
+
+        if (i == cache_.end()) {
+                i = cache_.emplace(&nonterminal,
+                                   &table_[nonterminal.name()]).first;
+        }
+
+        return *i->second;
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+RuleProfile::record(
+        const NonTerminal &nonterminal,
+        TokenKind          first,
+        size_t             rule
+)
+{
+        ++countsFor(nonterminal)[{ first, rule }];
+}
+
+//--------------------------------------
+
+WRPARSE_API uint64_t
+RuleProfile::count(
+        const NonTerminal &nonterminal,
+        TokenKind          first,
+        size_t             rule
+) const
+{
+        auto i = table_.find(nonterminal.name());
+
+        if (i != table_.end()) {
+                auto j = i->second.find({ first, rule });
+                if (j != i->second.end()) {
+                        return j->second;
+                }
+        }
+
+        return 0;
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+RuleProfile::clear()
+{
+        table_.clear();
+        cache_.clear();
+}
+
+//--------------------------------------
+/*
+ * one line per count, fields separated by tabs:
+ *     <nonterminal name> <token kind> <rule index> <count>
+ */
+WRPARSE_API bool
+RuleProfile::save(
+        std::ostream &to
+) const
+{
+        to << PROFILE_HEADER << '\n';
+
+        for (const auto &nonterminal: table_) {
+                for (const auto &entry: nonterminal.second) {
+                        to << nonterminal.first << '\t'
+                           << entry.first.first << '\t'
+                           << entry.first.second << '\t'
+                           << entry.second << '\n';
+                }
+        }
+
+        return !to.fail();
+}
+
+//--------------------------------------
+
+WRPARSE_API bool
+RuleProfile::save(
+        const char *file_name
+) const
+{
+        std::ofstream to(file_name);
+        return to && save(to);
+}
+
+//--------------------------------------
+
+WRPARSE_API bool
+RuleProfile::load(
+        std::istream &from
+)
+{
+        std::string line, name;
+
+        while (std::getline(from, line)) {
+                if (line.empty() || (line[0] == '#')) {
+                        continue;
+                }
+
+                size_t tab = line.find('\t');
+
+                if ((tab == 0) || (tab == std::string::npos)) {
+                        return false;
+                }
+
+                name.assign(line, 0, tab);
+
+                std::istringstream fields(line.substr(tab + 1));
+                unsigned           kind;
+                size_t             rule;
+                uint64_t           count;
+
+                if (!(fields >> kind >> rule >> count)
+                                || (kind > TokenKind(~0U))) {
+                        return false;
+                }
+
+                table_[name][{ static_cast<TokenKind>(kind), rule }] += count;
+        }
+
+        return from.eof();
+}
+
+//--------------------------------------
+
+WRPARSE_API bool
+RuleProfile::load(
+        const char *file_name
+)
+{
+        std::ifstream from(file_name);
+        return from && load(from);
+}
+
+//--------------------------------------
+
+WRPARSE_API size_t
+RuleProfile::apply(
+        const NonTerminal &start
+) const
+{
+        size_t count = 0;
+
+        for (const NonTerminal *nt: reachableNonTerminals(start)) {
+                auto i = table_.find(nt->name());
+
+                if ((i == table_.end()) || nt->isOrderedChoice()) {
+                        continue;
+                }
+
+                const Counts &counts = i->second;
+
+                nt->orderFirstSet([&counts](TokenKind t, size_t ir) {
+                        auto j = counts.find({ t, ir });
+                        return (j != counts.end()) ? j->second : 0;
+                });
+                ++count;
+        }
+
+        return count;
+}
+
+
+//--------------------------------------
+
+WRPARSE_API auto
+SlotProfile::Counts::operator+=(
+        const Counts &other
+) -> Counts &
+{
+        executions_ += other.executions_;
+        mismatches_ += other.mismatches_;
+        predicate_failures_ += other.predicate_failures_;
+        pops_ += other.pops_;
+        nodes_ += other.nodes_;
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+SlotProfile::find(
+        const Component &slot
+) const -> const Counts *
+{
+        auto i = table_.find(&slot);
+        return (i == table_.end()) ? nullptr : &i->second;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+SlotProfile::total(
+        const NonTerminal &nonterminal
+) const -> Counts
+{
+        Counts result = {};
+
+        for (const Rule &rule: nonterminal) {
+                for (auto i = rule.begin(); ; ++i) {
+                        if (const Counts *counts = find(*i)) {
+                                result += *counts;
+                        }
+                        if (i == rule.end()) {
+                                break;
+                        }
+                }
+        }
+
+        return result;
+}
+
+//--------------------------------------
+
+static void
+dumpCounts(
+        std::ostream              &to,
+        const SlotProfile::Counts &counts
+)
+{
+        to << "exec=" << std::setw(8) << std::left << counts.executions_
+           << " miss=" << std::setw(8) << counts.mismatches_
+           << " pred=" << std::setw(8) << counts.predicate_failures_
+           << " pop=" << std::setw(8) << counts.pops_
+           << " nodes=" << counts.nodes_ << std::right;
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+SlotProfile::dump(
+        std::ostream      &to,
+        const NonTerminal &start,
+        const Lexer       &lexer
+) const
+{
+        using Entry = std::pair<const NonTerminal *, Counts>;
+
+        std::vector<Entry> busy;
+
+        for (const NonTerminal *nt: reachableNonTerminals(start)) {
+                Counts counts = total(*nt);
+
+                if (counts.executions_ || counts.mismatches_
+                    || counts.predicate_failures_ || counts.pops_
+                    || counts.nodes_) {
+                        busy.emplace_back(nt, counts);
+                }
+        }
+
+        std::stable_sort(busy.begin(), busy.end(),
+                         [](const Entry &a, const Entry &b) {
+                return a.second.executions_ > b.second.executions_;
+        });
+
+        for (const Entry &entry: busy) {
+                to << entry.first->name() << ": ";
+                dumpCounts(to, entry.second);
+                to << '\n';
+
+                for (const Rule &rule: *entry.first) {
+                        to << "    " << rule.index() << ":";
+                        for (const Component &comp: rule) {
+                                to << ' ';
+                                comp.dump(to, lexer);
+                        }
+                        to << '\n';
+
+                        for (auto i = rule.begin(); ; ++i) {
+                                std::ostringstream label;
+
+                                if (i == rule.end()) {
+                                        label << "(end)";
+                                } else {
+                                        i->dump(label, lexer);
+                                }
+
+                                to << "        " << std::setw(24) << std::left
+                                   << label.str() << std::right << ' ';
+
+                                if (const Counts *counts = find(*i)) {
+                                        dumpCounts(to, *counts);
+                                } else {
+                                        dumpCounts(to, Counts());
+                                }
+                                to << '\n';
+
+                                if (i == rule.end()) {
+                                        break;
+                                }
+                        }
+                }
+        }
+}
+
+
+//--------------------------------------
+
+size_t
+AmbiguityProfile::KeyHash::operator()(
+        const Key &k
+) const
+{
+        return stdHash(&k, sizeof(k));
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+AmbiguityProfile::record(
+        const SPPFNode &node,
+        const SPPFNode &packed
+)
+{
+        const Component *slot = node.isIntermediate() ? node.component()
+                                                      : nullptr;
+        Key              key  = { slot ? static_cast<const void *>(slot)
+                                       : node.nonTerminal(),
+                                  node.startOffset(), node.endOffset() };
+        auto             i    = spots_.emplace(key, Hotspot());
+        Hotspot         &spot = i.first->second;
+
+        if (i.second) {
+                spot.nonterminal_ = slot ? slot->rule()->nonTerminal()
+                                         : node.nonTerminal();
+                spot.slot_ = slot;
+                spot.start_ = key.start_;
+                spot.end_ = key.end_;
+                spot.line_ = node.startLine();
+                spot.column_ = node.startColumn();
+                spot.excerpt_ = node.content(MAX_EXCERPT_TOKENS);
+                spot.alternatives_ = 0;
+
+                for (auto &child: node.children()) {
+                        if (child->isPacked() && (child.get() != &packed)) {
+                                spot.rules_.insert(static_cast<size_t>(
+                                                child->rule()->index()));
+                        }
+                }
+        }
+
+        ++spot.alternatives_;
+        spot.rules_.insert(static_cast<size_t>(packed.rule()->index()));
+        ++rules_[packed.rule()];
+}
+
+//--------------------------------------
+
+WRPARSE_API uint64_t
+AmbiguityProfile::count(
+        const Rule &rule
+) const
+{
+        auto i = rules_.find(&rule);
+        return (i == rules_.end()) ? 0 : i->second;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+AmbiguityProfile::top(
+        size_t limit
+) const -> std::vector<const Hotspot *>
+{
+        std::vector<const Hotspot *> result;
+
+        result.reserve(spots_.size());
+        for (const auto &entry: spots_) {
+                result.push_back(&entry.second);
+        }
+
+        auto more = [](const Hotspot *a, const Hotspot *b) {
+                if (a->alternatives_ != b->alternatives_) {
+                        return a->alternatives_ > b->alternatives_;
+                }
+                return a->start_ < b->start_;
+        };
+
+        limit = std::min(limit, result.size());
+        std::partial_sort(result.begin(), result.begin() + limit,
+                          result.end(), more);
+        result.resize(limit);
+
+        return result;
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+AmbiguityProfile::clear()
+{
+        spots_.clear();
+        rules_.clear();
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+AmbiguityProfile::report(
+        std::ostream &to,
+        const Lexer  &lexer,
+        size_t        limit
+) const
+{
+        using RuleCount = std::pair<const Rule *, uint64_t>;
+
+        std::vector<RuleCount> rules(rules_.begin(), rules_.end());
+
+        std::sort(rules.begin(), rules.end(),
+                  [](const RuleCount &a, const RuleCount &b) {
+                if (a.second != b.second) {
+                        return a.second > b.second;
+                }
+                return a.first < b.first;
+        });
+
+        to << "Alternative derivations by rule:\n";
+        for (const RuleCount &entry: rules) {
+                const Rule &rule = *entry.first;
+
+                to << std::setw(12) << entry.second << "  "
+                   << rule.nonTerminal()->name() << '.' << rule.index()
+                   << ':';
+                for (const Component &comp: rule) {
+                        to << ' ';
+                        comp.dump(to, lexer);
+                }
+                to << '\n';
+        }
+
+        to << "Most ambiguous spans:\n";
+        for (const Hotspot *spot: top(limit)) {
+                to << std::setw(12) << spot->alternatives_ << "  "
+                   << spot->nonterminal_->name();
+                if (spot->slot_) {
+                        to << '.' << spot->slot_->rule()->index() << '['
+                           << spot->slot_->index() << ']';
+                }
+                to << " at " << spot->line_ << ':' << spot->column_
+                   << " (bytes " << spot->start_ << '-' << spot->end_
+                   << "), rules";
+
+                const char *sep = " ";
+
+                for (size_t ir: spot->rules_) {
+                        to << sep << ir;
+                        sep = ", ";
+                }
+                to << "\n                " << spot->excerpt_ << '\n';
+        }
+}
+
+
+} // namespace parse
+} // namespace wr
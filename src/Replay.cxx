@@ -0,0 +1,500 @@
+/**
+ * \file Replay.cxx
+ *
+ * \brief Recording and replay of the tokens consumed by parsers
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <string.h>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <wrutil/CityHash.h>
+
+#include <wrparse/CodeGen.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Parser.h>
+#include <wrparse/Replay.h>
+
+
+namespace wr {
+namespace parse {
+
+
+/*
+ * A recording is the magic string (including its terminating null), a
+ * byte giving the SpellingMode, then a record per event:
+ *
+ *      'T' kind, offset delta*, line delta*, column, flags, spelling length,
+ *          then with HASH_SPELLINGS and a spelling length above zero, the
+ *          spelling's CityHash64 as 8 bytes, least significant first
+ *      'P' fingerprint as 8 bytes, name length, name
+ *      'R'
+ *
+ * Integers are written seven bits per byte, least significant first, with
+ * the top bit set on all but the last byte. Fields marked * are
+ * differences from the previous token's, mapped to unsigned integers by
+ * zigzag encoding.
+ */
+static const char RECORDING_MAGIC[] = "wrptok1";
+
+enum : char
+{
+        RECORD_TOKEN = 'T',
+        RECORD_PARSE = 'P',
+        RECORD_RESET = 'R'
+};
+
+static const char INVALID_RECORDING[] = "invalid token recording";
+
+//--------------------------------------
+
+static void
+putVarint(
+        std::ostream &out,
+        uint64_t      value
+)
+{
+        char   buf[10];
+        size_t n = 0;
+
+        while (value >= 0x80) {
+                buf[n++] = static_cast<char>((value & 0x7f) | 0x80);
+                value >>= 7;
+        }
+        buf[n++] = static_cast<char>(value);
+        out.write(buf, n);
+}
+
+//--------------------------------------
+
+static uint64_t
+getVarint(
+        std::istream &in
+)
+{
+        uint64_t value = 0;
+
+        for (int shift = 0; shift < 64; shift += 7) {
+                int c = in.get();
+
+                if (c == std::istream::traits_type::eof()) {
+                        break;
+                }
+                value |= static_cast<uint64_t>(c & 0x7f) << shift;
+                if (!(c & 0x80)) {
+                        return value;
+                }
+        }
+
+        throw std::runtime_error(INVALID_RECORDING);
+}
+
+//--------------------------------------
+/*
+ * read a varint, throwing if it exceeds the maximum of type T
+ */
+template <typename T> static T
+getVarint(
+        std::istream &in
+)
+{
+        uint64_t value = getVarint(in);
+
+        if (value > std::numeric_limits<T>::max()) {
+                throw std::runtime_error(INVALID_RECORDING);
+        }
+        return static_cast<T>(value);
+}
+
+//--------------------------------------
+
+static void
+putFixed64(
+        std::ostream &out,
+        uint64_t      value
+)
+{
+        char buf[8];
+
+        for (char &c: buf) {
+                c = static_cast<char>(value & 0xff);
+                value >>= 8;
+        }
+        out.write(buf, sizeof(buf));
+}
+
+//--------------------------------------
+
+static uint64_t
+getFixed64(
+        std::istream &in
+)
+{
+        unsigned char buf[8];
+        uint64_t      value = 0;
+
+        if (!in.read(reinterpret_cast<char *>(buf), sizeof(buf))) {
+                throw std::runtime_error(INVALID_RECORDING);
+        }
+        for (int i = 7; i >= 0; --i) {
+                value = (value << 8) | buf[i];
+        }
+        return value;
+}
+
+//--------------------------------------
+
+static uint64_t
+zigzag(
+        int64_t delta
+)
+{
+        return (static_cast<uint64_t>(delta) << 1)
+               ^ static_cast<uint64_t>(delta >> 63);
+}
+
+//--------------------------------------
+
+static int64_t
+unzigzag(
+        uint64_t value
+)
+{
+        return static_cast<int64_t>(value >> 1)
+               ^ -static_cast<int64_t>(value & 1);
+}
+
+//--------------------------------------
+/*
+ * append `bytes` letters chosen by `hash` to `out`; equal arguments give
+ * equal spellings
+ */
+static void
+synthesizeSpelling(
+        std::string &out,
+        uint64_t     hash,
+        size_t       bytes
+)
+{
+        for (size_t i = 0; i < bytes; ++i) {
+                out += static_cast<char>('a' + hash % 26);
+                hash = hash * 6364136223846793005u + 1442695040888963407u;
+        }
+}
+
+//--------------------------------------
+/*
+ * the nonterminal named `name` among those reachable from `root`, or
+ * nullptr if there is none
+ */
+static const NonTerminal *
+findNonTerminal(
+        const NonTerminal &root,
+        const std::string &name
+)
+{
+        for (const NonTerminal *nt: reachableNonTerminals(root)) {
+                if (nt->name() && (name == nt->name())) {
+                        return nt;
+                }
+        }
+
+        return nullptr;
+}
+
+//--------------------------------------
+
+WRPARSE_API
+TokenRecorder::TokenRecorder(
+        std::ostream &out,
+        SpellingMode  mode
+) :
+        out_        (out),
+        mode_       (mode),
+        size_       (0),
+        last_offset_(0),
+        last_line_  (0)
+{
+        out_.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+        out_.put(static_cast<char>(mode_));
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+TokenRecorder::recordParse(
+        const NonTerminal &start
+)
+{
+        const char *name = start.name() ? start.name() : "";
+        size_t      length = strlen(name);
+
+        out_.put(RECORD_PARSE);
+        putFixed64(out_, grammarFingerprint(start));
+        putVarint(out_, length);
+        out_.write(name, length);
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+TokenRecorder::recordReset()
+{
+        out_.put(RECORD_RESET);
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+TokenRecorder::recordToken(
+        const Token &token
+)
+{
+        out_.put(RECORD_TOKEN);
+        putVarint(out_, token.kind());
+        putVarint(out_, zigzag(static_cast<int64_t>(token.offset())
+                               - last_offset_));
+        putVarint(out_, zigzag(static_cast<int64_t>(token.line())
+                               - last_line_));
+        putVarint(out_, token.column());
+        putVarint(out_, token.flags());
+        putVarint(out_, token.bytes());
+        if ((mode_ == HASH_SPELLINGS) && token.bytes()) {
+                auto spelling = token.spelling();
+
+                putFixed64(out_, CityHash64(spelling.char_data(),
+                                            spelling.bytes()));
+        }
+
+        last_offset_ = token.offset();
+        last_line_ = token.line();
+        ++size_;
+}
+
+//--------------------------------------
+
+WRPARSE_API
+ReplayLexer::ReplayLexer(
+        std::istream &recording
+) :
+        base_t(),
+        mode_ (TokenRecorder::HASH_SPELLINGS),
+        next_ (0),
+        root_ (nullptr)
+{
+        char magic[sizeof(RECORDING_MAGIC)];
+
+        if (!recording.read(magic, sizeof(magic))
+            || memcmp(magic, RECORDING_MAGIC, sizeof(magic))) {
+                throw std::runtime_error(INVALID_RECORDING);
+        }
+
+        switch (recording.get()) {
+        case TokenRecorder::HASH_SPELLINGS:
+                mode_ = TokenRecorder::HASH_SPELLINGS;
+                break;
+        case TokenRecorder::REDACT_SPELLINGS:
+                mode_ = TokenRecorder::REDACT_SPELLINGS;
+                break;
+        default:
+                throw std::runtime_error(INVALID_RECORDING);
+        }
+
+        int64_t offset = 0,
+                line   = 0;
+
+        for (int tag; (tag = recording.get())
+                                != std::istream::traits_type::eof(); ) {
+                switch (tag) {
+                case RECORD_TOKEN: {
+                        RecordedToken t;
+
+                        t.kind_ = getVarint<TokenKind>(recording);
+                        offset += unzigzag(getVarint(recording));
+                        line += unzigzag(getVarint(recording));
+                        t.column_ = getVarint<Column>(recording);
+                        t.flags_ = getVarint<TokenFlags>(recording);
+                        t.bytes_ = getVarint<uint16_t>(recording);
+
+                        if ((offset < 0)
+                            || (offset > std::numeric_limits<
+                                                Token::Offset>::max())
+                            || (line < 0)
+                            || (line > std::numeric_limits<Line>::max())
+                            || (spellings_.size() + t.bytes_
+                                > std::numeric_limits<uint32_t>::max())) {
+                                throw std::runtime_error(INVALID_RECORDING);
+                        }
+                        t.offset_ = static_cast<Token::Offset>(offset);
+                        t.line_ = static_cast<Line>(line);
+                        t.spelling_ = static_cast<uint32_t>(
+                                                        spellings_.size());
+
+                        if (mode_ == TokenRecorder::REDACT_SPELLINGS) {
+                                spellings_.append(t.bytes_, 'x');
+                        } else if (t.bytes_) {
+                                synthesizeSpelling(spellings_,
+                                                   getFixed64(recording),
+                                                   t.bytes_);
+                        }
+                        tokens_.push_back(t);
+                        break;
+                }
+                case RECORD_PARSE: {
+                        Event event;
+
+                        event.kind_ = Event::PARSE;
+                        event.fingerprint_ = getFixed64(recording);
+                        event.start_.resize(getVarint<uint32_t>(recording));
+                        if (!recording.read(&event.start_[0],
+                                            event.start_.size())) {
+                                throw std::runtime_error(INVALID_RECORDING);
+                        }
+                        event.tokens_ = tokens_.size();
+                        events_.push_back(std::move(event));
+                        break;
+                }
+                case RECORD_RESET:
+                        events_.push_back({ Event::RESET, std::string(), 0,
+                                            tokens_.size() });
+                        break;
+                default:
+                        throw std::runtime_error(INVALID_RECORDING);
+                }
+        }
+}
+
+//--------------------------------------
+
+WRPARSE_API Token &
+ReplayLexer::lex(
+        Token &out_token
+)
+{
+        out_token.reset();
+
+        if (next_ >= tokens_.size()) {
+                out_token.setKind(TOK_EOF);
+                if (!tokens_.empty()) {
+                        const RecordedToken &last = tokens_.back();
+
+                        out_token.setOffset(last.offset_ + last.bytes_)
+                                 .setLine(last.line_);
+                }
+                return out_token;
+        }
+
+        const RecordedToken &t = tokens_[next_++];
+
+        out_token.setKind(t.kind_)
+                 .setOffset(t.offset_)
+                 .setLine(t.line_)
+                 .setColumn(t.column_)
+                 .setFlags(t.flags_);
+        if (t.bytes_) {
+                out_token.setSpelling(u8string_view(
+                                        spellings_.data() + t.spelling_,
+                                        t.bytes_));
+        }
+        return out_token;
+}
+
+//--------------------------------------
+
+WRPARSE_API void
+ReplayLexer::prepare(
+        const NonTerminal &root
+)
+{
+        std::unordered_map<std::string,
+                           const NonTerminal *>  found;
+        std::unordered_map<const NonTerminal *,
+                           uint64_t>             fingerprints;
+        std::vector<const NonTerminal *>         starts;
+
+        root_ = nullptr;
+
+        for (const Event &event: events_) {
+                const NonTerminal *start = nullptr;
+
+                if (event.kind_ == Event::PARSE) {
+                        auto i = found.find(event.start_);
+
+                        if (i != found.end()) {
+                                start = i->second;
+                        } else if ((start = findNonTerminal(root,
+                                                        event.start_))) {
+                                found.emplace(event.start_, start);
+                                fingerprints.emplace(start,
+                                                grammarFingerprint(*start));
+                        } else {
+                                throw std::runtime_error(
+                                        "recorded start symbol \""
+                                        + event.start_ + "\" not found");
+                        }
+
+                        if (fingerprints[start] != event.fingerprint_) {
+                                throw std::runtime_error(
+                                        "grammar of \"" + event.start_
+                                        + "\" differs from that recorded");
+                        }
+                }
+                starts.push_back(start);
+        }
+
+        starts_.swap(starts);
+        root_ = &root;
+}
+
+//--------------------------------------
+
+WRPARSE_API size_t
+ReplayLexer::replay(
+        Parser            &parser,
+        const NonTerminal &root
+)
+{
+        if (root_ != &root) {
+                prepare(root);  // fail before parsing
+        }
+
+        size_t matched = 0;
+
+        rewind();
+        for (size_t i = 0; i < events_.size(); ++i) {
+                if (events_[i].kind_ == Event::RESET) {
+                        parser.reset();
+                        next_ = events_[i].tokens_;
+                } else if (parser.parse(*starts_[i])
+                           && !parser.errorCount()) {
+                        ++matched;
+                }
+        }
+
+        return matched;
+}
+
+
+} // namespace parse
+} // namespace wr
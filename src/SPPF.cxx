@@ -24,9 +24,12 @@
  * \endparblock
  */
 #include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include <forward_list>
 #include <fstream>
 #include <stdexcept>
+#include <vector>
 #include <wrutil/CityHash.h>
 #include <wrutil/Format.h>
 #include <wrutil/numeric_cast.h>
@@ -914,6 +917,259 @@ countNonTerminals(
 
 //--------------------------------------
 
+/*
+ * append the hash codes of a node's label, excluding its children, to `key`
+ */
+static void
+appendLabel(
+        std::vector<size_t> &key,
+        const SPPFNode      &node
+)
+{
+        key.push_back(node.kind());
+
+        switch (node.kind()) {
+        case SPPFNode::TERMINAL:
+                if (!node.empty()) {
+                        u8string_view spelling = node.firstToken()->spelling();
+                        key.push_back(node.terminal());
+                        key.push_back(stdHash(spelling.data(),
+                                              spelling.bytes()));
+                }
+                break;
+        case SPPFNode::NONTERMINAL:
+                key.push_back(stdHash(node.nonTerminal()->name(),
+                                      strlen(node.nonTerminal()->name())));
+                break;
+        case SPPFNode::PACKED: case SPPFNode::INTERMEDIATE:
+                if (node.nonTerminal()) {
+                        key.push_back(stdHash(node.nonTerminal()->name(),
+                                          strlen(node.nonTerminal()->name())));
+                        key.push_back(node.rule()->index());
+                        key.push_back(node.component()->index());
+                }
+                break;
+        }
+}
+
+//--------------------------------------
+
+static size_t
+hashKey(
+        const std::vector<size_t> &key
+)
+{
+        return stdHash(key.data(), key.size() * sizeof(key[0]));
+}
+
+//--------------------------------------
+
+namespace {
+
+/*
+ * Tarjan's algorithm over the SPPF, so that the nodes of a cycle can be
+ * hashed together, independently of which of them is reached first
+ */
+struct StructuralHasher
+{
+        StructuralHashes                                &hashes;
+        std::unordered_map<const SPPFNode *, size_t>     index;
+        std::unordered_map<const SPPFNode *, size_t>     low;
+        std::vector<const SPPFNode *>                    stack;
+
+        StructuralHasher(StructuralHashes &h) : hashes(h) {}
+
+        bool inProgress(const SPPFNode *node) const
+                { return index.count(node) && !hashes.count(node); }
+
+        void visit(const SPPFNode &root);
+        void enter(const SPPFNode &node);
+        size_t nodeHash(const SPPFNode &node) const;
+        void hashComponent(size_t first);
+};
+
+} // anonymous namespace
+
+//--------------------------------------
+/*
+ * hash of `node` from its label and the hashes of its children; children
+ * not yet hashed, which are in the same cycle, contribute their labels
+ */
+size_t
+StructuralHasher::nodeHash(
+        const SPPFNode &node
+) const
+{
+        std::vector<size_t> key;
+        appendLabel(key, node);
+
+        size_t first_child = key.size();
+
+        for (SPPFNode::ConstPtr child: node.children()) {
+                auto i = hashes.find(child.get());
+
+                if (i != hashes.end()) {
+                        key.push_back(i->second);
+                } else {
+                        std::vector<size_t> label;
+                        appendLabel(label, *child);
+                        key.push_back(~hashKey(label));
+                }
+        }
+
+        if (node.hasChildren() && node.firstChild()->isPacked()) {
+                // alternative parses: order of discovery is not significant
+                std::sort(key.begin() + first_child, key.end());
+        }
+
+        return hashKey(key);
+}
+
+//--------------------------------------
+
+/*
+ * made iterative, as nested SPPFs may be as deep as the input is long
+ */
+void
+StructuralHasher::visit(
+        const SPPFNode &root
+)
+{
+        struct Call
+        {
+                const SPPFNode                      *node_;
+                SPPFNode::ChildList::const_iterator  next_;  // child to visit
+        };
+
+        std::vector<Call> calls;
+
+        enter(root);
+        calls.push_back({ &root, root.children().begin() });
+
+        while (!calls.empty()) {
+                const SPPFNode *node = calls.back().node_;
+
+                if (calls.back().next_ != node->children().end()) {
+                        const SPPFNode *c = (calls.back().next_++)->get();
+
+                        if (hashes.count(c)) {
+                                continue;
+                        } else if (!index.count(c)) {
+                                enter(*c);
+                                calls.push_back({ c, c->children().begin() });
+                        } else if (inProgress(c)) {
+                                low[node] = std::min(low[node], index[c]);
+                        }
+                        continue;
+                }
+
+                calls.pop_back();
+
+                if (!calls.empty()) {
+                        const SPPFNode *parent = calls.back().node_;
+
+                        low[parent] = std::min(low[parent], low[node]);
+                }
+
+                if (low[node] == index[node]) {
+                        auto pos = std::find(stack.rbegin(), stack.rend(),
+                                             node);
+
+                        hashComponent(stack.rend() - pos - 1);
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+StructuralHasher::enter(
+        const SPPFNode &node
+)
+{
+        size_t n = index.size();
+
+        index[&node] = n;
+        low[&node] = n;
+        stack.push_back(&node);
+}
+
+//--------------------------------------
+/*
+ * hash the strongly-connected component at stack[first...], popping it;
+ * the members of a cycle are hashed as a whole from the unordered
+ * collection of their own hashes, then each is distinguished by its label
+ */
+void
+StructuralHasher::hashComponent(
+        size_t first
+)
+{
+        if (first + 1 == stack.size()) {
+                const SPPFNode *node = stack.back();
+                bool            self_loop = false;
+
+                for (SPPFNode::ConstPtr child: node->children()) {
+                        self_loop = self_loop || (child.get() == node);
+                }
+
+                if (!self_loop) {
+                        hashes[node] = nodeHash(*node);
+                        stack.pop_back();
+                        return;
+                }
+        }
+
+        std::vector<size_t> members;
+
+        for (size_t i = first; i < stack.size(); ++i) {
+                members.push_back(nodeHash(*stack[i]));
+        }
+        std::sort(members.begin(), members.end());
+
+        size_t cycle = hashKey(members);
+
+        for (size_t i = first; i < stack.size(); ++i) {
+                std::vector<size_t> key = { cycle };
+
+                appendLabel(key, *stack[i]);
+                hashes[stack[i]] = hashKey(key);
+        }
+
+        stack.resize(first);
+}
+
+//--------------------------------------
+
+WRPARSE_API size_t
+structuralHash(
+        const SPPFNode   &root,
+        StructuralHashes &hashes
+)
+{
+        auto i = hashes.find(&root);
+
+        if (i != hashes.end()) {
+                return i->second;
+        }
+
+        StructuralHasher(hashes).visit(root);
+        return hashes[&root];
+}
+
+//--------------------------------------
+
+WRPARSE_API size_t
+structuralHash(
+        const SPPFNode &root
+)
+{
+        StructuralHashes hashes;
+        return structuralHash(root, hashes);
+}
+
+//--------------------------------------
+
 template <typename NodeT> WRPARSE_API auto
 SubProductionWalkerTemplate<NodeT>::operator++() -> this_t &
 {
@@ -0,0 +1,116 @@
+/**
+ * \file StaticGrammar.cxx
+ *
+ * \brief Run-time instantiation of grammars analysed at compile time
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <vector>
+
+#include <wrparse/StaticGrammar.h>
+
+
+namespace wr {
+namespace parse {
+
+
+WRPARSE_API
+StaticGrammarInstance::StaticGrammarInstance(
+        const StaticGrammarData &data
+) :
+        nonterminals_(new NonTerminal[data.nonterminal_count_]),
+        size_        (data.nonterminal_count_)
+{
+        std::vector<Rules> rules(size_);
+
+        for (size_t r = 0; r < data.rule_count_; ++r) {
+                const StaticComponent *c = data.components_
+                                           + data.rule_begin_[r];
+                const StaticComponent *end = data.components_
+                                             + data.rule_begin_[r + 1];
+                Rules                 &nt_rules = rules[c->value_];
+
+                nt_rules.emplace_back(std::initializer_list<Component>());
+                Rule &rule = nt_rules.back();
+
+                while (++c != end) {
+                        if (c->isTerminal()) {
+                                rule.base_t::insert(rule.end() - 1,
+                                        Component(c->value_,
+                                                  c->isOptional()));
+                        } else {
+                                rule.base_t::insert(rule.end() - 1,
+                                        Component(nonterminals_[c->value_],
+                                                  c->isOptional()));
+                        }
+                }
+                rule.updateComponents();
+        }
+
+        for (size_t i = 0; i < size_; ++i) {
+                NonTerminal &nt = nonterminals_[i];
+
+                nt = NonTerminal(data.nonterminals_[i].name_,
+                                 std::move(rules[i]),
+                                 data.nonterminals_[i].flags_);
+        }
+
+        /* seed the FIRST set caches as NonTerminal::Analysis::finish()
+           would, rule indices in ascending order */
+        std::vector<size_t> rule_index(size_, 0);
+
+        for (size_t r = 0; r < data.rule_count_; ++r) {
+                size_t          i = data.components_[data.rule_begin_[r]]
+                                                                .value_;
+                NonTerminal    &nt = nonterminals_[i];
+                size_t          ir = rule_index[i]++;
+                const uint64_t *bits = data.rule_first_ + r * data.words_;
+
+                if (data.rule_any_[r]) {
+                        bits = data.first_ + i * data.words_;
+                        nt.any_rules_.push_back(ir);
+                }
+
+                for (size_t w = 0; w < data.words_; ++w) {
+                        for (size_t b = 0; b < 64; ++b) {
+                                if ((bits[w] >> b) & 1) {
+                                        nt.first_[data.terminals_[w * 64 + b]]
+                                                .push_back(ir);
+                                }
+                        }
+                }
+
+                if (data.rule_nullable_[r]) {
+                        nt.first_[TOK_NULL].push_back(ir);
+                }
+        }
+
+        for (size_t i = 0; i < size_; ++i) {
+                NonTerminal &nt = nonterminals_[i];
+
+                nt.matches_empty_ = data.nullable_[i];
+                nt.is_ll1_ = data.ll1_[i];
+                nt.got_first_set_ = true;
+        }
+}
+
+
+} // namespace parse
+} // namespace wr
@@ -0,0 +1,213 @@
+/**
+ * \file SymbolTable.cxx
+ *
+ * \brief Persistent scoped symbol table for context-sensitive parsing
+ *
+ * \copyright
+ * \parblock
+ *
+ *   Copyright 2014-2016 James S. Waller
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ *
+ * \endparblock
+ */
+#include <string.h>
+#include <algorithm>
+#include <wrutil/CityHash.h>
+
+#include <wrparse/SymbolTable.h>
+
+
+namespace wr {
+namespace parse {
+
+
+static int
+compare(
+        u8string_view      a,
+        const std::string &b
+)
+{
+        size_t n      = std::min(a.bytes(), b.size());
+        int    result = memcmp(a.char_data(), b.data(), n);
+
+        if (!result && (a.bytes() != b.size())) {
+                result = (a.bytes() < b.size()) ? -1 : 1;
+        }
+
+        return result;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+SymbolTable::define(
+        u8string_view name,
+        Value         value
+) -> this_t &
+{
+        size_t   priority = stdHash(name.char_data(), name.bytes());
+        NodePtr  symbols  = top_ ? top_->symbols_ : nullptr;
+        ScopePtr parent   = top_ ? top_->parent_ : nullptr;
+
+        top_ = new Scope(insert(symbols, name, priority, value),
+                         std::move(parent));
+        return *this;
+}
+
+//--------------------------------------
+/*
+ * copies the path from the root to the new node, rotating it upwards
+ * while its priority exceeds its parent's, so that the result is the same
+ * treap as would be built from scratch; other subtrees are shared
+ */
+auto
+SymbolTable::insert(
+        const NodePtr &root,
+        u8string_view  key,
+        size_t         priority,
+        Value          value
+) -> NodePtr // static
+{
+        if (!root) {
+                return new Node(std::string(key.char_data(), key.bytes()),
+                                value, priority, nullptr, nullptr);
+        }
+
+        int order = compare(key, root->key_);
+
+        if (order == 0) {
+                return new Node(root->key_, value, root->priority_,
+                                root->left_, root->right_);
+        } else if (order < 0) {
+                NodePtr left = insert(root->left_, key, priority, value);
+
+                if (left->priority_ > root->priority_) {  // rotate right
+                        return new Node(left->key_, left->value_,
+                                        left->priority_, left->left_,
+                                        new Node(root->key_, root->value_,
+                                                 root->priority_,
+                                                 left->right_, root->right_));
+                }
+                return new Node(root->key_, root->value_, root->priority_,
+                                std::move(left), root->right_);
+        } else {
+                NodePtr right = insert(root->right_, key, priority, value);
+
+                if (right->priority_ > root->priority_) {  // rotate left
+                        return new Node(right->key_, right->value_,
+                                        right->priority_,
+                                        new Node(root->key_, root->value_,
+                                                 root->priority_,
+                                                 root->left_, right->left_),
+                                        right->right_);
+                }
+                return new Node(root->key_, root->value_, root->priority_,
+                                root->left_, std::move(right));
+        }
+}
+
+//--------------------------------------
+
+auto
+SymbolTable::find(
+        const NodePtr &root,
+        u8string_view  key
+) -> const Value * // static
+{
+        for (const Node *node = root.get(); node; ) {
+                int order = compare(key, node->key_);
+
+                if (order == 0) {
+                        return &node->value_;
+                }
+                node = (order < 0) ? node->left_.get() : node->right_.get();
+        }
+
+        return nullptr;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+SymbolTable::find(
+        u8string_view name
+) const -> const Value *
+{
+        for (const Scope *scope = top_.get(); scope;
+                                              scope = scope->parent_.get()) {
+                if (const Value *found = find(scope->symbols_, name)) {
+                        return found;
+                }
+        }
+
+        return nullptr;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+SymbolTable::findLocal(
+        u8string_view name
+) const -> const Value *
+{
+        return top_ ? find(top_->symbols_, name) : nullptr;
+}
+
+//--------------------------------------
+
+WRPARSE_API auto
+SymbolTable::enterScope() -> this_t &
+{
+        if (!top_) {
+                top_ = new Scope(nullptr, nullptr);  // outermost
+        }
+
+        top_ = new Scope(nullptr, top_);
+        return *this;
+}
+
+//--------------------------------------
+
+WRPARSE_API bool
+SymbolTable::leaveScope()
+{
+        if (!top_ || !top_->parent_) {
+                return false;
+        }
+
+        top_ = top_->parent_;
+        return true;
+}
+
+//--------------------------------------
+
+WRPARSE_API size_t
+SymbolTable::depth() const
+{
+        size_t depth = 1;
+
+        if (top_) {
+                for (const Scope *scope = top_->parent_.get(); scope;
+                                              scope = scope->parent_.get()) {
+                        ++depth;
+                }
+        }
+
+        return depth;
+}
+
+
+} // namespace parse
+} // namespace wr
@@ -0,0 +1,88 @@
+#ifndef WRPARSE_TEST_CHAR_LEXER_H
+#define WRPARSE_TEST_CHAR_LEXER_H
+
+#include <ctype.h>
+#include <istream>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+#include <wrparse/Token.h>
+
+
+/*
+ * single-character tokens and the engines to parse them with, shared by
+ * the tests
+ */
+namespace {
+
+
+using namespace wr::parse;
+
+/*
+ * each character other than a space is a token of its own kind; rule
+ * components must be given terminals of enumerated type
+ */
+enum CharToken : TokenKind {};
+
+constexpr CharToken
+tok(
+        char c
+)
+{
+        return static_cast<CharToken>(TOK_USER_MIN + c);
+}
+
+/*
+ * lexes the characters of its input as tokens of kind tok(c), skipping
+ * spaces; with IDENTIFIERS, letters are instead tokens of kind tok('i')
+ * spelled by the letter
+ */
+class CharLexer : public Lexer
+{
+public:
+        enum Mode { CHARACTERS, IDENTIFIERS };
+
+        CharLexer(std::istream &input, Mode mode = CHARACTERS) :
+                Lexer(input), mode_(mode) {}
+
+        virtual Token &lex(Token &out_token) override
+        {
+                char32_t c;
+
+                out_token.reset();
+                do {
+                        c = read();
+                } while (c == ' ');
+                out_token.setOffset(offset());
+                if (c == eof) {
+                        out_token.setKind(TOK_EOF);
+                } else if ((mode_ == IDENTIFIERS)
+                           && isalpha(static_cast<int>(c))) {
+                        char spelling = static_cast<char>(c);
+
+                        out_token.setKind(tok('i'))
+                                 .setSpelling(
+                                        wr::u8string_view(&spelling, 1));
+                } else {
+                        out_token.setKind(tok(static_cast<char>(c)));
+                }
+                return out_token;
+        }
+
+private:
+        Mode mode_;
+};
+
+const Parser::Engine ENGINES[] = { Parser::GLL_ENGINE, Parser::CRF_ENGINE };
+
+inline const char *
+engineName(
+        Parser::Engine engine
+)
+{
+        return (engine == Parser::CRF_ENGINE) ? "CRF" : "GLL";
+}
+
+
+} // anonymous namespace
+
+#endif // !WRPARSE_TEST_CHAR_LEXER_H
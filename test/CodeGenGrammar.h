@@ -0,0 +1,84 @@
+#ifndef WRPARSE_TEST_CODE_GEN_GRAMMAR_H
+#define WRPARSE_TEST_CODE_GEN_GRAMMAR_H
+
+#include <wrparse/Grammar.h>
+#include <wrparse/Parser.h>
+#include <wrparse/Token.h>
+
+#include "CharLexer.h"
+
+
+/*
+ * grammar shared by GenerateTestParser, which writes TestParser.h from it,
+ * and CodeGenTests, which compares the generated code with the CRF engine's
+ * interpretation of it
+ */
+namespace {
+
+
+using namespace wr::parse;
+
+/*
+ * a pure predicate: numbers are accepted only near the start of the input
+ */
+bool
+nearStart(
+        ParseState &state
+)
+{
+        return state.input()->offset() < 40;
+}
+
+/*
+ * statements with a dangling 'else', and left-recursive expressions with
+ * optional and nullable parts; covers each kind of component the generator
+ * emits
+ */
+struct CodeGenGrammar
+{
+        NonTerminal program, stmt, expr, term, factor, sign, args;
+
+        CodeGenGrammar()
+        {
+                program = NonTerminal("program", {
+                        { program, stmt },
+                        { stmt }
+                });
+                stmt = NonTerminal("stmt", {
+                        { tok('i'), expr, stmt },
+                        { tok('i'), expr, stmt, tok('e'), stmt },
+                        { expr, tok(';') },
+                        { tok(';') }
+                });
+                expr = NonTerminal("expr", {
+                        { expr, tok('+'), term },
+                        { expr, tok('-'), term },
+                        { term }
+                });
+                term = NonTerminal("term", {
+                        { term, tok('*'), factor },
+                        { factor }
+                });
+                factor = NonTerminal("factor", {
+                        { sign, pure(Component(tok('n'), false,
+                                               nearStart)) },
+                        { tok('('), expr, tok(')') },
+                        { tok('f'), tok('('), Component(args, true),
+                          tok(')') },
+                        { tok('v'), Component(tok('\''), true) }
+                });
+                sign = NonTerminal("sign", {
+                        { Component(tok('-'), true) },
+                        { tok('+') }
+                });
+                args = NonTerminal("args", {
+                        { args, tok(','), expr },
+                        { expr }
+                });
+        }
+};
+
+
+} // anonymous namespace
+
+#endif // !WRPARSE_TEST_CODE_GEN_GRAMMAR_H
@@ -0,0 +1,191 @@
+#include <sstream>
+#include <wrutil/TestManager.h>
+#include <wrparse/CodeGen.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+#include <wrparse/SPPF.h>
+
+#include "CharLexer.h"
+#include "CodeGenGrammar.h"
+#include "TestParser.h"  // generated from CodeGenGrammar.h
+
+
+namespace wr {
+namespace parse {
+
+
+class CodeGenTests : public TestManager
+{
+public:
+        using this_t = CodeGenTests;
+        using base_t = TestManager;
+
+        CodeGenTests(int argc, const char **argv) :
+                base_t("parse::CodeGen", argc, argv) {}
+
+        int runAll();
+
+        static void bindsOnlyToSameGrammar(),
+                    matchesInterpretedEngine();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::CodeGenTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::CodeGenTests::runAll()
+{
+        run("bindsOnlyToSameGrammar", 1, bindsOnlyToSameGrammar);
+        run("matchesInterpretedEngine", 1, matchesInterpretedEngine);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using wr::TestFailure;
+
+/*
+ * counts the slots matched by generated code, to show that it was used
+ */
+class CountingParser : public TestParser
+{
+public:
+        CountingParser(const NonTerminal &start) :
+                TestParser(start), slots_(0) {}
+
+        void parse(Engine &engine, Slot slot, Pos left,
+                   Pos pos) const override
+        {
+                ++slots_;
+                TestParser::parse(engine, slot, left, pos);
+        }
+
+        mutable size_t slots_;
+};
+
+struct Outcome
+{
+        bool               matched_;
+        size_t             hash_;    // structural hash of the result
+        size_t             errors_;
+        Parser::Statistics stats_;
+};
+
+/*
+ * parses `input` as `start` with the CRF engine, using `compiled` if not
+ * nullptr
+ */
+Outcome
+parseCRF(
+        const NonTerminal     &start,
+        const char            *input,
+        const CompiledGrammar *compiled
+)
+{
+        std::istringstream in(input);
+        CharLexer          lexer(in);
+        Parser             parser(lexer);
+        Outcome            outcome;
+
+        parser.setEngine(Parser::CRF_ENGINE).setCompiledGrammar(compiled);
+
+        SPPFNode::Ptr result = parser.parse(start);
+
+        // the result refers to tokens owned by the parser
+        outcome.matched_ = (result != nullptr);
+        outcome.hash_ = result ? structuralHash(*result) : 0;
+        outcome.errors_ = parser.errorCount();
+        outcome.stats_ = parser.statistics();
+        return outcome;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+wr::parse::CodeGenTests::bindsOnlyToSameGrammar() // static
+{
+        CodeGenGrammar same, changed;
+
+        if (!TestParser(same.program).isBound()) {
+                throw TestFailure("generated code not bound to another"
+                                  " instance of its grammar");
+        }
+
+        changed.sign = NonTerminal("sign", { { tok('-') }, { tok('+') } });
+        if (TestParser(changed.program).isBound()) {
+                throw TestFailure("generated code bound to a changed"
+                                  " grammar");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::CodeGenTests::matchesInterpretedEngine() // static
+{
+        static const char *const INPUTS[] = {
+                "n ;",
+                "n + - n * ( v' - + n ) ;",
+                "f ( ) ; f ( n , f ( v , n ) ) ;",
+                "i n i v ; e ; ;",   // ambiguous
+                "i n ; e",           // incomplete
+                "n + * n ;",         // mismatch
+                "v ; v ; v ; v ; v ; v ; v ; v ; v ; v ; n ;"  // too late
+        };
+
+        CodeGenGrammar g;
+        CountingParser compiled(g.program);
+
+        for (const char *input: INPUTS) {
+                Outcome interpreted = parseCRF(g.program, input, nullptr);
+                size_t  slots       = compiled.slots_;
+                Outcome generated   = parseCRF(g.program, input, &compiled);
+
+                if (compiled.slots_ == slots) {
+                        throw TestFailure("generated code not used for"
+                                          " \"%s\"", input);
+                }
+                if ((interpreted.matched_ != generated.matched_)
+                    || (interpreted.hash_ != generated.hash_)) {
+                        throw TestFailure("engines built different SPPFs"
+                                          " for \"%s\"", input);
+                }
+                if (interpreted.errors_ != generated.errors_) {
+                        throw TestFailure("engines reported different"
+                                          " errors for \"%s\"", input);
+                }
+
+                const Parser::Statistics &a = interpreted.stats_,
+                                         &b = generated.stats_;
+
+                if ((a.descriptors_ != b.descriptors_)
+                    || (a.gss_nodes_ != b.gss_nodes_)
+                    || (a.gss_edges_ != b.gss_edges_)
+                    || (a.sppf_nodes_ != b.sppf_nodes_)
+                    || (a.packed_nodes_ != b.packed_nodes_)) {
+                        throw TestFailure("engines did different work for"
+                                          " \"%s\"", input);
+                }
+        }
+}
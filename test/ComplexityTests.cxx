@@ -0,0 +1,348 @@
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <wrutil/TestManager.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+
+#include "CharLexer.h"
+
+
+namespace wr {
+namespace parse {
+
+
+/*
+ * Parses families of generated inputs at doubling sizes and fits the
+ * growth of the parser's work counts (see Parser::statistics()) to a
+ * power of the input size. The counts are deterministic, so the tests are
+ * not affected by machine load.
+ */
+class ComplexityTests : public TestManager
+{
+public:
+        using this_t = ComplexityTests;
+        using base_t = TestManager;
+
+        ComplexityTests(int argc, const char **argv) :
+                base_t("parse::Complexity", argc, argv) {}
+
+        int runAll();
+
+        static void ll1List(),
+                    ll1Nesting(),
+                    ll1Arrays(),
+                    leftRecursiveList(),
+                    ambiguousSum(),
+                    ambiguousConcatenation();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::ComplexityTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::ComplexityTests::runAll()
+{
+        run("ll1List", 1, ll1List);
+        run("ll1Nesting", 1, ll1Nesting);
+        run("ll1Arrays", 1, ll1Arrays);
+        run("leftRecursiveList", 1, leftRecursiveList);
+        run("ambiguousSum", 1, ambiguousSum);
+        run("ambiguousConcatenation", 1, ambiguousConcatenation);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+
+using Generator = std::string (*)(size_t n);
+
+struct Measure
+{
+        const char *name;
+        size_t Parser::Statistics::*count;
+};
+
+const Measure MEASURES[] = {
+        { "descriptors",  &Parser::Statistics::descriptors_ },
+        { "GSS nodes",    &Parser::Statistics::gss_nodes_ },
+        { "GSS edges",    &Parser::Statistics::gss_edges_ },
+        { "SPPF nodes",   &Parser::Statistics::sppf_nodes_ },
+        { "packed nodes", &Parser::Statistics::packed_nodes_ }
+};
+
+/*
+ * parse the input generated for each size, throwing TestFailure if any
+ * parse fails
+ */
+std::vector<Parser::Statistics>
+measure(
+        const NonTerminal         &start,
+        Generator                  generate,
+        const std::vector<size_t> &sizes,
+        Parser::Engine             engine
+)
+{
+        std::vector<Parser::Statistics> results;
+
+        for (size_t n: sizes) {
+                std::istringstream input(generate(n));
+                CharLexer          lexer(input);
+                Parser             parser(lexer);
+
+                parser.setEngine(engine);
+
+                if (!parser.parse(start) || parser.errorCount()) {
+                        throw TestFailure("%s engine failed to parse input of"
+                                          " size %u", engineName(engine),
+                                          static_cast<unsigned>(n));
+                }
+                results.push_back(parser.statistics());
+        }
+
+        return results;
+}
+
+/*
+ * least-squares slope of log(count) against log(size), taking counts of
+ * zero as one
+ */
+double
+degree(
+        const std::vector<size_t>             &sizes,
+        const std::vector<Parser::Statistics> &results,
+        size_t Parser::Statistics::*count
+)
+{
+        double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+        size_t n = sizes.size();
+
+        for (size_t i = 0; i < n; ++i) {
+                double x = log(static_cast<double>(sizes[i])),
+                       y = log(static_cast<double>(
+                                std::max<size_t>(results[i].*count, 1)));
+
+                sum_x += x;
+                sum_y += y;
+                sum_xx += x * x;
+                sum_xy += x * y;
+        }
+
+        return (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+}
+
+/*
+ * check that every measure of the parser's work grows with degree at most
+ * 'max_degree' for both engines
+ */
+void
+checkGrowth(
+        const NonTerminal         &start,
+        Generator                  generate,
+        const std::vector<size_t> &sizes,
+        double                     max_degree
+)
+{
+        for (Parser::Engine engine: ENGINES) {
+                auto results = measure(start, generate, sizes, engine);
+
+                for (const Measure &m: MEASURES) {
+                        double d = degree(sizes, results, m.count);
+
+                        if (d > max_degree) {
+                                throw TestFailure("%s engine %s grow with"
+                                                  " degree %.2f, expected at"
+                                                  " most %.2f",
+                                                  engineName(engine), m.name,
+                                                  d, max_degree);
+                        }
+                }
+        }
+}
+
+std::vector<size_t>
+doubling(
+        size_t first,
+        size_t count
+)
+{
+        std::vector<size_t> sizes;
+
+        for (size_t n = first; count--; n *= 2) {
+                sizes.push_back(n);
+        }
+        return sizes;
+}
+
+// allow for fixed overheads at the smallest sizes
+const double LINEAR = 1.1;
+const double CUBIC = 3.1;
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+wr::parse::ComplexityTests::ll1List() // static
+{
+        NonTerminal list, tail;
+
+        list = NonTerminal("list", {
+                { tok('x'), tail }
+        });
+        tail = NonTerminal("tail", {
+                { tok(','), list },
+                { tok(';') }
+        });
+
+        if (!list.isLL1() || !tail.isLL1()) {
+                throw TestFailure("grammar expected to be LL(1)");
+        }
+
+        checkGrowth(list, [](size_t n) {
+                std::string input;
+
+                for (size_t i = 1; i < n; ++i) {
+                        input += "x,";
+                }
+                return input + "x;";
+        }, doubling(32, 6), LINEAR);
+}
+
+//--------------------------------------
+
+void
+wr::parse::ComplexityTests::ll1Nesting() // static
+{
+        NonTerminal nest;
+
+        nest = NonTerminal("nest", {
+                { tok('('), nest, tok(')') },
+                { tok('x') }
+        });
+
+        if (!nest.isLL1()) {
+                throw TestFailure("grammar expected to be LL(1)");
+        }
+
+        checkGrowth(nest, [](size_t n) {
+                return std::string(n, '(') + 'x' + std::string(n, ')');
+        }, doubling(32, 6), LINEAR);
+}
+
+//--------------------------------------
+
+void
+wr::parse::ComplexityTests::ll1Arrays() // static
+{
+        NonTerminal value, elements, rest;
+
+        value = NonTerminal("value", {
+                { tok('n') },
+                { tok('['), elements }
+        });
+        elements = NonTerminal("elements", {
+                { value, rest }
+        });
+        rest = NonTerminal("rest", {
+                { tok(','), elements },
+                { tok(']') }
+        });
+
+        if (!value.isLL1() || !elements.isLL1() || !rest.isLL1()) {
+                throw TestFailure("grammar expected to be LL(1)");
+        }
+
+        checkGrowth(value, [](size_t n) {
+                std::string input = "[";
+
+                for (size_t i = 0; i < n; ++i) {
+                        input += (i % 3) ? "n," : "[n,[n]],";
+                }
+                return input + "n]";
+        }, doubling(32, 6), LINEAR);
+}
+
+//--------------------------------------
+
+void
+wr::parse::ComplexityTests::leftRecursiveList() // static
+{
+        NonTerminal list;
+
+        list = NonTerminal("list", {
+                { list, tok(','), tok('x') },
+                { tok('x') }
+        });
+
+        checkGrowth(list, [](size_t n) {
+                std::string input = "x";
+
+                for (size_t i = 1; i < n; ++i) {
+                        input += ",x";
+                }
+                return input;
+        }, doubling(32, 6), LINEAR);
+}
+
+//--------------------------------------
+
+void
+wr::parse::ComplexityTests::ambiguousSum() // static
+{
+        NonTerminal sum;
+
+        sum = NonTerminal("sum", {
+                { sum, tok('+'), sum },
+                { tok('n') }
+        });
+
+        checkGrowth(sum, [](size_t n) {
+                std::string input = "n";
+
+                for (size_t i = 1; i < n; ++i) {
+                        input += "+n";
+                }
+                return input;
+        }, doubling(8, 4), CUBIC);
+}
+
+//--------------------------------------
+
+void
+wr::parse::ComplexityTests::ambiguousConcatenation() // static
+{
+        NonTerminal s;
+
+        s = NonTerminal("s", {
+                { s, s },
+                { tok('a') }
+        });
+
+        checkGrowth(s, [](size_t n) {
+                return std::string(n, 'a');
+        }, doubling(8, 4), CUBIC);
+}
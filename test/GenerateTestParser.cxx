@@ -0,0 +1,34 @@
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <wrparse/CodeGen.h>
+
+#include "CodeGenGrammar.h"
+
+
+/*
+ * writes TestParser.h, the code generated for CodeGenGrammar, to the path
+ * given; built and run as part of building CodeGenTests
+ */
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        if (argc != 2) {
+                std::cerr << "Usage: GenerateTestParser OUTPUT\n";
+                return EXIT_FAILURE;
+        }
+
+        CodeGenGrammar g;
+        std::ofstream  out(argv[1]);
+
+        if (!wr::parse::generateParser(out, g.program, "TestParser")
+            || !out.flush()) {
+                std::cerr << "cannot write " << argv[1] << '\n';
+                return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,441 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <wrutil/TestManager.h>
+#include <wrparse/CodeGen.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/GrammarImage.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+#include <wrparse/SPPF.h>
+
+#include "CharLexer.h"
+
+
+namespace wr {
+namespace parse {
+
+
+class GrammarImageTests : public TestManager
+{
+public:
+        using this_t = GrammarImageTests;
+        using base_t = TestManager;
+
+        GrammarImageTests(int argc, const char **argv) :
+                base_t("parse::GrammarImage", argc, argv) {}
+
+        int runAll();
+
+        static void roundTripKeepsGrammar(),
+                    roundTripParsesAlike(),
+                    loadsImageFile(),
+                    rejectsBadImages();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::GrammarImageTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::GrammarImageTests::runAll()
+{
+        run("roundTripKeepsGrammar", 1, roundTripKeepsGrammar);
+        run("roundTripParsesAlike", 1, roundTripParsesAlike);
+        run("loadsImageFile", 1, loadsImageFile);
+        run("rejectsBadImages", 1, rejectsBadImages);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+
+size_t item_actions = 0;
+
+bool
+countItem(
+        ParseState &
+)
+{
+        ++item_actions;
+        return true;
+}
+
+bool
+nearStart(
+        ParseState &state
+)
+{
+        return state.input()->offset() < 20;
+}
+
+bool
+always(
+        ParseState &
+)
+{
+        return true;
+}
+
+double
+rateList(
+        const SPPFNode &
+)
+{
+        return 1;
+}
+
+/*
+ * uses each flag, kind of component and function an image records
+ */
+struct ImageGrammar
+{
+        NonTerminal list, item, word, any;
+
+        ImageGrammar()
+        {
+                list = NonTerminal("list", {
+                        { list, tok(','), item },
+                        { item }
+                }, NonTerminal::KEEP_RECURSION);
+                item = NonTerminal("item", {
+                        { tok('a') },
+                        { pure(Component(tok('b'), false, nearStart)) },
+                        { tok('('), opt(list), commit(tok(')')) },
+                        { word },
+                        { tok('!'), any },
+                        Rule({ tok('z') }, false)
+                });
+                word = NonTerminal("word", {
+                        { tok('x'), tok('y') },
+                        { tok('x') }
+                }, NonTerminal::ORDERED_CHOICE
+                   | NonTerminal::HIDE_IF_DELEGATE);
+                any = NonTerminal("any", { { Component(always) } },
+                                  NonTerminal::TRANSPARENT);
+
+                item.addPostParseAction(countItem);
+                list.setCostFunction(rateList);
+        }
+};
+
+GrammarImage::Registry
+functions()
+{
+        GrammarImage::Registry registry;
+
+        registry.add("countItem", countItem).add("nearStart", nearStart)
+                .add("always", always).add("rateList", rateList);
+        return registry;
+}
+
+/*
+ * the image of `start`, in memory aligned as GrammarImage requires
+ */
+std::vector<uint32_t>
+writeImage(
+        const NonTerminal            &start,
+        const GrammarImage::Registry &registry,
+        size_t                       &size
+)
+{
+        std::ostringstream out;
+
+        if (!GrammarImage::write(out, start, registry)) {
+                throw TestFailure("GrammarImage::write() failed");
+        }
+
+        std::string           bytes = out.str();
+        std::vector<uint32_t> image((bytes.size() + 3) / 4);
+
+        memcpy(image.data(), bytes.data(), bytes.size());
+        size = bytes.size();
+        return image;
+}
+
+bool
+sameFirstSets(
+        const NonTerminal &a,
+        const NonTerminal &b
+)
+{
+        auto i = a.firstSet().begin(), i_end = a.firstSet().end(),
+             j = b.firstSet().begin(), j_end = b.firstSet().end();
+
+        for (; (i != i_end) && (j != j_end); ++i, ++j) {
+                if ((i->first != j->first)
+                    || !std::equal(i->second.begin(), i->second.end(),
+                                   j->second.begin(), j->second.end())) {
+                        return false;
+                }
+        }
+
+        return (i == i_end) && (j == j_end);
+}
+
+/*
+ * throws TestFailure unless `loaded`, the image's copy of `original`, has
+ * the same flags, rules, components, functions and analysis
+ */
+void
+checkSame(
+        const NonTerminal  &original,
+        const NonTerminal  &loaded,
+        const GrammarImage &image
+)
+{
+        if (strcmp(original.name(), loaded.name()) != 0) {
+                throw TestFailure("nonterminals loaded out of order");
+        }
+        if ((original.isTransparent() != loaded.isTransparent())
+            || (original.hideIfDelegate() != loaded.hideIfDelegate())
+            || (original.keepRecursion() != loaded.keepRecursion())
+            || (original.isOrderedChoice() != loaded.isOrderedChoice())) {
+                throw TestFailure("flags of %s differ", original.name());
+        }
+        if ((original.matchesEmpty() != loaded.matchesEmpty())
+            || (original.isLL1() != loaded.isLL1())
+            || !sameFirstSets(original, loaded)
+            || !std::equal(original.anyTokenRules().begin(),
+                           original.anyTokenRules().end(),
+                           loaded.anyTokenRules().begin(),
+                           loaded.anyTokenRules().end())) {
+                throw TestFailure("analysis of %s differs", original.name());
+        }
+        if ((original.costFunction() != loaded.costFunction())
+            || (original.hasActions() != loaded.hasActions())) {
+                throw TestFailure("functions of %s differ", original.name());
+        }
+        if (original.size() != loaded.size()) {
+                throw TestFailure("rules of %s differ", original.name());
+        }
+
+        for (size_t r = 0; r < original.size(); ++r) {
+                const Rule &a = original[r], &b = loaded[r];
+
+                if ((a.size() != b.size())
+                    || (a.isEnabled() != b.isEnabled())) {
+                        throw TestFailure("rules of %s differ",
+                                          original.name());
+                }
+
+                for (size_t i = 0; i < a.size(); ++i) {
+                        const Component &x = a[i], &y = b[i];
+                        const NonTerminal *called = y.getAsNonTerminal();
+
+                        if ((x.isTerminal() != y.isTerminal())
+                            || (x.getAsTerminal() != y.getAsTerminal())
+                            || (called && (called != image.find(
+                                        x.getAsNonTerminal()->name())))
+                            || (x.isOptional() != y.isOptional())
+                            || (x.isCommitPoint() != y.isCommitPoint())
+                            || (x.isPure() != y.isPure())
+                            || (x.predicate() != y.predicate())) {
+                                throw TestFailure("components of %s differ",
+                                                  original.name());
+                        }
+                }
+        }
+}
+
+struct Outcome
+{
+        bool   matched_;
+        size_t hash_;     // structural hash of the result
+        size_t actions_;  // calls of countItem()
+};
+
+Outcome
+parseList(
+        const NonTerminal &start,
+        const char        *input
+)
+{
+        std::istringstream in(input);
+        CharLexer          lexer(in);
+        Parser             parser(lexer);
+
+        item_actions = 0;
+
+        SPPFNode::Ptr result = parser.parse(start);
+
+        // the result refers to tokens owned by the parser
+        return { result && !parser.errorCount(),
+                 result ? structuralHash(*result) : 0, item_actions };
+}
+
+bool
+loadFails(
+        const void                   *data,
+        size_t                        size,
+        const GrammarImage::Registry &registry
+)
+{
+        try {
+                GrammarImage image(data, size, registry);
+        } catch (std::runtime_error &) {
+                return true;
+        }
+        return false;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+wr::parse::GrammarImageTests::roundTripKeepsGrammar() // static
+{
+        ImageGrammar                     g;
+        GrammarImage::Registry           registry = functions();
+        size_t                           size;
+        std::vector<uint32_t>            data = writeImage(g.list, registry,
+                                                           size);
+        GrammarImage                     image(data.data(), size, registry);
+        std::vector<const NonTerminal *> order
+                                        = reachableNonTerminals(g.list);
+
+        if (image.size() != order.size()) {
+                throw TestFailure("image holds the wrong nonterminals");
+        }
+        if ((image.fingerprint() != grammarFingerprint(g.list))
+            || (grammarFingerprint(image.start()) != image.fingerprint())) {
+                throw TestFailure("fingerprint not kept");
+        }
+
+        for (size_t i = 0; i < order.size(); ++i) {
+                checkSame(*order[i], image[i], image);
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::GrammarImageTests::roundTripParsesAlike() // static
+{
+        static const char *const INPUTS[] = {
+                "a",
+                "a , b , ( a , x y ) , ! a",
+                "( ( x ) ) , x",
+                "a , a , a , a , a , a , a , a , b",  // predicate fails
+                "a , z",                              // disabled rule
+                "( a"
+        };
+
+        ImageGrammar           g;
+        GrammarImage::Registry registry = functions();
+        size_t                 size;
+        std::vector<uint32_t>  data = writeImage(g.list, registry, size);
+        GrammarImage           image(data.data(), size, registry);
+
+        for (const char *input: INPUTS) {
+                Outcome original = parseList(g.list, input),
+                        loaded   = parseList(image.start(), input);
+
+                if ((original.matched_ != loaded.matched_)
+                    || (original.hash_ != loaded.hash_)) {
+                        throw TestFailure("loaded grammar parsed \"%s\""
+                                          " differently", input);
+                }
+                if (original.actions_ != loaded.actions_) {
+                        throw TestFailure("actions not kept for \"%s\"",
+                                          input);
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::GrammarImageTests::loadsImageFile() // static
+{
+        static const char PATH[] = "GrammarImageTests.grammar";
+
+        ImageGrammar           g;
+        GrammarImage::Registry registry = functions();
+
+        {
+                std::ofstream out(PATH, std::ios::binary);
+
+                if (!GrammarImage::write(out, g.list, registry)
+                    || !out.flush()) {
+                        throw TestFailure("cannot write image file");
+                }
+        }
+
+        try {
+                GrammarImage image(PATH, registry);
+
+                if ((image.fingerprint() != grammarFingerprint(g.list))
+                    || !image.find("word")
+                    || (parseList(image.start(), "a , x y").hash_
+                        != parseList(g.list, "a , x y").hash_)) {
+                        throw TestFailure("image file not loaded intact");
+                }
+        } catch (...) {
+                remove(PATH);
+                throw;
+        }
+
+        remove(PATH);
+}
+
+//--------------------------------------
+
+void
+wr::parse::GrammarImageTests::rejectsBadImages() // static
+{
+        ImageGrammar           g;
+        GrammarImage::Registry registry = functions(), partial;
+        size_t                 size;
+        std::vector<uint32_t>  data = writeImage(g.list, registry, size);
+        std::ostringstream     out;
+        bool                   rejected = false;
+
+        partial.add("countItem", countItem);
+
+        try {
+                GrammarImage::write(out, g.list, partial);
+        } catch (std::invalid_argument &) {
+                rejected = true;
+        }
+        if (!rejected) {
+                throw TestFailure("image written with unnamed functions");
+        }
+
+        if (!loadFails(data.data(), size, partial)) {
+                throw TestFailure("image loaded with unnamed functions");
+        }
+        if (!loadFails(data.data(), size - 4, registry)) {
+                throw TestFailure("truncated image loaded");
+        }
+        data[0] ^= 1;
+        if (!loadFails(data.data(), size, registry)) {
+                throw TestFailure("image with bad magic number loaded");
+        }
+}
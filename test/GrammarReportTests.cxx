@@ -0,0 +1,361 @@
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <wrutil/TestManager.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/GrammarReport.h>
+
+#include "CharLexer.h"
+
+
+namespace wr {
+namespace parse {
+
+
+class GrammarReportTests : public TestManager
+{
+public:
+        using this_t = GrammarReportTests;
+        using base_t = TestManager;
+
+        GrammarReportTests(int argc, const char **argv) :
+                base_t("parse::GrammarReport", argc, argv) {}
+
+        int runAll();
+
+        static void conflictsAndComplexity(),
+                    leftRecursion(),
+                    ambiguityReasons(),
+                    deepCycle(),
+                    writesJSON();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::GrammarReportTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::GrammarReportTests::runAll()
+{
+        run("conflictsAndComplexity", 1, conflictsAndComplexity);
+        run("leftRecursion", 1, leftRecursion);
+        run("ambiguityReasons", 1, ambiguityReasons);
+        run("deepCycle", 1, deepCycle);
+        run("writesJSON", 1, writesJSON);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+
+/*
+ * the entry for `nt`, throwing TestFailure if there is none
+ */
+const GrammarReport::Entry &
+entryOf(
+        const GrammarReport &report,
+        const NonTerminal   &nt
+)
+{
+        const GrammarReport::Entry *entry = report.find(nt);
+
+        if (!entry) {
+                throw TestFailure("no entry for %s", nt.name());
+        }
+        return *entry;
+}
+
+/*
+ * throws TestFailure unless `nt` has the ambiguity reasons and complexity
+ * given
+ */
+void
+checkCost(
+        const GrammarReport       &report,
+        const NonTerminal         &nt,
+        unsigned                   ambiguity,
+        GrammarReport::Complexity  complexity
+)
+{
+        const GrammarReport::Entry &entry = entryOf(report, nt);
+
+        if (entry.ambiguity_ != ambiguity) {
+                throw TestFailure("%s has ambiguity reasons %u, expected %u",
+                                  nt.name(), entry.ambiguity_, ambiguity);
+        }
+        if (entry.complexity_ != complexity) {
+                throw TestFailure("%s is %s, expected %s", nt.name(),
+                                  GrammarReport::complexityName(
+                                                entry.complexity_),
+                                  GrammarReport::complexityName(complexity));
+        }
+}
+
+/*
+ * throws TestFailure unless `nt` has the left recursion given
+ */
+void
+checkRecursion(
+        const GrammarReport &report,
+        const NonTerminal   &nt,
+        bool                 left_recursive,
+        bool                 hidden
+)
+{
+        const GrammarReport::Entry &entry = entryOf(report, nt);
+
+        if ((entry.left_recursive_ != left_recursive)
+            || (entry.hidden_left_recursive_ != hidden)) {
+                throw TestFailure("%s wrongly %sleft recursive", nt.name(),
+                                  entry.hidden_left_recursive_ ? "hidden "
+                                                               : "");
+        }
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+wr::parse::GrammarReportTests::conflictsAndComplexity() // static
+{
+        NonTerminal top, s, u;
+
+        top = NonTerminal("top", {
+                { s, u }
+        });
+        s = NonTerminal("s", {
+                { tok('a'), tok('b') },
+                { tok('d') },
+                { tok('a'), tok('c') }
+        });
+        u = NonTerminal("u", {
+                { tok('x') }
+        });
+
+        GrammarReport report(top);
+
+        if ((report.size() != 3) || (report[0].nonterminal_ != &top)) {
+                throw TestFailure("report does not cover the grammar");
+        }
+
+        const GrammarReport::Entry &es = entryOf(report, s);
+
+        if (es.is_ll1_ || (es.conflicts_.size() != 1)
+            || (es.conflicts_[0].token_ != tok('a'))
+            || (es.conflicts_[0].rules_ != std::vector<size_t>({ 0, 2 }))) {
+                throw TestFailure("conflict of s not reported");
+        }
+        if (!entryOf(report, top).is_ll1_ || !entryOf(report, u).is_ll1_
+            || !entryOf(report, top).conflicts_.empty()
+            || !entryOf(report, u).conflicts_.empty()) {
+                throw TestFailure("conflict reported for LL(1) nonterminal");
+        }
+
+        // the complexity of top is that of s
+        checkCost(report, top, 0, GrammarReport::QUADRATIC);
+        checkCost(report, s, 0, GrammarReport::QUADRATIC);
+        checkCost(report, u, 0, GrammarReport::LINEAR);
+}
+
+//--------------------------------------
+
+void
+wr::parse::GrammarReportTests::leftRecursion() // static
+{
+        NonTerminal top, direct, a, b, hidden, prefix;
+
+        top = NonTerminal("top", {
+                { direct, a, hidden }
+        });
+        direct = NonTerminal("direct", {
+                { direct, tok('+'), tok('a') },
+                { tok('a') }
+        });
+        a = NonTerminal("a", {
+                { b, tok('x') },
+                { tok('y') }
+        });
+        b = NonTerminal("b", {
+                { a, tok('z') },
+                { tok('w') }
+        });
+        hidden = NonTerminal("hidden", {
+                { prefix, hidden, tok('x') },
+                { tok('y') }
+        });
+        prefix = NonTerminal("prefix", {
+                { opt(tok('p')) }
+        });
+
+        GrammarReport report(top);
+
+        checkRecursion(report, top, false, false);
+        checkRecursion(report, direct, true, false);
+        checkRecursion(report, a, true, false);
+        checkRecursion(report, b, true, false);
+        checkRecursion(report, hidden, true, true);
+        checkRecursion(report, prefix, false, false);
+}
+
+//--------------------------------------
+
+void
+wr::parse::GrammarReportTests::ambiguityReasons() // static
+{
+        NonTerminal top, p, q, twice, sum;
+
+        top = NonTerminal("top", {
+                { p, twice, sum }
+        });
+        p = NonTerminal("p", {
+                { q },
+                { tok('a') }
+        });
+        q = NonTerminal("q", {
+                { p },
+                { opt(tok('c')) }
+        });
+        twice = NonTerminal("twice", {
+                { tok('a'), tok('b') },
+                { tok('a'), tok('b') }
+        });
+        sum = NonTerminal("sum", {
+                { sum, tok('+'), sum },
+                { tok('a') }
+        });
+
+        GrammarReport report(top);
+
+        checkCost(report, p, GrammarReport::NULLABLE_CYCLE,
+                  GrammarReport::CUBIC);
+        checkCost(report, q, GrammarReport::NULLABLE_CYCLE
+                             | GrammarReport::MULTIPLE_EMPTY_RULES,
+                  GrammarReport::CUBIC);
+        checkCost(report, twice, GrammarReport::DUPLICATE_RULES,
+                  GrammarReport::CUBIC);
+        checkCost(report, sum, GrammarReport::BINARY_RECURSION,
+                  GrammarReport::CUBIC);
+        checkCost(report, top, 0, GrammarReport::CUBIC);
+}
+
+//--------------------------------------
+
+/*
+ * a cycle through more nonterminals than the stack could hold calls for
+ */
+void
+wr::parse::GrammarReportTests::deepCycle() // static
+{
+        enum { DEPTH = 100000 };
+
+        std::unique_ptr<NonTerminal[]> chain(new NonTerminal[DEPTH]);
+
+        for (size_t i = 0; i < DEPTH; ++i) {
+                chain[i] = NonTerminal("link", {
+                        { chain[(i + 1) % DEPTH], tok('a') },
+                        { tok('b') }
+                });
+        }
+
+        GrammarReport report(chain[0]);
+
+        if (report.size() != DEPTH) {
+                throw TestFailure("report does not cover the grammar");
+        }
+        for (const GrammarReport::Entry &entry: report) {
+                if (!entry.left_recursive_ || entry.is_ll1_
+                    || (entry.complexity_ != GrammarReport::QUADRATIC)) {
+                        throw TestFailure("cycle not found");
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::GrammarReportTests::writesJSON() // static
+{
+        NonTerminal top, sum, empty;
+
+        top = NonTerminal("top", {
+                { sum, empty }
+        });
+        sum = NonTerminal("sum", {
+                { sum, tok('+'), sum },
+                { tok('a') }
+        });
+        empty = NonTerminal("empty", {
+                { opt(tok('x')) },
+                { opt(tok('y')) }
+        });
+
+        std::ostringstream out;
+
+        if (!GrammarReport(top).writeJSON(out)) {
+                throw TestFailure("writeJSON() failed");
+        }
+
+        std::string expected =
+                "{\n"
+                "  \"nonterminals\": [\n"
+                "    {\n"
+                "      \"name\": \"top\",\n"
+                "      \"ll1\": true,\n"
+                "      \"conflicts\": [],\n"
+                "      \"matches_empty\": false,\n"
+                "      \"left_recursive\": false,\n"
+                "      \"hidden_left_recursive\": false,\n"
+                "      \"ambiguity\": [],\n"
+                "      \"complexity\": \"cubic\"\n"
+                "    },\n"
+                "    {\n"
+                "      \"name\": \"sum\",\n"
+                "      \"ll1\": false,\n"
+                "      \"conflicts\": [{\"token\": "
+                        + std::to_string(tok('a')) + ", \"rules\": [0, 1]}],\n"
+                "      \"matches_empty\": false,\n"
+                "      \"left_recursive\": true,\n"
+                "      \"hidden_left_recursive\": false,\n"
+                "      \"ambiguity\": [\"binary_recursion\"],\n"
+                "      \"complexity\": \"cubic\"\n"
+                "    },\n"
+                "    {\n"
+                "      \"name\": \"empty\",\n"
+                "      \"ll1\": false,\n"
+                "      \"conflicts\": [{\"token\": null,"
+                        " \"rules\": [0, 1]}],\n"
+                "      \"matches_empty\": true,\n"
+                "      \"left_recursive\": false,\n"
+                "      \"hidden_left_recursive\": false,\n"
+                "      \"ambiguity\": [\"multiple_empty_rules\"],\n"
+                "      \"complexity\": \"cubic\"\n"
+                "    }\n"
+                "  ]\n"
+                "}\n";
+
+        if (out.str() != expected) {
+                throw TestFailure("JSON report differs:\n%s",
+                                  out.str().c_str());
+        }
+}
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <wrutil/TestManager.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Parser.h>
+
+#include "CharLexer.h"
+
+
+namespace wr {
+namespace parse {
+
+
+class GrammarTests : public TestManager
+{
+public:
+        using this_t = GrammarTests;
+        using base_t = TestManager;
+
+        GrammarTests(int argc, const char **argv) :
+                base_t("parse::Grammar", argc, argv) {}
+
+        int runAll();
+
+        static void directLeftRecursion(),
+                    indirectLeftRecursion(),
+                    nullableCycle(),
+                    lonePredicate();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::GrammarTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::GrammarTests::runAll()
+{
+        run("directLeftRecursion", 1, directLeftRecursion);
+        run("indirectLeftRecursion", 1, indirectLeftRecursion);
+        run("nullableCycle", 1, nullableCycle);
+        run("lonePredicate", 1, lonePredicate);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+
+// the rules listed for each terminal; TOK_NULL for those matching empty
+using Expected = std::map<TokenKind, std::vector<size_t>>;
+
+/*
+ * throws TestFailure unless the analysis of `nonterminal` gives the FIRST
+ * set, rules beginning with any token, nullability and LL(1) property
+ * expected
+ */
+void
+checkAnalysis(
+        const NonTerminal         &nonterminal,
+        const Expected            &first,
+        const std::vector<size_t> &any,
+        bool                       nullable,
+        bool                       ll1
+)
+{
+        const NonTerminal::FirstSet &actual = nonterminal.firstSet();
+
+        if (actual.size() != first.size()) {
+                throw TestFailure("FIRST set of %s has %u terminals,"
+                                  " expected %u", nonterminal.name(),
+                                  static_cast<unsigned>(actual.size()),
+                                  static_cast<unsigned>(first.size()));
+        }
+
+        for (const auto &entry: first) {
+                auto i = actual.find(entry.first);
+
+                if ((i == actual.end())
+                    || !std::equal(i->second.begin(), i->second.end(),
+                                   entry.second.begin(),
+                                   entry.second.end())) {
+                        throw TestFailure("FIRST set of %s has the wrong"
+                                          " rules for a terminal",
+                                          nonterminal.name());
+                }
+        }
+
+        const RuleIndices &any_rules = nonterminal.anyTokenRules();
+
+        if (!std::equal(any_rules.begin(), any_rules.end(), any.begin(),
+                        any.end())) {
+                throw TestFailure("wrong rules of %s begin with any token",
+                                  nonterminal.name());
+        }
+        if (nonterminal.matchesEmpty() != nullable) {
+                throw TestFailure("%s %s match empty", nonterminal.name(),
+                                  nullable ? "does not" : "can");
+        }
+        if (nonterminal.isLL1() != ll1) {
+                throw TestFailure("%s %s LL(1)", nonterminal.name(),
+                                  ll1 ? "is not" : "is");
+        }
+}
+
+bool
+always(
+        ParseState &
+)
+{
+        return true;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+wr::parse::GrammarTests::directLeftRecursion() // static
+{
+        NonTerminal sum;
+
+        sum = NonTerminal("sum", {
+                { sum, tok('+'), tok('a') },
+                { tok('a') }
+        });
+
+        checkAnalysis(sum, { { tok('a'), { 0, 1 } } }, {}, false, false);
+}
+
+//--------------------------------------
+
+void
+wr::parse::GrammarTests::indirectLeftRecursion() // static
+{
+        // analysed together, whichever is queried first
+        for (bool b_first: { false, true }) {
+                NonTerminal a, b;
+
+                a = NonTerminal("a", {
+                        { b, tok('x') },
+                        { tok('y') }
+                });
+                b = NonTerminal("b", {
+                        { a, tok('z') },
+                        { tok('w') }
+                });
+
+                if (b_first) {
+                        b.firstSet();
+                }
+                checkAnalysis(a, { { tok('w'), { 0 } },
+                                   { tok('y'), { 0, 1 } } },
+                              {}, false, false);
+                checkAnalysis(b, { { tok('w'), { 0, 1 } },
+                                   { tok('y'), { 0 } } },
+                              {}, false, false);
+        }
+}
+
+//--------------------------------------
+
+/*
+ * nonterminals using each other that can both match empty, and one using
+ * them that cannot
+ */
+void
+wr::parse::GrammarTests::nullableCycle() // static
+{
+        NonTerminal s, p, q;
+
+        s = NonTerminal("s", {
+                { p, tok('d') }
+        });
+        p = NonTerminal("p", {
+                { q, opt(tok('b')) },
+                { tok('a') }
+        });
+        q = NonTerminal("q", {
+                { p },
+                { opt(tok('c')) }
+        });
+
+        checkAnalysis(s, { { tok('a'), { 0 } }, { tok('b'), { 0 } },
+                           { tok('c'), { 0 } }, { tok('d'), { 0 } } },
+                      {}, false, true);
+        checkAnalysis(p, { { TOK_NULL, { 0 } }, { tok('a'), { 0, 1 } },
+                           { tok('b'), { 0 } }, { tok('c'), { 0 } } },
+                      {}, true, false);
+        checkAnalysis(q, { { TOK_NULL, { 0, 1 } }, { tok('a'), { 0 } },
+                           { tok('b'), { 0 } }, { tok('c'), { 0, 1 } } },
+                      {}, true, false);
+}
+
+//--------------------------------------
+
+/*
+ * a rule consisting of a predicate alone may begin with any token, so is
+ * listed under each terminal of the FIRST set, as are the rules of
+ * nonterminals using it
+ */
+void
+wr::parse::GrammarTests::lonePredicate() // static
+{
+        NonTerminal n, m, only;
+
+        n = NonTerminal("n", {
+                { Component(always) },
+                { tok('a'), tok('b') },
+                { tok('c') }
+        });
+        m = NonTerminal("m", {
+                { n, tok('x') }
+        });
+        only = NonTerminal("only", {
+                { Component(always) }
+        });
+
+        checkAnalysis(n, { { tok('a'), { 0, 1 } }, { tok('c'), { 0, 2 } } },
+                      { 0 }, false, false);
+        checkAnalysis(m, { { tok('a'), { 0 } }, { tok('c'), { 0 } } },
+                      { 0 }, false, true);
+        checkAnalysis(only, {}, { 0 }, false, true);
+}
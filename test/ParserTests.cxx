@@ -0,0 +1,2007 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <wrutil/TestManager.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+#include <wrparse/Profile.h>
+#include <wrparse/SPPF.h>
+#include <wrparse/SymbolTable.h>
+
+#include "CharLexer.h"
+
+
+namespace wr {
+namespace parse {
+
+
+class ParserTests : public TestManager
+{
+public:
+        using this_t = ParserTests;
+        using base_t = TestManager;
+
+        ParserTests(int argc, const char **argv) :
+                base_t("parse::Parser", argc, argv) {}
+
+        int runAll();
+
+        static void firstMatchAtEOFConsumesInput(),
+                    commitsReportedOnceOnRetry(),
+                    commitsPendingOnFailureNotReported(),
+                    predictionKeepsLongestMatch(),
+                    sharedPrefixLabelsFollower(),
+                    sharedPrefixKeepsAmbiguity(),
+                    sharedPrefixFollowerPredicted(),
+                    purePredicateCalledOncePerPosition(),
+                    symbolTablesIsolatedPerDerivation(),
+                    symbolTablesMergedByVersion(),
+                    beamKeepsCheapestDerivations(),
+                    costLimitAbandonsWork(),
+                    actionsRunOncePerEngine(),
+                    actionNodesInResult(),
+                    orderedChoiceKeptAcrossCommits(),
+                    orderedChoiceCutsLaterRules(),
+                    orderedChoiceLaterRuleCompletesFirst(),
+                    orderedChoiceParsedByGLL(),
+                    workspaceReusedAlike(),
+                    workspaceTrimmedToLimit(),
+                    workspaceReusableAfterException(),
+                    crfForestNestedDeeply(),
+                    slotProfileCountsWork(),
+                    ambiguityProfileFindsHotspots(),
+                    ambiguityProfileQuietWhenUnambiguous(),
+                    ruleProfileSavedAndLoaded(),
+                    ruleProfileOrdersDispatch(),
+                    hiddenDelegatesBypassed();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::ParserTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::ParserTests::runAll()
+{
+        run("firstMatchAtEOFConsumesInput", 1, firstMatchAtEOFConsumesInput);
+        run("commitsReportedOnceOnRetry", 1, commitsReportedOnceOnRetry);
+        run("commitsPendingOnFailureNotReported", 1,
+            commitsPendingOnFailureNotReported);
+        run("predictionKeepsLongestMatch", 1, predictionKeepsLongestMatch);
+        run("sharedPrefixLabelsFollower", 1, sharedPrefixLabelsFollower);
+        run("sharedPrefixKeepsAmbiguity", 1, sharedPrefixKeepsAmbiguity);
+        run("sharedPrefixFollowerPredicted", 1,
+            sharedPrefixFollowerPredicted);
+        run("purePredicateCalledOncePerPosition", 1,
+            purePredicateCalledOncePerPosition);
+        run("symbolTablesIsolatedPerDerivation", 1,
+            symbolTablesIsolatedPerDerivation);
+        run("symbolTablesMergedByVersion", 1, symbolTablesMergedByVersion);
+        run("beamKeepsCheapestDerivations", 1, beamKeepsCheapestDerivations);
+        run("costLimitAbandonsWork", 1, costLimitAbandonsWork);
+        run("actionsRunOncePerEngine", 1, actionsRunOncePerEngine);
+        run("actionNodesInResult", 1, actionNodesInResult);
+        run("orderedChoiceKeptAcrossCommits", 1,
+            orderedChoiceKeptAcrossCommits);
+        run("orderedChoiceCutsLaterRules", 1, orderedChoiceCutsLaterRules);
+        run("orderedChoiceLaterRuleCompletesFirst", 1,
+            orderedChoiceLaterRuleCompletesFirst);
+        run("orderedChoiceParsedByGLL", 1, orderedChoiceParsedByGLL);
+        run("workspaceReusedAlike", 1, workspaceReusedAlike);
+        run("workspaceTrimmedToLimit", 1, workspaceTrimmedToLimit);
+        run("workspaceReusableAfterException", 1,
+            workspaceReusableAfterException);
+        run("crfForestNestedDeeply", 1, crfForestNestedDeeply);
+        run("slotProfileCountsWork", 1, slotProfileCountsWork);
+        run("ambiguityProfileFindsHotspots", 1,
+            ambiguityProfileFindsHotspots);
+        run("ambiguityProfileQuietWhenUnambiguous", 1,
+            ambiguityProfileQuietWhenUnambiguous);
+        run("ruleProfileSavedAndLoaded", 1, ruleProfileSavedAndLoaded);
+        run("ruleProfileOrdersDispatch", 1, ruleProfileOrdersDispatch);
+        run("hiddenDelegatesBypassed", 1, hiddenDelegatesBypassed);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+
+/*
+ * number of tokens matched by `result`, throwing TestFailure if the parse
+ * failed
+ */
+size_t
+matchedTokens(
+        const Parser        &parser,
+        const SPPFNode::Ptr &result
+)
+{
+        if (!result || parser.errorCount()) {
+                throw TestFailure("%s engine failed to parse input",
+                                  engineName(parser.engine()));
+        }
+        return result->countTokens();
+}
+
+/*
+ * counts the calls to onCommit()
+ */
+class CommitCounter : public Parser
+{
+public:
+        CommitCounter(Lexer &lexer) : Parser(lexer), commits_(0) {}
+
+        virtual void onCommit(SPPFNode::ConstPtr) override { ++commits_; }
+
+        size_t commits_;
+};
+
+/*
+ * a list of statements each committed on completion, followed by a tail
+ * whose rules begin with the same token but share no prefix
+ */
+struct Statements
+{
+        NonTerminal stmts, stmt, tail, xz, program;
+
+        Statements()
+        {
+                stmts = NonTerminal("stmts", {
+                        { stmts, commit(stmt) },
+                        { commit(stmt) }
+                });
+                stmt = NonTerminal("stmt", {
+                        { tok('a'), tok('b'), tok(';') },
+                        { tok('a'), tok('c'), tok(';') }
+                });
+                tail = NonTerminal("tail", {
+                        { tok('x'), tok('y') },
+                        { xz }
+                });
+                xz = NonTerminal("xz", {
+                        { tok('x'), tok('z') }
+                });
+                program = NonTerminal("program", {
+                        { stmts, tail }
+                });
+        }
+};
+
+/*
+ * `count` statements followed by `tail`
+ */
+std::string
+statements(
+        size_t      count,
+        const char *tail
+)
+{
+        std::string input;
+
+        for (size_t i = 0; i < count; ++i) {
+                input += "a b ; ";
+        }
+        return input + tail;
+}
+
+/*
+ * the intermediate and packed nodes reachable from `root` that belong to
+ * rules of `nonterminal`
+ */
+std::vector<SPPFNode::ConstPtr>
+ruleNodes(
+        const SPPFNode::ConstPtr &root,
+        const NonTerminal        &nonterminal
+)
+{
+        std::vector<SPPFNode::ConstPtr>      pending = { root }, found;
+        std::unordered_set<const SPPFNode *> seen    = { root.get() };
+
+        while (!pending.empty()) {
+                SPPFNode::ConstPtr node = pending.back();
+
+                pending.pop_back();
+                if ((node->isIntermediate() || node->isPacked())
+                    && (node->rule()->nonTerminal() == &nonterminal)) {
+                        found.push_back(node);
+                }
+                for (SPPFNode::ConstPtr child: node->children()) {
+                        if (seen.insert(child.get()).second) {
+                                pending.push_back(child);
+                        }
+                }
+        }
+
+        return found;
+}
+
+// calls of isItem() by input offset and rule
+std::map<std::pair<size_t, const Rule *>, unsigned> item_calls;
+
+bool
+isItem(
+        ParseState &state
+)
+{
+        ++item_calls[{ state.input()->offset(), &state.rule() }];
+        return state.input()->is(tok('i'));
+}
+
+// predicates changing the symbol table in different ways
+bool
+keepSymbols(
+        ParseState &
+)
+{
+        return true;
+}
+
+bool
+defineSymbol(
+        ParseState &state
+)
+{
+        state.symbols().define("t");
+        return true;
+}
+
+bool
+defineInScope(
+        ParseState &state
+)
+{
+        state.symbols().enterScope().define("t");
+        state.symbols().leaveScope();
+        return true;
+}
+
+// whether "t" was defined at each call of checkSymbol()
+std::vector<bool> symbol_checks;
+
+bool
+checkSymbol(
+        ParseState &state
+)
+{
+        symbol_checks.push_back(state.symbols().contains("t"));
+        return true;
+}
+
+/*
+ * two derivations of 'x', one of which calls `change`, each followed by
+ * 'tail', which records the symbols it sees; the calls are left in
+ * symbol_checks
+ */
+void
+parseWithChange(
+        Component::Predicate change
+)
+{
+        NonTerminal s, x, p, q, tail;
+
+        s = NonTerminal("s", { { x, tail } });
+        x = NonTerminal("x", { { p }, { q } });
+        p = NonTerminal("p", { { Component(tok('a'), false, change) } });
+        q = NonTerminal("q", { { tok('a') } });
+        tail = NonTerminal("tail", {
+                { Component(tok('b'), false, checkSymbol) }
+        });
+
+        std::istringstream input("a b");
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+        SymbolTable        outer;
+
+        // a table already holding a scope keeps its version across
+        // enterScope() and leaveScope()
+        outer.define("u");
+        parser.setSymbols(outer);
+        symbol_checks.clear();
+        matchedTokens(parser, parser.parse(s));
+}
+
+/*
+ * cost of a derivation of 'sum': one for each addition, and one more for an
+ * addition whose left operand is itself an addition, so that the cheapest
+ * derivation of any input is the right-associative one
+ */
+double
+rateSum(
+        const SPPFNode &derivation
+)
+{
+        if (derivation.rule()->index() != 0) {
+                return 0;
+        }
+
+        // the left part also holds the '+'
+        return (derivation.children().front()->countTokens() > 2) ? 2 : 1;
+}
+
+/*
+ * an ambiguous grammar of additions of 'a', with every association
+ * possible
+ */
+struct Sums
+{
+        NonTerminal sum;
+
+        Sums()
+        {
+                sum = NonTerminal("sum", {
+                        { sum, tok('+'), sum },
+                        { tok('a') }
+                });
+                sum.setCostFunction(rateSum);
+        }
+};
+
+const char SUM_INPUT[] = "a + a + a + a + a";
+
+/*
+ * parses SUM_INPUT with the beam given, storing the statistics in `stats`
+ */
+SPPFNode::Ptr
+parseSums(
+        const Sums         &g,
+        size_t              width,
+        double              limit,
+        Parser::Statistics &stats
+)
+{
+        std::istringstream input(SUM_INPUT);
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+
+        parser.setBeam(width, limit);
+
+        SPPFNode::Ptr result = parser.parse(g.sum);
+
+        stats = parser.statistics();
+        return result;
+}
+
+/*
+ * the nodes reachable from `root`, including `root`
+ */
+std::unordered_set<const SPPFNode *>
+nodesBelow(
+        const SPPFNode::ConstPtr &root
+)
+{
+        std::vector<SPPFNode::ConstPtr>      pending = { root };
+        std::unordered_set<const SPPFNode *> seen    = { root.get() };
+
+        while (!pending.empty()) {
+                SPPFNode::ConstPtr node = pending.back();
+
+                pending.pop_back();
+                for (SPPFNode::ConstPtr child: node->children()) {
+                        if (seen.insert(child.get()).second) {
+                                pending.push_back(child);
+                        }
+                }
+        }
+
+        return seen;
+}
+
+/*
+ * greatest number of derivations kept by any node reachable from `root`
+ */
+size_t
+mostDerivations(
+        const SPPFNode::ConstPtr &root
+)
+{
+        size_t most = 0;
+
+        for (const SPPFNode *node: nodesBelow(root)) {
+                if (!node->isPacked()) {
+                        most = std::max(most, node->countChildren());
+                }
+        }
+
+        return most;
+}
+
+/*
+ * cost of the derivation of `node` made of the first derivation listed
+ * under each node, throwing TestFailure if any node lists its derivations
+ * out of order
+ */
+double
+firstCost(
+        const SPPFNode::ConstPtr &node
+)
+{
+        double result = 0,
+               prev   = -1;
+
+        for (SPPFNode::ConstPtr packed: node->children()) {
+                // only derivations of a whole rule are rated
+                double cost = node->isNonTerminal() ? rateSum(*packed) : 0;
+
+                for (SPPFNode::ConstPtr child: packed->children()) {
+                        cost += firstCost(child);
+                }
+                if (cost < prev) {
+                        throw TestFailure("derivations not listed in"
+                                          " ascending order of cost");
+                }
+                if (prev < 0) {
+                        result = cost;
+                }
+                prev = cost;
+        }
+
+        return result;
+}
+
+
+// calls of parse actions, and the nodes given to post-parse actions
+unsigned                        pre_parse_calls, post_parse_calls;
+std::vector<SPPFNode::ConstPtr> action_nodes;
+
+bool
+countPreParse(
+        ParseState &
+)
+{
+        ++pre_parse_calls;
+        return true;
+}
+
+bool
+countPostParse(
+        ParseState &state
+)
+{
+        ++post_parse_calls;
+        action_nodes.push_back(state.parsedNode());
+        return true;
+}
+
+bool
+isEnd(
+        ParseState &state
+)
+{
+        return state.input()->is(tok('b'));
+}
+
+/*
+ * a list of items with parse actions, followed by 'b' checked by a
+ * predicate that is not pure
+ */
+struct Items
+{
+        NonTerminal list, item, end, top;
+
+        Items()
+        {
+                list = NonTerminal("list", {
+                        { list, item },
+                        { item }
+                });
+                item = NonTerminal("item", { { tok('a') } });
+                end = NonTerminal("end", {
+                        { Component(tok('b'), false, isEnd) }
+                });
+                top = NonTerminal("top", { { list, end } });
+                item.addPreParseAction(countPreParse);
+                item.addPostParseAction(countPostParse);
+        }
+};
+
+/*
+ * parses `input` as `start` with `engine`, recording the calls of parse
+ * actions
+ */
+SPPFNode::Ptr
+parseItems(
+        const NonTerminal &start,
+        const char        *input,
+        Parser::Engine     engine
+)
+{
+        std::istringstream in(input);
+        CharLexer          lexer(in);
+        Parser             parser(lexer);
+
+        parser.setEngine(engine);
+        pre_parse_calls = post_parse_calls = 0;
+        action_nodes.clear();
+
+        SPPFNode::Ptr result = parser.parse(start);
+
+        matchedTokens(parser, result);
+        return result;
+}
+
+/*
+ * a list of ordered choices whose first rule is left recursive, so that a
+ * later rule runs ahead of it; with `commits`, the second rule commits
+ * within the choice
+ */
+struct Ordered
+{
+        NonTerminal list, item;
+
+        Ordered(bool commits)
+        {
+                list = NonTerminal("list", {
+                        { list, item },
+                        { item }
+                });
+                item = NonTerminal("item", {
+                        { item, tok('x') },
+                        { tok('a'), commits ? commit(tok('b'))
+                                            : Component(tok('b')) },
+                        { tok('a'), tok('b'), tok('x') }
+                }, NonTerminal::ORDERED_CHOICE);
+        }
+};
+
+/*
+ * the rules of `nonterminal` deriving part of `result`
+ */
+std::set<const Rule *>
+rulesUsed(
+        const SPPFNode::ConstPtr &result,
+        const NonTerminal        &nonterminal
+)
+{
+        std::set<const Rule *> rules;
+
+        for (const SPPFNode::ConstPtr &node: ruleNodes(result, nonterminal)) {
+                rules.insert(node->rule());
+        }
+        return rules;
+}
+
+/*
+ * parses `input` as `start` with `engine`, throwing TestFailure unless
+ * the parse succeeds
+ */
+SPPFNode::Ptr
+parseWith(
+        const NonTerminal  &start,
+        const char         *input,
+        Parser::Engine      engine,
+        Parser::Statistics *statistics = nullptr
+)
+{
+        std::istringstream in(input);
+        CharLexer          lexer(in);
+        Parser             parser(lexer);
+
+        parser.setEngine(engine);
+
+        SPPFNode::Ptr result = parser.parse(start);
+
+        matchedTokens(parser, result);
+        if (statistics) {
+                *statistics = parser.statistics();
+        }
+        return result;
+}
+
+bool
+sameStatistics(
+        const Parser::Statistics &a,
+        const Parser::Statistics &b
+)
+{
+        return (a.descriptors_ == b.descriptors_)
+                && (a.gss_nodes_ == b.gss_nodes_)
+                && (a.gss_edges_ == b.gss_edges_)
+                && (a.sppf_nodes_ == b.sppf_nodes_)
+                && (a.packed_nodes_ == b.packed_nodes_);
+}
+
+/*
+ * `count` additions of 'a'
+ */
+std::string
+sumOf(
+        size_t count
+)
+{
+        std::string input = "a";
+
+        for (size_t i = 0; i < count; ++i) {
+                input += " + a";
+        }
+        return input;
+}
+
+struct Outcome
+{
+        size_t             hash_;        // structural hash of the result
+        Parser::Statistics statistics_;
+};
+
+/*
+ * parses `text` as `start` with `parser`, once reset, and its lexer reading
+ * `input`
+ */
+Outcome
+parseAgain(
+        Parser             &parser,
+        std::istringstream &input,
+        const NonTerminal  &start,
+        const std::string  &text
+)
+{
+        input.clear();
+        input.str(text);
+        parser.lexer()->reset(input);
+        parser.reset();
+
+        SPPFNode::Ptr result = parser.parse(start);
+
+        matchedTokens(parser, result);
+        return { structuralHash(*result), parser.statistics() };
+}
+
+bool throw_from_action = false;
+
+bool
+throwIfArmed(
+        ParseState &
+)
+{
+        if (throw_from_action) {
+                throw_from_action = false;
+                throw std::logic_error("thrown from a parse action");
+        }
+        return true;
+}
+
+/*
+ * releases the SPPF under `root` a node at a time, as a deep one would
+ * otherwise be destroyed recursively; returns the number of nodes of
+ * `nonterminal` it held
+ */
+size_t
+dismantle(
+        SPPFNode::Ptr      root,
+        const NonTerminal &nonterminal
+)
+{
+        std::vector<SPPFNode::Ptr>     pending = { root };
+        std::unordered_set<SPPFNode *> seen;
+        size_t                         count   = 0;
+
+        root.reset();
+        while (!pending.empty()) {
+                SPPFNode::Ptr node = pending.back();
+
+                pending.pop_back();
+                if (!seen.insert(node.get()).second) {
+                        continue;
+                }
+                if (node->isNonTerminal()
+                    && (node->nonTerminal() == &nonterminal)) {
+                        ++count;
+                }
+                for (const SPPFNode::Ptr &child: node->children()) {
+                        pending.push_back(child);
+                }
+                node->children().clear();
+        }
+
+        return count;
+}
+
+/*
+ * a CharLexer naming the tokens of ambiguous sums, for profile reports
+ */
+class SumLexer : public CharLexer
+{
+public:
+        SumLexer(std::istream &input) : CharLexer(input) {}
+
+        const char *tokenKindName(TokenKind kind) const override
+        {
+                switch (kind) {
+                case tok('a'):
+                        return "'a'";
+                case tok('+'):
+                        return "'+'";
+                case tok('*'):
+                        return "'*'";
+                default:
+                        return CharLexer::tokenKindName(kind);
+                }
+        }
+};
+
+bool
+never(
+        ParseState &
+)
+{
+        return false;
+}
+
+/*
+ * ambiguous sums, and rules for 'a' that the parser tries in vain: one
+ * expecting a '*' that never follows and one refused by its predicate
+ */
+struct ProfiledSums
+{
+        NonTerminal sum;
+
+        ProfiledSums()
+        {
+                sum = NonTerminal("sum", {
+                        { sum, tok('+'), sum },
+                        { tok('a') },
+                        { tok('a'), tok('*') },
+                        { Component(tok('a'), false, never) }
+                });
+        }
+};
+
+/*
+ * throws TestFailure unless the profile holds `expected` for component
+ * `index` of rule `rule` of `nonterminal`, the index of the rule's end
+ * denoting that
+ */
+void
+checkCounts(
+        const SlotProfile         &profile,
+        const NonTerminal         &nonterminal,
+        size_t                     rule,
+        size_t                     index,
+        const SlotProfile::Counts &expected
+)
+{
+        const Component           &slot   = *std::next(
+                                                nonterminal[rule].begin(),
+                                                index);
+        const SlotProfile::Counts *counts = profile.find(slot);
+        SlotProfile::Counts        actual = counts ? *counts
+                                                   : SlotProfile::Counts();
+
+        if ((actual.executions_ != expected.executions_)
+            || (actual.mismatches_ != expected.mismatches_)
+            || (actual.predicate_failures_ != expected.predicate_failures_)
+            || (actual.pops_ != expected.pops_)
+            || (actual.nodes_ != expected.nodes_)) {
+                throw TestFailure("wrong counts for slot %u of rule %u",
+                                  static_cast<unsigned>(index),
+                                  static_cast<unsigned>(rule));
+        }
+}
+
+/*
+ * parses `input` as `start` with `profile` attached, returning the result
+ */
+SPPFNode::Ptr
+parseProfiled(
+        const NonTerminal &start,
+        const char        *input,
+        AmbiguityProfile  &profile
+)
+{
+        std::istringstream in(input);
+        SumLexer           lexer(in);
+        Parser             parser(lexer);
+
+        parser.setAmbiguityProfile(&profile);
+
+        SPPFNode::Ptr result = parser.parse(start);
+
+        matchedTokens(parser, result);
+        return result;
+}
+
+// indices of the rules logRule() was called for, in order
+std::vector<size_t> explored_rules;
+
+bool
+logRule(
+        ParseState &state
+)
+{
+        explored_rules.push_back(static_cast<size_t>(state.rule().index()));
+        return true;
+}
+
+/*
+ * two rules for the same first token, neither sharing a prefix with the
+ * other, as an ordinary and as an ordered choice
+ */
+struct Choices
+{
+        NonTerminal word, ordered;
+
+        Choices()
+        {
+                word = NonTerminal("word", rules());
+                ordered = NonTerminal("ordered", rules(),
+                                      NonTerminal::ORDERED_CHOICE);
+        }
+
+        static Rules rules()
+        {
+                return {
+                        { Component(tok('a'), false, logRule), tok('x') },
+                        { Component(tok('a'), false, logRule), tok('y') }
+                };
+        }
+};
+
+bool
+listsRules(
+        const RuleIndices         &rules,
+        const std::vector<size_t> &expected
+)
+{
+        return std::equal(rules.begin(), rules.end(), expected.begin(),
+                          expected.end());
+}
+
+/*
+ * parses `input` as `start`, recording completed rules in `profile` if
+ * given; returns the structural hash of the result, and sets
+ * explored_rules
+ */
+size_t
+parseChoice(
+        const NonTerminal &start,
+        const char        *input,
+        RuleProfile       *profile = nullptr
+)
+{
+        std::istringstream in(input);
+        CharLexer          lexer(in);
+        Parser             parser(lexer);
+
+        parser.setRuleProfile(profile);
+        explored_rules.clear();
+
+        SPPFNode::Ptr result = parser.parse(start);
+
+        matchedTokens(parser, result);
+        return structuralHash(*result);
+}
+
+bool
+keepNode(
+        ParseState &
+)
+{
+        return true;
+}
+
+/*
+ * nonterminals delegating to one another, hidden from the result and so
+ * bypassed by the GLL engine unless given parse actions
+ */
+struct Delegates
+{
+        NonTerminal top, outer, middle, inner, pair;
+
+        Delegates(bool actions)
+        {
+                top = NonTerminal("top", { { outer, tok('c') } });
+                outer = NonTerminal("outer", {
+                        { middle },
+                        { pair }
+                }, NonTerminal::HIDE_IF_DELEGATE);
+                middle = NonTerminal("middle", { { inner } },
+                                     NonTerminal::TRANSPARENT);
+                inner = NonTerminal("inner", { { tok('a'), tok('a') } });
+                pair = NonTerminal("pair", { { tok('b'), tok('b') } },
+                                   NonTerminal::TRANSPARENT);
+                if (actions) {
+                        outer.addPostParseAction(keepNode);
+                        middle.addPostParseAction(keepNode);
+                }
+        }
+};
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::firstMatchAtEOFConsumesInput() // static
+{
+        NonTerminal list;
+
+        list = NonTerminal("list", {
+                { list, tok('a') },
+                { tok('a') }
+        });
+
+        for (Parser::Engine engine: ENGINES) {
+                std::istringstream input("a a a a");
+                CharLexer          lexer(input);
+                Parser             parser(lexer);
+
+                parser.setEngine(engine)
+                      .setMatchPolicy(Parser::FIRST_MATCH_AT_EOF);
+
+                size_t n = matchedTokens(parser, parser.parse(list));
+
+                if (n != 4) {
+                        throw TestFailure("%s engine matched %u tokens,"
+                                          " expected 4", engineName(engine),
+                                          static_cast<unsigned>(n));
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::commitsReportedOnceOnRetry() // static
+{
+        enum { STATEMENTS = 300 };  // enough to commit while parsing
+
+        Statements         g;
+        std::istringstream input(statements(STATEMENTS, "x y"));
+        CharLexer          lexer(input);
+        CommitCounter      parser(lexer);
+
+        parser.setPredictionDepth(1);
+        matchedTokens(parser, parser.parse(g.program));
+
+        /* the tail's second rule was not seen to complete, so is excluded
+           by prediction; the first attempt fails and is repeated */
+        input.clear();
+        input.str(statements(STATEMENTS, "x z"));
+        lexer.reset(input);
+        parser.reset();
+        parser.commits_ = 0;
+        matchedTokens(parser, parser.parse(g.program));
+
+        if (parser.commits_ != STATEMENTS) {
+                throw TestFailure("%u commits reported, expected %u",
+                                  static_cast<unsigned>(parser.commits_),
+                                  static_cast<unsigned>(STATEMENTS));
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::commitsPendingOnFailureNotReported() // static
+{
+        Statements         g;
+        std::istringstream input(statements(2, "q"));
+        CharLexer          lexer(input);
+        CommitCounter      parser(lexer);
+
+        parser.parse(g.program);
+
+        if (!parser.errorCount()) {
+                throw TestFailure("parse of invalid input succeeded");
+        } else if (parser.commits_) {
+                throw TestFailure("%u commits reported for a failed parse",
+                                  static_cast<unsigned>(parser.commits_));
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::predictionKeepsLongestMatch() // static
+{
+        NonTerminal s;
+
+        s = NonTerminal("s", {
+                { tok('a'), tok('b'), tok('c') },
+                { tok('a') }
+        });
+
+        std::istringstream input;
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+
+        parser.setPredictionDepth(1);
+
+        /* the first rule fails after 'a' in the first parse, but must still
+           be explored when it can match more of the input */
+        for (const char *text: { "a", "a b c", "a", "a b c" }) {
+                input.clear();
+                input.str(text);
+                lexer.reset(input);
+                parser.reset();
+
+                size_t n = matchedTokens(parser, parser.parse(s)),
+                       expected = (strlen(text) + 1) / 2;
+
+                if (n != expected) {
+                        throw TestFailure("matched %u tokens of \"%s\","
+                                          " expected %u",
+                                          static_cast<unsigned>(n), text,
+                                          static_cast<unsigned>(expected));
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::sharedPrefixLabelsFollower() // static
+{
+        NonTerminal a, b;
+
+        a = NonTerminal("a", {
+                { tok('x'), b, tok('c') },
+                { tok('x'), b, tok('d') }
+        });
+        b = NonTerminal("b", {
+                { tok('b') }
+        });
+
+        std::istringstream input("x b d");
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+        SPPFNode::Ptr      result = parser.parse(a);
+
+        matchedTokens(parser, result);
+
+        auto nodes = ruleNodes(result, a);
+
+        if (nodes.empty()) {
+                throw TestFailure("no nodes of rules of a");
+        }
+        for (const SPPFNode::ConstPtr &node: nodes) {
+                if (node->rule() != &a[1]) {
+                        throw TestFailure("node labelled with rule a.%d"
+                                          " derives a.1", a.indexOf(
+                                                        *node->rule()));
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::sharedPrefixKeepsAmbiguity() // static
+{
+        NonTerminal a, p, q;
+
+        a = NonTerminal("a", {
+                { p, q, tok('c') },
+                { p, q, tok('d') }
+        });
+        p = NonTerminal("p", {
+                { tok('y') },
+                { tok('y'), tok('y') }
+        });
+        q = NonTerminal("q", {
+                { tok('y') },
+                { tok('y'), tok('y') }
+        });
+
+        std::istringstream input("y y y d");
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+        SPPFNode::Ptr      result = parser.parse(a);
+
+        matchedTokens(parser, result);
+
+        /* "y y y" splits between p and q in two ways, each of which gives a
+           packed node after q */
+        size_t splits = 0;
+
+        for (const SPPFNode::ConstPtr &node: ruleNodes(result, a)) {
+                if (node->rule() != &a[1]) {
+                        throw TestFailure("node of rule a.%d in derivation"
+                                          " of a.1", a.indexOf(*node->rule()));
+                }
+                splits += node->isPacked() && (node->component() == &a[1][1]);
+        }
+        if (splits != 2) {
+                throw TestFailure("%u derivations of \"y y y\", expected 2",
+                                  static_cast<unsigned>(splits));
+        }
+}
+
+//--------------------------------------
+
+/*
+ * a follower that prediction excludes is not resumed from its leader, but
+ * is once the parse is retried without predictions
+ */
+void
+wr::parse::ParserTests::sharedPrefixFollowerPredicted() // static
+{
+        NonTerminal a, b;
+
+        a = NonTerminal("a", {
+                { tok('x'), b, tok('c') },
+                { tok('x'), b, tok('d') }
+        });
+        b = NonTerminal("b", {
+                { tok('b') }
+        });
+
+        std::istringstream input;
+        CharLexer          lexer(input);
+        Parser             parser(lexer), plain(lexer);
+
+        parser.setPredictionDepth(1);
+
+        // the follower is seen to fail, then excluded
+        Outcome first     = parseAgain(parser, input, a, "x b c"),
+                predicted = parseAgain(parser, input, a, "x b c");
+
+        if (predicted.statistics_.descriptors_
+                                >= first.statistics_.descriptors_) {
+                throw TestFailure("follower resumed though excluded");
+        }
+        if (predicted.hash_ != first.hash_) {
+                throw TestFailure("prediction changed the result");
+        }
+
+        // excluded wrongly, the follower is resumed on the retry
+        if (parseAgain(parser, input, a, "x b d").hash_
+                        != parseAgain(plain, input, a, "x b d").hash_) {
+                throw TestFailure("follower not resumed on the retry");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::purePredicateCalledOncePerPosition() // static
+{
+        for (bool purity: { false, true }) {
+                NonTerminal s, item, u, top;
+                Component   check(tok('i'), false, isItem);
+
+                if (purity) {
+                        check = pure(check);
+                }
+
+                /* 'item' is begun at each position by both 's' and 'u', so
+                   its predicate is reached more than once there */
+                item = NonTerminal("item", { { check } });
+                s = NonTerminal("s", { { s, item }, { item } });
+                u = NonTerminal("u", { { s, item } });
+                top = NonTerminal("top", { { s, tok(';') },
+                                           { u, tok(';') } });
+
+                for (Parser::Engine engine: ENGINES) {
+                        std::istringstream input("i i i i ;");
+                        CharLexer          lexer(input);
+                        Parser             parser(lexer);
+
+                        parser.setEngine(engine);
+                        item_calls.clear();
+                        matchedTokens(parser, parser.parse(top));
+
+                        unsigned most = 0;
+
+                        for (const auto &calls: item_calls) {
+                                most = std::max(most, calls.second);
+                        }
+                        if (purity && (most != 1)) {
+                                throw TestFailure("%s engine called pure"
+                                                  " predicate %u times at one"
+                                                  " position",
+                                                  engineName(engine), most);
+                        } else if (!purity && (most < 2)) {
+                                throw TestFailure("%s engine never reached"
+                                                  " predicate twice at one"
+                                                  " position",
+                                                  engineName(engine));
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::symbolTablesIsolatedPerDerivation() // static
+{
+        parseWithChange(defineSymbol);
+
+        std::set<bool> seen(symbol_checks.begin(), symbol_checks.end());
+
+        if ((symbol_checks.size() != 2) || (seen.size() != 2)) {
+                throw TestFailure("tail reached %u times, seeing %u distinct"
+                                  " tables, expected 2 and 2",
+                                  static_cast<unsigned>(symbol_checks.size()),
+                                  static_cast<unsigned>(seen.size()));
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::symbolTablesMergedByVersion() // static
+{
+        /* a table left unchanged, or changed and changed back by leaving
+           the scope entered, keeps its version, so both derivations reach
+           'tail' as one */
+        for (Component::Predicate change: { keepSymbols, defineInScope }) {
+                parseWithChange(change);
+
+                if ((symbol_checks.size() != 1) || symbol_checks.front()) {
+                        throw TestFailure("tail reached %u times, expected"
+                                          " once without \"t\"",
+                                          static_cast<unsigned>(
+                                                symbol_checks.size()));
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::beamKeepsCheapestDerivations() // static
+{
+        Sums               g;
+        Parser::Statistics unbounded,
+                           bounded;
+        SPPFNode::Ptr      all = parseSums(g, 0, INFINITY, unbounded);
+
+        // the last addition may follow any of the first four 'a'
+        if (!all || (all->countChildren() != 4)) {
+                throw TestFailure("unbounded parse kept %u derivations,"
+                                  " expected 4", static_cast<unsigned>(
+                                        all ? all->countChildren() : 0));
+        }
+
+        for (size_t width: { 1, 2 }) {
+                SPPFNode::Ptr kept = parseSums(g, width, INFINITY, bounded);
+
+                if (!kept || (kept->countChildren() != width)) {
+                        throw TestFailure("beam of %u kept %u derivations",
+                                          static_cast<unsigned>(width),
+                                          static_cast<unsigned>(
+                                                kept ? kept->countChildren()
+                                                     : 0));
+                }
+                if (mostDerivations(kept) != width) {
+                        throw TestFailure("beam of %u kept %u derivations"
+                                          " of some node",
+                                          static_cast<unsigned>(width),
+                                          static_cast<unsigned>(
+                                                mostDerivations(kept)));
+                }
+                // only the right-associative derivation of four additions
+                // costs 4, and the cheapest is listed first
+                if (firstCost(kept) != 4) {
+                        throw TestFailure("beam of %u did not list the"
+                                          " right-associative derivation"
+                                          " first",
+                                          static_cast<unsigned>(width));
+                }
+                // discarding derivations leaves the work scheduled alone
+                if (bounded.descriptors_ != unbounded.descriptors_) {
+                        throw TestFailure("beam of %u scheduled %u"
+                                          " descriptors, expected %u",
+                                          static_cast<unsigned>(width),
+                                          static_cast<unsigned>(
+                                                bounded.descriptors_),
+                                          static_cast<unsigned>(
+                                                unbounded.descriptors_));
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::costLimitAbandonsWork() // static
+{
+        Sums               g;
+        Parser::Statistics bounded;
+
+        // the cheapest derivation of the four additions is within a limit
+        // of 4
+        SPPFNode::Ptr      kept = parseSums(g, 0, 4, bounded);
+
+        if (!kept || (kept->countTokens() != 9) || (firstCost(kept) != 4)) {
+                throw TestFailure("cost limit of 4 lost the cheapest"
+                                  " derivation");
+        }
+
+        /* each lower limit abandons more work, and matches no more
+           additions than it allows */
+        for (double limit: { 3, 2, 1 }) {
+                size_t work = bounded.descriptors_;
+
+                kept = parseSums(g, 0, limit, bounded);
+                if (kept && (kept->countTokens() > 2 * limit + 1)) {
+                        throw TestFailure("cost limit of %u exceeded",
+                                          static_cast<unsigned>(limit));
+                }
+                if (bounded.descriptors_ >= work) {
+                        throw TestFailure("cost limit of %u scheduled %u"
+                                          " descriptors, no fewer than %u",
+                                          static_cast<unsigned>(limit),
+                                          static_cast<unsigned>(
+                                                bounded.descriptors_),
+                                          static_cast<unsigned>(work));
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::actionsRunOncePerEngine() // static
+{
+        Items g;
+
+        // the predicate on 'b' is reached only after every item
+        parseItems(g.top, "a a a b", Parser::GLL_ENGINE);
+
+        unsigned pre = pre_parse_calls,
+                 post = post_parse_calls;
+
+        parseItems(g.top, "a a a b", Parser::CRF_ENGINE);
+        if ((pre_parse_calls != pre) || (post_parse_calls != post)) {
+                throw TestFailure("CRF engine made %u and %u action calls,"
+                                  " GLL engine %u and %u", pre_parse_calls,
+                                  post_parse_calls, pre, post);
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::actionNodesInResult() // static
+{
+        Items g;
+
+        for (Parser::Engine engine: ENGINES) {
+                SPPFNode::Ptr result = parseItems(g.list, "a a a", engine);
+                auto          nodes  = nodesBelow(result);
+
+                if (action_nodes.empty()) {
+                        throw TestFailure("%s engine made no action calls",
+                                          engineName(engine));
+                }
+                for (SPPFNode::ConstPtr node: action_nodes) {
+                        if (!nodes.count(node.get())) {
+                                throw TestFailure("%s engine gave an action"
+                                                  " a node not in the"
+                                                  " result",
+                                                  engineName(engine));
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+
+/*
+ * an ordered choice's first rule still cuts its later rules once the
+ * state held for input before a commit point within it has been discarded
+ */
+void
+wr::parse::ParserTests::orderedChoiceKeptAcrossCommits() // static
+{
+        enum { ITEMS = 300 };  // enough to commit while parsing
+
+        Ordered     committed(true), plain(false);
+        std::string text;
+
+        for (size_t i = 0; i < ITEMS; ++i) {
+                text += "a b x x ";
+        }
+
+        std::istringstream input(text);
+        CharLexer          lexer(input);
+        CommitCounter      parser(lexer);
+        SPPFNode::Ptr      result = parser.parse(committed.list);
+
+        matchedTokens(parser, result);
+        if (!parser.commits_) {
+                throw TestFailure("no commits reported");
+        }
+        for (SPPFNode::ConstPtr node: ruleNodes(result, committed.item)) {
+                if (node->rule() == &committed.item[2]) {
+                        throw TestFailure("third rule not cut by the first");
+                }
+        }
+
+        input.clear();
+        input.str(text);
+        lexer.reset(input);
+
+        Parser plain_parser(lexer);
+
+        if (structuralHash(*result) != structuralHash(
+                                        *plain_parser.parse(plain.list))) {
+                throw TestFailure("commit points changed the result");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * once a rule of an ordered choice matches, later rules starting at the
+ * same input position are cut, but not those starting elsewhere
+ */
+void
+wr::parse::ParserTests::orderedChoiceCutsLaterRules() // static
+{
+        NonTerminal list, stmt, pair;
+
+        list = NonTerminal("list", {
+                { list, stmt },
+                { stmt }
+        });
+        stmt = NonTerminal("stmt", {
+                { pair },
+                { tok('a'), tok('b') },
+                { tok('c') }
+        }, NonTerminal::ORDERED_CHOICE);
+        pair = NonTerminal("pair", {
+                { tok('a'), tok('b') }
+        });
+
+        SPPFNode::Ptr          result = parseWith(list, "a b c a b",
+                                                  Parser::GLL_ENGINE);
+        std::set<const Rule *> rules  = rulesUsed(result, stmt);
+
+        if (rules.count(&stmt[1])) {
+                throw TestFailure("second rule not cut by the first");
+        }
+        if (!rules.count(&stmt[0]) || !rules.count(&stmt[2])) {
+                throw TestFailure("rules starting elsewhere were cut");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * a left recursive first rule completes only after a later rule has; the
+ * later rule's match stays as part of the first rule's, and a still later
+ * rule matching the same input is cut
+ */
+void
+wr::parse::ParserTests::orderedChoiceLaterRuleCompletesFirst() // static
+{
+        Ordered                g(false);
+        SPPFNode::Ptr          result = parseWith(g.item, "a b x x",
+                                                  Parser::GLL_ENGINE);
+        std::set<const Rule *> rules  = rulesUsed(result, g.item);
+
+        if (result->countTokens() != 4) {
+                throw TestFailure("matched %u tokens, expected 4",
+                                  static_cast<unsigned>(
+                                                result->countTokens()));
+        }
+        if ((rules.size() != 2) || !rules.count(&g.item[0])
+            || !rules.count(&g.item[1])) {
+                throw TestFailure("derived by the wrong rules");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * Parser::CRF does not order choices, so a grammar with an ordered choice
+ * is parsed by Parser::GLL whichever engine is selected
+ */
+void
+wr::parse::ParserTests::orderedChoiceParsedByGLL() // static
+{
+        Ordered            g(false);
+        Parser::Statistics gll, crf;
+        SPPFNode::Ptr      expected = parseWith(g.item, "a b x x",
+                                                Parser::GLL_ENGINE, &gll),
+                           result   = parseWith(g.item, "a b x x",
+                                                Parser::CRF_ENGINE, &crf);
+
+        if (structuralHash(*result) != structuralHash(*expected)) {
+                throw TestFailure("CRF engine result differs");
+        }
+        if (!sameStatistics(crf, gll)) {
+                throw TestFailure("CRF engine did not use GLL");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * a parser reusing its workspace gives the same result and statistics each
+ * time it parses the same input
+ */
+void
+wr::parse::ParserTests::workspaceReusedAlike() // static
+{
+        Sums               g;
+        std::istringstream input;
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+        Outcome            first = parseAgain(parser, input, g.sum, SUM_INPUT);
+
+        if (!parser.workspaceSize()) {
+                throw TestFailure("workspace not kept");
+        }
+
+        for (int i = 0; i < 3; ++i) {
+                Outcome next = parseAgain(parser, input, g.sum, SUM_INPUT);
+
+                if ((next.hash_ != first.hash_)
+                    || !sameStatistics(next.statistics_, first.statistics_)) {
+                        throw TestFailure("parse %d with the workspace"
+                                          " differs", i + 2);
+                }
+        }
+}
+
+//--------------------------------------
+
+/*
+ * the workspace is released after a parse that outgrows the limit, and
+ * kept after one that does not
+ */
+void
+wr::parse::ParserTests::workspaceTrimmedToLimit() // static
+{
+        enum { LIMIT = 64 };
+
+        Sums               g;
+        std::istringstream input;
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+        Outcome            small = parseAgain(parser, input, g.sum, sumOf(2));
+
+        parser.setWorkspaceLimit(LIMIT);
+        parseAgain(parser, input, g.sum, sumOf(40));
+        if (parser.workspaceSize()) {
+                throw TestFailure("workspace of %u elements kept beyond the"
+                                  " limit", static_cast<unsigned>(
+                                                parser.workspaceSize()));
+        }
+
+        Outcome again = parseAgain(parser, input, g.sum, sumOf(2));
+
+        if (!parser.workspaceSize() || (parser.workspaceSize() > LIMIT)) {
+                throw TestFailure("workspace of %u elements kept, limit %u",
+                                  static_cast<unsigned>(
+                                                parser.workspaceSize()),
+                                  static_cast<unsigned>(LIMIT));
+        }
+        if ((again.hash_ != small.hash_)
+            || !sameStatistics(again.statistics_, small.statistics_)) {
+                throw TestFailure("parse after release differs");
+        }
+
+        parser.setWorkspaceLimit(0);
+        parseAgain(parser, input, g.sum, sumOf(2));
+        if (parser.workspaceSize()) {
+                throw TestFailure("workspace kept with a zero limit");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * an exception thrown out of parse() by a parse action leaves the workspace
+ * fit for the next parse
+ */
+void
+wr::parse::ParserTests::workspaceReusableAfterException() // static
+{
+        Sums               g;
+        std::istringstream input;
+        CharLexer          lexer(input);
+        Parser             parser(lexer);
+        bool               thrown = false;
+
+        g.sum.addPostParseAction(throwIfArmed);
+
+        Outcome expected = parseAgain(parser, input, g.sum, SUM_INPUT);
+
+        throw_from_action = true;
+        try {
+                parseAgain(parser, input, g.sum, SUM_INPUT);
+        } catch (std::logic_error &) {
+                thrown = true;
+        }
+        if (!thrown) {
+                throw TestFailure("parse action did not throw");
+        }
+
+        Outcome after = parseAgain(parser, input, g.sum, SUM_INPUT);
+
+        if ((after.hash_ != expected.hash_)
+            || !sameStatistics(after.statistics_, expected.statistics_)) {
+                throw TestFailure("parse after an exception differs");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * the CRF engine builds an SPPF nested as deeply as the input is long
+ * without exhausting the stack
+ */
+void
+wr::parse::ParserTests::crfForestNestedDeeply() // static
+{
+        enum { LENGTH = 100000 };
+
+        NonTerminal list;
+
+        list = NonTerminal("list", {
+                { tok('a'), list },
+                { tok('b') }
+        });
+
+        std::string input;
+
+        for (size_t i = 0; i < LENGTH; ++i) {
+                input += "a ";
+        }
+        input += "b";
+
+        std::istringstream in(input);
+        CharLexer          lexer(in);
+        Parser             parser(lexer);
+
+        parser.setEngine(Parser::CRF_ENGINE);
+
+        SPPFNode::Ptr result  = parser.parse(list);
+        size_t        matched = matchedTokens(parser, result);
+
+        if (dismantle(std::move(result), list) != LENGTH + 1) {
+                throw TestFailure("deep list not nested as expected");
+        }
+        if (matched != LENGTH + 1) {
+                throw TestFailure("deep list matched %u tokens",
+                                  static_cast<unsigned>(matched));
+        }
+}
+
+//--------------------------------------
+
+/*
+ * the work of parsing "a + a + a", counted at each slot: sum is called
+ * twice at each 'a', from a rule and to begin its left recursion, and each
+ * call begins every rule; counts of nodes include packed nodes
+ */
+void
+wr::parse::ParserTests::slotProfileCountsWork() // static
+{
+        ProfiledSums       g;
+        std::istringstream in("a + a + a");
+        SumLexer           lexer(in);
+        Parser             parser(lexer);
+        SlotProfile        profile;
+
+        parser.setSlotProfile(&profile);
+        matchedTokens(parser, parser.parse(g.sum));
+
+        // executions, mismatches, predicate failures, pops, nodes
+        checkCounts(profile, g.sum, 0, 0, { 6, 0, 0, 6, 6 });
+        checkCounts(profile, g.sum, 0, 1, { 12, 6, 0, 0, 6 });
+        checkCounts(profile, g.sum, 0, 2, { 0, 0, 0, 3, 7 });
+        checkCounts(profile, g.sum, 0, 3, { 6, 0, 0, 0, 0 });  // (end)
+        checkCounts(profile, g.sum, 1, 0, { 6, 0, 0, 0, 6 });
+        checkCounts(profile, g.sum, 1, 1, { 0, 0, 0, 0, 0 });
+        checkCounts(profile, g.sum, 2, 0, { 6, 0, 0, 0, 0 });
+        checkCounts(profile, g.sum, 2, 1, { 0, 6, 0, 0, 0 });
+        checkCounts(profile, g.sum, 3, 0, { 6, 0, 6, 0, 0 });
+        checkCounts(profile, g.sum, 3, 1, { 0, 0, 0, 0, 0 });
+
+        SlotProfile::Counts total = profile.total(g.sum);
+
+        if ((total.executions_ != 42) || (total.mismatches_ != 12)
+            || (total.predicate_failures_ != 6) || (total.pops_ != 9)
+            || (total.nodes_ != 25)) {
+                throw TestFailure("wrong total counts for sum");
+        }
+
+        std::ostringstream out;
+
+        profile.dump(out, g.sum, lexer);
+
+        std::string expected =
+                "sum: exec=42       miss=12       pred=6        pop=9 "
+                       "       nodes=25\n"
+                "    0: sum '+' sum\n"
+                "        sum                      exec=6        miss=0 "
+                       "       pred=0        pop=6        nodes=6\n"
+                "        '+'                      exec=12       miss=6 "
+                       "       pred=0        pop=0        nodes=6\n"
+                "        sum                      exec=0        miss=0 "
+                       "       pred=0        pop=3        nodes=7\n"
+                "        (end)                    exec=6        miss=0 "
+                       "       pred=0        pop=0        nodes=0\n"
+                "    1: 'a'\n"
+                "        'a'                      exec=6        miss=0 "
+                       "       pred=0        pop=0        nodes=6\n"
+                "        (end)                    exec=0        miss=0 "
+                       "       pred=0        pop=0        nodes=0\n"
+                "    2: 'a' '*'\n"
+                "        'a'                      exec=6        miss=0 "
+                       "       pred=0        pop=0        nodes=0\n"
+                "        '*'                      exec=0        miss=6 "
+                       "       pred=0        pop=0        nodes=0\n"
+                "        (end)                    exec=0        miss=0 "
+                       "       pred=0        pop=0        nodes=0\n"
+                "    3: pred('a', ...)\n"
+                "        pred('a', ...)           exec=6        miss=0 "
+                       "       pred=6        pop=0        nodes=0\n"
+                "        (end)                    exec=0        miss=0 "
+                       "       pred=0        pop=0        nodes=0\n";
+
+        if (out.str() != expected) {
+                throw TestFailure("slot profile dump differs:\n%s",
+                                  out.str().c_str());
+        }
+}
+
+//--------------------------------------
+
+/*
+ * "a + a + a + a" has five derivations: two splits of each of the spans of
+ * three terms, and three splits of the whole; a rule prefix matching the
+ * same input two ways is reported by its last component
+ */
+void
+wr::parse::ParserTests::ambiguityProfileFindsHotspots() // static
+{
+        ProfiledSums     g;
+        AmbiguityProfile profile;
+        SPPFNode::Ptr    result = parseProfiled(g.sum, "a + a + a + a",
+                                                profile);
+
+        std::vector<const AmbiguityProfile::Hotspot *> top = profile.top(10);
+
+        if (top.size() != 3) {
+                throw TestFailure("%u hotspots found, expected 3",
+                                  static_cast<unsigned>(top.size()));
+        }
+        if ((top[0]->nonterminal_ != &g.sum) || top[0]->slot_
+            || (top[0]->start_ != result->startOffset())
+            || (top[0]->end_ != result->endOffset())
+            || (top[0]->alternatives_ != 2)
+            || (top[0]->rules_ != std::set<size_t>({ 0 }))) {
+                throw TestFailure("whole sum not the worst hotspot");
+        }
+        for (size_t i = 1; i < 3; ++i) {
+                if ((top[i]->nonterminal_ != &g.sum) || top[i]->slot_
+                    || (top[i]->alternatives_ != 1)
+                    || (top[i]->rules_ != std::set<size_t>({ 0 }))) {
+                        throw TestFailure("wrong hotspot for three terms");
+                }
+        }
+        if ((top[1]->start_ != top[0]->start_)
+            || (top[2]->end_ != top[0]->end_)
+            || (top[1]->end_ >= top[2]->end_)) {
+                throw TestFailure("hotspots of three terms out of order");
+        }
+        if ((profile.count(g.sum[0]) != 4) || profile.count(g.sum[1])
+            || (profile.top(1).size() != 1)) {
+                throw TestFailure("wrong counts of alternatives");
+        }
+
+        std::istringstream names;
+        SumLexer           lexer(names);
+        std::ostringstream out;
+
+        profile.report(out, lexer);
+
+        // CharLexer gives each token the offset following its character
+        std::string expected =
+                "Alternative derivations by rule:\n"
+                "           4  sum.0: sum '+' sum\n"
+                "Most ambiguous spans:\n"
+                "           2  sum at 0:0 (bytes 1-13), rules 0\n"
+                "                \n"
+                "           1  sum at 0:0 (bytes 1-9), rules 0\n"
+                "                \n"
+                "           1  sum at 0:0 (bytes 5-13), rules 0\n"
+                "                \n";
+
+        if (out.str() != expected) {
+                throw TestFailure("ambiguity report differs:\n%s",
+                                  out.str().c_str());
+        }
+
+        NonTerminal pair, part;
+
+        pair = NonTerminal("pair", {
+                { part, part, tok('c') }
+        });
+        part = NonTerminal("part", {
+                { tok('a') },
+                { tok('a'), tok('a') }
+        });
+
+        AmbiguityProfile prefixes;
+
+        parseProfiled(pair, "a a a c", prefixes);
+        top = prefixes.top(10);
+        if ((top.size() != 1) || (top[0]->nonterminal_ != &pair)
+            || (top[0]->slot_ != &pair[0][1])
+            || (top[0]->alternatives_ != 1)
+            || (top[0]->rules_ != std::set<size_t>({ 0 }))) {
+                throw TestFailure("ambiguous rule prefix not found");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::ambiguityProfileQuietWhenUnambiguous() // static
+{
+        ProfiledSums     g;
+        AmbiguityProfile profile;
+
+        parseProfiled(g.sum, "a + a", profile);
+        if (!profile.empty() || !profile.top(10).empty()
+            || profile.count(g.sum[0])) {
+                throw TestFailure("ambiguity recorded for unambiguous input");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ParserTests::ruleProfileSavedAndLoaded() // static
+{
+        Choices     g;
+        RuleProfile profile, loaded;
+
+        parseChoice(g.word, "a x", &profile);
+        parseChoice(g.word, "a x", &profile);
+        parseChoice(g.word, "a y", &profile);
+        if ((profile.count(g.word, tok('a'), 0) != 2)
+            || (profile.count(g.word, tok('a'), 1) != 1)
+            || profile.count(g.word, tok('x'), 0)) {
+                throw TestFailure("completed rules not counted");
+        }
+
+        std::stringstream saved;
+
+        if (!profile.save(saved) || !loaded.load(saved)
+            || (loaded.count(g.word, tok('a'), 0) != 2)
+            || (loaded.count(g.word, tok('a'), 1) != 1)) {
+                throw TestFailure("counts not kept by save() and load()");
+        }
+
+        // loading adds to the counts held
+        saved.clear();
+        saved.seekg(0);
+        if (!loaded.load(saved) || (loaded.count(g.word, tok('a'), 0) != 4)) {
+                throw TestFailure("loaded counts not merged");
+        }
+
+        std::string        kind = std::to_string(tok('a'));
+        std::istringstream bad_count("word\t" + kind + "\t0\t5\n"
+                                     "word\t" + kind + "\t1\tmany\n"),
+                           no_tab("word " + kind + " 0 5\n");
+        RuleProfile        partial;
+
+        if (partial.load(bad_count)
+            || (partial.count(g.word, tok('a'), 0) != 5)
+            || partial.count(g.word, tok('a'), 1)) {
+                throw TestFailure("malformed count accepted");
+        }
+        if (partial.load(no_tab)) {
+                throw TestFailure("line without fields accepted");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * the parser explores first the rule that has completed most often; the
+ * result is unchanged, and an ordered choice keeps the order of its rules
+ */
+void
+wr::parse::ParserTests::ruleProfileOrdersDispatch() // static
+{
+        Choices     g;
+        RuleProfile profile;
+        size_t      hashes[2];
+
+        hashes[0] = parseChoice(g.word, "a x", &profile);
+        if (explored_rules != std::vector<size_t>({ 1, 0 })) {
+                throw TestFailure("rules explored in unexpected order");
+        }
+        hashes[1] = parseChoice(g.word, "a y", &profile);
+        parseChoice(g.word, "a x", &profile);
+        parseChoice(g.ordered, "a x", &profile);
+        parseChoice(g.ordered, "a y", &profile);
+
+        if (profile.apply(g.word) != 1) {
+                throw TestFailure("profile not applied");
+        }
+        if (!listsRules(g.word.firstSet().at(tok('a')), { 1, 0 })) {
+                throw TestFailure("candidates not ordered by count");
+        }
+        if (parseChoice(g.word, "a x") != hashes[0]) {
+                throw TestFailure("result changed by ordering");
+        }
+        if (explored_rules != std::vector<size_t>({ 0, 1 })) {
+                throw TestFailure("most frequent rule not explored first");
+        }
+        if (parseChoice(g.word, "a y") != hashes[1]) {
+                throw TestFailure("result changed by ordering");
+        }
+
+        if (profile.apply(g.ordered)
+            || !listsRules(g.ordered.firstSet().at(tok('a')), { 0, 1 })) {
+                throw TestFailure("ordered choice reordered");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * hidden delegate rules are bypassed, saving the work of parsing them
+ * without changing the result, except where parse actions must see them;
+ * a transparent nonterminal's rules other than delegates are never
+ * bypassed
+ */
+void
+wr::parse::ParserTests::hiddenDelegatesBypassed() // static
+{
+        Delegates bypassed(false), kept(true);
+
+        if ((bypassed.outer[0].inlineTarget() != &bypassed.middle)
+            || (bypassed.middle[0].inlineTarget() != &bypassed.inner)
+            || (bypassed.outer[1].inlineTarget() != &bypassed.pair)
+            || bypassed.pair[0].inlineTarget()
+            || bypassed.top[0].inlineTarget()) {
+                throw TestFailure("unexpected inline targets");
+        }
+
+        for (const char *input: { "a a c", "b b c" }) {
+                Parser::Statistics fewer, more;
+                SPPFNode::Ptr      a = parseWith(bypassed.top, input,
+                                                 Parser::GLL_ENGINE, &fewer),
+                                   b = parseWith(kept.top, input,
+                                                 Parser::GLL_ENGINE, &more);
+
+                if (structuralHash(*a) != structuralHash(*b)) {
+                        throw TestFailure("result changed by bypass");
+                }
+                if ((fewer.descriptors_ >= more.descriptors_)
+                    || (fewer.gss_nodes_ >= more.gss_nodes_)
+                    || (fewer.sppf_nodes_ >= more.sppf_nodes_)) {
+                        throw TestFailure("hidden delegates not bypassed");
+                }
+        }
+}
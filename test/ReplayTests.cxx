@@ -0,0 +1,439 @@
+#include <ctype.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <wrutil/TestManager.h>
+#include <wrparse/CodeGen.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+#include <wrparse/Replay.h>
+
+#include "CharLexer.h"
+
+
+namespace wr {
+namespace parse {
+
+
+class ReplayTests : public TestManager
+{
+public:
+        using this_t = ReplayTests;
+        using base_t = TestManager;
+
+        ReplayTests(int argc, const char **argv) :
+                base_t("parse::Replay", argc, argv) {}
+
+        int runAll();
+
+        static void recordingRoundTrip(),
+                    hashedSpellingsKeepEquality(),
+                    redactedSpellingsKeepLength(),
+                    prepareChecksGrammar(),
+                    invalidRecordingRejected();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::ReplayTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::ReplayTests::runAll()
+{
+        run("recordingRoundTrip", 1, recordingRoundTrip);
+        run("hashedSpellingsKeepEquality", 1, hashedSpellingsKeepEquality);
+        run("redactedSpellingsKeepLength", 1, redactedSpellingsKeepLength);
+        run("prepareChecksGrammar", 1, prepareChecksGrammar);
+        run("invalidRecordingRejected", 1, invalidRecordingRejected);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+
+const CharToken ID = tok('i');  // words, lexed by WordLexer
+
+/*
+ * lexes words of letters as tokens of kind ID spelled by the word, and
+ * other characters as tokens of kind tok(c), setting the line, column and
+ * whitespace flags of each
+ */
+class WordLexer : public Lexer
+{
+public:
+        WordLexer(std::istream &input) : Lexer(input) {}
+
+        virtual Token &lex(Token &out_token) override
+        {
+                TokenFlags flags = offset() ? 0 : TF_STARTS_LINE;
+
+                out_token.reset();
+                while ((peek() == ' ') || (peek() == '\n')) {
+                        flags |= (read() == '\n') ? TF_STARTS_LINE
+                                                  : TF_SPACE_BEFORE;
+                }
+                out_token.setOffset(offset())
+                         .setLine(line())
+                         .setColumn(column())
+                         .setFlags(flags);
+
+                char32_t c = read();
+
+                if (c == eof) {
+                        out_token.setKind(TOK_EOF);
+                } else if (isalpha(static_cast<int>(c))) {
+                        std::string word(1, static_cast<char>(c));
+
+                        while (isalpha(static_cast<int>(peek()))) {
+                                word += static_cast<char>(read());
+                        }
+                        out_token.setKind(ID).setSpelling(store(
+                                wr::u8string_view(word.data(),
+                                                  word.size())));
+                } else {
+                        out_token.setKind(tok(static_cast<char>(c)));
+                }
+                return out_token;
+        }
+};
+
+struct Statements
+{
+        NonTerminal program, stmt, expr;
+
+        Statements()
+        {
+                program = NonTerminal("program", {
+                        { stmt },
+                        { expr }
+                });
+                stmt = NonTerminal("stmt", {
+                        { ID, tok('='), ID, tok(';') }
+                });
+                expr = NonTerminal("expr", {
+                        { ID, tok('+'), ID },
+                        { ID }
+                });
+        }
+};
+
+const char INPUT[] = "ab = cd;\n  cd = ab;\nxyz + ab q";
+
+/*
+ * the recording of two statements parsed from INPUT, a reset, then
+ * expressions parsed until the input is exhausted
+ */
+struct Recording
+{
+        std::string bytes;
+        size_t      tokens,   // recorded by TokenRecorder
+                    matched;  // parses succeeding without errors
+
+        Recording(
+                const Statements            &g,
+                TokenRecorder::SpellingMode  mode =
+                                                TokenRecorder::HASH_SPELLINGS
+        ) :
+                matched(0)
+        {
+                std::istringstream in(INPUT);
+                std::ostringstream out;
+                TokenRecorder      recorder(out, mode);
+                WordLexer          lexer(in);
+                Parser             parser(lexer);
+                const NonTerminal *starts[] = {
+                        &g.stmt, &g.stmt,
+                        nullptr,  // reset()
+                        &g.expr, &g.expr, &g.expr
+                };
+
+                parser.setTokenRecorder(&recorder);
+                for (const NonTerminal *start: starts) {
+                        if (!start) {
+                                parser.reset();
+                        } else if (parser.parse(*start)
+                                   && !parser.errorCount()) {
+                                ++matched;
+                        }
+                }
+                bytes = out.str();
+                tokens = recorder.size();
+        }
+};
+
+std::string
+spellingOf(
+        const Token &token
+)
+{
+        auto spelling = token.spelling();
+
+        return std::string(spelling.char_data(), spelling.bytes());
+}
+
+/*
+ * the spellings of the tokens of `recording`
+ */
+std::vector<std::string>
+replayedSpellings(
+        const std::string &recording
+)
+{
+        std::istringstream       in(recording);
+        ReplayLexer              replay(in);
+        std::vector<std::string> spellings;
+
+        for (Token t; !replay.lex(t).is(TOK_EOF);) {
+                spellings.push_back(spellingOf(t));
+        }
+        return spellings;
+}
+
+bool
+prepareFails(
+        ReplayLexer       &replay,
+        const NonTerminal &root
+)
+{
+        try {
+                replay.prepare(root);
+        } catch (std::runtime_error &) {
+                return true;
+        }
+        return false;
+}
+
+bool
+loadFails(
+        const std::string &recording
+)
+{
+        std::istringstream in(recording);
+
+        try {
+                ReplayLexer replay(in);
+        } catch (std::runtime_error &) {
+                return true;
+        }
+        return false;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+/*
+ * replaying a recording returns the tokens lexed from the original input,
+ * in the calls to parse() and reset() made, and repeats its parses
+ */
+void
+wr::parse::ReplayTests::recordingRoundTrip() // static
+{
+        Statements         g;
+        Recording          recording(g);
+        std::istringstream recorded(recording.bytes),
+                           original(INPUT);
+        ReplayLexer        replay(recorded);
+        WordLexer          lexer(original);
+
+        if (replay.size() != recording.tokens) {
+                throw TestFailure("replay.size() returned %u, expected %u",
+                                  static_cast<unsigned>(replay.size()),
+                                  static_cast<unsigned>(recording.tokens));
+        }
+        if (replay.size() < 12) {
+                throw TestFailure("only %u tokens recorded",
+                                  static_cast<unsigned>(replay.size()));
+        }
+
+        for (size_t i = 0; i < replay.size(); ++i) {
+                Token expected, actual;
+
+                lexer.lex(expected);
+                replay.lex(actual);
+                if ((actual.kind() != expected.kind())
+                    || (actual.offset() != expected.offset())
+                    || (actual.line() != expected.line())
+                    || (actual.column() != expected.column())
+                    || (actual.flags() != expected.flags())
+                    || (actual.bytes() != expected.bytes())) {
+                        throw TestFailure("token %u replayed differently",
+                                          static_cast<unsigned>(i));
+                }
+        }
+
+        Token end;
+
+        if (!replay.lex(end).is(TOK_EOF) || !replay.lex(end).is(TOK_EOF)) {
+                throw TestFailure("replay not ended by TOK_EOF");
+        }
+
+        const auto &events = replay.events();
+        const char *starts[] = { "stmt", "stmt", "", "expr", "expr",
+                                 "expr" };
+
+        if (events.size() != 6) {
+                throw TestFailure("%u events replayed, expected 6",
+                                  static_cast<unsigned>(events.size()));
+        }
+        for (size_t i = 0; i < events.size(); ++i) {
+                auto kind = *starts[i] ? ReplayLexer::Event::PARSE
+                                       : ReplayLexer::Event::RESET;
+
+                if ((events[i].kind_ != kind)
+                    || (events[i].start_ != starts[i])) {
+                        throw TestFailure("event %u replayed differently",
+                                          static_cast<unsigned>(i));
+                }
+                if ((i > 0) && (events[i].tokens_ < events[i - 1].tokens_)) {
+                        throw TestFailure("event %u precedes tokens of the"
+                                          " last", static_cast<unsigned>(i));
+                }
+        }
+        if ((events[0].fingerprint_ != grammarFingerprint(g.stmt))
+            || (events[3].fingerprint_ != grammarFingerprint(g.expr))) {
+                throw TestFailure("grammar fingerprints replayed"
+                                  " differently");
+        }
+
+        Parser parser(replay);
+        size_t matched = replay.replay(parser, g.program);
+
+        if ((recording.matched != 4) || (matched != recording.matched)) {
+                throw TestFailure("%u of %u parses matched on replay",
+                                  static_cast<unsigned>(matched),
+                                  static_cast<unsigned>(recording.matched));
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ReplayTests::hashedSpellingsKeepEquality() // static
+{
+        Statements g;
+        auto       spellings = replayedSpellings(Recording(g).bytes);
+
+        // ab = cd ; cd = ab ; xyz + ab q
+        if ((spellings.size() < 12) || (spellings[0].size() != 2)
+            || (spellings[0] != spellings[6])
+            || (spellings[0] != spellings[10])
+            || (spellings[2] != spellings[4])
+            || (spellings[0] == spellings[2])
+            || (spellings[8].size() != 3) || (spellings[11].size() != 1)
+            || !spellings[1].empty()) {
+                throw TestFailure("hashed spellings replayed incorrectly");
+        }
+        if (spellings[0] == "ab") {
+                throw TestFailure("original spelling replayed");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ReplayTests::redactedSpellingsKeepLength() // static
+{
+        Statements g;
+        Recording  recording(g, TokenRecorder::REDACT_SPELLINGS);
+        auto       spellings = replayedSpellings(recording.bytes);
+
+        if ((spellings.size() < 12) || (spellings[0] != "xx")
+            || (spellings[2] != "xx") || (spellings[8] != "xxx")
+            || (spellings[11] != "x") || !spellings[1].empty()) {
+                throw TestFailure("redacted spellings replayed"
+                                  " incorrectly");
+        }
+
+        std::istringstream in(recording.bytes);
+
+        if (ReplayLexer(in).spellingMode()
+                        != TokenRecorder::REDACT_SPELLINGS) {
+                throw TestFailure("spelling mode not recorded");
+        }
+}
+
+//--------------------------------------
+
+/*
+ * prepare() fails for a grammar lacking a recorded start symbol, or in
+ * which one has changed since recording
+ */
+void
+wr::parse::ReplayTests::prepareChecksGrammar() // static
+{
+        Statements         g, changed;
+        std::istringstream in(Recording(g).bytes);
+        ReplayLexer        replay(in);
+
+        changed.stmt = NonTerminal("stmt", {
+                { ID, tok('='), ID, tok(';') },
+                { ID, tok(';') }
+        });
+
+        if (prepareFails(replay, g.program)) {
+                throw TestFailure("prepare() failed for recorded grammar");
+        }
+        if (!prepareFails(replay, g.stmt)) {
+                throw TestFailure("prepare() found unreachable \"expr\"");
+        }
+        if (!prepareFails(replay, changed.program)) {
+                throw TestFailure("prepare() accepted changed \"stmt\"");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::ReplayTests::invalidRecordingRejected() // static
+{
+        Statements  g;
+        std::string valid = Recording(g).bytes,
+                    header(valid, 0, 9);
+
+        if (loadFails(valid) || loadFails(header)) {
+                throw TestFailure("valid recording rejected");
+        }
+
+        const std::string invalid[] = {
+                "",
+                "garbage",
+                std::string("wrptok1", 7),            // no terminating null
+                std::string("wrptok1", 8),            // no spelling mode
+                std::string("wrptok1\0\2", 9),        // bad spelling mode
+                valid.substr(0, valid.size() - 1),    // truncated record
+                valid + "Z",                          // unknown record
+                header + "T\x80",                     // truncated integer
+                header + "T\x80\x80\x04",             // kind out of range
+                header + std::string("T\x80\x08\x01\0\0\0\0", 8)
+                                                      // offset below zero
+        };
+
+        for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+                if (!loadFails(invalid[i])) {
+                        throw TestFailure("invalid recording %u accepted",
+                                          static_cast<unsigned>(i));
+                }
+        }
+}
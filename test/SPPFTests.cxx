@@ -0,0 +1,284 @@
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <wrutil/TestManager.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/Lexer.h>
+#include <wrparse/Parser.h>
+#include <wrparse/SPPF.h>
+
+#include "CharLexer.h"
+
+
+namespace wr {
+namespace parse {
+
+
+class SPPFTests : public TestManager
+{
+public:
+        using this_t = SPPFTests;
+        using base_t = TestManager;
+
+        SPPFTests(int argc, const char **argv) :
+                base_t("parse::SPPF", argc, argv) {}
+
+        int runAll();
+
+        static void structuralHashEqualAcrossParses(),
+                    structuralHashDiffersBySpelling(),
+                    structuralHashDiffersByStructure(),
+                    structuralHashCycleEntry(),
+                    structuralHashDeepTree();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::SPPFTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::SPPFTests::runAll()
+{
+        run("structuralHashEqualAcrossParses", 1,
+            structuralHashEqualAcrossParses);
+        run("structuralHashDiffersBySpelling", 1,
+            structuralHashDiffersBySpelling);
+        run("structuralHashDiffersByStructure", 1,
+            structuralHashDiffersByStructure);
+        run("structuralHashCycleEntry", 1, structuralHashCycleEntry);
+        run("structuralHashDeepTree", 1, structuralHashDeepTree);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+
+const CharToken ID = tok('i');  // letters, lexed as CharLexer::IDENTIFIERS
+
+struct Expressions
+{
+        NonTerminal expr, term;
+
+        Expressions()
+        {
+                expr = NonTerminal("expr", {
+                        { expr, tok('+'), term },
+                        { term }
+                });
+                term = NonTerminal("term", {
+                        { term, tok('*'), ID },
+                        { ID }
+                });
+        }
+};
+
+/*
+ * structural hash of the SPPF parsed from `input`, which is released
+ * before returning
+ */
+size_t
+hashOf(
+        const NonTerminal &start,
+        const char        *input
+)
+{
+        std::istringstream in(input);
+        CharLexer          lexer(in, CharLexer::IDENTIFIERS);
+        Parser             parser(lexer);
+        SPPFNode::Ptr      result = parser.parse(start);
+
+        if (!result || parser.errorCount()) {
+                throw TestFailure("failed to parse \"%s\"", input);
+        }
+        return structuralHash(*result);
+}
+
+/*
+ * releases the SPPF under `root` a node at a time, as a deep one would
+ * otherwise be destroyed recursively
+ */
+void
+dismantle(
+        SPPFNode::Ptr root
+)
+{
+        std::vector<SPPFNode::Ptr> pending = { root };
+
+        root.reset();
+        while (!pending.empty()) {
+                SPPFNode::Ptr node = pending.back();
+
+                pending.pop_back();
+                for (const SPPFNode::Ptr &child: node->children()) {
+                        pending.push_back(child);
+                }
+                node->children().clear();
+        }
+}
+
+/*
+ * structural hash of an SPPF for a list of `length` tokens matched by
+ *
+ *     list ::= 'a' list | 'a'
+ *
+ * and so nested as deeply as the list is long; built directly, as parsing
+ * such a list takes far longer than hashing it
+ */
+size_t
+deepListHash(
+        size_t length
+)
+{
+        NonTerminal list;
+
+        list = NonTerminal("list", {
+                { tok('a'), list },
+                { tok('a') }
+        });
+
+        std::vector<Token> tokens(length);
+        SPPFNode::Ptr      result;
+
+        for (size_t i = 0; i < length; ++i) {
+                tokens[i].setKind(tok('a')).setOffset(2 * i);
+        }
+        for (size_t i = length; i-- > 0;) {
+                SPPFNode::Ptr node = new SPPFNode(list, &tokens[i],
+                                                  tokens.back());
+
+                node->addChild(new SPPFNode(tokens[i]));
+                if (result) {
+                        node->addChild(result);
+                }
+                result = node;
+        }
+
+        size_t hash = structuralHash(*result);
+
+        dismantle(std::move(result));
+        return hash;
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+void
+wr::parse::SPPFTests::structuralHashEqualAcrossParses() // static
+{
+        Expressions g;
+
+        for (const char *input: { "a", "a + b * c", "a * b + c * d + e" }) {
+                size_t first = hashOf(g.expr, input);
+
+                for (int i = 0; i < 3; ++i) {
+                        if (hashOf(g.expr, input) != first) {
+                                throw TestFailure("hash of \"%s\" differs"
+                                                  " between parses", input);
+                        }
+                }
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::SPPFTests::structuralHashDiffersBySpelling() // static
+{
+        Expressions g;
+
+        if (hashOf(g.expr, "a + b") == hashOf(g.expr, "a + c")) {
+                throw TestFailure("\"a + b\" and \"a + c\" hash equal");
+        }
+        if (hashOf(g.expr, "a + b") == hashOf(g.expr, "b + a")) {
+                throw TestFailure("\"a + b\" and \"b + a\" hash equal");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::SPPFTests::structuralHashDiffersByStructure() // static
+{
+        Expressions g;
+
+        if (hashOf(g.expr, "a + b") == hashOf(g.expr, "a * b")) {
+                throw TestFailure("\"a + b\" and \"a * b\" hash equal");
+        }
+        if (hashOf(g.expr, "a + b * c") == hashOf(g.expr, "a * b + c")) {
+                throw TestFailure("\"a + b * c\" and \"a * b + c\" hash"
+                                  " equal");
+        }
+}
+
+//--------------------------------------
+
+void
+wr::parse::SPPFTests::structuralHashCycleEntry() // static
+{
+        NonTerminal s;
+
+        s = NonTerminal("s", {
+                { s },
+                { ID }
+        });
+
+        std::istringstream in("a");
+        CharLexer          lexer(in, CharLexer::IDENTIFIERS);
+        Parser             parser(lexer);
+        SPPFNode::Ptr      result = parser.parse(s);
+
+        if (!result || parser.errorCount()) {
+                throw TestFailure("failed to parse cyclic grammar");
+        }
+
+        size_t from_root = structuralHash(*result);
+
+        // hash each alternative first, then the root, in a shared table
+        for (SPPFNode::ConstPtr child: result->children()) {
+                StructuralHashes hashes;
+
+                structuralHash(*child, hashes);
+                if (structuralHash(*result, hashes) != from_root) {
+                        throw TestFailure("hash of root depends on the node"
+                                          " hashed first");
+                }
+        }
+}
+
+//--------------------------------------
+
+/*
+ * an SPPF nested as deeply as the input is long is hashed without
+ * exhausting the stack
+ */
+void
+wr::parse::SPPFTests::structuralHashDeepTree() // static
+{
+        enum { LENGTH = 100000 };
+
+        if ((deepListHash(LENGTH) != deepListHash(LENGTH))
+            || (deepListHash(LENGTH) == deepListHash(LENGTH - 1))) {
+                throw TestFailure("deep SPPFs hashed inconsistently");
+        }
+}
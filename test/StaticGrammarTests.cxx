@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <memory>
+#include <wrutil/TestManager.h>
+#include <wrparse/Grammar.h>
+#include <wrparse/StaticGrammar.h>
+
+
+namespace wr {
+namespace parse {
+
+
+class StaticGrammarTests : public TestManager
+{
+public:
+        using this_t = StaticGrammarTests;
+        using base_t = TestManager;
+
+        StaticGrammarTests(int argc, const char **argv) :
+                base_t("parse::StaticGrammar", argc, argv) {}
+
+        int runAll();
+
+        static void instanceMatchesAnalysis();
+};
+
+
+} // namespace parse
+} // namespace wr
+
+//--------------------------------------
+
+int
+main(
+        int          argc,
+        const char **argv
+)
+{
+        return wr::parse::StaticGrammarTests(argc, argv).runAll();
+}
+
+//--------------------------------------
+
+int
+wr::parse::StaticGrammarTests::runAll()
+{
+        run("instanceMatchesAnalysis", 1, instanceMatchesAnalysis);
+        return failed() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+//--------------------------------------
+
+namespace {
+
+
+using namespace wr::parse;
+using wr::TestFailure;
+using S = StaticComponent;
+
+constexpr TokenKind
+kind(
+        size_t k
+)
+{
+        return static_cast<TokenKind>(TOK_USER_MIN + k);
+}
+
+/*
+ * a grammar at the size the StaticGrammar documentation promises to
+ * analyse within the compiler's default limits: 400 nonterminals of three
+ * rules each, 100 terminals, 3600 table entries; each nonterminal `i`
+ * has the rules
+ *
+ *     i ::= i+1 K(i % 100)            (K(99) K(i % 100) for the last)
+ *         | K(i % 97) K(98)
+ *         | K(99)? K(99)?             if i % 4 == 0
+ *         | K(i * 7 % 100) K(97)      otherwise
+ */
+enum : size_t
+{
+        BIG_NONTERMINALS = 400,
+        BIG_RULES        = 3 * BIG_NONTERMINALS,
+        BIG_ENTRIES      = 3 * BIG_RULES,
+        BIG_TERMINALS    = 100
+};
+
+struct BigTable
+{
+        StaticNonTerminal nonterminals_[BIG_NONTERMINALS];
+        StaticComponent   rules_[BIG_ENTRIES];
+};
+
+constexpr BigTable
+makeBigTable()
+{
+        BigTable table = {};
+        size_t   e = 0;
+
+        for (size_t i = 0; i < BIG_NONTERMINALS; ++i) {
+                table.nonterminals_[i] = { "big", 0 };
+
+                table.rules_[e++] = S::rule(i);
+                table.rules_[e++] = (i + 1 < BIG_NONTERMINALS)
+                                    ? S::nonterminal(i + 1)
+                                    : S::terminal(kind(99));
+                table.rules_[e++] = S::terminal(kind(i % 100));
+
+                table.rules_[e++] = S::rule(i);
+                table.rules_[e++] = S::terminal(kind(i % 97));
+                table.rules_[e++] = S::terminal(kind(98));
+
+                table.rules_[e++] = S::rule(i);
+                if (i % 4 == 0) {
+                        table.rules_[e++] = S::terminal(kind(99)).opt();
+                        table.rules_[e++] = S::terminal(kind(99)).opt();
+                } else {
+                        table.rules_[e++] = S::terminal(kind(i * 7 % 100));
+                        table.rules_[e++] = S::terminal(kind(97));
+                }
+        }
+
+        return table;
+}
+
+constexpr BigTable big_table = makeBigTable();
+
+static_assert(staticRuleCount(big_table.rules_) == BIG_RULES, "");
+static_assert(staticTerminalCount(big_table.rules_) == BIG_TERMINALS, "");
+
+constexpr auto big = makeStaticGrammar<BIG_RULES, BIG_TERMINALS>(
+                big_table.nonterminals_, big_table.rules_);
+
+// tables sized by rules and terminals, not by the length of the table
+static_assert(decltype(big)::WORDS == 2, "");
+static_assert(sizeof(big) < 64 * 1024, "");
+
+// the last nonterminal: its own three rules
+static_assert(big.inFirstSet(399, kind(99)), "");
+static_assert(big.inFirstSet(399, kind(399 % 97)), "");
+static_assert(big.inFirstSet(399, kind(399 * 7 % 100)), "");
+static_assert(!big.inFirstSet(399, kind(0)), "");
+static_assert(!big.inFirstSet(399, TOK_EOF), "");
+static_assert(!big.matchesEmpty(399) && big.isLL1(399), "");
+
+// a terminal following a nullable nonterminal begins the rule
+static_assert(big.matchesEmpty(396) && !big.matchesEmpty(395), "");
+static_assert(big.inFirstSet(395, kind(95)), "");
+static_assert(!big.inFirstSet(396, kind(95)), "");
+
+// FIRST sets carried down the chain of 400 nonterminals
+static_assert(big.inFirstSet(0, kind(98)), "");   // from nonterminal 14
+static_assert(big.inFirstSet(0, kind(97)), "");   // from nonterminal 71
+static_assert(big.inFirstSet(0, kind(11)), "");   // from nonterminal 399
+
+// K(99) begins both the first rule (via 4) and the nullable third
+static_assert(big.matchesEmpty(0) && !big.isLL1(0), "");
+static_assert(big.isLL1(398) && !big.isLL1(396), "");
+
+/*
+ * the small grammar of the StaticGrammar documentation, analysed with tables
+ * sized by the length of the rule table
+ */
+enum : unsigned { EXPR, TERM, PRIMARY };
+
+constexpr TokenKind T_NUM = kind(0), T_PLUS = kind(1), T_LP = kind(2),
+                    T_RP = kind(3);
+
+constexpr StaticNonTerminal calc_nonterminals[] = {
+        { "expr", 0 }, { "term", 0 }, { "primary", 0 }
+};
+
+constexpr StaticComponent calc_rules[] = {
+        S::rule(EXPR),    S::nonterminal(TERM), S::terminal(T_PLUS),
+                          S::nonterminal(EXPR),
+        S::rule(EXPR),    S::nonterminal(TERM),
+        S::rule(TERM),    S::nonterminal(PRIMARY),
+        S::rule(PRIMARY), S::terminal(T_NUM),
+        S::rule(PRIMARY), S::terminal(T_LP), S::nonterminal(EXPR),
+                          S::terminal(T_RP)
+};
+
+constexpr auto calc = makeStaticGrammar(calc_nonterminals, calc_rules);
+
+static_assert(calc.inFirstSet(EXPR, T_NUM) && calc.inFirstSet(EXPR, T_LP),
+              "");
+static_assert(!calc.inFirstSet(EXPR, T_PLUS), "");
+static_assert(!calc.isLL1(EXPR) && calc.isLL1(TERM) && calc.isLL1(PRIMARY),
+              "");
+static_assert(!calc.matchesEmpty(EXPR), "");
+
+bool
+sameFirstSets(
+        const NonTerminal &a,
+        const NonTerminal &b
+)
+{
+        auto i = a.firstSet().begin(), i_end = a.firstSet().end(),
+             j = b.firstSet().begin(), j_end = b.firstSet().end();
+
+        for (; (i != i_end) && (j != j_end); ++i, ++j) {
+                if ((i->first != j->first)
+                    || !std::equal(i->second.begin(), i->second.end(),
+                                   j->second.begin(), j->second.end())) {
+                        return false;
+                }
+        }
+
+        return (i == i_end) && (j == j_end);
+}
+
+
+} // anonymous namespace
+
+//--------------------------------------
+
+/*
+ * the FIRST sets, nullability and LL(1) property taken from the tables
+ * match those found by analysing the same grammar built at run time
+ */
+void
+wr::parse::StaticGrammarTests::instanceMatchesAnalysis() // static
+{
+        StaticGrammarInstance          instance(big);
+        std::unique_ptr<NonTerminal[]> built(
+                                        new NonTerminal[BIG_NONTERMINALS]);
+        Rules                          rules[BIG_NONTERMINALS];
+
+        for (size_t e = 0; e < BIG_ENTRIES; e += 3) {
+                const StaticComponent *c = big_table.rules_ + e;
+                Component              parts[2];
+
+                for (size_t i = 0; i < 2; ++i) {
+                        const StaticComponent &p = c[i + 1];
+
+                        parts[i] = p.isTerminal()
+                                   ? Component(p.value_, p.isOptional())
+                                   : Component(built[p.value_],
+                                               p.isOptional());
+                }
+                rules[c->value_].push_back({ parts[0], parts[1] });
+        }
+
+        for (size_t i = 0; i < BIG_NONTERMINALS; ++i) {
+                built[i] = NonTerminal("big", std::move(rules[i]));
+        }
+
+        for (size_t i = 0; i < BIG_NONTERMINALS; ++i) {
+                const NonTerminal &a = instance[i], &b = built[i];
+
+                if (!sameFirstSets(a, b)) {
+                        throw TestFailure("FIRST sets differ");
+                }
+                if ((a.matchesEmpty() != b.matchesEmpty())
+                    || (a.isLL1() != b.isLL1())) {
+                        throw TestFailure("nullability or LL(1) differ");
+                }
+                if (a.isLL1() != big.isLL1(i)) {
+                        throw TestFailure("LL(1) not taken from the tables");
+                }
+        }
+}